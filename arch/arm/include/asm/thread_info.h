@@ -61,6 +61,8 @@ struct thread_info {
 	unsigned long		tp_value;
 #ifdef CONFIG_CRUNCH
 	struct crunch_state	crunchstate;
+	unsigned long		crunch_loads;	/* unit handed to this thread */
+	unsigned long		crunch_kept;	/* switched in still owning it */
 #endif
 	union fp_state		fpstate __attribute__((aligned(8)));
 	union vfp_state		vfpstate;
@@ -73,6 +73,7 @@ int main(void)
 #endif
 #ifdef CONFIG_CRUNCH
   DEFINE(TI_CRUNCH_STATE,	offsetof(struct thread_info, crunchstate));
+  DEFINE(TI_CRUNCH_LOADS,	offsetof(struct thread_info, crunch_loads));
 #endif
   BLANK();
   DEFINE(S_R0,			offsetof(struct pt_regs, ARM_r0));
@@ -16,6 +16,8 @@
 #include <linux/sched.h>
 #include <linux/init.h>
 #include <linux/io.h>
+#include <linux/proc_fs.h>
+#include <linux/seq_file.h>
 
 #include <asm/thread_notify.h>
 
@@ -57,7 +59,20 @@ static int crunch_do(struct notifier_block *self, unsigned long cmd, void *t)
 		crunch_task_release(thread);
 		break;
 
+	case THREAD_NOTIFY_COPY:
+		thread->crunch_loads = 0;
+		thread->crunch_kept = 0;
+		break;
+
 	case THREAD_NOTIFY_SWITCH:
+		/*
+		 * The unit is only saved and reloaded when a task faults on
+		 * it (see crunch_task_enable), so a task switched back in
+		 * while still the owner skips the save/restore entirely.
+		 */
+		if (crunch_owner == crunch_state)
+			thread->crunch_kept++;
+
 		devcfg = __raw_readl(EP93XX_SYSCON_DEVCFG);
 		if (crunch_enabled(devcfg) || crunch_owner == crunch_state) {
 			/*
@@ -75,6 +90,16 @@ static int crunch_do(struct notifier_block *self, unsigned long cmd, void *t)
 	return NOTIFY_DONE;
 }
 
+void arch_proc_pid_status(struct seq_file *m, struct task_struct *task)
+{
+	struct thread_info *thread = task_thread_info(task);
+
+	seq_printf(m,	"Crunch_loads:\t%lu\n"
+			"Crunch_switches_avoided:\t%lu\n",
+			thread->crunch_loads,
+			thread->crunch_kept);
+}
+
 static struct notifier_block crunch_notifier_block = {
 	.notifier_call	= crunch_do,
 };
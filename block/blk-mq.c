@@ -0,0 +1,720 @@
+/*
+ * Multi-queue block layer core
+ *
+ * Submitters queue requests on a per-CPU software queue (struct
+ * blk_mq_ctx), each of which feeds one of the driver's hardware
+ * dispatch contexts (struct blk_mq_hw_ctx). Requests and tags are
+ * preallocated per hardware context, so nothing on the submission path
+ * takes a lock shared by all CPUs; q->queue_lock is not used at all.
+ */
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/bio.h>
+#include <linux/blkdev.h>
+#include <linux/blk-mq.h>
+#include <linux/slab.h>
+#include <linux/delay.h>
+#include <linux/bitmap.h>
+#include <linux/cpumask.h>
+#include <linux/percpu.h>
+#include <linux/numa.h>
+#include <linux/cache.h>
+
+#include <trace/events/block.h>
+
+#include "blk.h"
+#include "blk-mq.h"
+
+/*
+ * Return the software queue of the current CPU with preemption
+ * disabled, pair with blk_mq_put_ctx().
+ */
+static struct blk_mq_ctx *blk_mq_get_ctx(struct request_queue *q)
+{
+	return per_cpu_ptr(q->queue_ctx, get_cpu());
+}
+
+static void blk_mq_put_ctx(struct blk_mq_ctx *ctx)
+{
+	put_cpu();
+}
+
+struct blk_mq_hw_ctx *blk_mq_map_queue(struct request_queue *q, const int cpu)
+{
+	return q->queue_hw_ctx[q->mq_map[cpu]];
+}
+EXPORT_SYMBOL(blk_mq_map_queue);
+
+static struct blk_mq_hw_ctx *blk_mq_rq_hctx(struct request *rq)
+{
+	return blk_mq_map_queue(rq->q, rq->mq_ctx->cpu);
+}
+
+static bool blk_mq_hctx_has_pending(struct blk_mq_hw_ctx *hctx)
+{
+	return !list_empty_careful(&hctx->dispatch) ||
+		!bitmap_empty(hctx->ctx_map, hctx->nr_ctx);
+}
+
+/*
+ * Tags are a bitmap per hardware context. The search starts from a per
+ * software queue hint, so submitters on different CPUs tend to work on
+ * different words of the map.
+ */
+static int blk_mq_get_tag(struct blk_mq_hw_ctx *hctx, struct blk_mq_ctx *ctx)
+{
+	unsigned int depth = hctx->queue_depth;
+	unsigned int tag, hint = ctx->last_tag;
+	bool wrapped = false;
+
+	if (hint >= depth)
+		hint = 0;
+
+	for (;;) {
+		tag = find_next_zero_bit(hctx->tag_map, depth, hint);
+		if (tag >= depth) {
+			if (wrapped || !hint)
+				return -1;
+			wrapped = true;
+			hint = 0;
+			continue;
+		}
+		if (!test_and_set_bit_lock(tag, hctx->tag_map))
+			break;
+		hint = tag + 1;
+	}
+
+	ctx->last_tag = tag + 1;
+	return tag;
+}
+
+static void blk_mq_put_tag(struct blk_mq_hw_ctx *hctx, unsigned int tag)
+{
+	clear_bit_unlock(tag, hctx->tag_map);
+	smp_mb__after_clear_bit();
+	if (waitqueue_active(&hctx->tag_wait))
+		wake_up(&hctx->tag_wait);
+}
+
+static void blk_mq_rq_ctx_init(struct blk_mq_ctx *ctx, struct request *rq,
+			       unsigned int rw_flags)
+{
+	struct request_queue *q = ctx->queue;
+	int tag = rq->tag;
+
+	blk_rq_init(q, rq);
+	rq->tag = tag;
+	rq->mq_ctx = ctx;
+	rq->cmd_flags = rw_flags;
+	if (blk_queue_io_stat(q))
+		rq->cmd_flags |= REQ_IO_STAT;
+}
+
+static struct request *__blk_mq_alloc_request(struct blk_mq_hw_ctx *hctx,
+					      struct blk_mq_ctx *ctx,
+					      unsigned int rw_flags)
+{
+	struct request *rq;
+	int tag;
+
+	tag = blk_mq_get_tag(hctx, ctx);
+	if (tag < 0)
+		return NULL;
+
+	rq = hctx->rqs[tag];
+	blk_mq_rq_ctx_init(ctx, rq, rw_flags);
+	return rq;
+}
+
+/*
+ * Sleep until a tag of @hctx frees up. @ctx must map to @hctx but need
+ * not belong to the CPU we end up running on. Returns NULL if @q died
+ * while we waited.
+ */
+static struct request *blk_mq_alloc_request_wait(struct blk_mq_hw_ctx *hctx,
+						 struct blk_mq_ctx *ctx,
+						 unsigned int rw_flags)
+{
+	struct request_queue *q = hctx->queue;
+	struct request *rq;
+	DEFINE_WAIT(wait);
+
+	for (;;) {
+		prepare_to_wait_exclusive(&hctx->tag_wait, &wait,
+					  TASK_UNINTERRUPTIBLE);
+		rq = __blk_mq_alloc_request(hctx, ctx, rw_flags);
+		if (rq || blk_queue_dead(q))
+			break;
+
+		/* make sure whatever holds the tags is being worked on */
+		blk_mq_run_hw_queue(hctx, true);
+		io_schedule();
+	}
+	finish_wait(&hctx->tag_wait, &wait);
+
+	return rq;
+}
+
+/**
+ * blk_mq_alloc_request - allocate a request from a multi-queue device
+ * @q:		request queue
+ * @rw:		READ or WRITE, plus any REQ_* flags
+ * @gfp:	allocation mask, only __GFP_WAIT is honoured
+ *
+ * Description:
+ *    Requests come out of the tag space of the hardware queue serving the
+ *    calling CPU. Without __GFP_WAIT this fails if that queue is full.
+ */
+struct request *blk_mq_alloc_request(struct request_queue *q, int rw,
+				     gfp_t gfp)
+{
+	struct blk_mq_hw_ctx *hctx;
+	struct blk_mq_ctx *ctx;
+	struct request *rq;
+
+	ctx = blk_mq_get_ctx(q);
+	hctx = blk_mq_map_queue(q, ctx->cpu);
+	rq = __blk_mq_alloc_request(hctx, ctx, rw);
+	blk_mq_put_ctx(ctx);
+
+	if (!rq && (gfp & __GFP_WAIT))
+		rq = blk_mq_alloc_request_wait(hctx, ctx, rw);
+
+	return rq;
+}
+EXPORT_SYMBOL(blk_mq_alloc_request);
+
+void blk_mq_free_request(struct request *rq)
+{
+	/* this is a bio leak */
+	WARN_ON(rq->bio != NULL);
+
+	blk_mq_put_tag(blk_mq_rq_hctx(rq), rq->tag);
+}
+EXPORT_SYMBOL(blk_mq_free_request);
+
+/**
+ * blk_mq_end_io - complete a request from a multi-queue device
+ * @rq:		request to complete
+ * @error:	0 for success, < 0 for error
+ *
+ * Description:
+ *    Ends all bios of @rq and releases its tag, unless an ->end_io
+ *    handler was attached in which case that is responsible for it.
+ *    May be called from interrupt context.
+ */
+void blk_mq_end_io(struct request *rq, int error)
+{
+	if (blk_update_request(rq, error, blk_rq_bytes(rq)))
+		BUG();
+
+	blk_account_io_done(rq);
+
+	if (rq->end_io)
+		rq->end_io(rq, error);
+	else
+		blk_mq_free_request(rq);
+}
+EXPORT_SYMBOL(blk_mq_end_io);
+
+static void __blk_mq_insert_request(struct blk_mq_hw_ctx *hctx,
+				    struct blk_mq_ctx *ctx,
+				    struct request *rq, bool at_head)
+{
+	trace_block_rq_insert(rq->q, rq);
+
+	spin_lock(&ctx->lock);
+	if (at_head)
+		list_add(&rq->queuelist, &ctx->rq_list);
+	else
+		list_add_tail(&rq->queuelist, &ctx->rq_list);
+	spin_unlock(&ctx->lock);
+
+	set_bit(ctx->index_hw, hctx->ctx_map);
+}
+
+/**
+ * blk_mq_insert_request - queue a prepared request for dispatch
+ * @rq:		request allocated with blk_mq_alloc_request()
+ * @at_head:	queue at the head of its software queue
+ * @run_queue:	kick the hardware queue after inserting
+ *
+ * Description:
+ *    Must be called from process context.
+ */
+void blk_mq_insert_request(struct request *rq, bool at_head, bool run_queue)
+{
+	struct blk_mq_hw_ctx *hctx = blk_mq_rq_hctx(rq);
+
+	__blk_mq_insert_request(hctx, rq->mq_ctx, rq, at_head);
+
+	if (run_queue)
+		blk_mq_run_hw_queue(hctx, false);
+}
+EXPORT_SYMBOL(blk_mq_insert_request);
+
+/*
+ * Pull everything pending off the software queues mapped to @hctx and
+ * hand it to the driver. Requests the driver has no room for are parked
+ * on hctx->dispatch, ahead of anything queued later. Called with
+ * preemption disabled.
+ */
+static void __blk_mq_run_hw_queue(struct blk_mq_hw_ctx *hctx)
+{
+	struct request_queue *q = hctx->queue;
+	struct request *rq;
+	LIST_HEAD(rq_list);
+	int bit, ret;
+
+	if (unlikely(test_bit(BLK_MQ_S_STOPPED, &hctx->state)))
+		return;
+
+	/*
+	 * Clear the pending bit before taking the list: a submitter that
+	 * adds after our splice sets it again and kicks the queue itself.
+	 */
+	for_each_set_bit(bit, hctx->ctx_map, hctx->nr_ctx) {
+		struct blk_mq_ctx *ctx = hctx->ctxs[bit];
+
+		clear_bit(bit, hctx->ctx_map);
+		spin_lock(&ctx->lock);
+		list_splice_tail_init(&ctx->rq_list, &rq_list);
+		spin_unlock(&ctx->lock);
+	}
+
+	if (!list_empty_careful(&hctx->dispatch)) {
+		spin_lock(&hctx->lock);
+		list_splice_init(&hctx->dispatch, &rq_list);
+		spin_unlock(&hctx->lock);
+	}
+
+	while (!list_empty(&rq_list)) {
+		rq = list_first_entry(&rq_list, struct request, queuelist);
+		list_del_init(&rq->queuelist);
+
+		trace_block_rq_issue(q, rq);
+
+		ret = q->mq_ops->queue_rq(hctx, rq);
+		if (ret == BLK_MQ_RQ_QUEUE_OK)
+			continue;
+
+		if (ret == BLK_MQ_RQ_QUEUE_BUSY) {
+			list_add(&rq->queuelist, &rq_list);
+			break;
+		}
+
+		pr_err("blk-mq: bad return on queue: %d\n", ret);
+		rq->errors = -EIO;
+		blk_mq_end_io(rq, rq->errors);
+	}
+
+	/*
+	 * The driver is out of resources. It is expected to stop the queue
+	 * and restart it once something completes.
+	 */
+	if (!list_empty(&rq_list)) {
+		spin_lock(&hctx->lock);
+		list_splice(&rq_list, &hctx->dispatch);
+		spin_unlock(&hctx->lock);
+	}
+}
+
+static void blk_mq_run_work_fn(struct work_struct *work)
+{
+	struct blk_mq_hw_ctx *hctx;
+
+	hctx = container_of(work, struct blk_mq_hw_ctx, run_work.work);
+
+	preempt_disable();
+	__blk_mq_run_hw_queue(hctx);
+	preempt_enable();
+}
+
+/**
+ * blk_mq_run_hw_queue - dispatch pending requests of a hardware queue
+ * @hctx:	hardware queue to run
+ * @async:	always defer to kblockd
+ *
+ * Description:
+ *    The queue is run inline when the caller sits on one of the CPUs
+ *    mapped to @hctx, otherwise it is punted to kblockd.
+ */
+void blk_mq_run_hw_queue(struct blk_mq_hw_ctx *hctx, bool async)
+{
+	if (unlikely(test_bit(BLK_MQ_S_STOPPED, &hctx->state)))
+		return;
+
+	if (!async) {
+		int cpu = get_cpu();
+
+		if (cpumask_test_cpu(cpu, hctx->cpumask)) {
+			__blk_mq_run_hw_queue(hctx);
+			put_cpu();
+			return;
+		}
+		put_cpu();
+	}
+
+	kblockd_schedule_delayed_work(hctx->queue, &hctx->run_work, 0);
+}
+EXPORT_SYMBOL(blk_mq_run_hw_queue);
+
+void blk_mq_run_queues(struct request_queue *q, bool async)
+{
+	struct blk_mq_hw_ctx *hctx;
+	int i;
+
+	queue_for_each_hw_ctx(q, hctx, i) {
+		if (blk_mq_hctx_has_pending(hctx))
+			blk_mq_run_hw_queue(hctx, async);
+	}
+}
+EXPORT_SYMBOL(blk_mq_run_queues);
+
+void blk_mq_stop_hw_queue(struct blk_mq_hw_ctx *hctx)
+{
+	cancel_delayed_work(&hctx->run_work);
+	set_bit(BLK_MQ_S_STOPPED, &hctx->state);
+}
+EXPORT_SYMBOL(blk_mq_stop_hw_queue);
+
+/*
+ * Safe to call from interrupt context, the queues are always restarted
+ * from kblockd.
+ */
+void blk_mq_start_stopped_hw_queues(struct request_queue *q)
+{
+	struct blk_mq_hw_ctx *hctx;
+	int i;
+
+	queue_for_each_hw_ctx(q, hctx, i) {
+		if (test_and_clear_bit(BLK_MQ_S_STOPPED, &hctx->state))
+			blk_mq_run_hw_queue(hctx, true);
+	}
+}
+EXPORT_SYMBOL(blk_mq_start_stopped_hw_queues);
+
+static void blk_mq_unplug(struct blk_plug_cb *cb, bool from_schedule)
+{
+	blk_mq_run_queues(cb->data, from_schedule);
+	kfree(cb);
+}
+
+static void blk_mq_make_request(struct request_queue *q, struct bio *bio)
+{
+	const int is_sync = rw_is_sync(bio->bi_rw);
+	const int is_flush_fua = bio->bi_rw & (REQ_FLUSH | REQ_FUA);
+	struct blk_mq_hw_ctx *hctx;
+	struct blk_mq_ctx *ctx;
+	struct request *rq;
+	unsigned int rw_flags;
+
+	blk_queue_bounce(q, &bio);
+
+	if (unlikely(blk_queue_dead(q))) {
+		bio_endio(bio, -ENODEV);
+		return;
+	}
+
+	rw_flags = bio_data_dir(bio);
+	if (is_sync)
+		rw_flags |= REQ_SYNC;
+
+	ctx = blk_mq_get_ctx(q);
+	hctx = blk_mq_map_queue(q, ctx->cpu);
+
+	trace_block_getrq(q, bio, rw_flags);
+	rq = __blk_mq_alloc_request(hctx, ctx, rw_flags);
+	if (unlikely(!rq)) {
+		blk_mq_put_ctx(ctx);
+		trace_block_sleeprq(q, bio, rw_flags);
+
+		rq = blk_mq_alloc_request_wait(hctx, ctx, rw_flags);
+		if (unlikely(!rq)) {
+			bio_endio(bio, -ENODEV);	/* @q is dead */
+			return;
+		}
+
+		/*
+		 * We may have migrated while asleep. Keep queueing on the
+		 * software queue the tag was taken for, it is locked anyway.
+		 */
+		preempt_disable();
+	}
+
+	init_request_from_bio(rq, bio);
+	if (test_bit(QUEUE_FLAG_SAME_COMP, &q->queue_flags))
+		rq->cpu = raw_smp_processor_id();
+
+	drive_stat_acct(rq, 1);
+	__blk_mq_insert_request(hctx, ctx, rq, false);
+
+	/*
+	 * While plugged, leave it to the unplug to kick the hardware queues
+	 * so that a batch of submissions is dispatched in one go.
+	 */
+	if (!is_flush_fua &&
+	    blk_check_plugged(blk_mq_unplug, q, sizeof(struct blk_plug_cb))) {
+		blk_mq_put_ctx(ctx);
+		return;
+	}
+
+	blk_mq_run_hw_queue(hctx, !is_sync || is_flush_fua);
+	blk_mq_put_ctx(ctx);
+}
+
+/**
+ * blk_mq_drain_queue - wait for all requests of a dying queue to finish
+ * @q:	queue to drain, already marked DEAD
+ */
+void blk_mq_drain_queue(struct request_queue *q)
+{
+	struct blk_mq_hw_ctx *hctx;
+	int i;
+
+	while (true) {
+		bool drain = false;
+
+		queue_for_each_hw_ctx(q, hctx, i) {
+			blk_mq_run_hw_queue(hctx, false);
+
+			/* waiters must notice @q is dead and bail out */
+			wake_up_all(&hctx->tag_wait);
+
+			if (!bitmap_empty(hctx->tag_map, hctx->queue_depth))
+				drain = true;
+		}
+
+		if (!drain)
+			break;
+		msleep(10);
+	}
+}
+
+static int blk_mq_init_rq_map(struct blk_mq_hw_ctx *hctx,
+			      unsigned int cmd_size)
+{
+	unsigned int depth = hctx->queue_depth;
+	size_t rq_size;
+	unsigned int i;
+
+	hctx->rqs = kzalloc_node(depth * sizeof(struct request *),
+				 GFP_KERNEL, hctx->numa_node);
+	hctx->tag_map = kzalloc_node(BITS_TO_LONGS(depth) * sizeof(long),
+				     GFP_KERNEL, hctx->numa_node);
+	if (!hctx->rqs || !hctx->tag_map)
+		return -ENOMEM;
+
+	/* driver data follows the request, see blk_mq_rq_to_pdu() */
+	rq_size = round_up(sizeof(struct request) + cmd_size,
+			   cache_line_size());
+
+	for (i = 0; i < depth; i++) {
+		struct request *rq;
+
+		rq = kzalloc_node(rq_size, GFP_KERNEL, hctx->numa_node);
+		if (!rq)
+			return -ENOMEM;
+
+		rq->tag = i;
+		hctx->rqs[i] = rq;
+	}
+
+	return 0;
+}
+
+static void blk_mq_free_rq_map(struct blk_mq_hw_ctx *hctx)
+{
+	unsigned int i;
+
+	if (hctx->rqs) {
+		for (i = 0; i < hctx->queue_depth; i++)
+			kfree(hctx->rqs[i]);
+		kfree(hctx->rqs);
+	}
+	kfree(hctx->tag_map);
+}
+
+/*
+ * Spread the possible CPUs evenly over the hardware queues, keeping
+ * neighbouring CPU ids on the same queue.
+ */
+static unsigned int *blk_mq_make_queue_map(unsigned int nr_queues, int node)
+{
+	unsigned int nr_cpus = num_possible_cpus();
+	unsigned int *map, i = 0;
+	int cpu;
+
+	map = kzalloc_node(nr_cpu_ids * sizeof(*map), GFP_KERNEL, node);
+	if (!map)
+		return NULL;
+
+	for_each_possible_cpu(cpu)
+		map[cpu] = i++ * nr_queues / nr_cpus;
+
+	return map;
+}
+
+static struct blk_mq_hw_ctx *blk_mq_alloc_hctx(struct request_queue *q,
+					       struct blk_mq_reg *reg,
+					       unsigned int index)
+{
+	struct blk_mq_hw_ctx *hctx;
+
+	hctx = kzalloc_node(sizeof(*hctx), GFP_KERNEL, reg->numa_node);
+	if (!hctx)
+		return NULL;
+
+	spin_lock_init(&hctx->lock);
+	INIT_LIST_HEAD(&hctx->dispatch);
+	INIT_DELAYED_WORK(&hctx->run_work, blk_mq_run_work_fn);
+	init_waitqueue_head(&hctx->tag_wait);
+
+	hctx->queue = q;
+	hctx->queue_num = index;
+	hctx->queue_depth = reg->queue_depth;
+	hctx->numa_node = reg->numa_node;
+
+	hctx->ctxs = kzalloc_node(nr_cpu_ids * sizeof(void *), GFP_KERNEL,
+				  reg->numa_node);
+	hctx->ctx_map = kzalloc_node(BITS_TO_LONGS(nr_cpu_ids) * sizeof(long),
+				     GFP_KERNEL, reg->numa_node);
+	if (!hctx->ctxs || !hctx->ctx_map ||
+	    !zalloc_cpumask_var_node(&hctx->cpumask, GFP_KERNEL,
+				     reg->numa_node)) {
+		kfree(hctx->ctxs);
+		kfree(hctx->ctx_map);
+		kfree(hctx);
+		return NULL;
+	}
+
+	return hctx;
+}
+
+/**
+ * blk_mq_init_queue - set up a multi-queue request queue
+ * @reg:	   hardware queue count, depth and driver operations
+ * @driver_data:   stored in q->queuedata and passed to ->init_hctx()
+ *
+ * Description:
+ *    Allocates one software queue per possible CPU and @reg->nr_hw_queues
+ *    hardware contexts (capped at the number of possible CPUs), each with
+ *    @reg->queue_depth preallocated requests carrying @reg->cmd_size
+ *    bytes of driver data. Bios are not merged, and REQ_FLUSH/REQ_FUA are
+ *    passed straight to the driver rather than sequenced by the block
+ *    layer. Tear down with blk_cleanup_queue().
+ *
+ *    Returns NULL on failure.
+ */
+struct request_queue *blk_mq_init_queue(struct blk_mq_reg *reg,
+					void *driver_data)
+{
+	struct blk_mq_ops *ops = reg->ops;
+	struct blk_mq_hw_ctx *hctx;
+	struct request_queue *q;
+	unsigned int nr_hw_queues, i;
+	int cpu;
+
+	if (!reg->nr_hw_queues || !ops->queue_rq || !reg->queue_depth ||
+	    reg->queue_depth > BLK_MQ_MAX_DEPTH)
+		return NULL;
+
+	nr_hw_queues = min(reg->nr_hw_queues, num_possible_cpus());
+
+	q = blk_alloc_queue_node(GFP_KERNEL, reg->numa_node);
+	if (!q)
+		return NULL;
+
+	q->queue_ctx = alloc_percpu(struct blk_mq_ctx);
+	q->queue_hw_ctx = kzalloc_node(nr_hw_queues * sizeof(hctx),
+				       GFP_KERNEL, reg->numa_node);
+	q->mq_map = blk_mq_make_queue_map(nr_hw_queues, reg->numa_node);
+	if (!q->queue_ctx || !q->queue_hw_ctx || !q->mq_map)
+		goto err_free;
+
+	q->nr_hw_queues = nr_hw_queues;
+	for (i = 0; i < nr_hw_queues; i++) {
+		q->queue_hw_ctx[i] = blk_mq_alloc_hctx(q, reg, i);
+		if (!q->queue_hw_ctx[i])
+			goto err_free;
+	}
+
+	for_each_possible_cpu(cpu) {
+		struct blk_mq_ctx *ctx = per_cpu_ptr(q->queue_ctx, cpu);
+
+		spin_lock_init(&ctx->lock);
+		INIT_LIST_HEAD(&ctx->rq_list);
+		ctx->cpu = cpu;
+		ctx->queue = q;
+
+		hctx = blk_mq_map_queue(q, cpu);
+		cpumask_set_cpu(cpu, hctx->cpumask);
+		ctx->index_hw = hctx->nr_ctx;
+		hctx->ctxs[hctx->nr_ctx++] = ctx;
+	}
+
+	for (i = 0; i < nr_hw_queues; i++) {
+		hctx = q->queue_hw_ctx[i];
+
+		if (hctx->numa_node == NUMA_NO_NODE)
+			hctx->numa_node =
+				cpu_to_node(cpumask_first(hctx->cpumask));
+
+		if (blk_mq_init_rq_map(hctx, reg->cmd_size))
+			goto err_exit;
+		if (ops->init_hctx && ops->init_hctx(hctx, driver_data, i))
+			goto err_exit;
+	}
+
+	blk_queue_make_request(q, blk_mq_make_request);
+	q->nr_requests = nr_hw_queues * reg->queue_depth;
+	q->queue_flags |= QUEUE_FLAG_MQ_DEFAULT;
+	q->queuedata = driver_data;
+	q->mq_ops = ops;
+
+	return q;
+
+err_exit:
+	while (i--) {
+		if (ops->exit_hctx)
+			ops->exit_hctx(q->queue_hw_ctx[i], i);
+	}
+err_free:
+	blk_mq_free_queue(q);
+	blk_cleanup_queue(q);
+	return NULL;
+}
+EXPORT_SYMBOL(blk_mq_init_queue);
+
+/*
+ * Called on final release of @q. Also used to unwind a partially set
+ * up queue, before ->mq_ops is assigned.
+ */
+void blk_mq_free_queue(struct request_queue *q)
+{
+	struct blk_mq_hw_ctx *hctx;
+	unsigned int i;
+
+	for (i = 0; i < q->nr_hw_queues; i++) {
+		hctx = q->queue_hw_ctx[i];
+		if (!hctx)
+			continue;
+
+		if (q->mq_ops && q->mq_ops->exit_hctx)
+			q->mq_ops->exit_hctx(hctx, i);
+
+		blk_mq_free_rq_map(hctx);
+		free_cpumask_var(hctx->cpumask);
+		kfree(hctx->ctx_map);
+		kfree(hctx->ctxs);
+		kfree(hctx);
+	}
+	q->nr_hw_queues = 0;
+
+	kfree(q->queue_hw_ctx);
+	q->queue_hw_ctx = NULL;
+	free_percpu(q->queue_ctx);
+	q->queue_ctx = NULL;
+	kfree(q->mq_map);
+	q->mq_map = NULL;
+}
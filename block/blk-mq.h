@@ -0,0 +1,25 @@
+#ifndef INT_BLK_MQ_H
+#define INT_BLK_MQ_H
+
+/*
+ * Per-CPU software queue. Submitters only ever touch the context of
+ * the CPU they run on, so the lock is effectively uncontended; the
+ * owning hardware context drains it when it runs.
+ */
+struct blk_mq_ctx {
+	struct {
+		spinlock_t		lock;
+		struct list_head	rq_list;
+	} ____cacheline_aligned_in_smp;
+
+	unsigned int		cpu;
+	unsigned int		index_hw;	/* bit in hctx->ctx_map */
+	unsigned int		last_tag;	/* tag search hint */
+
+	struct request_queue	*queue;
+};
+
+void blk_mq_drain_queue(struct request_queue *q);
+void blk_mq_free_queue(struct request_queue *q);
+
+#endif
@@ -10,6 +10,7 @@
 
 #include "blk.h"
 #include "blk-cgroup.h"
+#include "blk-mq.h"
 
 struct queue_sysfs_entry {
 	struct attribute attr;
@@ -530,6 +531,9 @@ static void blk_release_queue(struct kobject *kobj)
 
 	blk_exit_rl(&q->root_rl);
 
+	if (q->mq_ops)
+		blk_mq_free_queue(q);
+
 	if (q->queue_tags)
 		__blk_queue_free_tags(q);
 
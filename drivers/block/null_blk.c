@@ -0,0 +1,358 @@
+/*
+ * Null block device driver
+ *
+ * Completes every request without touching any data, so that the cost
+ * of the block layer itself can be measured. The bio, single queue and
+ * multi-queue submission paths can be selected at load time for
+ * comparison, see Documentation/block/null_blk.txt.
+ */
+
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/init.h>
+#include <linux/fs.h>
+#include <linux/blkdev.h>
+#include <linux/blk-mq.h>
+#include <linux/bio.h>
+#include <linux/slab.h>
+#include <linux/mutex.h>
+#include <linux/numa.h>
+#include <linux/hrtimer.h>
+#include <linux/percpu.h>
+
+struct nullb {
+	struct list_head list;
+	unsigned int index;
+	struct request_queue *q;
+	struct gendisk *disk;
+	spinlock_t lock;
+};
+
+/*
+ * Requests and bios waiting for the completion timer of their CPU.
+ */
+struct completion_queue {
+	struct bio_list bios;
+	struct list_head rqs;
+	struct hrtimer timer;
+};
+
+static DEFINE_PER_CPU(struct completion_queue, completion_queues);
+
+static LIST_HEAD(nullb_list);
+static DEFINE_MUTEX(nullb_lock);
+static int null_major;
+static unsigned int nullb_indexes;
+
+enum {
+	NULL_IRQ_NONE		= 0,
+	NULL_IRQ_SOFTIRQ	= 1,
+	NULL_IRQ_TIMER		= 2,
+};
+
+enum {
+	NULL_Q_BIO		= 0,
+	NULL_Q_RQ		= 1,
+	NULL_Q_MQ		= 2,
+};
+
+static int submit_queues;
+module_param(submit_queues, int, S_IRUGO);
+MODULE_PARM_DESC(submit_queues, "Number of hardware queues (default: one per online CPU)");
+
+static int home_node = NUMA_NO_NODE;
+module_param(home_node, int, S_IRUGO);
+MODULE_PARM_DESC(home_node, "Home node for the device");
+
+static int queue_mode = NULL_Q_MQ;
+module_param(queue_mode, int, S_IRUGO);
+MODULE_PARM_DESC(queue_mode, "Block interface to use (0=bio,1=rq,2=multiqueue)");
+
+static int gb = 250;
+module_param(gb, int, S_IRUGO);
+MODULE_PARM_DESC(gb, "Size in GB");
+
+static int bs = 512;
+module_param(bs, int, S_IRUGO);
+MODULE_PARM_DESC(bs, "Block size (in bytes)");
+
+static int nr_devices = 2;
+module_param(nr_devices, int, S_IRUGO);
+MODULE_PARM_DESC(nr_devices, "Number of devices to register");
+
+static int irqmode = NULL_IRQ_SOFTIRQ;
+module_param(irqmode, int, S_IRUGO);
+MODULE_PARM_DESC(irqmode, "IRQ completion handler. 0-none, 1-softirq, 2-timer");
+
+static unsigned long completion_nsec = 10000;
+module_param(completion_nsec, ulong, S_IRUGO);
+MODULE_PARM_DESC(completion_nsec, "Time in ns to complete a request in hardware. Default: 10,000ns");
+
+static int hw_queue_depth = 64;
+module_param(hw_queue_depth, int, S_IRUGO);
+MODULE_PARM_DESC(hw_queue_depth, "Queue depth for each hardware queue. Default: 64");
+
+static void null_end_request(struct request *rq)
+{
+	if (queue_mode == NULL_Q_MQ)
+		blk_mq_end_io(rq, 0);
+	else
+		blk_end_request_all(rq, 0);
+}
+
+static enum hrtimer_restart null_cmd_timer_expired(struct hrtimer *timer)
+{
+	struct completion_queue *cq;
+	struct request *rq, *next;
+	struct bio_list bios;
+	struct bio *bio;
+	unsigned long flags;
+	LIST_HEAD(rqs);
+
+	cq = container_of(timer, struct completion_queue, timer);
+
+	local_irq_save(flags);
+	bios = cq->bios;
+	bio_list_init(&cq->bios);
+	list_splice_init(&cq->rqs, &rqs);
+	local_irq_restore(flags);
+
+	while ((bio = bio_list_pop(&bios)) != NULL)
+		bio_endio(bio, 0);
+
+	list_for_each_entry_safe(rq, next, &rqs, queuelist) {
+		list_del_init(&rq->queuelist);
+		null_end_request(rq);
+	}
+
+	return HRTIMER_NORESTART;
+}
+
+/*
+ * Everything queued while the timer of this CPU is pending completes
+ * together when it fires, much like interrupt coalescing on real
+ * hardware.
+ */
+static void null_cmd_end_timer(struct request *rq, struct bio *bio)
+{
+	struct completion_queue *cq;
+	unsigned long flags;
+
+	local_irq_save(flags);
+	cq = &__get_cpu_var(completion_queues);
+	if (bio)
+		bio_list_add(&cq->bios, bio);
+	else
+		list_add_tail(&rq->queuelist, &cq->rqs);
+
+	if (!hrtimer_is_queued(&cq->timer))
+		hrtimer_start(&cq->timer, ktime_set(0, completion_nsec),
+			      HRTIMER_MODE_REL_PINNED);
+	local_irq_restore(flags);
+}
+
+static void null_softirq_done_fn(struct request *rq)
+{
+	null_end_request(rq);
+}
+
+static void null_queue_bio(struct request_queue *q, struct bio *bio)
+{
+	if (irqmode == NULL_IRQ_TIMER)
+		null_cmd_end_timer(NULL, bio);
+	else
+		bio_endio(bio, 0);
+}
+
+static void null_request_fn(struct request_queue *q)
+{
+	struct request *rq;
+
+	while ((rq = blk_fetch_request(q)) != NULL) {
+		switch (irqmode) {
+		case NULL_IRQ_SOFTIRQ:
+			blk_complete_request(rq);
+			break;
+		case NULL_IRQ_TIMER:
+			null_cmd_end_timer(rq, NULL);
+			break;
+		default:
+			__blk_end_request_all(rq, 0);
+			break;
+		}
+	}
+}
+
+static int null_queue_rq(struct blk_mq_hw_ctx *hctx, struct request *rq)
+{
+	switch (irqmode) {
+	case NULL_IRQ_SOFTIRQ:
+		blk_complete_request(rq);
+		break;
+	case NULL_IRQ_TIMER:
+		null_cmd_end_timer(rq, NULL);
+		break;
+	default:
+		blk_mq_end_io(rq, 0);
+		break;
+	}
+
+	return BLK_MQ_RQ_QUEUE_OK;
+}
+
+static struct blk_mq_ops null_mq_ops = {
+	.queue_rq	= null_queue_rq,
+};
+
+static struct blk_mq_reg null_mq_reg = {
+	.ops		= &null_mq_ops,
+};
+
+static const struct block_device_operations null_fops = {
+	.owner		= THIS_MODULE,
+};
+
+static void null_del_dev(struct nullb *nullb)
+{
+	list_del(&nullb->list);
+
+	del_gendisk(nullb->disk);
+	blk_cleanup_queue(nullb->q);
+	put_disk(nullb->disk);
+	kfree(nullb);
+}
+
+static int null_add_dev(void)
+{
+	struct gendisk *disk;
+	struct nullb *nullb;
+
+	nullb = kzalloc_node(sizeof(*nullb), GFP_KERNEL, home_node);
+	if (!nullb)
+		return -ENOMEM;
+
+	spin_lock_init(&nullb->lock);
+
+	switch (queue_mode) {
+	case NULL_Q_MQ:
+		null_mq_reg.nr_hw_queues = submit_queues;
+		null_mq_reg.queue_depth = hw_queue_depth;
+		null_mq_reg.numa_node = home_node;
+		nullb->q = blk_mq_init_queue(&null_mq_reg, nullb);
+		break;
+	case NULL_Q_BIO:
+		nullb->q = blk_alloc_queue_node(GFP_KERNEL, home_node);
+		if (nullb->q)
+			blk_queue_make_request(nullb->q, null_queue_bio);
+		break;
+	default:
+		nullb->q = blk_init_queue_node(null_request_fn, &nullb->lock,
+					       home_node);
+		break;
+	}
+
+	if (!nullb->q)
+		goto out_free;
+
+	nullb->q->queuedata = nullb;
+	queue_flag_set_unlocked(QUEUE_FLAG_NONROT, nullb->q);
+	blk_queue_softirq_done(nullb->q, null_softirq_done_fn);
+	blk_queue_logical_block_size(nullb->q, bs);
+	blk_queue_physical_block_size(nullb->q, bs);
+
+	disk = nullb->disk = alloc_disk_node(1, home_node);
+	if (!disk)
+		goto out_cleanup;
+
+	mutex_lock(&nullb_lock);
+	nullb->index = nullb_indexes++;
+	list_add_tail(&nullb->list, &nullb_list);
+	mutex_unlock(&nullb_lock);
+
+	set_capacity(disk, (sector_t)gb << (30 - 9));
+	disk->flags |= GENHD_FL_EXT_DEVT;
+	disk->major = null_major;
+	disk->first_minor = nullb->index;
+	disk->fops = &null_fops;
+	disk->private_data = nullb;
+	disk->queue = nullb->q;
+	sprintf(disk->disk_name, "nullb%d", nullb->index);
+	add_disk(disk);
+
+	return 0;
+
+out_cleanup:
+	blk_cleanup_queue(nullb->q);
+out_free:
+	kfree(nullb);
+	return -ENOMEM;
+}
+
+static int __init null_init(void)
+{
+	int i;
+
+	if (bs > PAGE_SIZE) {
+		pr_warn("null_blk: invalid block size\n");
+		pr_warn("null_blk: defaults block size to %lu\n", PAGE_SIZE);
+		bs = PAGE_SIZE;
+	}
+
+	if (queue_mode == NULL_Q_MQ &&
+	    (submit_queues <= 0 || submit_queues > nr_cpu_ids))
+		submit_queues = num_online_cpus();
+
+	if (hw_queue_depth <= 0 || hw_queue_depth > BLK_MQ_MAX_DEPTH)
+		hw_queue_depth = 64;
+
+	for_each_possible_cpu(i) {
+		struct completion_queue *cq = &per_cpu(completion_queues, i);
+
+		bio_list_init(&cq->bios);
+		INIT_LIST_HEAD(&cq->rqs);
+		hrtimer_init(&cq->timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+		cq->timer.function = null_cmd_timer_expired;
+	}
+
+	null_major = register_blkdev(0, "nullb");
+	if (null_major < 0)
+		return null_major;
+
+	for (i = 0; i < nr_devices; i++) {
+		if (null_add_dev()) {
+			struct nullb *nullb, *next;
+
+			mutex_lock(&nullb_lock);
+			list_for_each_entry_safe(nullb, next, &nullb_list, list)
+				null_del_dev(nullb);
+			mutex_unlock(&nullb_lock);
+
+			unregister_blkdev(null_major, "nullb");
+			return -EINVAL;
+		}
+	}
+
+	pr_info("null: module loaded\n");
+	return 0;
+}
+
+static void __exit null_exit(void)
+{
+	struct nullb *nullb, *next;
+	int i;
+
+	mutex_lock(&nullb_lock);
+	list_for_each_entry_safe(nullb, next, &nullb_list, list)
+		null_del_dev(nullb);
+	mutex_unlock(&nullb_lock);
+
+	unregister_blkdev(null_major, "nullb");
+
+	for_each_possible_cpu(i)
+		hrtimer_cancel(&per_cpu(completion_queues, i).timer);
+}
+
+module_init(null_init);
+module_exit(null_exit);
+
+MODULE_LICENSE("GPL");
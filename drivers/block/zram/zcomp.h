@@ -0,0 +1,61 @@
+/*
+ * Compression streams for the compressed RAM block device
+ *
+ * This code is released using a dual license strategy: BSD/GPL
+ * You can choose the licence that better fits your requirements.
+ *
+ * Released under the terms of 3-clause BSD License
+ * Released under the terms of GNU General Public License Version 2.0
+ */
+
+#ifndef _ZCOMP_H_
+#define _ZCOMP_H_
+
+#include <linux/crypto.h>
+#include <linux/list.h>
+#include <linux/spinlock.h>
+#include <linux/wait.h>
+
+#define ZCOMP_NAME_LEN	CRYPTO_MAX_ALG_NAME
+
+/*
+ * A compression stream: a transform of the compressor together with a
+ * buffer large enough for the worst case output of compressing a page.
+ * A stream is used by one request at a time.
+ */
+struct zcomp_strm {
+	struct crypto_comp *tfm;
+	void *buffer;
+	struct list_head list;
+};
+
+/*
+ * A pool of streams, one per compressing or decompressing request. Up to
+ * max_strm streams are created on demand, further requests wait for one
+ * to become idle.
+ */
+struct zcomp {
+	char name[ZCOMP_NAME_LEN];
+	spinlock_t strm_lock;		/* protects idle_strm and avail_strm */
+	struct list_head idle_strm;
+	int avail_strm;
+	int max_strm;
+	wait_queue_head_t strm_wait;
+};
+
+extern bool zcomp_available(const char *name);
+extern ssize_t zcomp_available_show(const char *cur, char *buf);
+
+extern struct zcomp *zcomp_create(const char *name, int max_strm);
+extern void zcomp_destroy(struct zcomp *comp);
+extern void zcomp_set_max_streams(struct zcomp *comp, int max_strm);
+
+extern struct zcomp_strm *zcomp_strm_find(struct zcomp *comp);
+extern void zcomp_strm_release(struct zcomp *comp, struct zcomp_strm *zstrm);
+
+extern int zcomp_compress(struct zcomp_strm *zstrm, const void *src,
+			  size_t *dst_len);
+extern int zcomp_decompress(struct zcomp_strm *zstrm, const void *src,
+			    size_t src_len, void *dst);
+
+#endif
@@ -19,11 +19,13 @@
  */
 
 #include <linux/clk.h>
+#include <linux/debugfs.h>
 #include <linux/init.h>
 #include <linux/interrupt.h>
 #include <linux/dmaengine.h>
 #include <linux/module.h>
 #include <linux/platform_device.h>
+#include <linux/seq_file.h>
 #include <linux/slab.h>
 
 #include <linux/platform_data/dma-ep93xx.h>
@@ -106,6 +108,7 @@
 
 #define DMA_MAX_CHAN_BYTES		0xffff
 #define DMA_MAX_CHAN_DESCRIPTORS	32
+#define DMA_MAX_CHAN_POOL		256
 
 struct ep93xx_dma_engine;
 
@@ -129,6 +132,28 @@ struct ep93xx_dma_desc {
 	struct list_head		node;
 };
 
+/**
+ * struct ep93xx_dma_stats - per-channel statistics
+ * @bytes: number of bytes moved by completed descriptors
+ * @completed: number of completed transactions (or periods when cyclic)
+ * @irq_callbacks: number of callbacks called from the interrupt handler
+ * @descs_allocated: number of descriptors owned by the channel
+ * @descs_in_use: number of descriptors currently prepared, queued or active
+ * @pool_grown: number of descriptors allocated after the initial pool
+ * @pool_starved: number of times a descriptor could not be provided
+ *
+ * All the fields are protected by the channel lock.
+ */
+struct ep93xx_dma_stats {
+	u64				bytes;
+	unsigned long			completed;
+	unsigned long			irq_callbacks;
+	unsigned int			descs_allocated;
+	unsigned int			descs_in_use;
+	unsigned long			pool_grown;
+	unsigned long			pool_starved;
+};
+
 /**
  * struct ep93xx_dma_chan - an EP93xx DMA M2P/M2M channel
  * @chan: dmaengine API channel
@@ -147,6 +172,7 @@ struct ep93xx_dma_desc {
  *                is set via %DMA_SLAVE_CONFIG before slave operation is
  *                prepared
  * @runtime_ctrl: M2M runtime values for the control register.
+ * @stats: statistics exported through debugfs
  *
  * As EP93xx DMA controller doesn't support real chained DMA descriptors we
  * will have slightly different scheme here: @active points to a head of
@@ -179,6 +205,7 @@ struct ep93xx_dma_chan {
 	struct list_head		free_list;
 	u32				runtime_addr;
 	u32				runtime_ctrl;
+	struct ep93xx_dma_stats		stats;
 };
 
 /**
@@ -217,11 +244,20 @@ static inline struct device *chan2dev(struct ep93xx_dma_chan *edmac)
 	return &edmac->chan.dev->device;
 }
 
+static dma_cookie_t ep93xx_dma_tx_submit(struct dma_async_tx_descriptor *tx);
+
 static struct ep93xx_dma_chan *to_ep93xx_dma_chan(struct dma_chan *chan)
 {
 	return container_of(chan, struct ep93xx_dma_chan, chan);
 }
 
+static inline bool ep93xx_dma_irq_callback(struct ep93xx_dma_chan *edmac)
+{
+	const struct ep93xx_dma_data *data = edmac->chan.private;
+
+	return data && data->irq_callback;
+}
+
 /**
  * ep93xx_dma_set_active - set new active descriptor chain
  * @edmac: channel
@@ -662,11 +698,40 @@ static int m2m_hw_interrupt(struct ep93xx_dma_chan *edmac)
  */
 
 static struct ep93xx_dma_desc *
+ep93xx_dma_desc_alloc(struct ep93xx_dma_chan *edmac, gfp_t gfp)
+{
+	struct ep93xx_dma_desc *desc;
+
+	desc = kzalloc(sizeof(*desc), gfp);
+	if (!desc)
+		return NULL;
+
+	INIT_LIST_HEAD(&desc->tx_list);
+	INIT_LIST_HEAD(&desc->node);
+
+	dma_async_tx_descriptor_init(&desc->txd, &edmac->chan);
+	desc->txd.flags = DMA_CTRL_ACK;
+	desc->txd.tx_submit = ep93xx_dma_tx_submit;
+
+	return desc;
+}
+
+/**
+ * ep93xx_dma_desc_get - get a free descriptor from the channel pool
+ * @edmac: channel
+ *
+ * Returns a free and acked descriptor from @edmac->free_list. If there is
+ * none, the pool is grown by one descriptor without sleeping, so that this
+ * can be called from any context the prep functions are called from.
+ * Returns %NULL only if the pool is exhausted and can't be grown.
+ */
+static struct ep93xx_dma_desc *
 ep93xx_dma_desc_get(struct ep93xx_dma_chan *edmac)
 {
 	struct ep93xx_dma_desc *desc, *_desc;
 	struct ep93xx_dma_desc *ret = NULL;
 	unsigned long flags;
+	bool grow;
 
 	spin_lock_irqsave(&edmac->lock, flags);
 	list_for_each_entry_safe(desc, _desc, &edmac->free_list, node) {
@@ -686,7 +751,27 @@ ep93xx_dma_desc_get(struct ep93xx_dma_chan *edmac)
 			break;
 		}
 	}
+	grow = !ret && edmac->stats.descs_allocated < DMA_MAX_CHAN_POOL;
+	if (ret)
+		edmac->stats.descs_in_use++;
 	spin_unlock_irqrestore(&edmac->lock, flags);
+
+	if (ret)
+		return ret;
+
+	if (grow)
+		ret = ep93xx_dma_desc_alloc(edmac, GFP_NOWAIT);
+
+	spin_lock_irqsave(&edmac->lock, flags);
+	if (ret) {
+		edmac->stats.descs_allocated++;
+		edmac->stats.descs_in_use++;
+		edmac->stats.pool_grown++;
+	} else {
+		edmac->stats.pool_starved++;
+	}
+	spin_unlock_irqrestore(&edmac->lock, flags);
+
 	return ret;
 }
 
@@ -694,9 +779,13 @@ static void ep93xx_dma_desc_put(struct ep93xx_dma_chan *edmac,
 				struct ep93xx_dma_desc *desc)
 {
 	if (desc) {
+		struct ep93xx_dma_desc *d;
 		unsigned long flags;
 
 		spin_lock_irqsave(&edmac->lock, flags);
+		edmac->stats.descs_in_use--;
+		list_for_each_entry(d, &desc->tx_list, node)
+			edmac->stats.descs_in_use--;
 		list_splice_init(&desc->tx_list, &edmac->free_list);
 		list_add(&desc->node, &edmac->free_list);
 		spin_unlock_irqrestore(&edmac->lock, flags);
@@ -755,15 +844,25 @@ static void ep93xx_dma_unmap_buffers(struct ep93xx_dma_desc *desc)
 	}
 }
 
-static void ep93xx_dma_tasklet(unsigned long data)
+/**
+ * ep93xx_dma_complete - finish the active transaction and start the next one
+ * @edmac: channel
+ *
+ * Completes the active descriptor chain if the hardware is done with it,
+ * pushes the next queued transaction to the hardware, releases the finished
+ * descriptors and calls the client callback. This normally runs from the
+ * channel tasklet, but is called directly from the interrupt handler when the
+ * client asked for &struct ep93xx_dma_data.irq_callback.
+ */
+static void ep93xx_dma_complete(struct ep93xx_dma_chan *edmac)
 {
-	struct ep93xx_dma_chan *edmac = (struct ep93xx_dma_chan *)data;
 	struct ep93xx_dma_desc *desc, *d;
 	dma_async_tx_callback callback = NULL;
 	void *callback_param = NULL;
+	unsigned long flags;
 	LIST_HEAD(list);
 
-	spin_lock_irq(&edmac->lock);
+	spin_lock_irqsave(&edmac->lock, flags);
 	/*
 	 * If dma_terminate_all() was called before we get to run, the active
 	 * list has become empty. If that happens we aren't supposed to do
@@ -776,11 +875,15 @@ static void ep93xx_dma_tasklet(unsigned long data)
 			if (!test_bit(EP93XX_DMA_IS_CYCLIC, &edmac->flags))
 				dma_cookie_complete(&desc->txd);
 			list_splice_init(&edmac->active, &list);
+
+			list_for_each_entry(d, &list, node)
+				edmac->stats.bytes += d->size;
+			edmac->stats.completed++;
 		}
 		callback = desc->txd.callback;
 		callback_param = desc->txd.callback_param;
 	}
-	spin_unlock_irq(&edmac->lock);
+	spin_unlock_irqrestore(&edmac->lock, flags);
 
 	/* Pick up the next descriptor from the queue */
 	ep93xx_dma_advance_work(edmac);
@@ -801,11 +904,17 @@ static void ep93xx_dma_tasklet(unsigned long data)
 		callback(callback_param);
 }
 
+static void ep93xx_dma_tasklet(unsigned long data)
+{
+	ep93xx_dma_complete((struct ep93xx_dma_chan *)data);
+}
+
 static irqreturn_t ep93xx_dma_interrupt(int irq, void *dev_id)
 {
 	struct ep93xx_dma_chan *edmac = dev_id;
 	struct ep93xx_dma_desc *desc;
 	irqreturn_t ret = IRQ_HANDLED;
+	bool complete = false;
 
 	spin_lock(&edmac->lock);
 
@@ -820,12 +929,15 @@ static irqreturn_t ep93xx_dma_interrupt(int irq, void *dev_id)
 	switch (edmac->edma->hw_interrupt(edmac)) {
 	case INTERRUPT_DONE:
 		desc->complete = true;
-		tasklet_schedule(&edmac->tasklet);
+		complete = true;
 		break;
 
 	case INTERRUPT_NEXT_BUFFER:
-		if (test_bit(EP93XX_DMA_IS_CYCLIC, &edmac->flags))
-			tasklet_schedule(&edmac->tasklet);
+		if (test_bit(EP93XX_DMA_IS_CYCLIC, &edmac->flags)) {
+			edmac->stats.bytes += desc->size;
+			edmac->stats.completed++;
+			complete = true;
+		}
 		break;
 
 	default:
@@ -834,6 +946,16 @@ static irqreturn_t ep93xx_dma_interrupt(int irq, void *dev_id)
 		break;
 	}
 
+	if (complete && ep93xx_dma_irq_callback(edmac)) {
+		edmac->stats.irq_callbacks++;
+		spin_unlock(&edmac->lock);
+		ep93xx_dma_complete(edmac);
+		return ret;
+	}
+
+	if (complete)
+		tasklet_schedule(&edmac->tasklet);
+
 	spin_unlock(&edmac->lock);
 	return ret;
 }
@@ -887,6 +1009,7 @@ static int ep93xx_dma_alloc_chan_resources(struct dma_chan *chan)
 	struct ep93xx_dma_chan *edmac = to_ep93xx_dma_chan(chan);
 	struct ep93xx_dma_data *data = chan->private;
 	const char *name = dma_chan_name(chan);
+	int nr_descs = DMA_MAX_CHAN_DESCRIPTORS;
 	int ret, i;
 
 	/* Sanity check the channel parameters */
@@ -915,6 +1038,8 @@ static int ep93xx_dma_alloc_chan_resources(struct dma_chan *chan)
 
 	if (data && data->name)
 		name = data->name;
+	if (data && data->nr_descs)
+		nr_descs = min_t(int, data->nr_descs, DMA_MAX_CHAN_POOL);
 
 	ret = clk_enable(edmac->clk);
 	if (ret)
@@ -926,28 +1051,26 @@ static int ep93xx_dma_alloc_chan_resources(struct dma_chan *chan)
 
 	spin_lock_irq(&edmac->lock);
 	dma_cookie_init(&edmac->chan);
+	memset(&edmac->stats, 0, sizeof(edmac->stats));
 	ret = edmac->edma->hw_setup(edmac);
 	spin_unlock_irq(&edmac->lock);
 
 	if (ret)
 		goto fail_free_irq;
 
-	for (i = 0; i < DMA_MAX_CHAN_DESCRIPTORS; i++) {
+	for (i = 0; i < nr_descs; i++) {
 		struct ep93xx_dma_desc *desc;
 
-		desc = kzalloc(sizeof(*desc), GFP_KERNEL);
+		desc = ep93xx_dma_desc_alloc(edmac, GFP_KERNEL);
 		if (!desc) {
 			dev_warn(chan2dev(edmac), "not enough descriptors\n");
 			break;
 		}
 
-		INIT_LIST_HEAD(&desc->tx_list);
-
-		dma_async_tx_descriptor_init(&desc->txd, chan);
-		desc->txd.flags = DMA_CTRL_ACK;
-		desc->txd.tx_submit = ep93xx_dma_tx_submit;
-
-		ep93xx_dma_desc_put(edmac, desc);
+		spin_lock_irq(&edmac->lock);
+		edmac->stats.descs_allocated++;
+		list_add(&desc->node, &edmac->free_list);
+		spin_unlock_irq(&edmac->lock);
 	}
 
 	return i;
@@ -982,6 +1105,7 @@ static void ep93xx_dma_free_chan_resources(struct dma_chan *chan)
 	edmac->runtime_addr = 0;
 	edmac->runtime_ctrl = 0;
 	edmac->buffer = 0;
+	edmac->stats.descs_allocated = 0;
 	list_splice_init(&edmac->free_list, &list);
 	spin_unlock_irqrestore(&edmac->lock, flags);
 
@@ -1337,6 +1461,63 @@ static void ep93xx_dma_issue_pending(struct dma_chan *chan)
 	ep93xx_dma_advance_work(to_ep93xx_dma_chan(chan));
 }
 
+#ifdef CONFIG_DEBUG_FS
+static int ep93xx_dma_debugfs_show(struct seq_file *s, void *data)
+{
+	struct ep93xx_dma_engine *edma = s->private;
+	int i;
+
+	seq_printf(s, "%-10s %12s %10s %10s %6s %6s %8s %8s\n",
+		   "channel", "bytes", "completed", "irq_cb",
+		   "descs", "busy", "grown", "starved");
+
+	for (i = 0; i < edma->num_channels; i++) {
+		struct ep93xx_dma_chan *edmac = &edma->channels[i];
+		struct ep93xx_dma_stats stats;
+		unsigned long flags;
+
+		if (IS_ERR_OR_NULL(edmac->clk))
+			continue;
+
+		spin_lock_irqsave(&edmac->lock, flags);
+		stats = edmac->stats;
+		spin_unlock_irqrestore(&edmac->lock, flags);
+
+		seq_printf(s, "%-10s %12llu %10lu %10lu %6u %6u %8lu %8lu\n",
+			   edmac->chan.dev ? dma_chan_name(&edmac->chan) : "-",
+			   (unsigned long long)stats.bytes, stats.completed,
+			   stats.irq_callbacks, stats.descs_allocated,
+			   stats.descs_in_use, stats.pool_grown,
+			   stats.pool_starved);
+	}
+
+	return 0;
+}
+
+static int ep93xx_dma_debugfs_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, ep93xx_dma_debugfs_show, inode->i_private);
+}
+
+static const struct file_operations ep93xx_dma_debugfs_operations = {
+	.open		= ep93xx_dma_debugfs_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static void ep93xx_dma_init_debugfs(struct ep93xx_dma_engine *edma)
+{
+	(void) debugfs_create_file(dev_name(edma->dma_dev.dev),
+				   S_IFREG | S_IRUGO, NULL, edma,
+				   &ep93xx_dma_debugfs_operations);
+}
+#else
+static inline void ep93xx_dma_init_debugfs(struct ep93xx_dma_engine *edma)
+{
+}
+#endif
+
 static int __init ep93xx_dma_probe(struct platform_device *pdev)
 {
 	struct ep93xx_dma_platform_data *pdata = dev_get_platdata(&pdev->dev);
@@ -1423,6 +1604,7 @@ static int __init ep93xx_dma_probe(struct platform_device *pdev)
 		}
 		kfree(edma);
 	} else {
+		ep93xx_dma_init_debugfs(edma);
 		dev_info(dma_dev->dev, "EP93xx M2%s DMA ready\n",
 			 edma->m2m ? "M" : "P");
 	}
@@ -39,6 +39,7 @@
 #include <linux/u64_stats_sync.h>
 
 static int numdummies = 1;
+static bool bql;
 
 /* fake multicast ability */
 static void set_multicast_list(struct net_device *dev)
@@ -49,6 +50,9 @@ struct pcpu_dstats {
 	u64			tx_packets;
 	u64			tx_bytes;
 	struct u64_stats_sync	syncp;
+	/* sent but not yet accounted, see dummy_xmit() */
+	unsigned int		pending_packets;
+	unsigned int		pending_bytes;
 };
 
 static struct rtnl_link_stats64 *dummy_get_stats64(struct net_device *dev,
@@ -76,11 +80,31 @@ static struct rtnl_link_stats64 *dummy_get_stats64(struct net_device *dev,
 static netdev_tx_t dummy_xmit(struct sk_buff *skb, struct net_device *dev)
 {
 	struct pcpu_dstats *dstats = this_cpu_ptr(dev->dstats);
-
-	u64_stats_update_begin(&dstats->syncp);
-	dstats->tx_packets++;
-	dstats->tx_bytes += skb->len;
-	u64_stats_update_end(&dstats->syncp);
+	struct netdev_queue *txq;
+
+	dstats->pending_packets++;
+	dstats->pending_bytes += skb->len;
+
+	txq = netdev_get_tx_queue(dev, skb_get_queue_mapping(skb));
+	if (bql)
+		netdev_tx_sent_queue(txq, skb->len);
+
+	/*
+	 * Publish the counters and complete the skbs once per batch, the way
+	 * a real driver would ring its doorbell only for the last skb it is
+	 * given.
+	 */
+	if (!skb->xmit_more || netif_xmit_stopped(txq)) {
+		u64_stats_update_begin(&dstats->syncp);
+		dstats->tx_packets += dstats->pending_packets;
+		dstats->tx_bytes += dstats->pending_bytes;
+		u64_stats_update_end(&dstats->syncp);
+		if (bql)
+			netdev_tx_completed_queue(txq, dstats->pending_packets,
+						  dstats->pending_bytes);
+		dstats->pending_packets = 0;
+		dstats->pending_bytes = 0;
+	}
 
 	dev_kfree_skb(skb);
 	return NETDEV_TX_OK;
@@ -119,13 +143,23 @@ static void dummy_setup(struct net_device *dev)
 	dev->destructor = free_netdev;
 
 	/* Fill in device structure with ethernet-generic values. */
-	dev->tx_queue_len = 0;
 	dev->flags |= IFF_NOARP;
 	dev->flags &= ~IFF_MULTICAST;
 	dev->priv_flags |= IFF_LIVE_ADDR_CHANGE;
 	dev->features	|= NETIF_F_SG | NETIF_F_FRAGLIST | NETIF_F_TSO;
-	dev->features	|= NETIF_F_HW_CSUM | NETIF_F_HIGHDMA | NETIF_F_LLTX;
+	dev->features	|= NETIF_F_HW_CSUM | NETIF_F_HIGHDMA;
 	eth_hw_addr_random(dev);
+
+	/*
+	 * With bql set, dummy keeps the default tx_queue_len and its queue
+	 * lock, so it gets a qdisc, the lock serialises the BQL accounting
+	 * and it sees the same batches as a real driver. Otherwise it is a
+	 * lockless blackhole.
+	 */
+	if (!bql) {
+		dev->tx_queue_len = 0;
+		dev->features |= NETIF_F_LLTX;
+	}
 }
 
 static int dummy_validate(struct nlattr *tb[], struct nlattr *data[])
@@ -148,6 +182,8 @@ static struct rtnl_link_ops dummy_link_ops __read_mostly = {
 /* Number of dummy devices to be set up by this module. */
 module_param(numdummies, int, 0);
 MODULE_PARM_DESC(numdummies, "Number of dummy pseudo devices");
+module_param(bql, bool, 0);
+MODULE_PARM_DESC(bql, "Transmit through a qdisc with byte queue limits");
 
 static int __init dummy_init_one(void)
 {
@@ -32,11 +32,41 @@
 #define DRV_MODULE_VERSION	"0.1"
 
 #define RX_QUEUE_ENTRIES	64
-#define TX_QUEUE_ENTRIES	8
+#define TX_QUEUE_MIN		32
+#define TX_QUEUE_MAX		256
+
+/*
+ * Worst case number of transmit descriptors a single skb can take; the
+ * queue is stopped as soon as fewer than this many are left.
+ */
+#define TX_DESCS_PER_SKB	(MAX_SKB_FRAGS + 1)
 
 #define MAX_PKT_SIZE		2044
 #define PKT_BUF_SIZE		2048
 
+/*
+ * Frames longer than rx_copybreak are received into half-page buffers
+ * which are attached to the skb as a page fragment; only the first
+ * RX_HDR_LEN bytes are copied so that the headers end up in the linear
+ * area.  The other half of the page is then handed to the hardware, so
+ * as long as the stack frees its skbs in time, no page is ever allocated
+ * on the receive path.  Only the half owned by the hardware is mapped, so
+ * that unmapping it never touches the cache lines of a half that belongs
+ * to an skb.
+ */
+#define RX_HDR_LEN		128
+#define RX_BUFS_PER_PAGE	(PAGE_SIZE / PKT_BUF_SIZE)
+
+static int rx_copybreak = 256;
+module_param(rx_copybreak, int, 0644);
+MODULE_PARM_DESC(rx_copybreak,
+		 "Receive frames up to this size by copying (default 256)");
+
+static int tx_queue_entries = 64;
+module_param(tx_queue_entries, int, 0444);
+MODULE_PARM_DESC(tx_queue_entries,
+		 "Number of transmit descriptors, a power of two (default 64)");
+
 #define REG_RXCTL		0x0000
 #define  REG_RXCTL_DEFAULT	0x00073800
 #define REG_TXCTL		0x0004
@@ -149,9 +179,37 @@ struct ep93xx_tstat
 struct ep93xx_descs
 {
 	struct ep93xx_rdesc	rdesc[RX_QUEUE_ENTRIES];
-	struct ep93xx_tdesc	tdesc[TX_QUEUE_ENTRIES];
 	struct ep93xx_rstat	rstat[RX_QUEUE_ENTRIES];
-	struct ep93xx_tstat	tstat[TX_QUEUE_ENTRIES];
+};
+
+/*
+ * The transmit rings are sized at open time, so they live in their own
+ * coherent allocation: tx_queue_entries descriptors followed by as many
+ * status entries.  The hardware writes one status entry per frame,
+ * carrying the buffer index of the frame's first descriptor.
+ */
+struct ep93xx_tx_buf
+{
+	struct sk_buff		*skb;
+	dma_addr_t		dma;
+	unsigned int		len;
+	bool			mapped_as_page;
+};
+
+struct ep93xx_rx_buf
+{
+	struct page		*page;
+	unsigned int		page_offset;
+	dma_addr_t		dma;		/* of the half at page_offset */
+};
+
+struct ep93xx_rx_stats
+{
+	unsigned long		rx_copybreak;
+	unsigned long		rx_page_recycled;
+	unsigned long		rx_page_alloc;
+	unsigned long		rx_alloc_errors;
+	unsigned long		rx_gro_merged;
 };
 
 struct ep93xx_priv
@@ -163,12 +221,19 @@ struct ep93xx_priv
 	struct ep93xx_descs	*descs;
 	dma_addr_t		descs_dma_addr;
 
-	void			*rx_buf[RX_QUEUE_ENTRIES];
-	void			*tx_buf[TX_QUEUE_ENTRIES];
+	struct ep93xx_rx_buf	rx_buf[RX_QUEUE_ENTRIES];
+	struct ep93xx_rx_stats	rx_stats;
+
+	struct ep93xx_tdesc	*tdesc;
+	struct ep93xx_tstat	*tstat;
+	dma_addr_t		tx_descs_dma_addr;
+	struct ep93xx_tx_buf	*tx_buf;
+	unsigned int		tx_entries;
 
 	spinlock_t		rx_lock;
 	unsigned int		rx_pointer;
 	unsigned int		tx_clean_pointer;
+	unsigned int		tx_stat_pointer;
 	unsigned int		tx_pointer;
 	spinlock_t		tx_pending_lock;
 	unsigned int		tx_pending;
@@ -229,6 +294,127 @@ static void ep93xx_mdio_write(struct net_device *dev, int phy_id, int reg, int d
 		pr_info("mdio write timed out\n");
 }
 
+static int ep93xx_alloc_rx_page(struct ep93xx_priv *ep,
+				struct ep93xx_rx_buf *rxb, gfp_t gfp)
+{
+	struct device *dev = ep->dev->dev.parent;
+	struct page *page;
+	dma_addr_t d;
+
+	page = alloc_page(gfp);
+	if (page == NULL)
+		return -ENOMEM;
+
+	d = dma_map_page(dev, page, 0, PKT_BUF_SIZE, DMA_FROM_DEVICE);
+	if (dma_mapping_error(dev, d)) {
+		__free_page(page);
+		return -ENOMEM;
+	}
+
+	rxb->page = page;
+	rxb->page_offset = 0;
+	rxb->dma = d;
+
+	return 0;
+}
+
+static void ep93xx_free_rx_page(struct ep93xx_priv *ep,
+				struct ep93xx_rx_buf *rxb)
+{
+	dma_unmap_page(ep->dev->dev.parent, rxb->dma, PKT_BUF_SIZE,
+		       DMA_FROM_DEVICE);
+	put_page(rxb->page);
+	rxb->page = NULL;
+}
+
+static void ep93xx_give_rx_buf(struct ep93xx_priv *ep, int entry)
+{
+	struct ep93xx_rx_buf *rxb = &ep->rx_buf[entry];
+	struct ep93xx_rdesc *rxd = &ep->descs->rdesc[entry];
+
+	rxd->buf_addr = rxb->dma;
+	rxd->rdesc1 = (entry << 16) | PKT_BUF_SIZE;
+}
+
+static struct sk_buff *ep93xx_rx_copy(struct ep93xx_priv *ep,
+				      struct ep93xx_rx_buf *rxb, int length)
+{
+	struct sk_buff *skb;
+
+	skb = netdev_alloc_skb_ip_align(ep->dev, length);
+	if (likely(skb != NULL))
+		memcpy(skb_put(skb, length),
+		       page_address(rxb->page) + rxb->page_offset, length);
+
+	dma_sync_single_for_device(ep->dev->dev.parent, rxb->dma, length,
+				   DMA_FROM_DEVICE);
+
+	return skb;
+}
+
+static struct sk_buff *ep93xx_rx_frag(struct ep93xx_priv *ep,
+				      struct ep93xx_rx_buf *rxb, int length)
+{
+	struct device *dev = ep->dev->dev.parent;
+	struct ep93xx_rx_buf new_rxb;
+	struct sk_buff *skb;
+	bool recycle;
+
+	/*
+	 * If we hold the only reference to the page, the stack is done
+	 * with every other buffer in it and we can move on to the next
+	 * buffer of the page.  Otherwise the page goes with the skb and a
+	 * replacement has to be found before we commit.  Either way the
+	 * half handed to the hardware next is mapped before the received
+	 * one is unmapped, so that failing leaves everything as it was.
+	 */
+	recycle = page_count(rxb->page) == 1;
+	if (recycle) {
+		new_rxb.page = rxb->page;
+		new_rxb.page_offset = (rxb->page_offset + PKT_BUF_SIZE) %
+				      (RX_BUFS_PER_PAGE * PKT_BUF_SIZE);
+		new_rxb.dma = dma_map_page(dev, new_rxb.page,
+					   new_rxb.page_offset, PKT_BUF_SIZE,
+					   DMA_FROM_DEVICE);
+		if (dma_mapping_error(dev, new_rxb.dma)) {
+			ep->rx_stats.rx_alloc_errors++;
+			return ep93xx_rx_copy(ep, rxb, length);
+		}
+	} else if (ep93xx_alloc_rx_page(ep, &new_rxb, GFP_ATOMIC)) {
+		ep->rx_stats.rx_alloc_errors++;
+		return ep93xx_rx_copy(ep, rxb, length);
+	}
+
+	skb = netdev_alloc_skb_ip_align(ep->dev, RX_HDR_LEN);
+	if (unlikely(skb == NULL)) {
+		dma_unmap_page(dev, new_rxb.dma, PKT_BUF_SIZE,
+			       DMA_FROM_DEVICE);
+		if (!recycle)
+			__free_page(new_rxb.page);
+		dma_sync_single_for_device(dev, rxb->dma, length,
+					   DMA_FROM_DEVICE);
+		return NULL;
+	}
+
+	/* only the received half, already synced for the CPU, is unmapped */
+	dma_unmap_page(dev, rxb->dma, PKT_BUF_SIZE, DMA_FROM_DEVICE);
+
+	memcpy(skb_put(skb, RX_HDR_LEN),
+	       page_address(rxb->page) + rxb->page_offset, RX_HDR_LEN);
+	skb_add_rx_frag(skb, 0, rxb->page, rxb->page_offset + RX_HDR_LEN,
+			length - RX_HDR_LEN, PKT_BUF_SIZE);
+
+	if (recycle) {
+		get_page(rxb->page);
+		ep->rx_stats.rx_page_recycled++;
+	} else {
+		ep->rx_stats.rx_page_alloc++;
+	}
+	*rxb = new_rxb;
+
+	return skb;
+}
+
 static int ep93xx_rx(struct net_device *dev, int processed, int budget)
 {
 	struct ep93xx_priv *ep = netdev_priv(dev);
@@ -236,6 +422,7 @@ static int ep93xx_rx(struct net_device *dev, int processed, int budget)
 	while (processed < budget) {
 		int entry;
 		struct ep93xx_rstat *rstat;
+		struct ep93xx_rx_buf *rxb;
 		u32 rstat0;
 		u32 rstat1;
 		int length;
@@ -282,20 +469,26 @@ static int ep93xx_rx(struct net_device *dev, int processed, int budget)
 		if (rstat0 & RSTAT0_CRCI)
 			length -= 4;
 
-		skb = netdev_alloc_skb(dev, length + 2);
+		rxb = &ep->rx_buf[entry];
+		dma_sync_single_for_cpu(dev->dev.parent, rxb->dma, length,
+					DMA_FROM_DEVICE);
+
+		if (length <= rx_copybreak || length <= RX_HDR_LEN) {
+			skb = ep93xx_rx_copy(ep, rxb, length);
+			ep->rx_stats.rx_copybreak++;
+		} else {
+			skb = ep93xx_rx_frag(ep, rxb, length);
+			ep93xx_give_rx_buf(ep, entry);
+		}
+
 		if (likely(skb != NULL)) {
-			struct ep93xx_rdesc *rxd = &ep->descs->rdesc[entry];
-			skb_reserve(skb, 2);
-			dma_sync_single_for_cpu(dev->dev.parent, rxd->buf_addr,
-						length, DMA_FROM_DEVICE);
-			skb_copy_to_linear_data(skb, ep->rx_buf[entry], length);
-			dma_sync_single_for_device(dev->dev.parent,
-						   rxd->buf_addr, length,
-						   DMA_FROM_DEVICE);
-			skb_put(skb, length);
+			gro_result_t ret;
+
 			skb->protocol = eth_type_trans(skb, dev);
 
-			netif_receive_skb(skb);
+			ret = napi_gro_receive(&ep->napi, skb);
+			if (ret == GRO_MERGED || ret == GRO_MERGED_FREE)
+				ep->rx_stats.rx_gro_merged++;
 
 			dev->stats.rx_packets++;
 			dev->stats.rx_bytes += length;
@@ -317,107 +510,160 @@ static int ep93xx_have_more_rx(struct ep93xx_priv *ep)
 	return !!((rstat->rstat0 & RSTAT0_RFP) && (rstat->rstat1 & RSTAT1_RFP));
 }
 
-static int ep93xx_poll(struct napi_struct *napi, int budget)
+static void ep93xx_unmap_tx_buf(struct ep93xx_priv *ep,
+				struct ep93xx_tx_buf *txb)
 {
-	struct ep93xx_priv *ep = container_of(napi, struct ep93xx_priv, napi);
-	struct net_device *dev = ep->dev;
-	int rx = 0;
-
-poll_some_more:
-	rx = ep93xx_rx(dev, rx, budget);
-	if (rx < budget) {
-		int more = 0;
-
-		spin_lock_irq(&ep->rx_lock);
-		__napi_complete(napi);
-		wrl(ep, REG_INTEN, REG_INTEN_TX | REG_INTEN_RX);
-		if (ep93xx_have_more_rx(ep)) {
-			wrl(ep, REG_INTEN, REG_INTEN_TX);
-			wrl(ep, REG_INTSTSP, REG_INTSTS_RX);
-			more = 1;
-		}
-		spin_unlock_irq(&ep->rx_lock);
-
-		if (more && napi_reschedule(napi))
-			goto poll_some_more;
-	}
-
-	if (rx) {
-		wrw(ep, REG_RXDENQ, rx);
-		wrw(ep, REG_RXSTSENQ, rx);
-	}
+	struct device *dev = ep->dev->dev.parent;
 
-	return rx;
+	if (txb->mapped_as_page)
+		dma_unmap_page(dev, txb->dma, txb->len, DMA_TO_DEVICE);
+	else
+		dma_unmap_single(dev, txb->dma, txb->len, DMA_TO_DEVICE);
+	txb->len = 0;
 }
 
 static int ep93xx_xmit(struct sk_buff *skb, struct net_device *dev)
 {
 	struct ep93xx_priv *ep = netdev_priv(dev);
+	struct device *ddev = dev->dev.parent;
+	struct ep93xx_tx_buf *txb;
 	struct ep93xx_tdesc *txd;
-	int entry;
+	int first, entry;
+	int nr_descs;
+	int i;
 
-	if (unlikely(skb->len > MAX_PKT_SIZE)) {
-		dev->stats.tx_dropped++;
-		dev_kfree_skb(skb);
-		return NETDEV_TX_OK;
+	if (unlikely(skb->len > MAX_PKT_SIZE))
+		goto drop;
+
+	/* There is no checksum offload; fill it in without copying.  */
+	if (skb->ip_summed == CHECKSUM_PARTIAL && skb_checksum_help(skb))
+		goto drop;
+
+	nr_descs = skb_shinfo(skb)->nr_frags + 1;
+
+	spin_lock(&ep->tx_pending_lock);
+	if (unlikely(ep->tx_entries - ep->tx_pending < nr_descs)) {
+		netif_stop_queue(dev);
+		spin_unlock(&ep->tx_pending_lock);
+		pr_err("tx ring full with queue awake\n");
+		return NETDEV_TX_BUSY;
 	}
+	spin_unlock(&ep->tx_pending_lock);
 
-	entry = ep->tx_pointer;
-	ep->tx_pointer = (ep->tx_pointer + 1) & (TX_QUEUE_ENTRIES - 1);
+	first = entry = ep->tx_pointer;
+
+	txb = &ep->tx_buf[entry];
+	txb->len = skb_headlen(skb);
+	txb->mapped_as_page = false;
+	txb->dma = dma_map_single(ddev, skb->data, txb->len, DMA_TO_DEVICE);
+	if (dma_mapping_error(ddev, txb->dma))
+		goto unmap;
+
+	for (i = 0; i < skb_shinfo(skb)->nr_frags; i++) {
+		const skb_frag_t *frag = &skb_shinfo(skb)->frags[i];
+
+		txd = &ep->tdesc[entry];
+		txd->buf_addr = txb->dma;
+		txd->tdesc1 = (first << 16) | txb->len;
+
+		entry = (entry + 1) & (ep->tx_entries - 1);
+		txb = &ep->tx_buf[entry];
+		txb->len = skb_frag_size(frag);
+		txb->mapped_as_page = true;
+		txb->dma = skb_frag_dma_map(ddev, frag, 0, txb->len,
+					    DMA_TO_DEVICE);
+		if (dma_mapping_error(ddev, txb->dma))
+			goto unmap;
+	}
 
-	txd = &ep->descs->tdesc[entry];
+	txd = &ep->tdesc[entry];
+	txd->buf_addr = txb->dma;
+	txd->tdesc1 = TDESC1_EOF | (first << 16) | txb->len;
+	txb->skb = skb;
 
-	txd->tdesc1 = TDESC1_EOF | (entry << 16) | (skb->len & 0xfff);
-	dma_sync_single_for_cpu(dev->dev.parent, txd->buf_addr, skb->len,
-				DMA_TO_DEVICE);
-	skb_copy_and_csum_dev(skb, ep->tx_buf[entry]);
-	dma_sync_single_for_device(dev->dev.parent, txd->buf_addr, skb->len,
-				   DMA_TO_DEVICE);
-	dev_kfree_skb(skb);
+	ep->tx_pointer = (entry + 1) & (ep->tx_entries - 1);
+	netdev_sent_queue(dev, skb->len);
 
-	spin_lock_irq(&ep->tx_pending_lock);
-	ep->tx_pending++;
-	if (ep->tx_pending == TX_QUEUE_ENTRIES)
+	spin_lock(&ep->tx_pending_lock);
+	ep->tx_pending += nr_descs;
+	if (ep->tx_entries - ep->tx_pending < TX_DESCS_PER_SKB)
 		netif_stop_queue(dev);
-	spin_unlock_irq(&ep->tx_pending_lock);
+	spin_unlock(&ep->tx_pending_lock);
+
+	wmb();
+	wrl(ep, REG_TXDENQ, nr_descs);
 
-	wrl(ep, REG_TXDENQ, 1);
+	return NETDEV_TX_OK;
 
+unmap:
+	txb->len = 0;
+	while (entry != first) {
+		entry = (entry - 1) & (ep->tx_entries - 1);
+		ep93xx_unmap_tx_buf(ep, &ep->tx_buf[entry]);
+	}
+drop:
+	dev->stats.tx_dropped++;
+	dev_kfree_skb(skb);
 	return NETDEV_TX_OK;
 }
 
+static int ep93xx_have_more_tx(struct ep93xx_priv *ep)
+{
+	struct ep93xx_tstat *tstat = ep->tstat + ep->tx_stat_pointer;
+	return !!(tstat->tstat0 & TSTAT0_TXFP);
+}
+
 static void ep93xx_tx_complete(struct net_device *dev)
 {
 	struct ep93xx_priv *ep = netdev_priv(dev);
+	unsigned int pkts_compl = 0;
+	unsigned int bytes_compl = 0;
 	int wake;
 
 	wake = 0;
 
 	spin_lock(&ep->tx_pending_lock);
-	while (1) {
+	while (ep->tx_pending) {
 		int entry;
 		struct ep93xx_tstat *tstat;
+		struct sk_buff *skb;
 		u32 tstat0;
 
-		entry = ep->tx_clean_pointer;
-		tstat = ep->descs->tstat + entry;
+		tstat = ep->tstat + ep->tx_stat_pointer;
 
 		tstat0 = tstat->tstat0;
 		if (!(tstat0 & TSTAT0_TXFP))
 			break;
 
 		tstat->tstat0 = 0;
+		ep->tx_stat_pointer = (ep->tx_stat_pointer + 1) &
+				      (ep->tx_entries - 1);
+
+		entry = ep->tx_clean_pointer;
 
 		if (tstat0 & TSTAT0_FA)
 			pr_crit("frame aborted %.8x\n", tstat0);
 		if ((tstat0 & TSTAT0_BUFFER_INDEX) != entry)
 			pr_crit("entry mismatch %.8x\n", tstat0);
 
-		if (tstat0 & TSTAT0_TXWE) {
-			int length = ep->descs->tdesc[entry].tdesc1 & 0xfff;
+		/* Release every descriptor of the frame, up to its EOF.  */
+		do {
+			skb = ep->tx_buf[entry].skb;
+			ep->tx_buf[entry].skb = NULL;
+			ep93xx_unmap_tx_buf(ep, &ep->tx_buf[entry]);
+			entry = (entry + 1) & (ep->tx_entries - 1);
+			ep->tx_pending--;
+		} while (skb == NULL && ep->tx_pending);
+		ep->tx_clean_pointer = entry;
+
+		if (unlikely(skb == NULL)) {
+			pr_crit("status without frame %.8x\n", tstat0);
+			break;
+		}
 
+		if (tstat0 & TSTAT0_TXWE) {
 			dev->stats.tx_packets++;
-			dev->stats.tx_bytes += length;
+			dev->stats.tx_bytes += skb->len;
 		} else {
 			dev->stats.tx_errors++;
 		}
@@ -428,17 +674,64 @@ static void ep93xx_tx_complete(struct net_device *dev)
 			dev->stats.tx_fifo_errors++;
 		dev->stats.collisions += (tstat0 >> 16) & 0x1f;
 
-		ep->tx_clean_pointer = (entry + 1) & (TX_QUEUE_ENTRIES - 1);
-		if (ep->tx_pending == TX_QUEUE_ENTRIES)
-			wake = 1;
-		ep->tx_pending--;
+		pkts_compl++;
+		bytes_compl += skb->len;
+		dev_kfree_skb(skb);
 	}
+
+	if (netif_queue_stopped(dev) &&
+	    ep->tx_entries - ep->tx_pending >= TX_DESCS_PER_SKB)
+		wake = 1;
 	spin_unlock(&ep->tx_pending_lock);
 
+	netdev_completed_queue(dev, pkts_compl, bytes_compl);
+
 	if (wake)
 		netif_wake_queue(dev);
 }
 
+static int ep93xx_poll(struct napi_struct *napi, int budget)
+{
+	struct ep93xx_priv *ep = container_of(napi, struct ep93xx_priv, napi);
+	struct net_device *dev = ep->dev;
+	int rx = 0;
+
+poll_some_more:
+	/*
+	 * Transmit completions are reaped here rather than from the
+	 * interrupt handler, so that a burst of them costs one interrupt.
+	 * They don't count against the budget.
+	 */
+	ep93xx_tx_complete(dev);
+
+	rx = ep93xx_rx(dev, rx, budget);
+	if (rx < budget) {
+		int more = 0;
+
+		napi_gro_flush(napi, false);
+
+		spin_lock_irq(&ep->rx_lock);
+		__napi_complete(napi);
+		wrl(ep, REG_INTEN, REG_INTEN_TX | REG_INTEN_RX);
+		if (ep93xx_have_more_rx(ep) || ep93xx_have_more_tx(ep)) {
+			wrl(ep, REG_INTEN, 0);
+			wrl(ep, REG_INTSTSP, REG_INTSTS_RX | REG_INTSTS_TX);
+			more = 1;
+		}
+		spin_unlock_irq(&ep->rx_lock);
+
+		if (more && napi_reschedule(napi))
+			goto poll_some_more;
+	}
+
+	if (rx) {
+		wrw(ep, REG_RXDENQ, rx);
+		wrw(ep, REG_RXSTSENQ, rx);
+	}
+
+	return rx;
+}
+
 static irqreturn_t ep93xx_irq(int irq, void *dev_id)
 {
 	struct net_device *dev = dev_id;
@@ -449,55 +742,108 @@ static irqreturn_t ep93xx_irq(int irq, void *dev_id)
 	if (status == 0)
 		return IRQ_NONE;
 
-	if (status & REG_INTSTS_RX) {
+	if (status & (REG_INTSTS_RX | REG_INTSTS_TX)) {
 		spin_lock(&ep->rx_lock);
 		if (likely(napi_schedule_prep(&ep->napi))) {
-			wrl(ep, REG_INTEN, REG_INTEN_TX);
+			wrl(ep, REG_INTEN, 0);
 			__napi_schedule(&ep->napi);
 		}
 		spin_unlock(&ep->rx_lock);
 	}
 
-	if (status & REG_INTSTS_TX)
-		ep93xx_tx_complete(dev);
-
 	return IRQ_HANDLED;
 }
 
-static void ep93xx_free_buffers(struct ep93xx_priv *ep)
+/*
+ * The TX ring is allocated apart from the rest, so that
+ * ep93xx_set_ringparam() can get a new one before giving up the old one.
+ */
+static int ep93xx_alloc_tx_ring(struct ep93xx_priv *ep, unsigned int entries,
+				struct ep93xx_tdesc **tdesc, dma_addr_t *dma,
+				struct ep93xx_tx_buf **tx_buf)
+{
+	struct device *dev = ep->dev->dev.parent;
+	size_t size = entries * (sizeof(struct ep93xx_tdesc) +
+				 sizeof(struct ep93xx_tstat));
+
+	*tdesc = dma_alloc_coherent(dev, size, dma, GFP_KERNEL);
+	if (*tdesc == NULL)
+		return -ENOMEM;
+
+	*tx_buf = kcalloc(entries, sizeof(struct ep93xx_tx_buf), GFP_KERNEL);
+	if (*tx_buf == NULL) {
+		dma_free_coherent(dev, size, *tdesc, *dma);
+		return -ENOMEM;
+	}
+
+	return 0;
+}
+
+static void ep93xx_set_tx_ring(struct ep93xx_priv *ep, unsigned int entries,
+			       struct ep93xx_tdesc *tdesc, dma_addr_t dma,
+			       struct ep93xx_tx_buf *tx_buf)
+{
+	ep->tx_entries = entries;
+	ep->tdesc = tdesc;
+	ep->tstat = (struct ep93xx_tstat *)(tdesc + entries);
+	ep->tx_descs_dma_addr = dma;
+	ep->tx_buf = tx_buf;
+}
+
+static void ep93xx_free_tx_ring(struct ep93xx_priv *ep)
 {
 	struct device *dev = ep->dev->dev.parent;
 	int i;
 
-	for (i = 0; i < RX_QUEUE_ENTRIES; i++) {
-		dma_addr_t d;
+	if (ep->tx_buf != NULL) {
+		for (i = 0; i < ep->tx_entries; i++) {
+			struct ep93xx_tx_buf *txb = &ep->tx_buf[i];
 
-		d = ep->descs->rdesc[i].buf_addr;
-		if (d)
-			dma_unmap_single(dev, d, PKT_BUF_SIZE, DMA_FROM_DEVICE);
+			if (txb->len)
+				ep93xx_unmap_tx_buf(ep, txb);
+			if (txb->skb != NULL)
+				dev_kfree_skb(txb->skb);
+		}
+		kfree(ep->tx_buf);
+		ep->tx_buf = NULL;
+	}
 
-		if (ep->rx_buf[i] != NULL)
-			kfree(ep->rx_buf[i]);
+	if (ep->tdesc != NULL) {
+		dma_free_coherent(dev, ep->tx_entries *
+				  (sizeof(struct ep93xx_tdesc) +
+				   sizeof(struct ep93xx_tstat)),
+				  ep->tdesc, ep->tx_descs_dma_addr);
+		ep->tdesc = NULL;
 	}
+}
 
-	for (i = 0; i < TX_QUEUE_ENTRIES; i++) {
-		dma_addr_t d;
+static void ep93xx_free_buffers(struct ep93xx_priv *ep)
+{
+	struct device *dev = ep->dev->dev.parent;
+	int i;
 
-		d = ep->descs->tdesc[i].buf_addr;
-		if (d)
-			dma_unmap_single(dev, d, PKT_BUF_SIZE, DMA_TO_DEVICE);
+	for (i = 0; i < RX_QUEUE_ENTRIES; i++) {
+		struct ep93xx_rx_buf *rxb = &ep->rx_buf[i];
 
-		if (ep->tx_buf[i] != NULL)
-			kfree(ep->tx_buf[i]);
+		if (rxb->page != NULL)
+			ep93xx_free_rx_page(ep, rxb);
 	}
 
-	dma_free_coherent(dev, sizeof(struct ep93xx_descs), ep->descs,
-							ep->descs_dma_addr);
+	ep93xx_free_tx_ring(ep);
+
+	if (ep->descs != NULL) {
+		dma_free_coherent(dev, sizeof(struct ep93xx_descs), ep->descs,
+				  ep->descs_dma_addr);
+		ep->descs = NULL;
+	}
 }
 
 static int ep93xx_alloc_buffers(struct ep93xx_priv *ep)
 {
 	struct device *dev = ep->dev->dev.parent;
+	struct ep93xx_tdesc *tdesc;
+	struct ep93xx_tx_buf *tx_buf;
+	dma_addr_t dma;
 	int i;
 
 	ep->descs = dma_alloc_coherent(dev, sizeof(struct ep93xx_descs),
@@ -506,41 +852,15 @@ static int ep93xx_alloc_buffers(struct ep93xx_priv *ep)
 		return 1;
 
 	for (i = 0; i < RX_QUEUE_ENTRIES; i++) {
-		void *buf;
-		dma_addr_t d;
-
-		buf = kmalloc(PKT_BUF_SIZE, GFP_KERNEL);
-		if (buf == NULL)
+		if (ep93xx_alloc_rx_page(ep, &ep->rx_buf[i], GFP_KERNEL))
 			goto err;
 
-		d = dma_map_single(dev, buf, PKT_BUF_SIZE, DMA_FROM_DEVICE);
-		if (dma_mapping_error(dev, d)) {
-			kfree(buf);
-			goto err;
-		}
-
-		ep->rx_buf[i] = buf;
-		ep->descs->rdesc[i].buf_addr = d;
-		ep->descs->rdesc[i].rdesc1 = (i << 16) | PKT_BUF_SIZE;
+		ep93xx_give_rx_buf(ep, i);
 	}
 
-	for (i = 0; i < TX_QUEUE_ENTRIES; i++) {
-		void *buf;
-		dma_addr_t d;
-
-		buf = kmalloc(PKT_BUF_SIZE, GFP_KERNEL);
-		if (buf == NULL)
-			goto err;
-
-		d = dma_map_single(dev, buf, PKT_BUF_SIZE, DMA_TO_DEVICE);
-		if (dma_mapping_error(dev, d)) {
-			kfree(buf);
-			goto err;
-		}
-
-		ep->tx_buf[i] = buf;
-		ep->descs->tdesc[i].buf_addr = d;
-	}
+	if (ep93xx_alloc_tx_ring(ep, ep->tx_entries, &tdesc, &dma, &tx_buf))
+		goto err;
+	ep93xx_set_tx_ring(ep, ep->tx_entries, tdesc, dma, tx_buf);
 
 	return 0;
 
@@ -586,16 +906,17 @@ static int ep93xx_start_hw(struct net_device *dev)
 	wrw(ep, REG_RXSTSQBLEN, RX_QUEUE_ENTRIES * sizeof(struct ep93xx_rstat));
 
 	/* Transmit descriptor ring.  */
-	addr = ep->descs_dma_addr + offsetof(struct ep93xx_descs, tdesc);
+	addr = ep->tx_descs_dma_addr;
 	wrl(ep, REG_TXDQBADD, addr);
 	wrl(ep, REG_TXDQCURADD, addr);
-	wrw(ep, REG_TXDQBLEN, TX_QUEUE_ENTRIES * sizeof(struct ep93xx_tdesc));
+	wrw(ep, REG_TXDQBLEN, ep->tx_entries * sizeof(struct ep93xx_tdesc));
 
 	/* Transmit status ring.  */
-	addr = ep->descs_dma_addr + offsetof(struct ep93xx_descs, tstat);
+	addr = ep->tx_descs_dma_addr +
+	       ep->tx_entries * sizeof(struct ep93xx_tdesc);
 	wrl(ep, REG_TXSTSQBADD, addr);
 	wrl(ep, REG_TXSTSQCURADD, addr);
-	wrw(ep, REG_TXSTSQBLEN, TX_QUEUE_ENTRIES * sizeof(struct ep93xx_tstat));
+	wrw(ep, REG_TXSTSQBLEN, ep->tx_entries * sizeof(struct ep93xx_tstat));
 
 	wrl(ep, REG_BMCTL, REG_BMCTL_ENABLE_TX | REG_BMCTL_ENABLE_RX);
 	wrl(ep, REG_INTEN, REG_INTEN_TX | REG_INTEN_RX);
@@ -647,6 +968,19 @@ static void ep93xx_stop_hw(struct net_device *dev)
 		pr_crit("hw failed to reset\n");
 }
 
+/* the rings start over when the hardware is (re)started */
+static void ep93xx_reset_pointers(struct net_device *dev)
+{
+	struct ep93xx_priv *ep = netdev_priv(dev);
+
+	ep->rx_pointer = 0;
+	ep->tx_clean_pointer = 0;
+	ep->tx_stat_pointer = 0;
+	ep->tx_pointer = 0;
+	ep->tx_pending = 0;
+	netdev_reset_queue(dev);
+}
+
 static int ep93xx_open(struct net_device *dev)
 {
 	struct ep93xx_priv *ep = netdev_priv(dev);
@@ -664,11 +998,8 @@ static int ep93xx_open(struct net_device *dev)
 	}
 
 	spin_lock_init(&ep->rx_lock);
-	ep->rx_pointer = 0;
-	ep->tx_clean_pointer = 0;
-	ep->tx_pointer = 0;
 	spin_lock_init(&ep->tx_pending_lock);
-	ep->tx_pending = 0;
+	ep93xx_reset_pointers(dev);
 
 	err = request_irq(ep->irq, ep93xx_irq, IRQF_SHARED, dev->name, dev);
 	if (err) {
@@ -738,12 +1069,131 @@ static u32 ep93xx_get_link(struct net_device *dev)
 	return mii_link_ok(&ep->mii);
 }
 
+static void ep93xx_get_ringparam(struct net_device *dev,
+				 struct ethtool_ringparam *ring)
+{
+	struct ep93xx_priv *ep = netdev_priv(dev);
+
+	ring->rx_max_pending = RX_QUEUE_ENTRIES;
+	ring->tx_max_pending = TX_QUEUE_MAX;
+	ring->rx_pending = RX_QUEUE_ENTRIES;
+	ring->tx_pending = ep->tx_entries;
+}
+
+static int ep93xx_set_ringparam(struct net_device *dev,
+				struct ethtool_ringparam *ring)
+{
+	struct ep93xx_priv *ep = netdev_priv(dev);
+	struct ep93xx_tdesc *tdesc;
+	struct ep93xx_tx_buf *tx_buf;
+	unsigned int entries;
+	dma_addr_t dma;
+	int err;
+
+	if (ring->rx_pending != RX_QUEUE_ENTRIES ||
+	    ring->rx_mini_pending || ring->rx_jumbo_pending)
+		return -EINVAL;
+	if (ring->tx_pending < TX_QUEUE_MIN || ring->tx_pending > TX_QUEUE_MAX)
+		return -EINVAL;
+
+	entries = roundup_pow_of_two(ring->tx_pending);
+	if (!netif_running(dev)) {
+		ep->tx_entries = entries;
+		return 0;
+	}
+
+	/* failing here leaves the device running on the old ring */
+	if (ep93xx_alloc_tx_ring(ep, entries, &tdesc, &dma, &tx_buf))
+		return -ENOMEM;
+
+	napi_disable(&ep->napi);
+	netif_tx_disable(dev);
+	wrl(ep, REG_GIINTMSK, 0);
+	synchronize_irq(ep->irq);
+	ep93xx_stop_hw(dev);
+
+	/*
+	 * The RX buffers stay where they are; only their status entries
+	 * are cleared, as the hardware starts over from the first one.
+	 */
+	ep93xx_free_tx_ring(ep);
+	ep93xx_set_tx_ring(ep, entries, tdesc, dma, tx_buf);
+	memset(ep->descs->rstat, 0, sizeof(ep->descs->rstat));
+	ep93xx_reset_pointers(dev);
+
+	/*
+	 * If the restart fails the device stays up but does not pass
+	 * traffic, in a state ep93xx_close() can still tear down.
+	 */
+	err = ep93xx_start_hw(dev) ? -EIO : 0;
+	napi_enable(&ep->napi);
+	if (err)
+		return err;
+
+	wrl(ep, REG_GIINTMSK, REG_GIINTMSK_ENABLE);
+	netif_wake_queue(dev);
+
+	return 0;
+}
+
+#define EP93XX_RX_STAT(m)	\
+	{ #m, offsetof(struct ep93xx_rx_stats, m) }
+
+static const struct {
+	char		name[ETH_GSTRING_LEN];
+	size_t		offset;
+} ep93xx_rx_stats_info[] = {
+	EP93XX_RX_STAT(rx_copybreak),
+	EP93XX_RX_STAT(rx_page_recycled),
+	EP93XX_RX_STAT(rx_page_alloc),
+	EP93XX_RX_STAT(rx_alloc_errors),
+	EP93XX_RX_STAT(rx_gro_merged),
+};
+
+static int ep93xx_get_sset_count(struct net_device *dev, int sset)
+{
+	switch (sset) {
+	case ETH_SS_STATS:
+		return ARRAY_SIZE(ep93xx_rx_stats_info);
+	default:
+		return -EOPNOTSUPP;
+	}
+}
+
+static void ep93xx_get_strings(struct net_device *dev, u32 sset, u8 *data)
+{
+	int i;
+
+	if (sset != ETH_SS_STATS)
+		return;
+
+	for (i = 0; i < ARRAY_SIZE(ep93xx_rx_stats_info); i++)
+		memcpy(data + i * ETH_GSTRING_LEN,
+		       ep93xx_rx_stats_info[i].name, ETH_GSTRING_LEN);
+}
+
+static void ep93xx_get_ethtool_stats(struct net_device *dev,
+				     struct ethtool_stats *stats, u64 *data)
+{
+	struct ep93xx_priv *ep = netdev_priv(dev);
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(ep93xx_rx_stats_info); i++)
+		data[i] = *(unsigned long *)((void *)&ep->rx_stats +
+					     ep93xx_rx_stats_info[i].offset);
+}
+
 static const struct ethtool_ops ep93xx_ethtool_ops = {
 	.get_drvinfo		= ep93xx_get_drvinfo,
 	.get_settings		= ep93xx_get_settings,
 	.set_settings		= ep93xx_set_settings,
 	.nway_reset		= ep93xx_nway_reset,
 	.get_link		= ep93xx_get_link,
+	.get_ringparam		= ep93xx_get_ringparam,
+	.set_ringparam		= ep93xx_set_ringparam,
+	.get_sset_count		= ep93xx_get_sset_count,
+	.get_strings		= ep93xx_get_strings,
+	.get_ethtool_stats	= ep93xx_get_ethtool_stats,
 };
 
 static const struct net_device_ops ep93xx_netdev_ops = {
@@ -849,6 +1299,8 @@ static int ep93xx_eth_probe(struct platform_device *pdev)
 		goto err_out;
 	}
 	ep->irq = irq;
+	ep->tx_entries = roundup_pow_of_two(clamp(tx_queue_entries,
+						  TX_QUEUE_MIN, TX_QUEUE_MAX));
 
 	ep->mii.phy_id = data->phy_id;
 	ep->mii.phy_id_mask = 0x1f;
@@ -17,6 +17,7 @@
  * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
  */
 //#define DEBUG
+#include <linux/interrupt.h>
 #include <linux/netdevice.h>
 #include <linux/etherdevice.h>
 #include <linux/ethtool.h>
@@ -76,6 +77,9 @@ struct virtnet_info {
 	/* Work struct for refilling if we run low on memory. */
 	struct delayed_work refill;
 
+	/* Frees transmitted skbs once the host has used enough of them. */
+	struct tasklet_struct tx_reclaim;
+
 	/* Work struct for config space updates */
 	struct work_struct config_work;
 
@@ -147,8 +151,8 @@ static void skb_xmit_done(struct virtqueue *svq)
 	/* Suppress further interrupts. */
 	virtqueue_disable_cb(svq);
 
-	/* We were probably waiting for more output buffers. */
-	netif_wake_queue(vi->dev);
+	/* The used skbs must be freed before BQL lets the queue go again. */
+	tasklet_schedule(&vi->tx_reclaim);
 }
 
 static void set_skb_frag(struct sk_buff *skb, struct page *page,
@@ -557,10 +561,12 @@ again:
 	return received;
 }
 
+/* Called with the tx queue lock held */
 static unsigned int free_old_xmit_skbs(struct virtnet_info *vi)
 {
 	struct sk_buff *skb;
 	unsigned int len, tot_sgs = 0;
+	unsigned int packets = 0, bytes = 0;
 	struct virtnet_stats *stats = this_cpu_ptr(vi->stats);
 
 	while ((skb = virtqueue_get_buf(vi->svq, &len)) != NULL) {
@@ -571,12 +577,42 @@ static unsigned int free_old_xmit_skbs(struct virtnet_info *vi)
 		stats->tx_packets++;
 		u64_stats_update_end(&stats->tx_syncp);
 
+		packets++;
+		bytes += skb->len;
 		tot_sgs += skb_vnet_hdr(skb)->num_sg;
 		dev_kfree_skb_any(skb);
 	}
+	netdev_completed_queue(vi->dev, packets, bytes);
 	return tot_sgs;
 }
 
+static void virtnet_tx_reclaim(unsigned long data)
+{
+	struct virtnet_info *vi = (struct virtnet_info *)data;
+	struct netdev_queue *txq = netdev_get_tx_queue(vi->dev, 0);
+	bool again = false;
+
+	__netif_tx_lock(txq, smp_processor_id());
+	free_old_xmit_skbs(vi);
+
+	/* We were probably waiting for more output buffers. */
+	netif_wake_queue(vi->dev);
+
+	/*
+	 * BQL may still hold the queue back. Ask for another interrupt, or
+	 * look again right away if the host has already used more.
+	 */
+	if (netif_xmit_stopped(txq) &&
+	    unlikely(!virtqueue_enable_cb_delayed(vi->svq))) {
+		virtqueue_disable_cb(vi->svq);
+		again = true;
+	}
+	__netif_tx_unlock(txq);
+
+	if (again)
+		tasklet_schedule(&vi->tx_reclaim);
+}
+
 static int xmit_skb(struct virtnet_info *vi, struct sk_buff *skb)
 {
 	struct skb_vnet_hdr *hdr = skb_vnet_hdr(skb);
@@ -627,6 +663,8 @@ static int xmit_skb(struct virtnet_info *vi, struct sk_buff *skb)
 static netdev_tx_t start_xmit(struct sk_buff *skb, struct net_device *dev)
 {
 	struct virtnet_info *vi = netdev_priv(dev);
+	struct netdev_queue *txq = netdev_get_tx_queue(dev, 0);
+	bool kick = !skb->xmit_more;
 	int capacity;
 
 	/* Free up any pending old buffers before queueing new ones. */
@@ -650,28 +688,45 @@ static netdev_tx_t start_xmit(struct sk_buff *skb, struct net_device *dev)
 		}
 		dev->stats.tx_dropped++;
 		kfree_skb(skb);
+		/* Buffers added earlier in the batch still need the kick */
+		if (kick)
+			virtqueue_kick(vi->svq);
 		return NETDEV_TX_OK;
 	}
-	virtqueue_kick(vi->svq);
 
 	/* Don't wait up for transmitted skbs to be freed. */
 	skb_orphan(skb);
 	nf_reset(skb);
 
+	netdev_sent_queue(dev, skb->len);
+
 	/* Apparently nice girls don't return TX_BUSY; stop the queue
 	 * before it gets out of hand.  Naturally, this wastes entries. */
-	if (capacity < 2+MAX_SKB_FRAGS) {
+	if (capacity < 2+MAX_SKB_FRAGS)
 		netif_stop_queue(dev);
-		if (unlikely(!virtqueue_enable_cb_delayed(vi->svq))) {
-			/* More just got used, free them then recheck. */
-			capacity += free_old_xmit_skbs(vi);
-			if (capacity >= 2+MAX_SKB_FRAGS) {
-				netif_start_queue(dev);
-				virtqueue_disable_cb(vi->svq);
-			}
-		}
+
+	/*
+	 * The queue is stopped because the ring is nearly full or because
+	 * BQL has enough in flight. Only completions restart it, so ask the
+	 * host for an interrupt.
+	 */
+	if (netif_xmit_stopped(txq) &&
+	    unlikely(!virtqueue_enable_cb_delayed(vi->svq))) {
+		/* More just got used, free them then recheck. */
+		capacity += free_old_xmit_skbs(vi);
+		if (capacity >= 2+MAX_SKB_FRAGS)
+			netif_start_queue(dev);
+		if (!netif_xmit_stopped(txq))
+			virtqueue_disable_cb(vi->svq);
 	}
 
+	/*
+	 * Notify the host once per batch. Nobody will send the rest of the
+	 * batch while the queue is stopped, so kick then too.
+	 */
+	if (kick || netif_xmit_stopped(txq))
+		virtqueue_kick(vi->svq);
+
 	return NETDEV_TX_OK;
 }
 
@@ -1114,6 +1169,7 @@ static int virtnet_probe(struct virtio_device *vdev)
 		goto free;
 
 	INIT_DELAYED_WORK(&vi->refill, refill_work);
+	tasklet_init(&vi->tx_reclaim, virtnet_tx_reclaim, (unsigned long)vi);
 	mutex_init(&vi->config_lock);
 	vi->config_enable = true;
 	INIT_WORK(&vi->config_work, virtnet_config_changed_work);
@@ -1197,9 +1253,11 @@ static void free_unused_bufs(struct virtnet_info *vi)
 static void remove_vq_common(struct virtnet_info *vi)
 {
 	vi->vdev->config->reset(vi->vdev);
+	tasklet_kill(&vi->tx_reclaim);
 
 	/* Free unused buffers in both send and recv, if any. */
 	free_unused_bufs(vi);
+	netdev_reset_queue(vi->dev);
 
 	vi->vdev->config->del_vqs(vi->vdev);
 
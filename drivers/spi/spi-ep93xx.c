@@ -18,6 +18,7 @@
 
 #include <linux/io.h>
 #include <linux/clk.h>
+#include <linux/debugfs.h>
 #include <linux/err.h>
 #include <linux/delay.h>
 #include <linux/device.h>
@@ -29,6 +30,8 @@
 #include <linux/workqueue.h>
 #include <linux/sched.h>
 #include <linux/scatterlist.h>
+#include <linux/seq_file.h>
+#include <linux/slab.h>
 #include <linux/spi/spi.h>
 
 #include <linux/platform_data/dma-ep93xx.h>
@@ -67,6 +70,28 @@
 #define SPI_TIMEOUT		5
 /* maximum depth of RX/TX FIFO */
 #define SPI_FIFO_SIZE		8
+/*
+ * Messages that are expected to be on the wire for at most this many
+ * microseconds are transferred by polling the FIFOs from the worker,
+ * rather than through the interrupt handler.
+ */
+#define SPI_FAST_PATH_USECS	50
+/* maximum number of messages the worker handles before yielding */
+#define SPI_MAX_BATCH		16
+/* number of log2 buckets in the per-device latency histogram */
+#define SPI_LAT_BUCKETS		16
+/* number of queued messages whose latency can be tracked at a time */
+#define SPI_LAT_STAMPS		16
+
+/**
+ * struct ep93xx_spi_stamp - time a queued message was submitted
+ * @msg: the message, %NULL if the slot is free
+ * @queued: value of ep93xx_spi_now_us() when @msg was queued
+ */
+struct ep93xx_spi_stamp {
+	struct spi_message		*msg;
+	u32				queued;
+};
 
 /**
  * struct ep93xx_spi - EP93xx SPI controller structure
@@ -96,6 +121,9 @@
  * @tx_sgt: sg table for TX transfers
  * @zeropage: dummy page used as RX buffer when only TX buffer is passed in by
  *            the client
+ * @polled: current message is being transferred by polling (fast path)
+ * @stamps: submission times of queued messages, for the latency histogram
+ * @debugfs: debugfs directory of the controller
  *
  * This structure holds EP93xx SPI controller specific information. When
  * @running is %true, driver accepts transfer requests from protocol drivers.
@@ -105,7 +133,7 @@
  *
  * Most of the fields are only written once and they can be accessed without
  * taking the @lock. Fields that are accessed concurrently are: @current_msg,
- * @running, and @msg_queue.
+ * @running, @msg_queue and @stamps.
  */
 struct ep93xx_spi {
 	spinlock_t			lock;
@@ -131,6 +159,9 @@ struct ep93xx_spi {
 	struct sg_table			rx_sgt;
 	struct sg_table			tx_sgt;
 	void				*zeropage;
+	bool				polled;
+	struct ep93xx_spi_stamp		stamps[SPI_LAT_STAMPS];
+	struct dentry			*debugfs;
 };
 
 /**
@@ -141,6 +172,14 @@ struct ep93xx_spi {
  * @div_scr: scr divider
  * @dss: bits per word (4 - 16 bits)
  * @ops: private chip operations
+ * @lat_hist: message latency histogram, bucket n counts messages that took
+ *            less than 2^n microseconds from ep93xx_spi_transfer() until
+ *            their completion (the last bucket takes everything longer)
+ * @fast_path: number of messages transferred by polling
+ * @batched: number of messages handled without re-enabling the controller
+ * @dma_merged: number of transfers that shared a DMA chain with the
+ *              previous one
+ * @debugfs: debugfs file holding the statistics
  *
  * This structure is used to store hardware register specific settings for each
  * SPI device. Settings are written to hardware by function
@@ -153,6 +192,11 @@ struct ep93xx_spi_chip {
 	u8				div_scr;
 	u8				dss;
 	struct ep93xx_spi_chip_ops	*ops;
+	unsigned long			lat_hist[SPI_LAT_BUCKETS];
+	unsigned long			fast_path;
+	unsigned long			batched;
+	unsigned long			dma_merged;
+	struct dentry			*debugfs;
 };
 
 /* converts bits per word to CR0.DSS value */
@@ -282,6 +326,104 @@ static void ep93xx_spi_cs_control(struct spi_device *spi, bool control)
 		chip->ops->cs_control(spi, value);
 }
 
+static inline u32 ep93xx_spi_now_us(void)
+{
+	return (u32)ktime_to_us(ktime_get());
+}
+
+/**
+ * ep93xx_spi_stamp() - note the time a message is queued
+ * @espi: ep93xx SPI controller struct
+ * @msg: message being queued
+ *
+ * Called with @espi->lock held. Messages queued while all the slots are in
+ * use are left out of the latency histogram.
+ */
+static void ep93xx_spi_stamp(struct ep93xx_spi *espi, struct spi_message *msg)
+{
+	int i;
+
+	for (i = 0; i < SPI_LAT_STAMPS; i++) {
+		if (!espi->stamps[i].msg) {
+			espi->stamps[i].msg = msg;
+			espi->stamps[i].queued = ep93xx_spi_now_us();
+			return;
+		}
+	}
+}
+
+/**
+ * ep93xx_spi_account() - record the latency of a finished message
+ * @espi: ep93xx SPI controller struct
+ * @msg: message which is about to be completed
+ */
+static void ep93xx_spi_account(struct ep93xx_spi *espi,
+			       struct spi_message *msg)
+{
+	struct ep93xx_spi_chip *chip = spi_get_ctldata(msg->spi);
+	unsigned long flags;
+	u32 delta;
+	int i;
+
+	spin_lock_irqsave(&espi->lock, flags);
+	for (i = 0; i < SPI_LAT_STAMPS; i++) {
+		if (espi->stamps[i].msg == msg) {
+			espi->stamps[i].msg = NULL;
+			delta = ep93xx_spi_now_us() - espi->stamps[i].queued;
+			chip->lat_hist[min_t(int, fls(delta),
+					     SPI_LAT_BUCKETS - 1)]++;
+			break;
+		}
+	}
+	spin_unlock_irqrestore(&espi->lock, flags);
+}
+
+#ifdef CONFIG_DEBUG_FS
+static int ep93xx_spi_debugfs_show(struct seq_file *s, void *data)
+{
+	struct ep93xx_spi_chip *chip = s->private;
+	int i;
+
+	seq_printf(s, "fast_path: %lu\n", chip->fast_path);
+	seq_printf(s, "batched: %lu\n", chip->batched);
+	seq_printf(s, "dma_merged: %lu\n", chip->dma_merged);
+	seq_puts(s, "latency:\n");
+	for (i = 0; i < SPI_LAT_BUCKETS - 1; i++)
+		seq_printf(s, "  < %6u us: %lu\n", 1U << i, chip->lat_hist[i]);
+	seq_printf(s, "  >= %5u us: %lu\n", 1U << i, chip->lat_hist[i]);
+
+	return 0;
+}
+
+static int ep93xx_spi_debugfs_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, ep93xx_spi_debugfs_show, inode->i_private);
+}
+
+static const struct file_operations ep93xx_spi_debugfs_ops = {
+	.open		= ep93xx_spi_debugfs_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static void ep93xx_spi_debugfs_add(struct ep93xx_spi *espi,
+				   struct ep93xx_spi_chip *chip)
+{
+	if (!espi->debugfs)
+		return;
+
+	chip->debugfs = debugfs_create_file(dev_name(&chip->spi->dev),
+					    S_IFREG | S_IRUGO, espi->debugfs,
+					    chip, &ep93xx_spi_debugfs_ops);
+}
+#else
+static inline void ep93xx_spi_debugfs_add(struct ep93xx_spi *espi,
+					  struct ep93xx_spi_chip *chip)
+{
+}
+#endif /* CONFIG_DEBUG_FS */
+
 /**
  * ep93xx_spi_setup() - setup an SPI device
  * @spi: SPI device to setup
@@ -323,6 +465,7 @@ static int ep93xx_spi_setup(struct spi_device *spi)
 		}
 
 		spi_set_ctldata(spi, chip);
+		ep93xx_spi_debugfs_add(espi, chip);
 	}
 
 	if (spi->max_speed_hz != chip->rate) {
@@ -330,6 +473,7 @@ static int ep93xx_spi_setup(struct spi_device *spi)
 
 		err = ep93xx_spi_calc_divisors(espi, chip, spi->max_speed_hz);
 		if (err != 0) {
+			debugfs_remove(chip->debugfs);
 			spi_set_ctldata(spi, NULL);
 			kfree(chip);
 			return err;
@@ -344,21 +488,47 @@ static int ep93xx_spi_setup(struct spi_device *spi)
 }
 
 /**
- * ep93xx_spi_transfer() - queue message to be transferred
- * @spi: target SPI device
- * @msg: message to be transferred
+ * ep93xx_spi_fast_path_ok() - check whether a message may be polled
+ * @espi: ep93xx SPI controller struct
+ * @msg: message to check
  *
- * This function is called by SPI device drivers when they are going to transfer
- * a new message. It simply puts the message in the queue and schedules
- * workqueue to perform the actual transfer later on.
+ * Only messages made of transfers which fit into the FIFO, need no delays or
+ * chipselect changes, and which take at most %SPI_FAST_PATH_USECS on the wire
+ * are transferred by polling. For those, busy-waiting on the FIFO is cheaper
+ * than an interrupt round trip per transfer.
+ */
+static bool ep93xx_spi_fast_path_ok(const struct ep93xx_spi *espi,
+				    struct spi_message *msg)
+{
+	struct ep93xx_spi_chip *chip = spi_get_ctldata(msg->spi);
+	struct spi_transfer *t;
+	unsigned long rate;
+	u64 bits = 0;
+
+	rate = clamp(chip->rate, espi->min_rate, espi->max_rate);
+
+	list_for_each_entry(t, &msg->transfers, transfer_list) {
+		if (t->len > SPI_FIFO_SIZE || t->delay_usecs || t->cs_change)
+			return false;
+		if (t->speed_hz && t->speed_hz < rate)
+			return false;
+		bits += t->len * BITS_PER_BYTE;
+	}
+
+	return bits * USEC_PER_SEC <= (u64)SPI_FAST_PATH_USECS * rate;
+}
+
+/**
+ * ep93xx_spi_init_message() - validate and initialize a new message
+ * @espi: ep93xx SPI controller struct
+ * @msg: message to be transferred
  *
  * Returns %0 on success and negative error in case of failure.
  */
-static int ep93xx_spi_transfer(struct spi_device *spi, struct spi_message *msg)
+static int ep93xx_spi_init_message(const struct ep93xx_spi *espi,
+				   struct spi_message *msg)
 {
-	struct ep93xx_spi *espi = spi_master_get_devdata(spi->master);
 	struct spi_transfer *t;
-	unsigned long flags;
 
 	if (!msg || !msg->complete)
 		return -EINVAL;
@@ -377,17 +547,42 @@ static int ep93xx_spi_transfer(struct spi_device *spi, struct spi_message *msg)
 	 * Now that we own the message, let's initialize it so that it is
 	 * suitable for us. We use @msg->status to signal whether there was
 	 * error in transfer and @msg->state is used to hold pointer to the
-	 * current transfer (or %NULL if no active current transfer).
+	 * current transfer.
 	 */
 	msg->state = NULL;
 	msg->status = 0;
 	msg->actual_length = 0;
 
+	return 0;
+}
+
+/**
+ * ep93xx_spi_transfer() - queue message to be transferred
+ * @spi: target SPI device
+ * @msg: message to be transferred
+ *
+ * This function is called by SPI device drivers when they are going to transfer
+ * a new message. It puts the message in the queue and schedules workqueue to
+ * perform the actual transfer later on.
+ *
+ * Returns %0 on success and negative error in case of failure.
+ */
+static int ep93xx_spi_transfer(struct spi_device *spi, struct spi_message *msg)
+{
+	struct ep93xx_spi *espi = spi_master_get_devdata(spi->master);
+	unsigned long flags;
+	int err;
+
+	err = ep93xx_spi_init_message(espi, msg);
+	if (err)
+		return err;
+
 	spin_lock_irqsave(&espi->lock, flags);
 	if (!espi->running) {
 		spin_unlock_irqrestore(&espi->lock, flags);
 		return -ESHUTDOWN;
 	}
+	ep93xx_spi_stamp(espi, msg);
 	list_add_tail(&msg->queue, &espi->msg_queue);
 	queue_work(espi->wq, &espi->msg_work);
 	spin_unlock_irqrestore(&espi->lock, flags);
@@ -410,6 +605,7 @@ static void ep93xx_spi_cleanup(struct spi_device *spi)
 	if (chip) {
 		if (chip->ops && chip->ops->cleanup)
 			chip->ops->cleanup(spi);
+		debugfs_remove(chip->debugfs);
 		spi_set_ctldata(spi, NULL);
 		kfree(chip);
 	}
@@ -523,6 +719,26 @@ static int ep93xx_spi_read_write(struct ep93xx_spi *espi)
 
 static void ep93xx_spi_pio_transfer(struct ep93xx_spi *espi)
 {
+	int loops = 2 * SPI_FAST_PATH_USECS;
+
+	/*
+	 * Short messages are transferred by polling the FIFOs. The transfer
+	 * is known to take at most %SPI_FAST_PATH_USECS, so give up after
+	 * twice as many rounds.
+	 */
+	if (espi->polled) {
+		while (ep93xx_spi_read_write(espi)) {
+			if (!--loops) {
+				dev_warn(&espi->pdev->dev,
+					 "timeout in polled transfer\n");
+				espi->current_msg->status = -ETIMEDOUT;
+				return;
+			}
+			udelay(1);
+		}
+		return;
+	}
+
 	/*
 	 * Now everything is set up for the current transfer. We prime the TX
 	 * FIFO, enable interrupts, and wait for the transfer to complete.
@@ -533,28 +749,77 @@ static void ep93xx_spi_pio_transfer(struct ep93xx_spi *espi)
 	}
 }
 
+/**
+ * ep93xx_spi_dma_run() - find transfers that can share one DMA chain
+ * @espi: ep93xx SPI controller struct
+ * @msg: current message
+ * @t: first transfer of the run
+ *
+ * Consecutive transfers that keep the chipselect asserted and use the same
+ * speed and word size are indistinguishable on the wire from a single long
+ * transfer, so they are pushed to the DMA engine as one chain. The zero page
+ * can't be both the TX source and the RX sink of a chain, so a run can't mix
+ * transfers without TX buffer and transfers without RX buffer.
+ *
+ * Returns the last transfer of the run, which is @t if nothing can be merged.
+ */
+static struct spi_transfer *ep93xx_spi_dma_run(struct ep93xx_spi *espi,
+					       struct spi_message *msg,
+					       struct spi_transfer *t)
+{
+	struct spi_transfer *last = t;
+	bool zero_tx = !t->tx_buf;
+	bool zero_rx = !t->rx_buf;
+
+	if (!espi->dma_rx || espi->polled)
+		return t;
+
+	while (!list_is_last(&last->transfer_list, &msg->transfers)) {
+		struct spi_transfer *next;
+
+		if (last->cs_change || last->delay_usecs)
+			break;
+
+		next = list_entry(last->transfer_list.next, struct spi_transfer,
+				  transfer_list);
+		if (next->speed_hz != t->speed_hz ||
+		    next->bits_per_word != t->bits_per_word)
+			break;
+
+		zero_tx |= !next->tx_buf;
+		zero_rx |= !next->rx_buf;
+		if (zero_tx && zero_rx)
+			break;
+
+		last = next;
+	}
+
+	return last;
+}
+
 /**
  * ep93xx_spi_dma_prepare() - prepares a DMA transfer
  * @espi: ep93xx SPI controller struct
  * @dir: DMA transfer direction
+ * @last: last transfer of the chain, which starts with the current transfer
  *
- * Function configures the DMA, maps the buffer and prepares the DMA
+ * Function configures the DMA, maps the buffers and prepares the DMA
  * descriptor. Returns a valid DMA descriptor in case of success and ERR_PTR
  * in case of failure.
  */
 static struct dma_async_tx_descriptor *
-ep93xx_spi_dma_prepare(struct ep93xx_spi *espi, enum dma_transfer_direction dir)
+ep93xx_spi_dma_prepare(struct ep93xx_spi *espi, enum dma_transfer_direction dir,
+		       struct spi_transfer *last)
 {
-	struct spi_transfer *t = espi->current_msg->state;
+	struct spi_transfer *first = espi->current_msg->state;
+	struct spi_transfer *t;
 	struct dma_async_tx_descriptor *txd;
 	enum dma_slave_buswidth buswidth;
 	struct dma_slave_config conf;
 	struct scatterlist *sg;
 	struct sg_table *sgt;
 	struct dma_chan *chan;
-	const void *buf, *pbuf;
-	size_t len = t->len;
-	int i, ret, nents;
+	int ret, nents;
 
 	if (bits_per_word(espi) > 8)
 		buswidth = DMA_SLAVE_BUSWIDTH_2_BYTES;
@@ -566,14 +831,12 @@ ep93xx_spi_dma_prepare(struct ep93xx_spi *espi, enum dma_transfer_direction dir)
 
 	if (dir == DMA_DEV_TO_MEM) {
 		chan = espi->dma_rx;
-		buf = t->rx_buf;
 		sgt = &espi->rx_sgt;
 
 		conf.src_addr = espi->sspdr_phys;
 		conf.src_addr_width = buswidth;
 	} else {
 		chan = espi->dma_tx;
-		buf = t->tx_buf;
 		sgt = &espi->tx_sgt;
 
 		conf.dst_addr = espi->sspdr_phys;
@@ -594,7 +857,16 @@ ep93xx_spi_dma_prepare(struct ep93xx_spi *espi, enum dma_transfer_direction dir)
 	 * last sg_table is released in ep93xx_spi_release_dma().
 	 */
 
-	nents = DIV_ROUND_UP(len, PAGE_SIZE);
+	nents = 0;
+	t = first;
+	for (;;) {
+		nents += DIV_ROUND_UP(t->len, PAGE_SIZE);
+		if (t == last)
+			break;
+		t = list_entry(t->transfer_list.next, struct spi_transfer,
+			       transfer_list);
+	}
+
 	if (nents != sgt->nents) {
 		sg_free_table(sgt);
 
@@ -603,25 +875,35 @@ ep93xx_spi_dma_prepare(struct ep93xx_spi *espi, enum dma_transfer_direction dir)
 			return ERR_PTR(ret);
 	}
 
-	pbuf = buf;
-	for_each_sg(sgt->sgl, sg, sgt->nents, i) {
-		size_t bytes = min_t(size_t, len, PAGE_SIZE);
+	sg = sgt->sgl;
+	t = first;
+	for (;;) {
+		const void *buf, *pbuf;
+		size_t len = t->len;
 
-		if (buf) {
-			sg_set_page(sg, virt_to_page(pbuf), bytes,
-				    offset_in_page(pbuf));
-		} else {
-			sg_set_page(sg, virt_to_page(espi->zeropage),
-				    bytes, 0);
-		}
+		buf = (dir == DMA_DEV_TO_MEM) ? t->rx_buf : t->tx_buf;
+		pbuf = buf;
 
-		pbuf += bytes;
-		len -= bytes;
-	}
+		while (len) {
+			size_t bytes = min_t(size_t, len, PAGE_SIZE);
 
-	if (WARN_ON(len)) {
-		dev_warn(&espi->pdev->dev, "len = %d expected 0!", len);
-		return ERR_PTR(-EINVAL);
+			if (buf) {
+				sg_set_page(sg, virt_to_page(pbuf), bytes,
+					    offset_in_page(pbuf));
+			} else {
+				sg_set_page(sg, virt_to_page(espi->zeropage),
+					    bytes, 0);
+			}
+
+			pbuf += bytes;
+			len -= bytes;
+			sg = sg_next(sg);
+		}
+
+		if (t == last)
+			break;
+		t = list_entry(t->transfer_list.next, struct spi_transfer,
+			       transfer_list);
 	}
 
 	nents = dma_map_sg(chan->device->dev, sgt->sgl, sgt->nents, dir);
@@ -666,19 +948,20 @@ static void ep93xx_spi_dma_callback(void *callback_param)
 	complete(callback_param);
 }
 
-static void ep93xx_spi_dma_transfer(struct ep93xx_spi *espi)
+static void ep93xx_spi_dma_transfer(struct ep93xx_spi *espi,
+				    struct spi_transfer *last)
 {
 	struct spi_message *msg = espi->current_msg;
 	struct dma_async_tx_descriptor *rxd, *txd;
 
-	rxd = ep93xx_spi_dma_prepare(espi, DMA_DEV_TO_MEM);
+	rxd = ep93xx_spi_dma_prepare(espi, DMA_DEV_TO_MEM, last);
 	if (IS_ERR(rxd)) {
 		dev_err(&espi->pdev->dev, "DMA RX failed: %ld\n", PTR_ERR(rxd));
 		msg->status = PTR_ERR(rxd);
 		return;
 	}
 
-	txd = ep93xx_spi_dma_prepare(espi, DMA_MEM_TO_DEV);
+	txd = ep93xx_spi_dma_prepare(espi, DMA_MEM_TO_DEV, last);
 	if (IS_ERR(txd)) {
 		ep93xx_spi_dma_finish(espi, DMA_DEV_TO_MEM);
 		dev_err(&espi->pdev->dev, "DMA TX failed: %ld\n", PTR_ERR(rxd));
@@ -709,18 +992,44 @@ static void ep93xx_spi_dma_transfer(struct ep93xx_spi *espi)
  * @msg: current message
  * @t: transfer to process
  *
- * This function processes one SPI transfer given in @t. Function waits until
- * transfer is complete (may sleep) and updates @msg->status based on whether
- * transfer was successfully processed or not.
+ * This function processes one SPI transfer given in @t, together with any
+ * following transfers that can share its DMA chain (see ep93xx_spi_dma_run()).
+ * Function waits until transfer is complete (may sleep unless on the fast
+ * path) and updates @msg->status based on whether transfer was successfully
+ * processed or not.
+ *
+ * Returns the last transfer that was processed.
  */
-static void ep93xx_spi_process_transfer(struct ep93xx_spi *espi,
-					struct spi_message *msg,
-					struct spi_transfer *t)
+static struct spi_transfer *
+ep93xx_spi_process_transfer(struct ep93xx_spi *espi, struct spi_message *msg,
+			    struct spi_transfer *t)
 {
 	struct ep93xx_spi_chip *chip = spi_get_ctldata(msg->spi);
+	struct spi_transfer *last, *x;
+	size_t len;
 
 	msg->state = t;
 
+	last = ep93xx_spi_dma_run(espi, msg, t);
+	len = 0;
+	for (x = t; ; x = list_entry(x->transfer_list.next,
+				     struct spi_transfer, transfer_list)) {
+		len += x->len;
+		if (x == last)
+			break;
+	}
+
+	/* Short runs go through PIO, one transfer at a time */
+	if (last != t && len <= SPI_FIFO_SIZE) {
+		last = t;
+		len = t->len;
+	}
+
+	for (x = t; x != last; x = list_entry(x->transfer_list.next,
+					      struct spi_transfer,
+					      transfer_list))
+		chip->dma_merged++;
+
 	/*
 	 * Handle any transfer specific settings if needed. We use
 	 * temporary chip settings here and restore original later when
@@ -738,7 +1047,7 @@ static void ep93xx_spi_process_transfer(struct ep93xx_spi *espi,
 				dev_err(&espi->pdev->dev,
 					"failed to adjust speed\n");
 				msg->status = err;
-				return;
+				return last;
 			}
 		}
 
@@ -759,8 +1068,8 @@ static void ep93xx_spi_process_transfer(struct ep93xx_spi *espi,
 	 * fit into the FIFO and can be transferred with a single interrupt.
 	 * So in these cases we will be using PIO and don't bother for DMA.
 	 */
-	if (espi->dma_rx && t->len > SPI_FIFO_SIZE)
-		ep93xx_spi_dma_transfer(espi);
+	if (espi->dma_rx && !espi->polled && len > SPI_FIFO_SIZE)
+		ep93xx_spi_dma_transfer(espi, last);
 	else
 		ep93xx_spi_pio_transfer(espi);
 
@@ -769,9 +1078,10 @@ static void ep93xx_spi_process_transfer(struct ep93xx_spi *espi,
 	 * the message.
 	 */
 	if (msg->status)
-		return;
+		return last;
 
-	msg->actual_length += t->len;
+	msg->actual_length += len;
+	t = last;
 
 	/*
 	 * After this transfer is finished, perform any possible
@@ -796,49 +1106,63 @@ static void ep93xx_spi_process_transfer(struct ep93xx_spi *espi,
 
 	if (t->speed_hz || t->bits_per_word)
 		ep93xx_spi_chip_setup(espi, chip);
+
+	return last;
 }
 
 /*
  * ep93xx_spi_process_message() - process one SPI message
  * @espi: ep93xx SPI controller struct
  * @msg: message to process
+ * @enabled: the controller was left enabled by the previous message
  *
  * This function processes a single SPI message. We go through all transfers in
  * the message and pass them to ep93xx_spi_process_transfer(). Chipselect is
  * asserted during the whole message (unless per transfer cs_change is set).
  *
+ * When @enabled is %true, the previous message went to the same device and the
+ * controller has not been disabled in between, so there is no need to enable
+ * and flush it again.
+ *
  * @msg->status contains %0 in case of success or negative error code in case of
- * failure.
+ * failure. Returns %true if the controller is left enabled, in which case the
+ * caller must eventually call ep93xx_spi_disable().
  */
-static void ep93xx_spi_process_message(struct ep93xx_spi *espi,
-				       struct spi_message *msg)
+static bool ep93xx_spi_process_message(struct ep93xx_spi *espi,
+				       struct spi_message *msg, bool enabled)
 {
-	unsigned long timeout;
 	struct spi_transfer *t;
+	int loops;
 	int err;
 
-	/*
-	 * Enable the SPI controller and its clock.
-	 */
-	err = ep93xx_spi_enable(espi);
-	if (err) {
-		dev_err(&espi->pdev->dev, "failed to enable SPI controller\n");
-		msg->status = err;
-		return;
-	}
+	if (!enabled) {
+		/*
+		 * Enable the SPI controller and its clock.
+		 */
+		err = ep93xx_spi_enable(espi);
+		if (err) {
+			dev_err(&espi->pdev->dev,
+				"failed to enable SPI controller\n");
+			msg->status = err;
+			return false;
+		}
 
-	/*
-	 * Just to be sure: flush any data from RX FIFO.
-	 */
-	timeout = jiffies + msecs_to_jiffies(SPI_TIMEOUT);
-	while (ep93xx_spi_read_u16(espi, SSPSR) & SSPSR_RNE) {
-		if (time_after(jiffies, timeout)) {
-			dev_warn(&espi->pdev->dev,
-				 "timeout while flushing RX FIFO\n");
-			msg->status = -ETIMEDOUT;
-			return;
+		/*
+		 * Just to be sure: flush any data from RX FIFO. It holds no
+		 * more than %SPI_FIFO_SIZE frames, so if it doesn't drain
+		 * within twice as many reads something is wrong.
+		 */
+		loops = 2 * SPI_FIFO_SIZE;
+		while (ep93xx_spi_read_u16(espi, SSPSR) & SSPSR_RNE) {
+			if (!loops--) {
+				dev_warn(&espi->pdev->dev,
+					 "timeout while flushing RX FIFO\n");
+				msg->status = -ETIMEDOUT;
+				ep93xx_spi_disable(espi);
+				return false;
+			}
+			ep93xx_spi_read_u16(espi, SSPDR);
 		}
-		ep93xx_spi_read_u16(espi, SSPDR);
 	}
 
 	/*
@@ -855,17 +1179,48 @@ static void ep93xx_spi_process_message(struct ep93xx_spi *espi,
 	ep93xx_spi_cs_control(msg->spi, true);
 
 	list_for_each_entry(t, &msg->transfers, transfer_list) {
-		ep93xx_spi_process_transfer(espi, msg, t);
+		t = ep93xx_spi_process_transfer(espi, msg, t);
 		if (msg->status)
 			break;
 	}
 
 	/*
 	 * Now the whole message is transferred (or failed for some reason). We
-	 * deselect the device and disable the SPI controller.
+	 * deselect the device. After a failure the controller is disabled
+	 * right away, otherwise the caller decides.
 	 */
 	ep93xx_spi_cs_control(msg->spi, false);
-	ep93xx_spi_disable(espi);
+	if (msg->status) {
+		ep93xx_spi_disable(espi);
+		return false;
+	}
+
+	return true;
+}
+
+/**
+ * ep93xx_spi_complete() - release the controller and complete a message
+ * @espi: ep93xx SPI controller struct
+ * @msg: message that has been processed
+ *
+ * Clears @espi->current_msg, re-schedules the worker if there are more
+ * messages in the queue and notifies the protocol driver.
+ */
+static void ep93xx_spi_complete(struct ep93xx_spi *espi,
+				struct spi_message *msg)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&espi->lock, flags);
+	espi->current_msg = NULL;
+	if (espi->running && !list_empty(&espi->msg_queue))
+		queue_work(espi->wq, &espi->msg_work);
+	spin_unlock_irqrestore(&espi->lock, flags);
+
+	ep93xx_spi_account(espi, msg);
+
+	/* notify the protocol driver that we are done with this message */
+	msg->complete(msg->context);
 }
 
 #define work_to_espi(work) (container_of((work), struct ep93xx_spi, msg_work))
@@ -875,8 +1230,12 @@ static void ep93xx_spi_process_message(struct ep93xx_spi *espi,
  * @work: work struct
  *
  * Workqueue worker function. This function is called when there are new
- * SPI messages to be processed. Message is taken out from the queue and then
- * passed to ep93xx_spi_process_message().
+ * SPI messages to be processed. Messages are taken out from the queue and then
+ * passed to ep93xx_spi_process_message(), up to %SPI_MAX_BATCH of them in one
+ * go. As long as consecutive messages go to the same device, the controller is
+ * kept enabled between them. Messages accepted by ep93xx_spi_fast_path_ok()
+ * are transferred by polling instead of waiting for interrupts; those of
+ * spi_sync() callers usually don't get here, see ep93xx_spi_transfer_sync().
  *
  * After message is transferred, protocol driver is notified by calling
  * @msg->complete(). In case of error, @msg->status is set to negative error
@@ -885,7 +1244,9 @@ static void ep93xx_spi_process_message(struct ep93xx_spi *espi,
 static void ep93xx_spi_work(struct work_struct *work)
 {
 	struct ep93xx_spi *espi = work_to_espi(work);
-	struct spi_message *msg;
+	struct spi_message *msg, *next;
+	bool enabled = false;
+	int batch = 0;
 
 	spin_lock_irq(&espi->lock);
 	if (!espi->running || espi->current_msg ||
@@ -898,20 +1259,100 @@ static void ep93xx_spi_work(struct work_struct *work)
 	espi->current_msg = msg;
 	spin_unlock_irq(&espi->lock);
 
-	ep93xx_spi_process_message(espi, msg);
+	for (;;) {
+		espi->polled = ep93xx_spi_fast_path_ok(espi, msg);
+		if (espi->polled) {
+			struct ep93xx_spi_chip *chip = spi_get_ctldata(msg->spi);
+
+			chip->fast_path++;
+		}
+		enabled = ep93xx_spi_process_message(espi, msg, enabled);
+		espi->polled = false;
+
+		/*
+		 * Keep hold of the controller and pick up the next message
+		 * directly, unless we have been busy for long enough.
+		 */
+		next = NULL;
+		spin_lock_irq(&espi->lock);
+		if (espi->running && !list_empty(&espi->msg_queue) &&
+		    ++batch < SPI_MAX_BATCH) {
+			next = list_first_entry(&espi->msg_queue,
+						struct spi_message, queue);
+			list_del_init(&next->queue);
+			espi->current_msg = next;
+		}
+		spin_unlock_irq(&espi->lock);
+
+		if (enabled && (!next || next->spi != msg->spi)) {
+			ep93xx_spi_disable(espi);
+			enabled = false;
+		}
+
+		if (!next)
+			break;
+
+		if (enabled) {
+			struct ep93xx_spi_chip *chip;
+
+			chip = spi_get_ctldata(next->spi);
+			chip->batched++;
+		}
+
+		ep93xx_spi_account(espi, msg);
+		msg->complete(msg->context);
+		msg = next;
+	}
+
+	ep93xx_spi_complete(espi, msg);
+}
+
+/**
+ * ep93xx_spi_transfer_sync() - transfer a message of spi_sync() right away
+ * @spi: target SPI device
+ * @msg: message to be transferred
+ *
+ * Messages accepted by ep93xx_spi_fast_path_ok() are polled in the context of
+ * the caller when the controller is idle, saving the round trip through the
+ * workqueue. Anything else returns %-EAGAIN and is queued by the SPI core
+ * through ep93xx_spi_transfer().
+ *
+ * Returns %0 once @msg has been completed and negative error otherwise.
+ */
+static int ep93xx_spi_transfer_sync(struct spi_device *spi,
+				    struct spi_message *msg)
+{
+	struct ep93xx_spi *espi = spi_master_get_devdata(spi->master);
+	struct ep93xx_spi_chip *chip = spi_get_ctldata(spi);
+	int err;
+
+	err = ep93xx_spi_init_message(espi, msg);
+	if (err)
+		return err;
+	if (!ep93xx_spi_fast_path_ok(espi, msg))
+		return -EAGAIN;
 
-	/*
-	 * Update the current message and re-schedule ourselves if there are
-	 * more messages in the queue.
-	 */
 	spin_lock_irq(&espi->lock);
-	espi->current_msg = NULL;
-	if (espi->running && !list_empty(&espi->msg_queue))
-		queue_work(espi->wq, &espi->msg_work);
+	if (!espi->running) {
+		spin_unlock_irq(&espi->lock);
+		return -ESHUTDOWN;
+	}
+	if (espi->current_msg || !list_empty(&espi->msg_queue)) {
+		spin_unlock_irq(&espi->lock);
+		return -EAGAIN;
+	}
+	espi->current_msg = msg;
+	ep93xx_spi_stamp(espi, msg);
 	spin_unlock_irq(&espi->lock);
 
-	/* notify the protocol driver that we are done with this message */
-	msg->complete(msg->context);
+	chip->fast_path++;
+	espi->polled = true;
+	if (ep93xx_spi_process_message(espi, msg, false))
+		ep93xx_spi_disable(espi);
+	espi->polled = false;
+
+	ep93xx_spi_complete(espi, msg);
+	return 0;
 }
 
 static irqreturn_t ep93xx_spi_interrupt(int irq, void *dev_id)
@@ -978,6 +1419,8 @@ static int ep93xx_spi_setup_dma(struct ep93xx_spi *espi)
 	espi->dma_rx_data.port = EP93XX_DMA_SSP;
 	espi->dma_rx_data.direction = DMA_DEV_TO_MEM;
 	espi->dma_rx_data.name = "ep93xx-spi-rx";
+	/* The callback only completes espi->wait, so skip the tasklet */
+	espi->dma_rx_data.irq_callback = true;
 
 	espi->dma_rx = dma_request_channel(mask, ep93xx_spi_dma_filter,
 					   &espi->dma_rx_data);
@@ -1042,6 +1485,7 @@ static int __devinit ep93xx_spi_probe(struct platform_device *pdev)
 
 	master->setup = ep93xx_spi_setup;
 	master->transfer = ep93xx_spi_transfer;
+	master->transfer_sync = ep93xx_spi_transfer_sync;
 	master->cleanup = ep93xx_spi_cleanup;
 	master->bus_num = pdev->id;
 	master->num_chipselect = info->num_chipselect;
@@ -1114,10 +1558,12 @@ static int __devinit ep93xx_spi_probe(struct platform_device *pdev)
 	/* make sure that the hardware is disabled */
 	ep93xx_spi_write_u8(espi, SSPCR1, 0);
 
+	espi->debugfs = debugfs_create_dir(dev_name(&pdev->dev), NULL);
+
 	error = spi_register_master(master);
 	if (error) {
 		dev_err(&pdev->dev, "failed to register SPI master\n");
-		goto fail_free_queue;
+		goto fail_remove_debugfs;
 	}
 
 	dev_info(&pdev->dev, "EP93xx SPI Controller at 0x%08lx irq %d\n",
@@ -1125,7 +1571,8 @@ static int __devinit ep93xx_spi_probe(struct platform_device *pdev)
 
 	return 0;
 
-fail_free_queue:
+fail_remove_debugfs:
+	debugfs_remove_recursive(espi->debugfs);
 	destroy_workqueue(espi->wq);
 fail_free_dma:
 	ep93xx_spi_release_dma(espi);
@@ -1171,6 +1618,7 @@ static int __devexit ep93xx_spi_remove(struct platform_device *pdev)
 	platform_set_drvdata(pdev, NULL);
 
 	spi_unregister_master(master);
+	debugfs_remove_recursive(espi->debugfs);
 	return 0;
 }
 
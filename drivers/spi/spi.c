@@ -1187,7 +1187,7 @@ int spi_setup(struct spi_device *spi)
 }
 EXPORT_SYMBOL_GPL(spi_setup);
 
-static int __spi_async(struct spi_device *spi, struct spi_message *message)
+static int __spi_validate(struct spi_device *spi, struct spi_message *message)
 {
 	struct spi_master *master = spi->master;
 
@@ -1213,6 +1213,18 @@ static int __spi_async(struct spi_device *spi, struct spi_message *message)
 
 	message->spi = spi;
 	message->status = -EINPROGRESS;
+	return 0;
+}
+
+static int __spi_async(struct spi_device *spi, struct spi_message *message)
+{
+	struct spi_master *master = spi->master;
+	int ret;
+
+	ret = __spi_validate(spi, message);
+	if (ret)
+		return ret;
+
 	return master->transfer(spi, message);
 }
 
@@ -1336,7 +1348,18 @@ static int __spi_sync(struct spi_device *spi, struct spi_message *message,
 	if (!bus_locked)
 		mutex_lock(&master->bus_lock_mutex);
 
-	status = spi_async_locked(spi, message);
+	/*
+	 * The bus lock mutex keeps out spi_bus_lock() users, so the master
+	 * may process the message right here rather than queue it.
+	 */
+	status = -EAGAIN;
+	if (master->transfer_sync) {
+		status = __spi_validate(spi, message);
+		if (!status)
+			status = master->transfer_sync(spi, message);
+	}
+	if (status == -EAGAIN)
+		status = spi_async_locked(spi, message);
 
 	if (!bus_locked)
 		mutex_unlock(&master->bus_lock_mutex);
@@ -1466,20 +1466,18 @@ restart:
 	spin_unlock(&btp->bt_lru_lock);
 }
 
-int
-xfs_buftarg_shrink(
+static unsigned long
+xfs_buftarg_shrink_scan(
 	struct shrinker		*shrink,
 	struct shrink_control	*sc)
 {
 	struct xfs_buftarg	*btp = container_of(shrink,
 					struct xfs_buftarg, bt_shrinker);
 	struct xfs_buf		*bp;
-	int nr_to_scan = sc->nr_to_scan;
+	long			nr_to_scan = sc->nr_to_scan;
+	unsigned long		freed = 0;
 	LIST_HEAD(dispose);
 
-	if (!nr_to_scan)
-		return btp->bt_lru_nr;
-
 	spin_lock(&btp->bt_lru_lock);
 	while (!list_empty(&btp->bt_lru)) {
 		if (nr_to_scan-- <= 0)
@@ -1504,6 +1502,7 @@ xfs_buftarg_shrink(
 		list_move(&bp->b_lru, &dispose);
 		btp->bt_lru_nr--;
 		bp->b_lru_flags |= _XBF_LRU_DISPOSE;
+		freed++;
 	}
 	spin_unlock(&btp->bt_lru_lock);
 
@@ -1513,6 +1512,17 @@ xfs_buftarg_shrink(
 		xfs_buf_rele(bp);
 	}
 
+	return freed;
+}
+
+static unsigned long
+xfs_buftarg_shrink_count(
+	struct shrinker		*shrink,
+	struct shrink_control	*sc)
+{
+	struct xfs_buftarg	*btp = container_of(shrink,
+					struct xfs_buftarg, bt_shrinker);
+
 	return btp->bt_lru_nr;
 }
 
@@ -1599,7 +1609,8 @@ xfs_alloc_buftarg(
 	spin_lock_init(&btp->bt_lru_lock);
 	if (xfs_setsize_buftarg_early(btp, bdev))
 		goto error;
-	btp->bt_shrinker.shrink = xfs_buftarg_shrink;
+	btp->bt_shrinker.count_objects = xfs_buftarg_shrink_count;
+	btp->bt_shrinker.scan_objects = xfs_buftarg_shrink_scan;
 	btp->bt_shrinker.seeks = DEFAULT_SEEKS;
 	register_shrinker(&btp->bt_shrinker);
 	return btp;
@@ -207,6 +207,8 @@ struct dentry_operations {
 	(DCACHE_MOUNTED|DCACHE_NEED_AUTOMOUNT|DCACHE_MANAGE_TRANSIT)
 
 #define DCACHE_DENTRY_KILLED	0x100000
+#define DCACHE_MAY_FREE		0x200000 /* killed on a shrink list, its
+					    owner frees it */
 
 extern seqlock_t rename_lock;
 
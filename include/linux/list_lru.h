@@ -0,0 +1,127 @@
+/*
+ * Per-node LRU lists of objects, for caches that are shrunk by reclaim.
+ *
+ * Objects are put on the list of the node their memory is on, so that a
+ * shrinker can scan just the nodes reclaim is running for, and each node
+ * has its own lock.
+ */
+#ifndef _LRU_LIST_H
+#define _LRU_LIST_H
+
+#include <linux/list.h>
+#include <linux/nodemask.h>
+#include <linux/spinlock.h>
+
+/* list_lru_walk_cb has to always return one of those */
+enum lru_status {
+	LRU_REMOVED,		/* item removed from list */
+	LRU_ROTATE,		/* item referenced, give another pass */
+	LRU_SKIP,		/* item cannot be locked, skip */
+	LRU_RETRY,		/* the lock was dropped, restart the walk.
+				   Has to return with the lock held. */
+};
+
+struct list_lru_node {
+	spinlock_t		lock;
+	struct list_head	list;
+	/* kept as signed so we can catch imbalance bugs */
+	long			nr_items;
+} ____cacheline_aligned_in_smp;
+
+struct list_lru {
+	struct list_lru_node	*node;		/* nr_node_ids entries */
+	nodemask_t		active_nodes;	/* nodes with items */
+};
+
+extern int list_lru_init(struct list_lru *lru);
+extern void list_lru_destroy(struct list_lru *lru);
+
+/**
+ * list_lru_add: add an element to the lru list's tail
+ * @lru: the lru pointer
+ * @item: the item to be added.
+ *
+ * The item goes on the list of the node its memory belongs to. The
+ * caller has to serialize adding and removing the same item, a lock
+ * protecting the item is fine for that.
+ *
+ * Return value: true if the list was updated, false otherwise
+ */
+extern bool list_lru_add(struct list_lru *lru, struct list_head *item);
+
+/**
+ * list_lru_del: delete an element from the lru list
+ * @lru: the lru pointer
+ * @item: the item to be deleted.
+ *
+ * The item is left initialized, so that list_empty() on it tells whether
+ * it is on a list.
+ *
+ * Return value: true if the list was updated, false otherwise
+ */
+extern bool list_lru_del(struct list_lru *lru, struct list_head *item);
+
+/**
+ * list_lru_count_node: return the number of objects on a node of the lru
+ * @lru: the lru pointer.
+ * @nid: the node id to count from.
+ *
+ * The value is not serialized against additions and removals, it is
+ * good enough for a shrinker's count_objects.
+ */
+extern unsigned long list_lru_count_node(struct list_lru *lru, int nid);
+
+static inline unsigned long list_lru_count(struct list_lru *lru)
+{
+	unsigned long count = 0;
+	int nid;
+
+	for_each_node_mask(nid, lru->active_nodes)
+		count += list_lru_count_node(lru, nid);
+
+	return count;
+}
+
+typedef enum lru_status
+(*list_lru_walk_cb)(struct list_head *item, spinlock_t *lock, void *cb_arg);
+
+/**
+ * list_lru_walk_node: walk a list_lru of one node, isolating items
+ * @lru: the lru pointer.
+ * @nid: the node id to scan from.
+ * @isolate: callback function that is responsible for deciding what to do
+ *  with the item currently being scanned
+ * @cb_arg: opaque type that will be passed to @isolate
+ * @nr_to_walk: how many items to scan, decremented for each one scanned.
+ *
+ * The list is walked from its head, the least recently added items, with
+ * the node lock held. @isolate is called for each item and tells with its
+ * return value what became of it: it can take the item off the list
+ * (LRU_REMOVED), typically onto a private dispose list, have it moved to
+ * the tail (LRU_ROTATE), leave it (LRU_SKIP), or report that it dropped
+ * the lock and the walk has to start over (LRU_RETRY). @isolate must not
+ * sleep, and the freeing of isolated items is best done by the caller
+ * once the walk is over.
+ *
+ * Return value: the number of items removed from the list.
+ */
+extern unsigned long list_lru_walk_node(struct list_lru *lru, int nid,
+		list_lru_walk_cb isolate, void *cb_arg,
+		unsigned long *nr_to_walk);
+
+static inline unsigned long
+list_lru_walk(struct list_lru *lru, list_lru_walk_cb isolate,
+	      void *cb_arg, unsigned long nr_to_walk)
+{
+	unsigned long isolated = 0;
+	int nid;
+
+	for_each_node_mask(nid, lru->active_nodes) {
+		isolated += list_lru_walk_node(lru, nid, isolate,
+					       cb_arg, &nr_to_walk);
+		if (!nr_to_walk)
+			break;
+	}
+	return isolated;
+}
+#endif /* _LRU_LIST_H */
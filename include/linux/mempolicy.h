@@ -198,6 +198,19 @@ static inline int vma_migratable(struct vm_area_struct *vma)
 	return 1;
 }
 
+#ifdef CONFIG_NUMA_BALANCING
+extern int mpol_misplaced(struct page *page, struct vm_area_struct *vma,
+			  unsigned long addr);
+extern unsigned long change_prot_numa(struct vm_area_struct *vma,
+				      unsigned long start, unsigned long end);
+#else
+static inline int mpol_misplaced(struct page *page, struct vm_area_struct *vma,
+				 unsigned long addr)
+{
+	return -1;
+}
+#endif
+
 #else
 
 struct mempolicy {};
@@ -323,5 +336,11 @@ static inline int mpol_to_str(char *buffer, int maxlen, struct mempolicy *pol,
 	return 0;
 }
 
+static inline int mpol_misplaced(struct page *page, struct vm_area_struct *vma,
+				 unsigned long addr)
+{
+	return -1;
+}
+
 #endif /* CONFIG_NUMA */
 #endif
@@ -397,6 +397,17 @@ struct mm_struct {
 #endif
 #ifdef CONFIG_CPUMASK_OFFSTACK
 	struct cpumask cpumask_allocation;
+#endif
+#ifdef CONFIG_NUMA_BALANCING
+	/*
+	 * numa_next_scan is the next time, in jiffies, the address space
+	 * is sampled for NUMA hinting faults. Sampling resumes at
+	 * numa_scan_offset, and numa_scan_seq counts the completed passes
+	 * so that tasks can tell a scan period is over.
+	 */
+	unsigned long numa_next_scan;
+	unsigned long numa_scan_offset;
+	int numa_scan_seq;
 #endif
 	struct uprobes_state uprobes_state;
 };
@@ -30,6 +30,13 @@
  * @port: peripheral which is requesting the channel
  * @direction: TX/RX channel
  * @name: optional name for the channel, this is displayed in /proc/interrupts
+ * @nr_descs: number of descriptors preallocated for the channel, %0 selects
+ *            the driver default. The pool grows on demand without sleeping,
+ *            so this only needs to cover the usual number of in-flight
+ *            buffers.
+ * @irq_callback: call the completion callbacks directly from the channel
+ *                interrupt handler instead of deferring them to a tasklet.
+ *                The callbacks must then be safe to run in hard-IRQ context.
  *
  * This information is passed as private channel parameter in a filter
  * function. Note that this is only needed for slave/cyclic channels.  For
@@ -39,6 +46,8 @@ struct ep93xx_dma_data {
 	int				port;
 	enum dma_transfer_direction	direction;
 	const char			*name;
+	unsigned int			nr_descs;
+	bool				irq_callback;
 };
 
 /**
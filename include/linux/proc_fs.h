@@ -175,6 +175,10 @@ extern struct proc_dir_entry *proc_net_mkdir(struct net *net, const char *name,
 
 extern struct file *proc_ns_fget(int fd);
 
+struct seq_file;
+struct task_struct;
+extern void arch_proc_pid_status(struct seq_file *m, struct task_struct *task);
+
 #else
 
 #define proc_net_fops_create(net, name, mode, fops)  ({ (void)(mode), NULL; })
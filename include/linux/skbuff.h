@@ -108,6 +108,7 @@
 struct net_device;
 struct scatterlist;
 struct pipe_inode_info;
+struct splice_pipe_desc;
 
 #if defined(CONFIG_NF_CONNTRACK) || defined(CONFIG_NF_CONNTRACK_MODULE)
 struct nf_conntrack {
@@ -237,11 +238,22 @@ enum {
  * lower device, the skb last reference should be 0 when calling this.
  * The ctx field is used to track device context.
  * The desc field is used to track userspace buffer index.
+ *
+ * Sockets sending with MSG_ZEROCOPY embed the ubuf_info in the control
+ * block of their completion notification skb. Its user pages may then
+ * be shared by clones and segments, each holding a reference in refcnt.
+ * id is the notification counter value of the send call, len is one
+ * unless that call was aborted, and zerocopy is cleared if the data had
+ * to be copied after all.
  */
 struct ubuf_info {
 	void (*callback)(struct ubuf_info *);
 	void *ctx;
 	unsigned long desc;
+	atomic_t refcnt;
+	u32 id;
+	u16 len;
+	u16 zerocopy:1;
 };
 
 /* This data is invariant across clones and lives at
@@ -305,6 +317,9 @@ enum {
 	SKB_GSO_TCPV6 = 1 << 4,
 
 	SKB_GSO_FCOE = 1 << 5,
+
+	/* Equal sized UDP datagrams, each with its own UDP header. */
+	SKB_GSO_UDP_L4 = 1 << 6,
 };
 
 #if BITS_PER_LONG > 32
@@ -368,8 +383,11 @@ typedef unsigned char *sk_buff_data_t;
  *	@wifi_acked_valid: wifi_acked was set
  *	@wifi_acked: whether frame was acked on wifi or not
  *	@no_fcs:  Request NIC to treat last 4 bytes as Ethernet FCS
+ *	@xmit_more: More SKBs are pending for this queue, see
+ *		Documentation/networking/netdevices.txt
  *	@dma_cookie: a cookie to one of several possible DMA operations
  *		done by skb DMA functions
+ *	@napi_id: id of the NAPI struct this skb came from
  *	@secmark: security marking
  *	@mark: Generic packet mark
  *	@dropcount: total number of sk_receive_queue overflows
@@ -425,6 +443,16 @@ struct sk_buff {
 				ip_summed:2,
 				nohdr:1,
 				nfctinfo:3;
+
+/* if you move pkt_type around you also must adapt those constants */
+#ifdef __BIG_ENDIAN_BITFIELD
+#define PKT_TYPE_MAX	(7 << 5)
+#else
+#define PKT_TYPE_MAX	7
+#endif
+#define PKT_TYPE_OFFSET()	offsetof(struct sk_buff, __pkt_type_offset)
+
+	__u8			__pkt_type_offset[0];
 	__u8			pkt_type:3,
 				fclone:2,
 				ipvs_property:1,
@@ -469,12 +497,16 @@ struct sk_buff {
 	__u8			wifi_acked:1;
 	__u8			no_fcs:1;
 	__u8			head_frag:1;
-	/* 8/10 bit hole (depending on ndisc_nodetype presence) */
+	__u8			xmit_more:1;
+	/* 7/9 bit hole (depending on ndisc_nodetype presence) */
 	kmemcheck_bitfield_end(flags2);
 
 #ifdef CONFIG_NET_DMA
 	dma_cookie_t		dma_cookie;
 #endif
+#ifdef CONFIG_NET_RX_BUSY_POLL
+	unsigned int		napi_id;
+#endif
 #ifdef CONFIG_NETWORK_SECMARK
 	__u32			secmark;
 #endif
@@ -591,6 +623,13 @@ static inline struct sk_buff *alloc_skb_fclone(unsigned int size,
 
 extern struct sk_buff *skb_morph(struct sk_buff *dst, struct sk_buff *src);
 extern int skb_copy_ubufs(struct sk_buff *skb, gfp_t gfp_mask);
+extern struct ubuf_info *sock_zerocopy_alloc(struct sock *sk);
+extern void sock_zerocopy_callback(struct ubuf_info *uarg);
+extern void sock_zerocopy_put_abort(struct ubuf_info *uarg);
+extern int skb_zerocopy_iter(struct sk_buff *skb, const void __user *from,
+			     int len);
+extern int skb_zerocopy_iovec(struct sk_buff *skb, const struct iovec *iov,
+			      int offset, int len);
 extern struct sk_buff *skb_clone(struct sk_buff *skb,
 				 gfp_t priority);
 extern struct sk_buff *skb_copy(const struct sk_buff *skb,
@@ -679,6 +718,53 @@ static inline struct skb_shared_hwtstamps *skb_hwtstamps(struct sk_buff *skb)
 	return &skb_shinfo(skb)->hwtstamps;
 }
 
+#define skb_uarg(SKB)	((struct ubuf_info *)(skb_shinfo(SKB)->destructor_arg))
+
+/* Returns the ubuf_info of an skb that carries user pages, or NULL */
+static inline struct ubuf_info *skb_zcopy(struct sk_buff *skb)
+{
+	bool is_zcopy = skb && skb_shinfo(skb)->tx_flags & SKBTX_DEV_ZEROCOPY;
+
+	return is_zcopy ? skb_uarg(skb) : NULL;
+}
+
+/* Pages of MSG_ZEROCOPY sockets may be shared, see skb_orphan_frags() */
+static inline bool skb_zcopy_shareable(struct sk_buff *skb)
+{
+	return skb_uarg(skb)->callback == sock_zerocopy_callback;
+}
+
+static inline void sock_zerocopy_get(struct ubuf_info *uarg)
+{
+	atomic_inc(&uarg->refcnt);
+}
+
+static inline void sock_zerocopy_put(struct ubuf_info *uarg)
+{
+	if (uarg)
+		sock_zerocopy_callback(uarg);
+}
+
+static inline void skb_zcopy_set(struct sk_buff *skb, struct ubuf_info *uarg)
+{
+	if (uarg) {
+		sock_zerocopy_get(uarg);
+		skb_shinfo(skb)->destructor_arg = uarg;
+		skb_shinfo(skb)->tx_flags |= SKBTX_DEV_ZEROCOPY;
+	}
+}
+
+/*
+ * Let @nskb, which has taken references on frags of @orig, share its
+ * pages. Only MSG_ZEROCOPY pages can be shared, others must have been
+ * orphaned before.
+ */
+static inline void skb_zcopy_clone(struct sk_buff *nskb, struct sk_buff *orig)
+{
+	if (skb_zcopy(orig) && skb_zcopy_shareable(orig))
+		skb_zcopy_set(nskb, skb_uarg(orig));
+}
+
 /**
  *	skb_queue_empty - check if a queue is empty
  *	@list: queue head
@@ -1698,8 +1784,30 @@ static inline void skb_orphan(struct sk_buff *skb)
  */
 static inline int skb_orphan_frags(struct sk_buff *skb, gfp_t gfp_mask)
 {
-	if (likely(!(skb_shinfo(skb)->tx_flags & SKBTX_DEV_ZEROCOPY)))
+	if (likely(!skb_zcopy(skb)))
+		return 0;
+	if (skb_zcopy_shareable(skb))
+		return 0;
+	return skb_copy_ubufs(skb, gfp_mask);
+}
+
+/**
+ *	skb_orphan_frags_rx - orphan the frags of a buffer about to be queued
+ *	@skb: buffer to orphan frags from
+ *	@gfp_mask: allocation mask for replacement pages
+ *
+ *	Like skb_orphan_frags(), but also copies the user pages that
+ *	MSG_ZEROCOPY senders share between clones. Use it where the buffer
+ *	may be held for an unbounded time, such as a local receive queue.
+ */
+static inline int skb_orphan_frags_rx(struct sk_buff *skb, gfp_t gfp_mask)
+{
+	if (likely(!skb_zcopy(skb)))
 		return 0;
+	/* the sender still holds a clone, copy into a private shinfo */
+	if (skb_zcopy_shareable(skb) && skb_cloned(skb) &&
+	    pskb_expand_head(skb, 0, 0, gfp_mask))
+		return -ENOMEM;
 	return skb_copy_ubufs(skb, gfp_mask);
 }
 
@@ -2235,10 +2343,17 @@ extern __wsum	       skb_copy_and_csum_bits(const struct sk_buff *skb,
 					      int offset, u8 *to, int len,
 					      __wsum csum);
 extern int             skb_splice_bits(struct sk_buff *skb,
+						struct sock *sk,
 						unsigned int offset,
 						struct pipe_inode_info *pipe,
 						unsigned int len,
-						unsigned int flags);
+						unsigned int flags,
+						ssize_t (*splice_cb)(struct sock *,
+								     struct pipe_inode_info *,
+								     struct splice_pipe_desc *));
+extern ssize_t	       skb_socket_splice(struct sock *sk,
+					 struct pipe_inode_info *pipe,
+					 struct splice_pipe_desc *spd);
 extern void	       skb_copy_and_csum_dev(const struct sk_buff *skb, u8 *to);
 extern void	       skb_split(struct sk_buff *skb,
 				 struct sk_buff *skb1, const u32 len);
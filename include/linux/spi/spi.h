@@ -235,6 +235,8 @@ static inline void spi_unregister_driver(struct spi_driver *sdrv)
  *	It's always safe to call this unless transfers are pending on
  *	the device whose settings are being modified.
  * @transfer: adds a message to the controller's transfer queue.
+ * @transfer_sync: optionally runs a message of spi_sync() right away, in
+ *	the calling context
  * @cleanup: frees controller-specific state
  * @queued: whether this master is providing an internal message queue
  * @kworker: thread struct for message pump
@@ -338,6 +340,14 @@ struct spi_master {
 	int			(*transfer)(struct spi_device *spi,
 						struct spi_message *mesg);
 
+	/* Optional, for spi_sync(): process the message in the calling
+	 * context, which may sleep, and complete it before returning zero.
+	 * Returning -EAGAIN has the message go through transfer() instead,
+	 * as when the controller is busy.
+	 */
+	int			(*transfer_sync)(struct spi_device *spi,
+						struct spi_message *mesg);
+
 	/* called on release() to free memory provided by spi_master */
 	void			(*cleanup)(struct spi_device *spi);
 
@@ -277,6 +277,8 @@ struct tcp_sock {
 
 	int			linger2;
 
+	u32	notsent_lowat;	/* TCP_NOTSENT_LOWAT */
+
 /* Receiver side RTT estimation */
 	struct {
 		u32	rtt;
@@ -58,7 +58,9 @@ struct udp_sock {
 #define UDPLITE_SEND_CC  0x2  		/* set via udplite setsockopt         */
 #define UDPLITE_RECV_CC  0x4		/* set via udplite setsocktopt        */
 	__u8		 pcflag;        /* marks socket as UDP-Lite if > 0    */
-	__u8		 unused[3];
+	__u8		 gro_enabled:1;	/* may receive coalesced datagrams    */
+	__u8		 unused[2];
+	__u16		 gso_size;	/* segment size for UDP_SEGMENT       */
 	/*
 	 * For encapsulation sockets.
 	 */
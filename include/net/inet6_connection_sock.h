@@ -29,8 +29,7 @@ extern struct dst_entry* inet6_csk_route_req(struct sock *sk,
 					     struct flowi6 *fl6,
 					     const struct request_sock *req);
 
-extern struct request_sock *inet6_csk_search_req(const struct sock *sk,
-						 struct request_sock ***prevp,
+extern struct request_sock *inet6_csk_search_req(struct sock *sk,
 						 const __be16 rport,
 						 const struct in6_addr *raddr,
 						 const struct in6_addr *laddr,
@@ -50,6 +50,11 @@ struct request_sock_ops {
 };
 
 /* struct request_sock - mini sock to represent a connection request
+ *
+ * A request hashed by a listener lives in the reqchain of the established
+ * hash bucket of its four tuple, protected by the bucket lock, and holds a
+ * reference on its listener. @rsk_lock serializes its processing, so that
+ * SYN and ACK processing for a listener does not need the listener lock.
  */
 struct request_sock {
 	struct request_sock		*dl_next; /* Must be first member! */
@@ -65,14 +70,25 @@ struct request_sock {
 	struct sock			*sk;
 	u32				secid;
 	u32				peer_secid;
+	u32				rsk_hash;
+	atomic_t			rsk_refcnt;
+	spinlock_t			rsk_lock;
+	struct sock			*rsk_listener;
+	struct hlist_node		rsk_hash_node;
+	struct timer_list		rsk_timer;
 };
 
 static inline struct request_sock *reqsk_alloc(const struct request_sock_ops *ops)
 {
 	struct request_sock *req = kmem_cache_alloc(ops->slab, GFP_ATOMIC);
 
-	if (req != NULL)
+	if (req != NULL) {
 		req->rsk_ops = ops;
+		req->rsk_listener = NULL;
+		atomic_set(&req->rsk_refcnt, 1);
+		spin_lock_init(&req->rsk_lock);
+		INIT_HLIST_NODE(&req->rsk_hash_node);
+	}
 
 	return req;
 }
@@ -88,23 +104,23 @@ static inline void reqsk_free(struct request_sock *req)
 	__reqsk_free(req);
 }
 
-extern int sysctl_max_syn_backlog;
+static inline void reqsk_put(struct request_sock *req)
+{
+	if (atomic_dec_and_test(&req->rsk_refcnt)) {
+		struct sock *listener = req->rsk_listener;
 
-/** struct listen_sock - listen state
- *
- * @max_qlen_log - log_2 of maximal queued SYNs/REQUESTs
- */
-struct listen_sock {
-	u8			max_qlen_log;
-	u8			synflood_warned;
-	/* 2 bytes hole, try to use */
-	int			qlen;
-	int			qlen_young;
-	int			clock_hand;
-	u32			hash_rnd;
-	u32			nr_table_entries;
-	struct request_sock	*syn_table[0];
-};
+		reqsk_free(req);
+		if (listener)
+			sock_put(listener);
+	}
+}
+
+static inline bool reqsk_hashed(const struct request_sock *req)
+{
+	return !hlist_unhashed(&req->rsk_hash_node);
+}
+
+extern int sysctl_max_syn_backlog;
 
 /*
  * For a TCP Fast Open listener -
@@ -113,15 +129,12 @@ struct listen_sock {
  *	qlen - pending TFO requests (still in TCP_SYN_RECV).
  *	max_qlen - max TFO reqs allowed before TFO is disabled.
  *
- *	XXX (TFO) - ideally these fields can be made as part of "listen_sock"
- *	structure above. But there is some implementation difficulty due to
- *	listen_sock being part of request_sock_queue hence will be freed when
- *	a listener is stopped. But TFO related fields may continue to be
+ *	XXX (TFO) - ideally these fields can be made as part of
+ *	"request_sock_queue" below. TFO related fields may continue to be
  *	accessed even after a listener is closed, until its sk_refcnt drops
- *	to 0 implying no more outstanding TFO reqs. One solution is to keep
- *	listen_opt around until	sk_refcnt drops to 0. But there is some other
- *	complexity that needs to be resolved. E.g., a listener can be disabled
- *	temporarily through shutdown()->tcp_disconnect(), and re-enabled later.
+ *	to 0 implying no more outstanding TFO reqs, and a listener can be
+ *	disabled temporarily through shutdown()->tcp_disconnect(), and
+ *	re-enabled later, so this needs some care.
  */
 struct fastopen_queue {
 	struct request_sock	*rskq_rst_head; /* Keep track of past TFO */
@@ -138,25 +151,29 @@ struct fastopen_queue {
  *
  * @rskq_accept_head - FIFO head of established children
  * @rskq_accept_tail - FIFO tail of established children
+ * @rskq_lock - serializer of the accept FIFO and sk_ack_backlog
  * @rskq_defer_accept - User waits for some data after accept()
- * @syn_wait_lock - serializer
- *
- * %syn_wait_lock is necessary only to avoid proc interface having to grab the main
- * lock sock while browsing the listening hash (otherwise it's deadlock prone).
+ * @max_qlen_log - log_2 of maximal queued SYNs/REQUESTs
+ * @qlen - number of requests hashed for this listener
+ * @young - number of those requests whose SYN-ACK was never retransmitted
  *
- * This lock is acquired in read mode only from listening_get_next() seq_file
- * op and it's acquired in write mode _only_ from code that is actively
- * changing rskq_accept_head. All readers that are holding the master sock lock
- * don't need to grab this lock in read mode too as rskq_accept_head. writes
- * are always protected from the main sock lock.
+ * The requests themselves live in the established hash (see struct
+ * inet_ehash_bucket), the listener only keeps count of them, so SYNs and
+ * ACKs for a listener are processed without its socket lock. %rskq_lock
+ * is taken by softirqs adding children and by accept() removing them.
+ * Requests of a previous listen() may still be around when the socket
+ * listens again, so the lock is set up once, when the socket is created.
  */
 struct request_sock_queue {
 	struct request_sock	*rskq_accept_head;
 	struct request_sock	*rskq_accept_tail;
-	rwlock_t		syn_wait_lock;
+	spinlock_t		rskq_lock;
 	u8			rskq_defer_accept;
-	/* 3 bytes hole, try to pack */
-	struct listen_sock	*listen_opt;
+	u8			max_qlen_log;
+	u8			synflood_warned;
+	/* 1 byte hole, try to pack */
+	atomic_t		qlen;
+	atomic_t		young;
 	struct fastopen_queue	*fastopenq; /* This is non-NULL iff TFO has been
 					     * enabled on this listener. Check
 					     * max_qlen != 0 in fastopen_queue
@@ -165,20 +182,21 @@ struct request_sock_queue {
 					     */
 };
 
-extern int reqsk_queue_alloc(struct request_sock_queue *queue,
-			     unsigned int nr_table_entries);
+extern void reqsk_queue_alloc(struct request_sock_queue *queue,
+			      unsigned int nr_table_entries);
 
-extern void __reqsk_queue_destroy(struct request_sock_queue *queue);
-extern void reqsk_queue_destroy(struct request_sock_queue *queue);
 extern void reqsk_fastopen_remove(struct sock *sk,
 				  struct request_sock *req, bool reset);
 
 static inline struct request_sock *
 	reqsk_queue_yank_acceptq(struct request_sock_queue *queue)
 {
-	struct request_sock *req = queue->rskq_accept_head;
+	struct request_sock *req;
 
+	spin_lock_bh(&queue->rskq_lock);
+	req = queue->rskq_accept_head;
 	queue->rskq_accept_head = NULL;
+	spin_unlock_bh(&queue->rskq_lock);
 	return req;
 }
 
@@ -187,95 +205,51 @@ static inline int reqsk_queue_empty(struct request_sock_queue *queue)
 	return queue->rskq_accept_head == NULL;
 }
 
-static inline void reqsk_queue_unlink(struct request_sock_queue *queue,
-				      struct request_sock *req,
-				      struct request_sock **prev_req)
-{
-	write_lock(&queue->syn_wait_lock);
-	*prev_req = req->dl_next;
-	write_unlock(&queue->syn_wait_lock);
-}
-
-static inline void reqsk_queue_add(struct request_sock_queue *queue,
-				   struct request_sock *req,
-				   struct sock *parent,
-				   struct sock *child)
-{
-	req->sk = child;
-	sk_acceptq_added(parent);
-
-	if (queue->rskq_accept_head == NULL)
-		queue->rskq_accept_head = req;
-	else
-		queue->rskq_accept_tail->dl_next = req;
-
-	queue->rskq_accept_tail = req;
-	req->dl_next = NULL;
-}
-
-static inline struct request_sock *reqsk_queue_remove(struct request_sock_queue *queue)
+static inline struct request_sock *reqsk_queue_remove(struct request_sock_queue *queue,
+						      struct sock *parent)
 {
-	struct request_sock *req = queue->rskq_accept_head;
+	struct request_sock *req;
 
+	spin_lock_bh(&queue->rskq_lock);
+	req = queue->rskq_accept_head;
 	WARN_ON(req == NULL);
 
 	queue->rskq_accept_head = req->dl_next;
 	if (queue->rskq_accept_head == NULL)
 		queue->rskq_accept_tail = NULL;
+	sk_acceptq_removed(parent);
+	spin_unlock_bh(&queue->rskq_lock);
 
 	return req;
 }
 
-static inline int reqsk_queue_removed(struct request_sock_queue *queue,
-				      struct request_sock *req)
+static inline void reqsk_queue_removed(struct request_sock_queue *queue,
+				       const struct request_sock *req)
 {
-	struct listen_sock *lopt = queue->listen_opt;
-
 	if (req->retrans == 0)
-		--lopt->qlen_young;
-
-	return --lopt->qlen;
+		atomic_dec(&queue->young);
+	atomic_dec(&queue->qlen);
 }
 
-static inline int reqsk_queue_added(struct request_sock_queue *queue)
+static inline void reqsk_queue_added(struct request_sock_queue *queue)
 {
-	struct listen_sock *lopt = queue->listen_opt;
-	const int prev_qlen = lopt->qlen;
-
-	lopt->qlen_young++;
-	lopt->qlen++;
-	return prev_qlen;
+	atomic_inc(&queue->young);
+	atomic_inc(&queue->qlen);
 }
 
 static inline int reqsk_queue_len(const struct request_sock_queue *queue)
 {
-	return queue->listen_opt != NULL ? queue->listen_opt->qlen : 0;
+	return atomic_read(&queue->qlen);
 }
 
 static inline int reqsk_queue_len_young(const struct request_sock_queue *queue)
 {
-	return queue->listen_opt->qlen_young;
+	return atomic_read(&queue->young);
 }
 
 static inline int reqsk_queue_is_full(const struct request_sock_queue *queue)
 {
-	return queue->listen_opt->qlen >> queue->listen_opt->max_qlen_log;
-}
-
-static inline void reqsk_queue_hash_req(struct request_sock_queue *queue,
-					u32 hash, struct request_sock *req,
-					unsigned long timeout)
-{
-	struct listen_sock *lopt = queue->listen_opt;
-
-	req->expires = jiffies + timeout;
-	req->retrans = 0;
-	req->sk = NULL;
-	req->dl_next = lopt->syn_table[hash];
-
-	write_lock(&queue->syn_wait_lock);
-	lopt->syn_table[hash] = req;
-	write_unlock(&queue->syn_wait_lock);
+	return reqsk_queue_len(queue) >> queue->max_qlen_log;
 }
 
 #endif /* _REQUEST_SOCK_H */
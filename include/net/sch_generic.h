@@ -25,6 +25,8 @@ enum qdisc_state_t {
 	__QDISC_STATE_SCHED,
 	__QDISC_STATE_DEACTIVATED,
 	__QDISC_STATE_THROTTLED,
+	__QDISC_STATE_RUNNING,
+	__QDISC_STATE_MISSED,
 };
 
 /*
@@ -50,6 +52,7 @@ struct Qdisc {
 #define TCQ_F_INGRESS		2
 #define TCQ_F_CAN_BYPASS	4
 #define TCQ_F_MQROOT		8
+#define TCQ_F_NOLOCK		16 /* qdisc does not require locking */
 #define TCQ_F_WARN_NONWC	(1 << 16)
 	int			padded;
 	const struct Qdisc_ops	*ops;
@@ -72,6 +75,7 @@ struct Qdisc {
 	struct Qdisc		*next_sched;
 
 	struct sk_buff		*gso_skb;
+	struct sk_buff_head	bulk_q;		/* dequeued but not yet sent */
 	/*
 	 * For performance sake on SMP, we put highly modified fields at the end
 	 */
@@ -87,11 +91,26 @@ struct Qdisc {
 
 static inline bool qdisc_is_running(const struct Qdisc *qdisc)
 {
+	if (qdisc->flags & TCQ_F_NOLOCK)
+		return test_bit(__QDISC_STATE_RUNNING, &qdisc->state);
 	return (qdisc->__state & __QDISC___STATE_RUNNING) ? true : false;
 }
 
+/*
+ * A TCQ_F_NOLOCK qdisc is run without its root lock, so ownership is
+ * taken with an atomic bit instead. A CPU that loses the race leaves
+ * __QDISC_STATE_MISSED behind; the owner reschedules the qdisc if it
+ * finds it set on the way out, so a packet enqueued just as the owner
+ * found the queue empty is not left behind.
+ */
 static inline bool qdisc_run_begin(struct Qdisc *qdisc)
 {
+	if (qdisc->flags & TCQ_F_NOLOCK) {
+		if (!test_and_set_bit(__QDISC_STATE_RUNNING, &qdisc->state))
+			return true;
+		set_bit(__QDISC_STATE_MISSED, &qdisc->state);
+		return !test_and_set_bit(__QDISC_STATE_RUNNING, &qdisc->state);
+	}
 	if (qdisc_is_running(qdisc))
 		return false;
 	qdisc->__state |= __QDISC___STATE_RUNNING;
@@ -100,9 +119,31 @@ static inline bool qdisc_run_begin(struct Qdisc *qdisc)
 
 static inline void qdisc_run_end(struct Qdisc *qdisc)
 {
+	if (qdisc->flags & TCQ_F_NOLOCK) {
+		smp_mb__before_clear_bit();
+		clear_bit(__QDISC_STATE_RUNNING, &qdisc->state);
+		smp_mb__after_clear_bit();
+		if (unlikely(test_and_clear_bit(__QDISC_STATE_MISSED,
+						&qdisc->state)))
+			__netif_schedule(qdisc);
+		return;
+	}
 	qdisc->__state &= ~__QDISC___STATE_RUNNING;
 }
 
+/*
+ * Number of bytes the driver of @txq can take right now, as tracked by BQL.
+ * Drivers that do not use BQL report nothing, and are fed one skb at a time.
+ */
+static inline int qdisc_avail_bulklimit(const struct netdev_queue *txq)
+{
+#ifdef CONFIG_BQL
+	return dql_avail(&txq->dql);
+#else
+	return 0;
+#endif
+}
+
 static inline bool qdisc_is_throttled(const struct Qdisc *qdisc)
 {
 	return test_bit(__QDISC_STATE_THROTTLED, &qdisc->state) ? true : false;
@@ -163,6 +204,8 @@ struct Qdisc_ops {
 	void			(*destroy)(struct Qdisc *);
 	int			(*change)(struct Qdisc *, struct nlattr *arg);
 	void			(*attach)(struct Qdisc *);
+	int			(*change_tx_queue_len)(struct Qdisc *,
+						       unsigned int);
 
 	int			(*dump)(struct Qdisc *, struct sk_buff *);
 	int			(*dump_stats)(struct Qdisc *, struct gnet_dump *);
@@ -307,6 +350,7 @@ static inline void sch_tree_unlock(const struct Qdisc *q)
 extern struct Qdisc noop_qdisc;
 extern struct Qdisc_ops noop_qdisc_ops;
 extern struct Qdisc_ops pfifo_fast_ops;
+extern struct Qdisc_ops pfifo_ring_ops;
 extern struct Qdisc_ops mq_qdisc_ops;
 
 struct Qdisc_class_common {
@@ -354,6 +398,7 @@ extern void dev_shutdown(struct net_device *dev);
 extern void dev_activate(struct net_device *dev);
 extern void dev_deactivate(struct net_device *dev);
 extern void dev_deactivate_many(struct list_head *head);
+extern int dev_qdisc_change_tx_queue_len(struct net_device *dev);
 extern struct Qdisc *dev_graft_qdisc(struct netdev_queue *dev_queue,
 				     struct Qdisc *qdisc);
 extern void qdisc_reset(struct Qdisc *qdisc);
@@ -31,6 +31,7 @@
 #include <linux/ipv6.h>
 #include <linux/seq_file.h>
 #include <linux/poll.h>
+#include <linux/static_key.h>
 
 /**
  *	struct udp_skb_cb  -  UDP(-Lite) private variables
@@ -267,7 +268,86 @@ extern void udp_init(void);
 extern int udp4_ufo_send_check(struct sk_buff *skb);
 extern struct sk_buff *udp4_ufo_fragment(struct sk_buff *skb,
 	netdev_features_t features);
+extern struct sk_buff *__udp_gso_segment(struct sk_buff *gso_skb,
+	netdev_features_t features);
 extern void udp_encap_enable(void);
+
+/* UDP GSO, see Documentation/networking/udp-gso.txt */
+#define UDP_MAX_SEGMENTS	64
+
+extern int udp_cmsg_send(struct sock *sk, struct msghdr *msg, u16 *gso_size);
+
+/* UDP GRO, see Documentation/networking/udp-gro.txt */
+#define UDP_GRO_CNT_MAX		64
+
+extern struct static_key udp_gro_needed;
+extern struct sk_buff **udp_gro_receive(struct sk_buff **head,
+					struct sk_buff *skb,
+					struct udphdr *uh);
+extern int udp_gro_complete(struct sk_buff *skb);
+extern struct sk_buff **udp4_gro_receive(struct sk_buff **head,
+					 struct sk_buff *skb);
+extern int udp4_gro_complete(struct sk_buff *skb);
+
+/* Only sockets with UDP_GRO set expect coalesced datagrams. The option
+ * may have been cleared while packets were in flight, and encapsulation
+ * handlers always parse one datagram at a time. UFO packets, as from
+ * virtio_net or tun, carry a single large datagram and are left alone.
+ */
+static inline bool udp_unexpected_gso(struct sock *sk, struct sk_buff *skb)
+{
+	return skb_is_gso(skb) &&
+	       (skb_shinfo(skb)->gso_type & SKB_GSO_UDP_L4) &&
+	       (!udp_sk(sk)->gro_enabled || udp_sk(sk)->encap_type);
+}
+
+/**
+ *	udp_rcv_segment  -  split a coalesced datagram back up
+ *	@sk:	socket the datagrams are delivered to
+ *	@skb:	GRO packet, data pointing at the UDP header
+ *	@ipv4:	address family of @skb
+ *
+ *	Returns the list of datagrams, data again pointing at the UDP
+ *	header, or NULL when @skb had to be dropped. @skb is consumed.
+ */
+static inline struct sk_buff *udp_rcv_segment(struct sock *sk,
+					      struct sk_buff *skb, bool ipv4)
+{
+	struct sk_buff *segs, *seg;
+
+	__skb_push(skb, skb->data - skb_mac_header(skb));
+	segs = skb_gso_segment(skb, NETIF_F_SG | NETIF_F_HW_CSUM);
+	if (IS_ERR_OR_NULL(segs)) {
+		int segs_nr = skb_shinfo(skb)->gso_segs;
+
+		atomic_add(segs_nr, &sk->sk_drops);
+		if (ipv4)
+			UDP_INC_STATS_BH(sock_net(sk), UDP_MIB_INERRORS,
+					 IS_UDPLITE(sk));
+		else
+			UDP6_INC_STATS_BH(sock_net(sk), UDP_MIB_INERRORS,
+					  IS_UDPLITE(sk));
+		kfree_skb(skb);
+		return NULL;
+	}
+
+	consume_skb(skb);
+	for (seg = segs; seg; seg = seg->next)
+		__skb_pull(seg, skb_transport_offset(seg));
+	return segs;
+}
+
+/* Tell a UDP_GRO socket the size of the datagrams a packet coalesces */
+static inline void udp_cmsg_recv(struct msghdr *msg, struct sock *sk,
+				 struct sk_buff *skb)
+{
+	int gso_size;
+
+	if (skb_shinfo(skb)->gso_type & SKB_GSO_UDP_L4) {
+		gso_size = skb_shinfo(skb)->gso_size;
+		put_cmsg(msg, SOL_UDP, UDP_GRO, sizeof(gso_size), &gso_size);
+	}
+}
 #if IS_ENABLED(CONFIG_IPV6)
 extern void udpv6_encap_enable(void);
 #endif
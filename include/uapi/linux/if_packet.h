@@ -50,10 +50,15 @@ struct sockaddr_ll {
 #define PACKET_TX_TIMESTAMP		16
 #define PACKET_TIMESTAMP		17
 #define PACKET_FANOUT			18
+#define PACKET_FANOUT_STATS		32
 
 #define PACKET_FANOUT_HASH		0
 #define PACKET_FANOUT_LB		1
 #define PACKET_FANOUT_CPU		2
+#define PACKET_FANOUT_ROLLOVER		3
+#define PACKET_FANOUT_RND		4
+#define PACKET_FANOUT_QM		5
+#define PACKET_FANOUT_FLAG_ROLLOVER	0x1000
 #define PACKET_FANOUT_FLAG_DEFRAG	0x8000
 
 struct tpacket_stats {
@@ -72,6 +77,13 @@ union tpacket_stats_u {
 	struct tpacket_stats_v3 stats3;
 };
 
+/* Per member counters of a fanout group, never reset */
+struct tpacket_fanout_stats {
+	__aligned_u64	tp_delivered;	/* handed to this member */
+	__aligned_u64	tp_dropped;	/* of those, dropped by this member */
+	__aligned_u64	tp_rollover;	/* moved on to another member */
+};
+
 struct tpacket_auxdata {
 	__u32		tp_status;
 	__u32		tp_len;
@@ -245,6 +245,14 @@ enum
 	LINUX_MIB_TCPFASTOPENPASSIVEFAIL,	/* TCPFastOpenPassiveFail */
 	LINUX_MIB_TCPFASTOPENLISTENOVERFLOW,	/* TCPFastOpenListenOverflow */
 	LINUX_MIB_TCPFASTOPENCOOKIEREQD,	/* TCPFastOpenCookieReqd */
+	LINUX_MIB_BUSYPOLLRXPACKETS,		/* BusyPollRxPackets */
+	LINUX_MIB_BUSYPOLLHITS,			/* BusyPollHits */
+	LINUX_MIB_BUSYPOLLMISSES,		/* BusyPollMisses */
+	LINUX_MIB_BUSYPOLLUSECS,		/* BusyPollUsecs */
+	LINUX_MIB_TCPREQTIMEOUT,		/* TCPReqTimeout */
+	LINUX_MIB_TCPREQRETRANS,		/* TCPReqRetrans */
+	LINUX_MIB_TCPREQLISTENERCLOSED,		/* TCPReqListenerClosed */
+	LINUX_MIB_TCPREQRACE,			/* TCPReqRace */
 	__LINUX_MIB_MAX
 };
 
@@ -61,3 +61,12 @@ SCHED_FEAT(TTWU_QUEUE, true)
 SCHED_FEAT(FORCE_SD_OVERLAP, false)
 SCHED_FEAT(RT_RUNTIME_SHARE, true)
 SCHED_FEAT(LB_MIN, false)
+
+#ifdef CONFIG_NUMA_BALANCING
+/*
+ * Let the load balancer move a task to its preferred node even if it is
+ * cache hot, and treat it as cache hot when it would leave that node.
+ */
+SCHED_FEAT(NUMA_FAVOUR_HIGHER, true)
+SCHED_FEAT(NUMA_RESIST_LOWER, true)
+#endif
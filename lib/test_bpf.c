@@ -0,0 +1,525 @@
+/*
+ * Testsuite for BPF interpreter and BPF JIT compiler
+ *
+ * Every classic filter below goes through sk_unattached_filter_create(),
+ * so it is translated to internal BPF and run by the interpreter, or by
+ * the JIT when net.core.bpf_jit_enable is set. Load the module once with
+ * the JIT disabled and once with it enabled to compare the ns per run
+ * reported for each test.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of version 2 of the GNU General Public
+ * License as published by the Free Software Foundation.
+ */
+
+#define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
+
+#include <linux/init.h>
+#include <linux/module.h>
+#include <linux/filter.h>
+#include <linux/skbuff.h>
+#include <linux/netdevice.h>
+#include <linux/if_ether.h>
+#include <linux/if_packet.h>
+#include <linux/ktime.h>
+#include <linux/slab.h>
+
+#define MAX_SUBTESTS	3
+#define MAX_DATA	128
+#define MAX_INSNS	64
+#define MAX_RUNS	100000
+
+#define SKB_MARK	0x1234aaaa
+#define SKB_HASH	0x1234aaab
+#define SKB_QUEUE_MAP	123
+
+enum {
+	CLASSIC = 0,
+	INTERNAL = 1,
+};
+
+struct bpf_test {
+	const char *descr;
+	union {
+		struct sock_filter insns[MAX_INSNS];
+		struct sock_filter_int insns_int[MAX_INSNS];
+	} u;
+	int aux;
+	u8 data[MAX_DATA];
+	struct {
+		int data_size;
+		u32 result;
+	} test[MAX_SUBTESTS];
+};
+
+/* Ethernet, IPv4 and TCP headers of a segment from 10.1.1.1 to port 22 */
+#define TCP_FRAME(dport)						\
+	{ 0x00, 0x11, 0x22, 0x33, 0x44, 0x55,				\
+	  0x00, 0x66, 0x77, 0x88, 0x99, 0xaa, 0x08, 0x00,		\
+	  0x45, 0x00, 0x00, 0x28, 0x00, 0x01, 0x00, 0x00,		\
+	  0x40, 0x06, 0x00, 0x00, 0x0a, 0x01, 0x01, 0x01,		\
+	  0xc0, 0xa8, 0x00, 0x01, 0x9c, 0x40, 0x00, (dport),		\
+	  0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00,		\
+	  0x50, 0x02, 0x20, 0x00, 0x00, 0x00, 0x00, 0x00 }
+
+/* Ethernet, IPv4 and UDP headers of a datagram to port 53 */
+#define UDP_FRAME							\
+	{ 0x00, 0x11, 0x22, 0x33, 0x44, 0x55,				\
+	  0x00, 0x66, 0x77, 0x88, 0x99, 0xaa, 0x08, 0x00,		\
+	  0x45, 0x00, 0x00, 0x1c, 0x00, 0x01, 0x00, 0x00,		\
+	  0x40, 0x11, 0x00, 0x00, 0xc0, 0xa8, 0x00, 0x02,		\
+	  0x08, 0x08, 0x08, 0x08, 0xd4, 0x31, 0x00, 0x35,		\
+	  0x00, 0x08, 0x00, 0x00 }
+
+/* tcpdump -dd 'ip and tcp dst port 22' */
+#define TCP_DPORT_22							\
+	BPF_STMT(BPF_LD | BPF_H | BPF_ABS, 12),				\
+	BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, ETH_P_IP, 0, 8),		\
+	BPF_STMT(BPF_LD | BPF_B | BPF_ABS, 23),				\
+	BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, 6, 0, 6),			\
+	BPF_STMT(BPF_LD | BPF_H | BPF_ABS, 20),				\
+	BPF_JUMP(BPF_JMP | BPF_JSET | BPF_K, 0x1fff, 4, 0),		\
+	BPF_STMT(BPF_LDX | BPF_B | BPF_MSH, 14),			\
+	BPF_STMT(BPF_LD | BPF_H | BPF_IND, 16),				\
+	BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, 22, 0, 1),			\
+	BPF_STMT(BPF_RET | BPF_K, 0xffff),				\
+	BPF_STMT(BPF_RET | BPF_K, 0)
+
+static struct bpf_test tests[] = {
+	{
+		"tcp dst port 22",
+		.u.insns = { TCP_DPORT_22 },
+		CLASSIC,
+		TCP_FRAME(22),
+		{ { 54, 0xffff }, { 30, 0 } }
+	},
+	{
+		"tcp dst port 22, other port",
+		.u.insns = { TCP_DPORT_22 },
+		CLASSIC,
+		TCP_FRAME(80),
+		{ { 54, 0 } }
+	},
+	{
+		"tcp dst port 22, udp",
+		.u.insns = { TCP_DPORT_22 },
+		CLASSIC,
+		UDP_FRAME,
+		{ { 42, 0 } }
+	},
+	{
+		/* tcpdump -dd 'ip and udp dst port 53' */
+		"udp dst port 53",
+		.u.insns = {
+			BPF_STMT(BPF_LD | BPF_H | BPF_ABS, 12),
+			BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, ETH_P_IP, 0, 8),
+			BPF_STMT(BPF_LD | BPF_B | BPF_ABS, 23),
+			BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, 17, 0, 6),
+			BPF_STMT(BPF_LD | BPF_H | BPF_ABS, 20),
+			BPF_JUMP(BPF_JMP | BPF_JSET | BPF_K, 0x1fff, 4, 0),
+			BPF_STMT(BPF_LDX | BPF_B | BPF_MSH, 14),
+			BPF_STMT(BPF_LD | BPF_H | BPF_IND, 16),
+			BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, 53, 0, 1),
+			BPF_STMT(BPF_RET | BPF_K, 0xffff),
+			BPF_STMT(BPF_RET | BPF_K, 0),
+		},
+		CLASSIC,
+		UDP_FRAME,
+		{ { 42, 0xffff }, { 20, 0 } }
+	},
+	{
+		/* tcpdump -dd 'arp' */
+		"arp",
+		.u.insns = {
+			BPF_STMT(BPF_LD | BPF_H | BPF_ABS, 12),
+			BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, ETH_P_ARP, 0, 1),
+			BPF_STMT(BPF_RET | BPF_K, 0xffff),
+			BPF_STMT(BPF_RET | BPF_K, 0),
+		},
+		CLASSIC,
+		TCP_FRAME(22),
+		{ { 54, 0 } }
+	},
+	{
+		/* tcpdump -dd 'src net 10.0.0.0/8' */
+		"src net 10.0.0.0/8",
+		.u.insns = {
+			BPF_STMT(BPF_LD | BPF_H | BPF_ABS, 12),
+			BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, ETH_P_IP, 0, 4),
+			BPF_STMT(BPF_LD | BPF_W | BPF_ABS, 26),
+			BPF_STMT(BPF_ALU | BPF_AND | BPF_K, 0xff000000),
+			BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, 0x0a000000, 0, 1),
+			BPF_STMT(BPF_RET | BPF_K, 0xffff),
+			BPF_STMT(BPF_RET | BPF_K, 0),
+		},
+		CLASSIC,
+		TCP_FRAME(22),
+		{ { 54, 0xffff } }
+	},
+	{
+		"ALU",
+		.u.insns = {
+			BPF_STMT(BPF_LD | BPF_IMM, 10),
+			BPF_STMT(BPF_LDX | BPF_IMM, 3),
+			BPF_STMT(BPF_ALU | BPF_SUB | BPF_X, 0),
+			BPF_STMT(BPF_ALU | BPF_ADD | BPF_K, 2),
+			BPF_STMT(BPF_ALU | BPF_MUL | BPF_X, 0),
+			BPF_STMT(BPF_ALU | BPF_DIV | BPF_K, 2),
+			BPF_STMT(BPF_ALU | BPF_MOD | BPF_K, 5),
+			BPF_STMT(BPF_ALU | BPF_LSH | BPF_K, 4),
+			BPF_STMT(BPF_ALU | BPF_OR | BPF_K, 1),
+			BPF_STMT(BPF_ALU | BPF_XOR | BPF_X, 0),
+			BPF_STMT(BPF_ALU | BPF_AND | BPF_K, 0xfe),
+			BPF_STMT(BPF_ALU | BPF_NEG, 0),
+			BPF_STMT(BPF_RET | BPF_A, 0),
+		},
+		CLASSIC,
+		{ },
+		{ { 1, 0xffffffce } }
+	},
+	{
+		"DIV by zero X",
+		.u.insns = {
+			BPF_STMT(BPF_LD | BPF_IMM, 1),
+			BPF_STMT(BPF_LDX | BPF_IMM, 0),
+			BPF_STMT(BPF_ALU | BPF_DIV | BPF_X, 0),
+			BPF_STMT(BPF_RET | BPF_K, 1),
+		},
+		CLASSIC,
+		{ },
+		{ { 1, 0 } }
+	},
+	{
+		"scratch memory",
+		.u.insns = {
+			BPF_STMT(BPF_LD | BPF_IMM, 5),
+			BPF_STMT(BPF_ST, 0),
+			BPF_STMT(BPF_LD | BPF_IMM, 7),
+			BPF_STMT(BPF_ST, 15),
+			BPF_STMT(BPF_LDX | BPF_MEM, 0),
+			BPF_STMT(BPF_LD | BPF_MEM, 15),
+			BPF_STMT(BPF_ALU | BPF_ADD | BPF_X, 0),
+			BPF_STMT(BPF_MISC | BPF_TAX, 0),
+			BPF_STMT(BPF_LD | BPF_IMM, 0),
+			BPF_STMT(BPF_MISC | BPF_TXA, 0),
+			BPF_STMT(BPF_RET | BPF_A, 0),
+		},
+		CLASSIC,
+		{ },
+		{ { 1, 12 } }
+	},
+	{
+		"unsigned and bit test jumps",
+		.u.insns = {
+			BPF_STMT(BPF_LDX | BPF_LEN, 0),
+			BPF_STMT(BPF_LD | BPF_B | BPF_ABS, 1),
+			BPF_JUMP(BPF_JMP | BPF_JGT | BPF_X, 0, 1, 0),
+			BPF_STMT(BPF_RET | BPF_K, 1),
+			BPF_JUMP(BPF_JMP | BPF_JGE | BPF_K, 0x80, 1, 0),
+			BPF_STMT(BPF_RET | BPF_K, 2),
+			BPF_JUMP(BPF_JMP | BPF_JSET | BPF_X, 0, 1, 0),
+			BPF_STMT(BPF_RET | BPF_K, 3),
+			BPF_STMT(BPF_RET | BPF_K, 4),
+		},
+		CLASSIC,
+		{ 0x00, 0xf0 },
+		{ { 2, 3 }, { MAX_DATA, 4 } }
+	},
+	{
+		"load beyond the packet",
+		.u.insns = {
+			BPF_STMT(BPF_LD | BPF_H | BPF_ABS, 1000),
+			BPF_STMT(BPF_RET | BPF_K, 1),
+		},
+		CLASSIC,
+		TCP_FRAME(22),
+		{ { 54, 0 } }
+	},
+	{
+		"network and link layer offsets",
+		.u.insns = {
+			BPF_STMT(BPF_LD | BPF_B | BPF_ABS, SKF_NET_OFF + 9),
+			BPF_STMT(BPF_MISC | BPF_TAX, 0),
+			BPF_STMT(BPF_LD | BPF_H | BPF_ABS, SKF_LL_OFF + 12),
+			BPF_STMT(BPF_ALU | BPF_ADD | BPF_X, 0),
+			BPF_STMT(BPF_RET | BPF_A, 0),
+		},
+		CLASSIC,
+		TCP_FRAME(22),
+		{ { 54, ETH_P_IP + 6 } }
+	},
+	{
+		"ancillary protocol, pkttype and queue",
+		.u.insns = {
+			BPF_STMT(BPF_LD | BPF_W | BPF_ABS,
+				 SKF_AD_OFF + SKF_AD_PROTOCOL),
+			BPF_STMT(BPF_MISC | BPF_TAX, 0),
+			BPF_STMT(BPF_LD | BPF_W | BPF_ABS,
+				 SKF_AD_OFF + SKF_AD_PKTTYPE),
+			BPF_STMT(BPF_ALU | BPF_ADD | BPF_X, 0),
+			BPF_STMT(BPF_MISC | BPF_TAX, 0),
+			BPF_STMT(BPF_LD | BPF_W | BPF_ABS,
+				 SKF_AD_OFF + SKF_AD_QUEUE),
+			BPF_STMT(BPF_ALU | BPF_ADD | BPF_X, 0),
+			BPF_STMT(BPF_RET | BPF_A, 0),
+		},
+		CLASSIC,
+		{ },
+		{ { 1, ETH_P_IP + PACKET_OTHERHOST + SKB_QUEUE_MAP } }
+	},
+	{
+		"ancillary mark and rxhash",
+		.u.insns = {
+			BPF_STMT(BPF_LD | BPF_W | BPF_ABS,
+				 SKF_AD_OFF + SKF_AD_MARK),
+			BPF_STMT(BPF_MISC | BPF_TAX, 0),
+			BPF_STMT(BPF_LD | BPF_W | BPF_ABS,
+				 SKF_AD_OFF + SKF_AD_RXHASH),
+			BPF_STMT(BPF_LD | BPF_W | BPF_ABS,
+				 SKF_AD_OFF + SKF_AD_ALU_XOR_X),
+			BPF_STMT(BPF_RET | BPF_A, 0),
+		},
+		CLASSIC,
+		{ },
+		{ { 1, SKB_MARK ^ SKB_HASH } }
+	},
+	{
+		"ancillary ifindex without device",
+		.u.insns = {
+			BPF_STMT(BPF_LD | BPF_W | BPF_ABS,
+				 SKF_AD_OFF + SKF_AD_IFINDEX),
+			BPF_STMT(BPF_RET | BPF_K, 1),
+		},
+		CLASSIC,
+		{ },
+		{ { 1, 0 } }
+	},
+	{
+		"INT: 64-bit ALU, stack and signed jumps",
+		.u.insns_int = {
+			BPF_MOV64_IMM(BPF_REG_0, 1),
+			BPF_ALU64_IMM(BPF_LSH, BPF_REG_0, 40),
+			BPF_MOV64_IMM(BPF_REG_1, -16),
+			BPF_ALU64_IMM(BPF_ARSH, BPF_REG_1, 2),
+			BPF_STX_MEM(BPF_DW, BPF_REG_10, BPF_REG_0, -8),
+			BPF_LDX_MEM(BPF_DW, BPF_REG_2, BPF_REG_10, -8),
+			BPF_JMP_IMM(BPF_JSGT, BPF_REG_1, 0, 6),
+			BPF_JMP_REG(BPF_JSGE, BPF_REG_1, BPF_REG_2, 5),
+			BPF_JMP_IMM(BPF_JNE, BPF_REG_1, -4, 4),
+			BPF_ALU64_IMM(BPF_RSH, BPF_REG_2, 32),
+			BPF_ALU64_REG(BPF_SUB, BPF_REG_2, BPF_REG_1),
+			BPF_MOV32_REG(BPF_REG_0, BPF_REG_2),
+			BPF_EXIT_INSN(),
+			BPF_MOV32_IMM(BPF_REG_0, 0),
+			BPF_EXIT_INSN(),
+		},
+		INTERNAL,
+		{ },
+		{ { 1, 260 } }
+	},
+	{
+		"INT: xadd, multiply, divide and byte swap",
+		.u.insns_int = {
+			BPF_ST_MEM(BPF_DW, BPF_REG_10, -16, 10),
+			BPF_MOV64_IMM(BPF_REG_3, 5),
+			BPF_RAW_INSN(BPF_STX | BPF_XADD | BPF_DW, BPF_REG_10,
+				     BPF_REG_3, -16, 0),
+			BPF_LDX_MEM(BPF_DW, BPF_REG_4, BPF_REG_10, -16),
+			BPF_ALU64_IMM(BPF_MUL, BPF_REG_4, 1000),
+			BPF_MOV64_IMM(BPF_REG_5, 7),
+			BPF_ALU64_REG(BPF_DIV, BPF_REG_4, BPF_REG_5),
+			BPF_ALU64_IMM(BPF_MOD, BPF_REG_4, 1000),
+			BPF_MOV32_IMM(BPF_REG_0, 0x1234),
+			BPF_ENDIAN(BPF_TO_BE, BPF_REG_0, 16),
+			BPF_ALU64_IMM(BPF_LSH, BPF_REG_0, 16),
+			BPF_ALU64_REG(BPF_OR, BPF_REG_0, BPF_REG_4),
+			BPF_EXIT_INSN(),
+		},
+		INTERNAL,
+		{ },
+		{ { 1, ((u32)__constant_htons(0x1234) << 16) | 142 } }
+	},
+};
+
+static int get_length(struct bpf_test *test)
+{
+	int len;
+
+	for (len = MAX_INSNS - 1; len > 0; --len) {
+		if (test->aux == INTERNAL) {
+			if (test->u.insns_int[len].code ||
+			    test->u.insns_int[len].imm)
+				break;
+		} else {
+			if (test->u.insns[len].code || test->u.insns[len].k)
+				break;
+		}
+	}
+
+	return len + 1;
+}
+
+static struct sk_filter *generate_filter(struct bpf_test *test)
+{
+	struct sk_filter *fp;
+	struct sock_fprog fprog;
+	int len = get_length(test);
+	int err;
+
+	if (test->aux == CLASSIC) {
+		fprog.filter = test->u.insns;
+		fprog.len = len;
+
+		err = sk_unattached_filter_create(&fp, &fprog);
+		if (err) {
+			pr_cont("FAIL to attach err=%d len=%d\n", err, len);
+			return NULL;
+		}
+		return fp;
+	}
+
+	fp = kzalloc(sizeof(*fp) + len * sizeof(struct sock_filter_int),
+		     GFP_KERNEL);
+	if (!fp) {
+		pr_cont("UNEXPECTED_FAIL no memory left\n");
+		return NULL;
+	}
+
+	atomic_set(&fp->refcnt, 1);
+	fp->len = len;
+	memcpy(fp->insnsi, test->u.insns_int,
+	       len * sizeof(struct sock_filter_int));
+	sk_filter_select_runtime(fp);
+
+	return fp;
+}
+
+static void release_filter(struct sk_filter *fp, int aux)
+{
+	if (aux == CLASSIC)
+		sk_unattached_filter_destroy(fp);
+	else
+		sk_filter_free(fp);
+}
+
+static struct sk_buff *populate_skb(u8 *buf, int size)
+{
+	struct sk_buff *skb;
+
+	skb = alloc_skb(MAX_DATA, GFP_KERNEL);
+	if (!skb)
+		return NULL;
+
+	memcpy(__skb_put(skb, size), buf, size);
+
+	skb_reset_mac_header(skb);
+	skb_set_network_header(skb, min(size, ETH_HLEN));
+	skb->protocol = htons(ETH_P_IP);
+	skb->pkt_type = PACKET_OTHERHOST;
+	skb->mark = SKB_MARK;
+	skb->rxhash = SKB_HASH;
+	skb->queue_mapping = SKB_QUEUE_MAP;
+	skb->dev = NULL;
+
+	return skb;
+}
+
+static u32 run_filter(struct sk_filter *fp, struct sk_buff *skb,
+		      int runs, u64 *duration)
+{
+	ktime_t start, finish;
+	u32 ret = 0;
+	int i;
+
+	start = ktime_get();
+	for (i = 0; i < runs; i++)
+		ret = SK_RUN_FILTER(fp, skb);
+	finish = ktime_get();
+
+	*duration = div_u64(ktime_to_ns(ktime_sub(finish, start)), runs);
+
+	return ret;
+}
+
+static int run_one(struct sk_filter *fp, struct bpf_test *test)
+{
+	int err_cnt = 0, i;
+
+	for (i = 0; i < MAX_SUBTESTS; i++) {
+		struct sk_buff *skb;
+		u64 duration;
+		u32 ret;
+
+		/* unused subtest slots are zero */
+		if (test->test[i].data_size == 0)
+			break;
+
+		skb = populate_skb(test->data, test->test[i].data_size);
+		if (!skb) {
+			err_cnt++;
+			break;
+		}
+
+		ret = run_filter(fp, skb, MAX_RUNS, &duration);
+		kfree_skb(skb);
+
+		if (ret == test->test[i].result) {
+			pr_cont("%llu ", (unsigned long long)duration);
+		} else {
+			pr_cont("ret %u != %u ", ret, test->test[i].result);
+			err_cnt++;
+		}
+	}
+
+	return err_cnt;
+}
+
+static __init int test_bpf(void)
+{
+	int i, err_cnt = 0;
+
+	for (i = 0; i < ARRAY_SIZE(tests); i++) {
+		struct sk_filter *fp;
+		int err;
+
+		pr_info("#%d %s ", i, tests[i].descr);
+
+		fp = generate_filter(&tests[i]);
+		if (!fp) {
+			err_cnt++;
+			continue;
+		}
+		pr_cont("jited:%u ", fp->jited);
+
+		err = run_one(fp, &tests[i]);
+		release_filter(fp, tests[i].aux);
+
+		if (err) {
+			pr_cont("FAIL (%d times)\n", err);
+			err_cnt++;
+		} else {
+			pr_cont("PASS\n");
+		}
+	}
+
+	if (err_cnt)
+		pr_info("%d of %zu tests FAILED\n", err_cnt, ARRAY_SIZE(tests));
+	else
+		pr_info("all %zu tests PASSED\n", ARRAY_SIZE(tests));
+
+	return err_cnt ? -EINVAL : 0;
+}
+
+static int __init test_bpf_init(void)
+{
+	return test_bpf();
+}
+
+static void __exit test_bpf_exit(void)
+{
+}
+
+module_init(test_bpf_init);
+module_exit(test_bpf_exit);
+
+MODULE_LICENSE("GPL");
@@ -59,7 +59,7 @@
  *
  *  ->i_mmap_mutex		(truncate_pagecache)
  *    ->private_lock		(__free_pte->__set_page_dirty_buffers)
- *      ->swap_lock		(exclusive_swap_page, others)
+ *      ->swap_info_struct->lock	(exclusive_swap_page, others)
  *        ->mapping->tree_lock
  *
  *  ->i_mutex
@@ -87,7 +87,7 @@
  *    ->page_table_lock or pte_lock	(anon_vma_prepare and various)
  *
  *  ->page_table_lock or pte_lock
- *    ->swap_lock		(try_to_unmap_one)
+ *    ->swap_info_struct->lock	(try_to_unmap_one)
  *    ->private_lock		(try_to_unmap_one)
  *    ->tree_lock		(try_to_unmap_one)
  *    ->zone.lru_lock		(follow_page->mark_page_accessed)
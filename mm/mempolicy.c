@@ -2341,6 +2341,111 @@ void mpol_free_shared_policy(struct shared_policy *p)
 	mutex_unlock(&p->mutex);
 }
 
+#ifdef CONFIG_NUMA_BALANCING
+/*
+ * mpol_misplaced - check whether a page is on the right node
+ * @page: page that took a NUMA hinting fault
+ * @vma: vma the page is mapped in
+ * @addr: virtual address the page is mapped at
+ *
+ * Only pages under a local policy, which includes the default one, are
+ * second-guessed: they belong on the node of the CPU referencing them.
+ * Explicit placement by the user is left alone.
+ *
+ * Called from the fault path with the mmap_sem held for read.
+ *
+ * Returns the node the page should be migrated to, -1 if it is fine
+ * where it is.
+ */
+int mpol_misplaced(struct page *page, struct vm_area_struct *vma,
+		   unsigned long addr)
+{
+	struct mempolicy *pol;
+	int curnid = page_to_nid(page);
+	int thisnid = numa_node_id();
+	int last_nid;
+	int ret = -1;
+
+	pol = get_vma_policy(current, vma, addr);
+	if (pol->mode != MPOL_PREFERRED || !(pol->flags & MPOL_F_LOCAL))
+		goto out;
+
+	/*
+	 * Two-stage filter: a page only moves once two hinting faults in a
+	 * row came from the same node. If a task uses a page with
+	 * probability p, this happens with p^2, which squashes short-lived
+	 * and unlikely task<->page relations.
+	 */
+	last_nid = page_nid_xchg_last(page, thisnid);
+	if (curnid == thisnid || last_nid != thisnid)
+		goto out;
+
+	if (node_isset(thisnid, cpuset_current_mems_allowed))
+		ret = thisnid;
+out:
+	mpol_cond_put(pol);
+	return ret;
+}
+
+/*
+ * Turn the ptes of the private pages in [addr, end) of @vma into NUMA
+ * hinting ptes, so that the next access to them faults and tells where
+ * they are used from. Returns the number of ptes changed.
+ */
+unsigned long change_prot_numa(struct vm_area_struct *vma,
+			       unsigned long addr, unsigned long end)
+{
+	unsigned long nr_updated;
+
+	nr_updated = change_protection(vma, addr, end, vma->vm_page_prot, 0, 1);
+	if (nr_updated)
+		count_vm_numa_events(NUMA_PTE_UPDATES, nr_updated);
+
+	return nr_updated;
+}
+
+static int numabalancing_override __initdata;
+
+static void __init check_numabalancing_enable(void)
+{
+	bool numabalancing_default = false;
+
+	if (IS_ENABLED(CONFIG_NUMA_BALANCING_DEFAULT_ENABLED))
+		numabalancing_default = true;
+
+	/* An explicit numa_balancing= on the command line wins */
+	if (numabalancing_override) {
+		set_numabalancing_state(numabalancing_override == 1);
+		return;
+	}
+
+	if (nr_node_ids > 1 && numabalancing_default) {
+		printk(KERN_INFO "Enabling automatic NUMA balancing. "
+			"Configure with numa_balancing= or the "
+			"kernel.numa_balancing sysctl\n");
+		set_numabalancing_state(true);
+	}
+}
+
+static int __init setup_numabalancing(char *str)
+{
+	if (!strcmp(str, "enable"))
+		numabalancing_override = 1;
+	else if (!strcmp(str, "disable"))
+		numabalancing_override = -1;
+	else {
+		printk(KERN_WARNING "Unable to parse numa_balancing=\n");
+		return 0;
+	}
+	return 1;
+}
+__setup("numa_balancing=", setup_numabalancing);
+#else
+static inline void __init check_numabalancing_enable(void)
+{
+}
+#endif /* CONFIG_NUMA_BALANCING */
+
 /* assumes fs == KERNEL_DS */
 void __init numa_policy_init(void)
 {
@@ -2382,6 +2487,8 @@ void __init numa_policy_init(void)
 
 	if (do_set_mempolicy(MPOL_INTERLEAVE, 0, &interleave_nodes))
 		printk("numa_policy_init: interleaving failed\n");
+
+	check_numabalancing_enable();
 }
 
 /* Reset policy of current process to default */
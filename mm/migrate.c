@@ -1404,3 +1404,142 @@ int migrate_vmas(struct mm_struct *mm, const nodemask_t *to,
  	return err;
 }
 #endif
+
+#ifdef CONFIG_NUMA_BALANCING
+/*
+ * Do not migrate more than ratelimit_pages to a node within a window of
+ * migrate_interval_millisecs, 1280MB per second by default. Placement is
+ * no good if the memory bus is saturated by the migration itself.
+ */
+static unsigned int migrate_interval_millisecs __read_mostly = 100;
+static unsigned int ratelimit_pages __read_mostly = 128 << (20 - PAGE_SHIFT);
+
+/* Returns true if migration to @node is currently rate limited */
+bool migrate_ratelimited(int node)
+{
+	pg_data_t *pgdat = NODE_DATA(node);
+
+	if (time_after(jiffies, pgdat->numabalancing_migrate_next_window))
+		return false;
+
+	return pgdat->numabalancing_migrate_nr_pages >= ratelimit_pages;
+}
+
+static bool numamigrate_update_ratelimit(pg_data_t *pgdat,
+					 unsigned long nr_pages)
+{
+	bool rate_limited = false;
+
+	spin_lock(&pgdat->numabalancing_migrate_lock);
+	if (time_after(jiffies, pgdat->numabalancing_migrate_next_window)) {
+		pgdat->numabalancing_migrate_nr_pages = 0;
+		pgdat->numabalancing_migrate_next_window = jiffies +
+			msecs_to_jiffies(migrate_interval_millisecs);
+	}
+	if (pgdat->numabalancing_migrate_nr_pages >= ratelimit_pages)
+		rate_limited = true;
+	else
+		pgdat->numabalancing_migrate_nr_pages += nr_pages;
+	spin_unlock(&pgdat->numabalancing_migrate_lock);
+
+	return rate_limited;
+}
+
+/*
+ * Returns true if a zone of @pgdat can take @nr_migrate_pages without
+ * dropping below its high watermark, that is without waking kswapd.
+ */
+static bool migrate_balanced_pgdat(struct pglist_data *pgdat,
+				   unsigned long nr_migrate_pages)
+{
+	int z;
+
+	for (z = pgdat->nr_zones - 1; z >= 0; z--) {
+		struct zone *zone = pgdat->node_zones + z;
+
+		if (!populated_zone(zone))
+			continue;
+
+		if (zone->all_unreclaimable)
+			continue;
+
+		if (zone_watermark_ok(zone, 0,
+				      high_wmark_pages(zone) + nr_migrate_pages,
+				      0, 0))
+			return true;
+	}
+	return false;
+}
+
+static struct page *alloc_misplaced_dst_page(struct page *page,
+					     unsigned long data,
+					     int **result)
+{
+	int nid = (int) data;
+	struct page *newpage;
+
+	newpage = alloc_pages_exact_node(nid,
+					 (GFP_HIGHUSER_MOVABLE | GFP_THISNODE |
+					  __GFP_NOMEMALLOC | __GFP_NORETRY |
+					  __GFP_NOWARN) &
+					 ~GFP_IOFS, 0);
+	if (newpage)
+		page_nid_xchg_last(newpage, page_nid_last(page));
+
+	return newpage;
+}
+
+/*
+ * Isolate @page for migration to @pgdat, unless the node is short of
+ * memory. The reference of the caller is dropped either way, isolation
+ * holds one of its own.
+ */
+static int numamigrate_isolate_page(pg_data_t *pgdat, struct page *page)
+{
+	int ret = 0;
+
+	if (migrate_balanced_pgdat(pgdat, 1) && !isolate_lru_page(page)) {
+		inc_zone_page_state(page, NR_ISOLATED_ANON +
+				    page_is_file_cache(page));
+		ret = 1;
+	}
+
+	put_page(page);
+	return ret;
+}
+
+/*
+ * Attempt to migrate a page that took a NUMA hinting fault to @node. The
+ * caller holds a reference to the page, which is released. Returns true
+ * if the page was migrated.
+ */
+int migrate_misplaced_page(struct page *page, int node)
+{
+	pg_data_t *pgdat = NODE_DATA(node);
+	LIST_HEAD(migratepages);
+	int nr_remaining;
+
+	/*
+	 * Pages mapped by several processes are not moved, they cannot be
+	 * placed well for all of them.
+	 */
+	if (page_mapcount(page) != 1 || numamigrate_update_ratelimit(pgdat, 1)) {
+		put_page(page);
+		return 0;
+	}
+
+	if (!numamigrate_isolate_page(pgdat, page))
+		return 0;
+
+	list_add(&page->lru, &migratepages);
+	nr_remaining = migrate_pages(&migratepages, alloc_misplaced_dst_page,
+				     node, false, MIGRATE_ASYNC);
+	if (nr_remaining) {
+		putback_lru_pages(&migratepages);
+		return 0;
+	}
+
+	count_vm_numa_event(NUMA_PAGE_MIGRATE);
+	return 1;
+}
+#endif /* CONFIG_NUMA_BALANCING */
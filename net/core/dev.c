@@ -135,6 +135,7 @@
 #include <linux/net_tstamp.h>
 #include <linux/static_key.h>
 #include <net/flow_keys.h>
+#include <net/busy_poll.h>
 
 #include "net-sysfs.h"
 
@@ -1625,12 +1626,10 @@ static inline bool is_skb_forwardable(struct net_device *dev,
  */
 int dev_forward_skb(struct net_device *dev, struct sk_buff *skb)
 {
-	if (skb_shinfo(skb)->tx_flags & SKBTX_DEV_ZEROCOPY) {
-		if (skb_copy_ubufs(skb, GFP_ATOMIC)) {
-			atomic_long_inc(&dev->rx_dropped);
-			kfree_skb(skb);
-			return NET_RX_DROP;
-		}
+	if (skb_orphan_frags_rx(skb, GFP_ATOMIC)) {
+		atomic_long_inc(&dev->rx_dropped);
+		kfree_skb(skb);
+		return NET_RX_DROP;
 	}
 
 	skb_orphan(skb);
@@ -1658,7 +1657,7 @@ static inline int deliver_skb(struct sk_buff *skb,
 			      struct packet_type *pt_prev,
 			      struct net_device *orig_dev)
 {
-	if (unlikely(skb_orphan_frags(skb, GFP_ATOMIC)))
+	if (unlikely(skb_orphan_frags_rx(skb, GFP_ATOMIC)))
 		return -ENOMEM;
 	atomic_inc(&skb->users);
 	return pt_prev->func(skb, skb->dev, pt_prev, orig_dev);
@@ -1726,8 +1725,12 @@ static void dev_queue_xmit_nit(struct sk_buff *skb, struct net_device *dev)
 			pt_prev = ptype;
 		}
 	}
-	if (pt_prev)
-		pt_prev->func(skb2, skb->dev, pt_prev, skb->dev);
+	if (pt_prev) {
+		if (unlikely(skb_orphan_frags_rx(skb2, GFP_ATOMIC)))
+			kfree_skb(skb2);
+		else
+			pt_prev->func(skb2, skb->dev, pt_prev, skb->dev);
+	}
 	rcu_read_unlock();
 }
 
@@ -2210,9 +2213,8 @@ static inline int skb_needs_linearize(struct sk_buff *skb,
 }
 
 int dev_hard_start_xmit(struct sk_buff *skb, struct net_device *dev,
-			struct netdev_queue *txq)
+			struct netdev_queue *txq, bool more)
 {
-	const struct net_device_ops *ops = dev->netdev_ops;
 	int rc = NETDEV_TX_OK;
 	unsigned int skb_len;
 
@@ -2264,7 +2266,7 @@ int dev_hard_start_xmit(struct sk_buff *skb, struct net_device *dev,
 			dev_queue_xmit_nit(skb, dev);
 
 		skb_len = skb->len;
-		rc = ops->ndo_start_xmit(skb, dev);
+		rc = netdev_start_xmit(skb, dev, more);
 		trace_net_dev_xmit(skb, rc, dev, skb_len);
 		if (rc == NETDEV_TX_OK)
 			txq_trans_update(txq);
@@ -2289,7 +2291,7 @@ gso:
 			dev_queue_xmit_nit(nskb, dev);
 
 		skb_len = nskb->len;
-		rc = ops->ndo_start_xmit(nskb, dev);
+		rc = netdev_start_xmit(nskb, dev, more || skb->next);
 		trace_net_dev_xmit(nskb, rc, dev, skb_len);
 		if (unlikely(rc != NETDEV_TX_OK)) {
 			if (rc & ~NETDEV_TX_MASK)
@@ -2434,6 +2436,54 @@ struct netdev_queue *netdev_pick_tx(struct net_device *dev,
 	return netdev_get_tx_queue(dev, queue_index);
 }
 
+/*
+ * Transmit through a TCQ_F_NOLOCK qdisc: the queue protects itself, so the
+ * root lock and busylock are never taken.
+ */
+static int __dev_xmit_skb_nolock(struct sk_buff *skb, struct Qdisc *q,
+				 struct net_device *dev,
+				 struct netdev_queue *txq)
+{
+	int rc;
+
+	if (unlikely(test_bit(__QDISC_STATE_DEACTIVATED, &q->state))) {
+		kfree_skb(skb);
+		return NET_XMIT_DROP;
+	}
+
+	if ((q->flags & TCQ_F_CAN_BYPASS) &&
+	    !test_and_set_bit(__QDISC_STATE_RUNNING, &q->state)) {
+		/*
+		 * Only the owner dequeues, so if nothing is queued now
+		 * nothing older than this skb can be sent after it.
+		 */
+		if (!q->gso_skb && !skb_queue_len(&q->bulk_q) &&
+		    !q->ops->peek(q)) {
+			if (!(dev->priv_flags & IFF_XMIT_DST_RELEASE))
+				skb_dst_force(skb);
+
+			qdisc_bstats_update(q, skb);
+
+			if (sch_direct_xmit(skb, q, dev, txq, NULL))
+				__qdisc_run(q);
+			else
+				qdisc_run_end(q);
+
+			return NET_XMIT_SUCCESS;
+		}
+
+		skb_dst_force(skb);
+		rc = q->enqueue(skb, q) & NET_XMIT_MASK;
+		__qdisc_run(q);
+		return rc;
+	}
+
+	skb_dst_force(skb);
+	rc = q->enqueue(skb, q) & NET_XMIT_MASK;
+	qdisc_run(q);
+	return rc;
+}
+
 static inline int __dev_xmit_skb(struct sk_buff *skb, struct Qdisc *q,
 				 struct net_device *dev,
 				 struct netdev_queue *txq)
@@ -2444,6 +2494,10 @@ static inline int __dev_xmit_skb(struct sk_buff *skb, struct Qdisc *q,
 
 	qdisc_skb_cb(skb)->pkt_len = skb->len;
 	qdisc_calculate_pkt_len(skb, q);
+
+	if (q->flags & TCQ_F_NOLOCK)
+		return __dev_xmit_skb_nolock(skb, q, dev, txq);
+
 	/*
 	 * Heuristic to force contended enqueues to serialize on a
 	 * separate lock before trying to get qdisc main lock.
@@ -2608,7 +2662,7 @@ int dev_queue_xmit(struct sk_buff *skb)
 
 			if (!netif_xmit_stopped(txq)) {
 				__this_cpu_inc(xmit_recursion);
-				rc = dev_hard_start_xmit(skb, dev, txq);
+				rc = dev_hard_start_xmit(skb, dev, txq, false);
 				__this_cpu_dec(xmit_recursion);
 				if (dev_xmit_complete(rc)) {
 					HARD_TX_UNLOCK(dev, txq);
@@ -3062,6 +3116,13 @@ static void net_tx_action(struct softirq_action *h)
 
 			head = head->next_sched;
 
+			if (q->flags & TCQ_F_NOLOCK) {
+				smp_mb__before_clear_bit();
+				clear_bit(__QDISC_STATE_SCHED, &q->state);
+				qdisc_run(q);
+				continue;
+			}
+
 			root_lock = qdisc_lock(q);
 			if (spin_trylock(root_lock)) {
 				smp_mb__before_clear_bit();
@@ -3350,7 +3411,7 @@ ncls:
 	}
 
 	if (pt_prev) {
-		if (unlikely(skb_orphan_frags(skb, GFP_ATOMIC)))
+		if (unlikely(skb_orphan_frags_rx(skb, GFP_ATOMIC)))
 			goto drop;
 		else
 			ret = pt_prev->func(skb, skb->dev, pt_prev, orig_dev);
@@ -3668,6 +3729,7 @@ static void skb_gro_reset_offset(struct sk_buff *skb)
 
 gro_result_t napi_gro_receive(struct napi_struct *napi, struct sk_buff *skb)
 {
+	skb_mark_napi_id(skb, napi);
 	skb_gro_reset_offset(skb);
 
 	return napi_skb_finish(__napi_gro_receive(napi, skb), skb);
@@ -3769,6 +3831,8 @@ gro_result_t napi_gro_frags(struct napi_struct *napi)
 	if (!skb)
 		return GRO_DROP;
 
+	skb_mark_napi_id(skb, napi);
+
 	return napi_frags_finish(napi, skb, __napi_gro_receive(napi, skb));
 }
 EXPORT_SYMBOL(napi_gro_frags);
@@ -3903,6 +3967,170 @@ void napi_complete(struct napi_struct *n)
 }
 EXPORT_SYMBOL(napi_complete);
 
+#ifdef CONFIG_NET_RX_BUSY_POLL
+/*
+ * Sockets only remember the id of the NAPI context that last fed them,
+ * and find the context again through this hash when they want to poll
+ * it, so no reference to the device is ever held from socket context.
+ */
+#define NAPI_HASH_BITS	8
+#define NAPI_HASH_MASK	((1 << NAPI_HASH_BITS) - 1)
+
+static struct hlist_head napi_hash[1 << NAPI_HASH_BITS];
+static DEFINE_SPINLOCK(napi_hash_lock);
+static unsigned int napi_gen_id;
+
+/* must be called under rcu_read_lock() or napi_hash_lock */
+static struct napi_struct *napi_by_id(unsigned int napi_id)
+{
+	struct hlist_head *head = &napi_hash[napi_id & NAPI_HASH_MASK];
+	struct napi_struct *napi;
+	struct hlist_node *node;
+
+	hlist_for_each_entry_rcu(napi, node, head, napi_hash_node)
+		if (napi->napi_id == napi_id)
+			return napi;
+
+	return NULL;
+}
+
+static void napi_hash_add(struct napi_struct *napi)
+{
+	spin_lock(&napi_hash_lock);
+
+	/* 0 means "no NAPI context", and skip ids still in use after a wrap */
+	do {
+		if (unlikely(++napi_gen_id == 0))
+			napi_gen_id = 1;
+	} while (napi_by_id(napi_gen_id));
+	napi->napi_id = napi_gen_id;
+
+	hlist_add_head_rcu(&napi->napi_hash_node,
+			   &napi_hash[napi->napi_id & NAPI_HASH_MASK]);
+
+	spin_unlock(&napi_hash_lock);
+}
+
+/* Returns true if the caller must wait for an RCU grace period */
+static bool napi_hash_del(struct napi_struct *napi)
+{
+	bool hashed;
+
+	spin_lock(&napi_hash_lock);
+	hashed = !hlist_unhashed(&napi->napi_hash_node);
+	if (hashed)
+		hlist_del_init_rcu(&napi->napi_hash_node);
+	spin_unlock(&napi_hash_lock);
+
+	return hashed;
+}
+
+/*
+ * Poll @n once on behalf of a socket. The instance is claimed through
+ * NAPI_STATE_SCHED exactly as its interrupt handler would claim it, so
+ * we never run concurrently with net_rx_action() or netpoll, and simply
+ * back off if either of them (or napi_disable()) got there first.
+ */
+static int napi_busy_poll_one(struct napi_struct *n)
+{
+	void *have;
+	int work;
+
+	if (test_and_set_bit(NAPI_STATE_SCHED, &n->state))
+		return 0;
+
+	have = netpoll_poll_lock(n);
+
+	/* Not on any poll list, but ->poll() will napi_complete() it */
+	INIT_LIST_HEAD(&n->poll_list);
+
+	work = n->poll(n, BUSY_POLL_BUDGET);
+	trace_napi_poll(n);
+
+	WARN_ON_ONCE(work > BUSY_POLL_BUDGET);
+
+	/*
+	 * Consuming the whole budget leaves the instance scheduled and
+	 * owned by us. Hand it to the softirq, which keeps polling it just
+	 * as net_rx_action() does for an instance that used its weight.
+	 */
+	if (work == BUSY_POLL_BUDGET) {
+		if (n->gro_list)
+			napi_gro_flush(n, false);
+		local_irq_disable();
+		____napi_schedule(&__get_cpu_var(softnet_data), n);
+		local_irq_enable();
+	}
+
+	netpoll_poll_unlock(have);
+
+	return work;
+}
+
+/**
+ *	sk_busy_loop - poll the NAPI context that last fed a socket
+ *	@sk: socket with an empty receive queue
+ *	@nonblock: poll only once instead of for sk->sk_ll_usec
+ *
+ *	Spins on the NAPI context recorded in @sk until data shows up on
+ *	the receive queue, the time budget runs out or someone else needs
+ *	the CPU. Bottom halves are enabled between passes so that anything
+ *	a pass raised, including a context handed back to the softirq, is
+ *	processed promptly. Returns true if the receive queue is not empty.
+ */
+bool sk_busy_loop(struct sock *sk, int nonblock)
+{
+	unsigned long start = busy_loop_us_clock();
+	unsigned long end_time = start + ACCESS_ONCE(sk->sk_ll_usec);
+	struct net *net = sock_net(sk);
+	struct napi_struct *napi;
+	bool found;
+
+	for (;;) {
+		rcu_read_lock_bh();
+		napi = napi_by_id(sk->sk_napi_id);
+		if (napi) {
+			int work = napi_busy_poll_one(napi);
+
+			if (work > 0)
+				NET_ADD_STATS_BH(net,
+						 LINUX_MIB_BUSYPOLLRXPACKETS,
+						 work);
+		}
+		rcu_read_unlock_bh();
+
+		/* the device went away, nothing left to poll */
+		if (!napi)
+			return false;
+
+		found = !skb_queue_empty(&sk->sk_receive_queue);
+		if (found || nonblock || need_resched() ||
+		    busy_loop_timeout(end_time))
+			break;
+		cpu_relax();
+	}
+
+	local_bh_disable();
+	NET_INC_STATS_BH(net, found ? LINUX_MIB_BUSYPOLLHITS :
+				      LINUX_MIB_BUSYPOLLMISSES);
+	NET_ADD_STATS_BH(net, LINUX_MIB_BUSYPOLLUSECS,
+			 busy_loop_us_clock() - start);
+	local_bh_enable();
+
+	return found;
+}
+EXPORT_SYMBOL(sk_busy_loop);
+#else
+static inline void napi_hash_add(struct napi_struct *napi)
+{
+}
+
+static inline bool napi_hash_del(struct napi_struct *napi)
+{
+	return false;
+}
+#endif /* CONFIG_NET_RX_BUSY_POLL */
+
 void netif_napi_add(struct net_device *dev, struct napi_struct *napi,
 		    int (*poll)(struct napi_struct *, int), int weight)
 {
@@ -3919,6 +4147,7 @@ void netif_napi_add(struct net_device *dev, struct napi_struct *napi,
 	napi->poll_owner = -1;
 #endif
 	set_bit(NAPI_STATE_SCHED, &napi->state);
+	napi_hash_add(napi);
 }
 EXPORT_SYMBOL(netif_napi_add);
 
@@ -3929,6 +4158,10 @@ void netif_napi_del(struct napi_struct *napi)
 	list_del_init(&napi->dev_list);
 	napi_free_frags(napi);
 
+	/* busy polling sockets may still be looking at it */
+	if (napi_hash_del(napi))
+		synchronize_net();
+
 	for (skb = napi->gro_list; skb; skb = next) {
 		next = skb->next;
 		skb->next = NULL;
@@ -4886,6 +5119,35 @@ int dev_set_mtu(struct net_device *dev, int new_mtu)
 }
 EXPORT_SYMBOL(dev_set_mtu);
 
+/**
+ *	dev_change_tx_queue_len - Change TX queue length of a netdevice
+ *	@dev: device
+ *	@new_len: new tx queue length
+ *
+ *	Change the transmit queue length of the device and let the attached
+ *	qdiscs follow. The old length is restored if they cannot.
+ */
+int dev_change_tx_queue_len(struct net_device *dev, unsigned long new_len)
+{
+	unsigned long orig_len = dev->tx_queue_len;
+	int err;
+
+	if (new_len != (unsigned int)new_len)
+		return -ERANGE;
+
+	if (new_len == orig_len)
+		return 0;
+
+	dev->tx_queue_len = new_len;
+	err = dev_qdisc_change_tx_queue_len(dev);
+	if (err) {
+		netdev_err(dev, "refused to change device tx_queue_len\n");
+		dev->tx_queue_len = orig_len;
+	}
+	return err;
+}
+EXPORT_SYMBOL(dev_change_tx_queue_len);
+
 /**
  *	dev_set_group - Change group this device belongs to
  *	@dev: device
@@ -5053,8 +5315,7 @@ static int dev_ifsioc(struct net *net, struct ifreq *ifr, unsigned int cmd)
 	case SIOCSIFTXQLEN:
 		if (ifr->ifr_qlen < 0)
 			return -EINVAL;
-		dev->tx_queue_len = ifr->ifr_qlen;
-		return 0;
+		return dev_change_tx_queue_len(dev, ifr->ifr_qlen);
 
 	case SIOCSIFNAME:
 		ifr->ifr_newname[IFNAMSIZ-1] = '\0';
@@ -376,11 +376,6 @@ load_b:
 				A = 0;
 			continue;
 		}
-#ifdef CONFIG_SECCOMP_FILTER
-		case BPF_S_ANC_SECCOMP_LD_W:
-			A = seccomp_bpf_load(fentry->k);
-			continue;
-#endif
 		default:
 			WARN_RATELIMIT(1, "Unknown code:%u jt:%u tf:%u k:%u\n",
 				       fentry->code, fentry->jt,
@@ -393,6 +388,982 @@ load_b:
 }
 EXPORT_SYMBOL(sk_run_filter);
 
+/*
+ * Internal BPF
+ *
+ * Filters are translated into the internal instruction set described
+ * in include/linux/filter.h by sk_convert_filter() and then either run
+ * by __sk_run_filter() below or handed to an architecture JIT.
+ */
+
+/*
+ * Base function for offset calculation. Helpers are encoded as imm32
+ * offsets from it, so it needs to stay in .text next to them.
+ */
+noinline u64 __bpf_call_base(u64 r1, u64 r2, u64 r3, u64 r4, u64 r5)
+{
+	return 0;
+}
+EXPORT_SYMBOL_GPL(__bpf_call_base);
+
+/* Register accessors of the interpreter */
+#define BPF_R0	regs[BPF_REG_0]
+#define BPF_R1	regs[BPF_REG_1]
+#define BPF_R2	regs[BPF_REG_2]
+#define BPF_R3	regs[BPF_REG_3]
+#define BPF_R4	regs[BPF_REG_4]
+#define BPF_R5	regs[BPF_REG_5]
+#define FP	regs[BPF_REG_FP]
+#define CTX	regs[BPF_REG_CTX]
+#define DST	regs[insn->dst_reg]
+#define SRC	regs[insn->src_reg]
+#define IMM	insn->imm
+
+/**
+ *	__sk_run_filter - run an internal BPF program
+ *	@ctx: the context the program is run on, usually the skb
+ *	@insn: the internal BPF program
+ *
+ * Instead of a switch the opcode indexes a table of label addresses,
+ * so every handler jumps straight to the next one and the dispatch
+ * branch is predicted per instruction rather than through a single
+ * indirect jump at the top of the loop.
+ */
+static unsigned int __sk_run_filter(void *ctx, const struct sock_filter_int *insn)
+{
+	u64 stack[MAX_BPF_STACK / sizeof(u64)];
+	u64 regs[MAX_BPF_REG], tmp;
+	void *ptr;
+	int off;
+
+	static const void *jumptable[256] = {
+		[0 ... 255] = &&default_label,
+		/* Now overwrite non-defaults ... */
+#define DL(A, B, C)	[A|B|C] = &&A##_##B##_##C
+		DL(BPF_ALU, BPF_ADD, BPF_X),
+		DL(BPF_ALU, BPF_ADD, BPF_K),
+		DL(BPF_ALU, BPF_SUB, BPF_X),
+		DL(BPF_ALU, BPF_SUB, BPF_K),
+		DL(BPF_ALU, BPF_AND, BPF_X),
+		DL(BPF_ALU, BPF_AND, BPF_K),
+		DL(BPF_ALU, BPF_OR, BPF_X),
+		DL(BPF_ALU, BPF_OR, BPF_K),
+		DL(BPF_ALU, BPF_LSH, BPF_X),
+		DL(BPF_ALU, BPF_LSH, BPF_K),
+		DL(BPF_ALU, BPF_RSH, BPF_X),
+		DL(BPF_ALU, BPF_RSH, BPF_K),
+		DL(BPF_ALU, BPF_XOR, BPF_X),
+		DL(BPF_ALU, BPF_XOR, BPF_K),
+		DL(BPF_ALU, BPF_MUL, BPF_X),
+		DL(BPF_ALU, BPF_MUL, BPF_K),
+		DL(BPF_ALU, BPF_MOV, BPF_X),
+		DL(BPF_ALU, BPF_MOV, BPF_K),
+		DL(BPF_ALU, BPF_DIV, BPF_X),
+		DL(BPF_ALU, BPF_DIV, BPF_K),
+		DL(BPF_ALU, BPF_MOD, BPF_X),
+		DL(BPF_ALU, BPF_MOD, BPF_K),
+		DL(BPF_ALU, BPF_NEG, 0),
+		DL(BPF_ALU, BPF_END, BPF_TO_BE),
+		DL(BPF_ALU, BPF_END, BPF_TO_LE),
+		DL(BPF_ALU64, BPF_ADD, BPF_X),
+		DL(BPF_ALU64, BPF_ADD, BPF_K),
+		DL(BPF_ALU64, BPF_SUB, BPF_X),
+		DL(BPF_ALU64, BPF_SUB, BPF_K),
+		DL(BPF_ALU64, BPF_AND, BPF_X),
+		DL(BPF_ALU64, BPF_AND, BPF_K),
+		DL(BPF_ALU64, BPF_OR, BPF_X),
+		DL(BPF_ALU64, BPF_OR, BPF_K),
+		DL(BPF_ALU64, BPF_LSH, BPF_X),
+		DL(BPF_ALU64, BPF_LSH, BPF_K),
+		DL(BPF_ALU64, BPF_RSH, BPF_X),
+		DL(BPF_ALU64, BPF_RSH, BPF_K),
+		DL(BPF_ALU64, BPF_XOR, BPF_X),
+		DL(BPF_ALU64, BPF_XOR, BPF_K),
+		DL(BPF_ALU64, BPF_MUL, BPF_X),
+		DL(BPF_ALU64, BPF_MUL, BPF_K),
+		DL(BPF_ALU64, BPF_MOV, BPF_X),
+		DL(BPF_ALU64, BPF_MOV, BPF_K),
+		DL(BPF_ALU64, BPF_ARSH, BPF_X),
+		DL(BPF_ALU64, BPF_ARSH, BPF_K),
+		DL(BPF_ALU64, BPF_DIV, BPF_X),
+		DL(BPF_ALU64, BPF_DIV, BPF_K),
+		DL(BPF_ALU64, BPF_MOD, BPF_X),
+		DL(BPF_ALU64, BPF_MOD, BPF_K),
+		DL(BPF_ALU64, BPF_NEG, 0),
+		DL(BPF_JMP, BPF_CALL, 0),
+		DL(BPF_JMP, BPF_JA, 0),
+		DL(BPF_JMP, BPF_JEQ, BPF_X),
+		DL(BPF_JMP, BPF_JEQ, BPF_K),
+		DL(BPF_JMP, BPF_JNE, BPF_X),
+		DL(BPF_JMP, BPF_JNE, BPF_K),
+		DL(BPF_JMP, BPF_JGT, BPF_X),
+		DL(BPF_JMP, BPF_JGT, BPF_K),
+		DL(BPF_JMP, BPF_JGE, BPF_X),
+		DL(BPF_JMP, BPF_JGE, BPF_K),
+		DL(BPF_JMP, BPF_JSGT, BPF_X),
+		DL(BPF_JMP, BPF_JSGT, BPF_K),
+		DL(BPF_JMP, BPF_JSGE, BPF_X),
+		DL(BPF_JMP, BPF_JSGE, BPF_K),
+		DL(BPF_JMP, BPF_JSET, BPF_X),
+		DL(BPF_JMP, BPF_JSET, BPF_K),
+		DL(BPF_JMP, BPF_EXIT, 0),
+		DL(BPF_STX, BPF_MEM, BPF_B),
+		DL(BPF_STX, BPF_MEM, BPF_H),
+		DL(BPF_STX, BPF_MEM, BPF_W),
+		DL(BPF_STX, BPF_MEM, BPF_DW),
+		DL(BPF_STX, BPF_XADD, BPF_W),
+		DL(BPF_STX, BPF_XADD, BPF_DW),
+		DL(BPF_ST, BPF_MEM, BPF_B),
+		DL(BPF_ST, BPF_MEM, BPF_H),
+		DL(BPF_ST, BPF_MEM, BPF_W),
+		DL(BPF_ST, BPF_MEM, BPF_DW),
+		DL(BPF_LDX, BPF_MEM, BPF_B),
+		DL(BPF_LDX, BPF_MEM, BPF_H),
+		DL(BPF_LDX, BPF_MEM, BPF_W),
+		DL(BPF_LDX, BPF_MEM, BPF_DW),
+		DL(BPF_LD, BPF_ABS, BPF_W),
+		DL(BPF_LD, BPF_ABS, BPF_H),
+		DL(BPF_LD, BPF_ABS, BPF_B),
+		DL(BPF_LD, BPF_IND, BPF_W),
+		DL(BPF_LD, BPF_IND, BPF_H),
+		DL(BPF_LD, BPF_IND, BPF_B),
+#undef DL
+	};
+
+#define CONT	 ({ insn++; goto select_insn; })
+#define CONT_JMP ({ insn++; goto select_insn; })
+
+	FP = (u64) (unsigned long) &stack[ARRAY_SIZE(stack)];
+	BPF_R1 = (u64) (unsigned long) ctx;
+
+select_insn:
+	goto *jumptable[insn->code];
+
+	/* ALU */
+#define ALU(OPCODE, OP)						\
+	BPF_ALU64_##OPCODE##_BPF_X:				\
+		DST = DST OP SRC;			\
+		CONT;						\
+	BPF_ALU_##OPCODE##_BPF_X:				\
+		DST = (u32) DST OP (u32) SRC;	\
+		CONT;						\
+	BPF_ALU64_##OPCODE##_BPF_K:				\
+		DST = DST OP IMM;			\
+		CONT;						\
+	BPF_ALU_##OPCODE##_BPF_K:				\
+		DST = (u32) DST OP (u32) IMM;	\
+		CONT;
+
+	ALU(BPF_ADD,  +)
+	ALU(BPF_SUB,  -)
+	ALU(BPF_AND,  &)
+	ALU(BPF_OR,   |)
+	ALU(BPF_LSH, <<)
+	ALU(BPF_RSH, >>)
+	ALU(BPF_XOR,  ^)
+	ALU(BPF_MUL,  *)
+#undef ALU
+	BPF_ALU_BPF_NEG_0:
+		DST = (u32) -DST;
+		CONT;
+	BPF_ALU64_BPF_NEG_0:
+		DST = -DST;
+		CONT;
+	BPF_ALU_BPF_MOV_BPF_X:
+		DST = (u32) SRC;
+		CONT;
+	BPF_ALU_BPF_MOV_BPF_K:
+		DST = (u32) IMM;
+		CONT;
+	BPF_ALU64_BPF_MOV_BPF_X:
+		DST = SRC;
+		CONT;
+	BPF_ALU64_BPF_MOV_BPF_K:
+		DST = IMM;
+		CONT;
+	BPF_ALU64_BPF_ARSH_BPF_X:
+		(*(s64 *) &DST) >>= SRC;
+		CONT;
+	BPF_ALU64_BPF_ARSH_BPF_K:
+		(*(s64 *) &DST) >>= IMM;
+		CONT;
+	BPF_ALU64_BPF_MOD_BPF_X:
+		if (unlikely(SRC == 0))
+			return 0;
+		DST -= div64_u64(DST, SRC) * SRC;
+		CONT;
+	BPF_ALU_BPF_MOD_BPF_X:
+		if (unlikely((u32) SRC == 0))
+			return 0;
+		DST = (u32) DST % (u32) SRC;
+		CONT;
+	BPF_ALU64_BPF_MOD_BPF_K:
+		tmp = IMM;
+		DST -= div64_u64(DST, tmp) * tmp;
+		CONT;
+	BPF_ALU_BPF_MOD_BPF_K:
+		DST = (u32) DST % (u32) IMM;
+		CONT;
+	BPF_ALU64_BPF_DIV_BPF_X:
+		if (unlikely(SRC == 0))
+			return 0;
+		DST = div64_u64(DST, SRC);
+		CONT;
+	BPF_ALU_BPF_DIV_BPF_X:
+		if (unlikely((u32) SRC == 0))
+			return 0;
+		DST = (u32) DST / (u32) SRC;
+		CONT;
+	BPF_ALU64_BPF_DIV_BPF_K:
+		DST = div64_u64(DST, (u64) (s64) IMM);
+		CONT;
+	BPF_ALU_BPF_DIV_BPF_K:
+		DST = (u32) DST / (u32) IMM;
+		CONT;
+	BPF_ALU_BPF_END_BPF_TO_BE:
+		switch (IMM) {
+		case 16:
+			DST = (__force u16) cpu_to_be16(DST);
+			break;
+		case 32:
+			DST = (__force u32) cpu_to_be32(DST);
+			break;
+		case 64:
+			DST = (__force u64) cpu_to_be64(DST);
+			break;
+		}
+		CONT;
+	BPF_ALU_BPF_END_BPF_TO_LE:
+		switch (IMM) {
+		case 16:
+			DST = (__force u16) cpu_to_le16(DST);
+			break;
+		case 32:
+			DST = (__force u32) cpu_to_le32(DST);
+			break;
+		case 64:
+			DST = (__force u64) cpu_to_le64(DST);
+			break;
+		}
+		CONT;
+
+	/* CALL */
+	BPF_JMP_BPF_CALL_0:
+		/*
+		 * Calls clobber R1-R5, preserve R6-R9 and return the
+		 * result in R0.
+		 */
+		BPF_R0 = (__bpf_call_base + insn->imm)(BPF_R1, BPF_R2, BPF_R3,
+						       BPF_R4, BPF_R5);
+		CONT;
+
+	/* JMP */
+	BPF_JMP_BPF_JA_0:
+		insn += insn->off;
+		CONT;
+	BPF_JMP_BPF_JEQ_BPF_X:
+		if (DST == SRC) {
+			insn += insn->off;
+			CONT_JMP;
+		}
+		CONT;
+	BPF_JMP_BPF_JEQ_BPF_K:
+		if (DST == IMM) {
+			insn += insn->off;
+			CONT_JMP;
+		}
+		CONT;
+	BPF_JMP_BPF_JNE_BPF_X:
+		if (DST != SRC) {
+			insn += insn->off;
+			CONT_JMP;
+		}
+		CONT;
+	BPF_JMP_BPF_JNE_BPF_K:
+		if (DST != IMM) {
+			insn += insn->off;
+			CONT_JMP;
+		}
+		CONT;
+	BPF_JMP_BPF_JGT_BPF_X:
+		if (DST > SRC) {
+			insn += insn->off;
+			CONT_JMP;
+		}
+		CONT;
+	BPF_JMP_BPF_JGT_BPF_K:
+		if (DST > IMM) {
+			insn += insn->off;
+			CONT_JMP;
+		}
+		CONT;
+	BPF_JMP_BPF_JGE_BPF_X:
+		if (DST >= SRC) {
+			insn += insn->off;
+			CONT_JMP;
+		}
+		CONT;
+	BPF_JMP_BPF_JGE_BPF_K:
+		if (DST >= IMM) {
+			insn += insn->off;
+			CONT_JMP;
+		}
+		CONT;
+	BPF_JMP_BPF_JSGT_BPF_X:
+		if (((s64) DST) > ((s64) SRC)) {
+			insn += insn->off;
+			CONT_JMP;
+		}
+		CONT;
+	BPF_JMP_BPF_JSGT_BPF_K:
+		if (((s64) DST) > ((s64) IMM)) {
+			insn += insn->off;
+			CONT_JMP;
+		}
+		CONT;
+	BPF_JMP_BPF_JSGE_BPF_X:
+		if (((s64) DST) >= ((s64) SRC)) {
+			insn += insn->off;
+			CONT_JMP;
+		}
+		CONT;
+	BPF_JMP_BPF_JSGE_BPF_K:
+		if (((s64) DST) >= ((s64) IMM)) {
+			insn += insn->off;
+			CONT_JMP;
+		}
+		CONT;
+	BPF_JMP_BPF_JSET_BPF_X:
+		if (DST & SRC) {
+			insn += insn->off;
+			CONT_JMP;
+		}
+		CONT;
+	BPF_JMP_BPF_JSET_BPF_K:
+		if (DST & IMM) {
+			insn += insn->off;
+			CONT_JMP;
+		}
+		CONT;
+	BPF_JMP_BPF_EXIT_0:
+		return BPF_R0;
+
+	/* STX, ST and LDX */
+#define LDST(SIZEOP, SIZE)						\
+	BPF_STX_BPF_MEM_##SIZEOP:					\
+		*(SIZE *)(unsigned long) (DST + insn->off) = SRC;	\
+		CONT;							\
+	BPF_ST_BPF_MEM_##SIZEOP:					\
+		*(SIZE *)(unsigned long) (DST + insn->off) = IMM;	\
+		CONT;							\
+	BPF_LDX_BPF_MEM_##SIZEOP:					\
+		DST = *(SIZE *)(unsigned long) (SRC + insn->off);	\
+		CONT;
+
+	LDST(BPF_B,   u8)
+	LDST(BPF_H,  u16)
+	LDST(BPF_W,  u32)
+	LDST(BPF_DW, u64)
+#undef LDST
+	BPF_STX_BPF_XADD_BPF_W: /* lock xadd *(u32 *)(dst_reg + off16) += src_reg */
+		atomic_add((u32) SRC, (atomic_t *)(unsigned long)
+			   (DST + insn->off));
+		CONT;
+	BPF_STX_BPF_XADD_BPF_DW: /* lock xadd *(u64 *)(dst_reg + off16) += src_reg */
+		atomic64_add((u64) SRC, (atomic64_t *)(unsigned long)
+			     (DST + insn->off));
+		CONT;
+
+	/*
+	 * Packet loads only appear in programs whose context is an skb,
+	 * which sk_convert_filter() keeps in R6 for their whole life.
+	 * Like calls they clobber R1-R5 and leave the result in R0; a
+	 * load beyond the packet ends the program with 0, as in the
+	 * classic interpreter.
+	 */
+	BPF_LD_BPF_ABS_BPF_W: /* R0 = ntohl(*(u32 *) (skb->data + imm32)) */
+		off = IMM;
+load_word:
+		ptr = load_pointer((struct sk_buff *) (unsigned long) CTX,
+				   off, 4, &tmp);
+		if (likely(ptr != NULL)) {
+			BPF_R0 = get_unaligned_be32(ptr);
+			CONT;
+		}
+		return 0;
+	BPF_LD_BPF_ABS_BPF_H: /* R0 = ntohs(*(u16 *) (skb->data + imm32)) */
+		off = IMM;
+load_half:
+		ptr = load_pointer((struct sk_buff *) (unsigned long) CTX,
+				   off, 2, &tmp);
+		if (likely(ptr != NULL)) {
+			BPF_R0 = get_unaligned_be16(ptr);
+			CONT;
+		}
+		return 0;
+	BPF_LD_BPF_ABS_BPF_B: /* R0 = *(u8 *) (skb->data + imm32) */
+		off = IMM;
+load_byte:
+		ptr = load_pointer((struct sk_buff *) (unsigned long) CTX,
+				   off, 1, &tmp);
+		if (likely(ptr != NULL)) {
+			BPF_R0 = *(u8 *)ptr;
+			CONT;
+		}
+		return 0;
+	BPF_LD_BPF_IND_BPF_W: /* R0 = ntohl(*(u32 *) (skb->data + src_reg + imm32)) */
+		off = IMM + SRC;
+		goto load_word;
+	BPF_LD_BPF_IND_BPF_H: /* R0 = ntohs(*(u16 *) (skb->data + src_reg + imm32)) */
+		off = IMM + SRC;
+		goto load_half;
+	BPF_LD_BPF_IND_BPF_B: /* R0 = *(u8 *) (skb->data + src_reg + imm32) */
+		off = IMM + SRC;
+		goto load_byte;
+
+	default_label:
+		/* If we ever reach this, we have a bug somewhere. */
+		WARN_RATELIMIT(1, "unknown opcode %02x\n", insn->code);
+		return 0;
+#undef CONT_JMP
+#undef CONT
+}
+
+#undef BPF_R0
+#undef BPF_R1
+#undef BPF_R2
+#undef BPF_R3
+#undef BPF_R4
+#undef BPF_R5
+#undef FP
+#undef CTX
+#undef DST
+#undef SRC
+#undef IMM
+
+/*
+ * sk_filter->bpf_func of programs run by the interpreter. The context
+ * is not necessarily an skb, seccomp passes its struct seccomp_data.
+ */
+static unsigned int sk_run_filter_int(const struct sk_buff *ctx,
+				      const struct sock_filter *insns)
+{
+	return __sk_run_filter((void *) ctx,
+			       (const struct sock_filter_int *) insns);
+}
+
+/* Helpers called from translated programs for the heavier extensions */
+
+static u64 __skb_get_nlattr(u64 ctx, u64 A, u64 X, u64 r4, u64 r5)
+{
+	struct sk_buff *skb = (struct sk_buff *)(unsigned long) ctx;
+	struct nlattr *nla;
+
+	if (skb_is_nonlinear(skb))
+		return 0;
+
+	if ((u32) A > skb->len - sizeof(struct nlattr))
+		return 0;
+
+	nla = nla_find((struct nlattr *) &skb->data[A], skb->len - A, X);
+	if (nla)
+		return (void *) nla - (void *) skb->data;
+
+	return 0;
+}
+
+static u64 __skb_get_nlattr_nest(u64 ctx, u64 A, u64 X, u64 r4, u64 r5)
+{
+	struct sk_buff *skb = (struct sk_buff *)(unsigned long) ctx;
+	struct nlattr *nla;
+
+	if (skb_is_nonlinear(skb))
+		return 0;
+
+	if ((u32) A > skb->len - sizeof(struct nlattr))
+		return 0;
+
+	nla = (struct nlattr *) &skb->data[A];
+	if (nla->nla_len > (u32) A - skb->len)
+		return 0;
+
+	nla = nla_find_nested(nla, X);
+	if (nla)
+		return (void *) nla - (void *) skb->data;
+
+	return 0;
+}
+
+static u64 __get_raw_cpu_id(u64 ctx, u64 A, u64 X, u64 r4, u64 r5)
+{
+	return raw_smp_processor_id();
+}
+
+/* Translate one ancillary load, leaving *insnp at the last insn emitted */
+static bool convert_bpf_extensions(struct sock_filter *fp,
+				   struct sock_filter_int **insnp)
+{
+	struct sock_filter_int *insn = *insnp;
+
+	switch (fp->code) {
+	case BPF_S_ANC_PROTOCOL:
+		/* A = ntohs(skb->protocol) */
+		*insn++ = BPF_LDX_MEM(BPF_H, BPF_REG_A, BPF_REG_CTX,
+				      offsetof(struct sk_buff, protocol));
+		*insn = BPF_ENDIAN(BPF_FROM_BE, BPF_REG_A, 16);
+		break;
+
+	case BPF_S_ANC_PKTTYPE:
+		/* A = skb->pkt_type, a bit field sharing its byte */
+		*insn++ = BPF_LDX_MEM(BPF_B, BPF_REG_A, BPF_REG_CTX,
+				      PKT_TYPE_OFFSET());
+		*insn = BPF_ALU32_IMM(BPF_AND, BPF_REG_A, PKT_TYPE_MAX);
+#ifdef __BIG_ENDIAN_BITFIELD
+		insn++;
+		*insn = BPF_ALU32_IMM(BPF_RSH, BPF_REG_A, 5);
+#endif
+		break;
+
+	case BPF_S_ANC_IFINDEX:
+	case BPF_S_ANC_HATYPE:
+		BUILD_BUG_ON(FIELD_SIZEOF(struct net_device, ifindex) != 4);
+		BUILD_BUG_ON(FIELD_SIZEOF(struct net_device, type) != 2);
+
+		/* tmp = skb->dev, the filter returns 0 without one */
+		*insn++ = BPF_LDX_MEM(BPF_FIELD_SIZEOF(struct sk_buff, dev),
+				      BPF_REG_TMP, BPF_REG_CTX,
+				      offsetof(struct sk_buff, dev));
+		*insn++ = BPF_JMP_IMM(BPF_JNE, BPF_REG_TMP, 0, 2);
+		*insn++ = BPF_MOV32_IMM(BPF_REG_A, 0);
+		*insn++ = BPF_EXIT_INSN();
+		if (fp->code == BPF_S_ANC_IFINDEX)
+			*insn = BPF_LDX_MEM(BPF_W, BPF_REG_A, BPF_REG_TMP,
+					    offsetof(struct net_device, ifindex));
+		else
+			*insn = BPF_LDX_MEM(BPF_H, BPF_REG_A, BPF_REG_TMP,
+					    offsetof(struct net_device, type));
+		break;
+
+	case BPF_S_ANC_MARK:
+		*insn = BPF_LDX_MEM(BPF_FIELD_SIZEOF(struct sk_buff, mark),
+				    BPF_REG_A, BPF_REG_CTX,
+				    offsetof(struct sk_buff, mark));
+		break;
+
+	case BPF_S_ANC_RXHASH:
+		*insn = BPF_LDX_MEM(BPF_FIELD_SIZEOF(struct sk_buff, rxhash),
+				    BPF_REG_A, BPF_REG_CTX,
+				    offsetof(struct sk_buff, rxhash));
+		break;
+
+	case BPF_S_ANC_QUEUE:
+		*insn = BPF_LDX_MEM(BPF_FIELD_SIZEOF(struct sk_buff,
+						     queue_mapping),
+				    BPF_REG_A, BPF_REG_CTX,
+				    offsetof(struct sk_buff, queue_mapping));
+		break;
+
+	case BPF_S_ANC_NLATTR:
+	case BPF_S_ANC_NLATTR_NEST:
+	case BPF_S_ANC_CPU:
+		/* A = helper(ctx, A, X) */
+		*insn++ = BPF_MOV64_REG(BPF_REG_ARG1, BPF_REG_CTX);
+		*insn++ = BPF_MOV64_REG(BPF_REG_ARG2, BPF_REG_A);
+		*insn++ = BPF_MOV64_REG(BPF_REG_ARG3, BPF_REG_X);
+		switch (fp->code) {
+		case BPF_S_ANC_NLATTR:
+			*insn = BPF_EMIT_CALL(__skb_get_nlattr);
+			break;
+		case BPF_S_ANC_NLATTR_NEST:
+			*insn = BPF_EMIT_CALL(__skb_get_nlattr_nest);
+			break;
+		case BPF_S_ANC_CPU:
+			*insn = BPF_EMIT_CALL(__get_raw_cpu_id);
+			break;
+		}
+		break;
+
+	case BPF_S_ANC_ALU_XOR_X:
+		/* A ^= X */
+		*insn = BPF_ALU32_REG(BPF_XOR, BPF_REG_A, BPF_REG_X);
+		break;
+
+	default:
+		return false;
+	}
+
+	*insnp = insn;
+	return true;
+}
+
+/*
+ * Classic opcodes of the checked instructions whose internal form uses
+ * the same encoding, indexed by the BPF_S_* code sk_chk_filter() gave
+ * them.
+ */
+static const u16 bpf_s_codes[] = {
+	[BPF_S_ALU_ADD_K]	= BPF_ALU | BPF_ADD | BPF_K,
+	[BPF_S_ALU_ADD_X]	= BPF_ALU | BPF_ADD | BPF_X,
+	[BPF_S_ALU_SUB_K]	= BPF_ALU | BPF_SUB | BPF_K,
+	[BPF_S_ALU_SUB_X]	= BPF_ALU | BPF_SUB | BPF_X,
+	[BPF_S_ALU_MUL_K]	= BPF_ALU | BPF_MUL | BPF_K,
+	[BPF_S_ALU_MUL_X]	= BPF_ALU | BPF_MUL | BPF_X,
+	[BPF_S_ALU_DIV_X]	= BPF_ALU | BPF_DIV | BPF_X,
+	[BPF_S_ALU_MOD_K]	= BPF_ALU | BPF_MOD | BPF_K,
+	[BPF_S_ALU_MOD_X]	= BPF_ALU | BPF_MOD | BPF_X,
+	[BPF_S_ALU_AND_K]	= BPF_ALU | BPF_AND | BPF_K,
+	[BPF_S_ALU_AND_X]	= BPF_ALU | BPF_AND | BPF_X,
+	[BPF_S_ALU_OR_K]	= BPF_ALU | BPF_OR | BPF_K,
+	[BPF_S_ALU_OR_X]	= BPF_ALU | BPF_OR | BPF_X,
+	[BPF_S_ALU_XOR_K]	= BPF_ALU | BPF_XOR | BPF_K,
+	[BPF_S_ALU_XOR_X]	= BPF_ALU | BPF_XOR | BPF_X,
+	[BPF_S_ALU_LSH_K]	= BPF_ALU | BPF_LSH | BPF_K,
+	[BPF_S_ALU_LSH_X]	= BPF_ALU | BPF_LSH | BPF_X,
+	[BPF_S_ALU_RSH_K]	= BPF_ALU | BPF_RSH | BPF_K,
+	[BPF_S_ALU_RSH_X]	= BPF_ALU | BPF_RSH | BPF_X,
+	[BPF_S_ALU_NEG]		= BPF_ALU | BPF_NEG,
+	[BPF_S_LD_W_ABS]	= BPF_LD | BPF_W | BPF_ABS,
+	[BPF_S_LD_H_ABS]	= BPF_LD | BPF_H | BPF_ABS,
+	[BPF_S_LD_B_ABS]	= BPF_LD | BPF_B | BPF_ABS,
+	[BPF_S_LD_W_IND]	= BPF_LD | BPF_W | BPF_IND,
+	[BPF_S_LD_H_IND]	= BPF_LD | BPF_H | BPF_IND,
+	[BPF_S_LD_B_IND]	= BPF_LD | BPF_B | BPF_IND,
+	[BPF_S_JMP_JEQ_K]	= BPF_JMP | BPF_JEQ | BPF_K,
+	[BPF_S_JMP_JEQ_X]	= BPF_JMP | BPF_JEQ | BPF_X,
+	[BPF_S_JMP_JGE_K]	= BPF_JMP | BPF_JGE | BPF_K,
+	[BPF_S_JMP_JGE_X]	= BPF_JMP | BPF_JGE | BPF_X,
+	[BPF_S_JMP_JGT_K]	= BPF_JMP | BPF_JGT | BPF_K,
+	[BPF_S_JMP_JGT_X]	= BPF_JMP | BPF_JGT | BPF_X,
+	[BPF_S_JMP_JSET_K]	= BPF_JMP | BPF_JSET | BPF_K,
+	[BPF_S_JMP_JSET_X]	= BPF_JMP | BPF_JSET | BPF_X,
+};
+
+/*
+ * One pass of the translation. Nothing is written unless @new_prog is
+ * given; @addrs, when given, records where every classic instruction
+ * starts and is what jump offsets are computed from, so they are only
+ * right once a previous pass has filled it in.
+ */
+static int __sk_convert_filter(struct sock_filter *prog, int len,
+			       struct sock_filter_int *new_prog, int *addrs)
+{
+	struct sock_filter_int tmp_insns[6];
+	struct sock_filter_int *insn;
+	struct sock_filter *fp;
+	int new_len = 0, target, i;
+	u16 code;
+
+#define BPF_EMIT_JMP							\
+	do {								\
+		if (target >= len || target < 0)			\
+			return -EINVAL;					\
+		insn->off = addrs ? addrs[target] - addrs[i] - 1 : 0;	\
+		/* Adjust pc relative offset for 2nd or 3rd insn. */	\
+		insn->off -= insn - tmp_insns;				\
+	} while (0)
+
+	/* A and X start out as 0 and the context arrives in R1 */
+	tmp_insns[0] = BPF_ALU32_REG(BPF_XOR, BPF_REG_A, BPF_REG_A);
+	tmp_insns[1] = BPF_ALU32_REG(BPF_XOR, BPF_REG_X, BPF_REG_X);
+	tmp_insns[2] = BPF_MOV64_REG(BPF_REG_CTX, BPF_REG_ARG1);
+	if (new_prog)
+		memcpy(new_prog, tmp_insns, 3 * sizeof(*insn));
+	new_len = 3;
+
+	for (i = 0, fp = prog; i < len; i++, fp++) {
+		memset(tmp_insns, 0, sizeof(tmp_insns));
+		insn = tmp_insns;
+
+		if (addrs)
+			addrs[i] = new_len;
+
+		switch (fp->code) {
+		/* Arithmetic maps one to one, all of it is 32 bit */
+		case BPF_S_ALU_ADD_K:
+		case BPF_S_ALU_ADD_X:
+		case BPF_S_ALU_SUB_K:
+		case BPF_S_ALU_SUB_X:
+		case BPF_S_ALU_MUL_K:
+		case BPF_S_ALU_MUL_X:
+		case BPF_S_ALU_DIV_X:
+		case BPF_S_ALU_MOD_K:
+		case BPF_S_ALU_MOD_X:
+		case BPF_S_ALU_AND_K:
+		case BPF_S_ALU_AND_X:
+		case BPF_S_ALU_OR_K:
+		case BPF_S_ALU_OR_X:
+		case BPF_S_ALU_XOR_K:
+		case BPF_S_ALU_XOR_X:
+		case BPF_S_ALU_LSH_K:
+		case BPF_S_ALU_LSH_X:
+		case BPF_S_ALU_RSH_K:
+		case BPF_S_ALU_RSH_X:
+		case BPF_S_ALU_NEG:
+			code = bpf_s_codes[fp->code];
+			*insn = BPF_RAW_INSN(code, BPF_REG_A,
+					     BPF_SRC(code) == BPF_X ?
+					     BPF_REG_X : 0, 0, fp->k);
+			break;
+
+		/*
+		 * sk_chk_filter() replaced k by its reciprocal, divide
+		 * exactly like reciprocal_divide() does.
+		 */
+		case BPF_S_ALU_DIV_K:
+			*insn++ = BPF_MOV32_IMM(BPF_REG_TMP, fp->k);
+			*insn++ = BPF_ALU64_REG(BPF_MUL, BPF_REG_A, BPF_REG_TMP);
+			*insn = BPF_ALU64_IMM(BPF_RSH, BPF_REG_A, 32);
+			break;
+
+		/* Packet loads, the result lands in R0 which is A */
+		case BPF_S_LD_W_ABS:
+		case BPF_S_LD_H_ABS:
+		case BPF_S_LD_B_ABS:
+			*insn = BPF_RAW_INSN(bpf_s_codes[fp->code], 0, 0, 0,
+					     fp->k);
+			break;
+
+		case BPF_S_LD_W_IND:
+		case BPF_S_LD_H_IND:
+		case BPF_S_LD_B_IND:
+			*insn = BPF_RAW_INSN(bpf_s_codes[fp->code], 0,
+					     BPF_REG_X, 0, fp->k);
+			break;
+
+		/* X = 4 * (P[k] & 0xf), without losing A */
+		case BPF_S_LDX_B_MSH:
+			*insn++ = BPF_MOV64_REG(BPF_REG_TMP, BPF_REG_A);
+			*insn++ = BPF_LD_ABS(BPF_B, fp->k);
+			*insn++ = BPF_ALU32_IMM(BPF_AND, BPF_REG_A, 0xf);
+			*insn++ = BPF_ALU32_IMM(BPF_LSH, BPF_REG_A, 2);
+			*insn++ = BPF_MOV64_REG(BPF_REG_X, BPF_REG_A);
+			*insn = BPF_MOV64_REG(BPF_REG_A, BPF_REG_TMP);
+			break;
+
+		case BPF_S_LD_W_LEN:
+			*insn = BPF_LDX_MEM(BPF_W, BPF_REG_A, BPF_REG_CTX,
+					    offsetof(struct sk_buff, len));
+			break;
+
+		case BPF_S_LDX_W_LEN:
+			*insn = BPF_LDX_MEM(BPF_W, BPF_REG_X, BPF_REG_CTX,
+					    offsetof(struct sk_buff, len));
+			break;
+
+		case BPF_S_LD_IMM:
+			*insn = BPF_MOV32_IMM(BPF_REG_A, fp->k);
+			break;
+
+		case BPF_S_LDX_IMM:
+			*insn = BPF_MOV32_IMM(BPF_REG_X, fp->k);
+			break;
+
+		/* The scratch memory lives at the top of the stack */
+		case BPF_S_LD_MEM:
+			*insn = BPF_LDX_MEM(BPF_W, BPF_REG_A, BPF_REG_FP,
+					    -(BPF_MEMWORDS - fp->k) * 4);
+			break;
+
+		case BPF_S_LDX_MEM:
+			*insn = BPF_LDX_MEM(BPF_W, BPF_REG_X, BPF_REG_FP,
+					    -(BPF_MEMWORDS - fp->k) * 4);
+			break;
+
+		case BPF_S_ST:
+			*insn = BPF_STX_MEM(BPF_W, BPF_REG_FP, BPF_REG_A,
+					    -(BPF_MEMWORDS - fp->k) * 4);
+			break;
+
+		case BPF_S_STX:
+			*insn = BPF_STX_MEM(BPF_W, BPF_REG_FP, BPF_REG_X,
+					    -(BPF_MEMWORDS - fp->k) * 4);
+			break;
+
+		case BPF_S_MISC_TAX:
+			*insn = BPF_MOV32_REG(BPF_REG_X, BPF_REG_A);
+			break;
+
+		case BPF_S_MISC_TXA:
+			*insn = BPF_MOV32_REG(BPF_REG_A, BPF_REG_X);
+			break;
+
+		case BPF_S_RET_K:
+			*insn++ = BPF_MOV32_IMM(BPF_REG_A, fp->k);
+			*insn = BPF_EXIT_INSN();
+			break;
+
+		case BPF_S_RET_A:
+			*insn = BPF_EXIT_INSN();
+			break;
+
+		case BPF_S_JMP_JA:
+			insn->code = BPF_JMP | BPF_JA;
+			target = i + fp->k + 1;
+			BPF_EMIT_JMP;
+			break;
+
+		case BPF_S_JMP_JEQ_K:
+		case BPF_S_JMP_JEQ_X:
+		case BPF_S_JMP_JGE_K:
+		case BPF_S_JMP_JGE_X:
+		case BPF_S_JMP_JGT_K:
+		case BPF_S_JMP_JGT_X:
+		case BPF_S_JMP_JSET_K:
+		case BPF_S_JMP_JSET_X:
+			code = bpf_s_codes[fp->code];
+			if (BPF_SRC(code) == BPF_K && (int) fp->k < 0) {
+				/*
+				 * Immediates are sign extended to 64 bit
+				 * while A is zero extended, compare against
+				 * a zero extended copy of k instead.
+				 */
+				*insn++ = BPF_MOV32_IMM(BPF_REG_TMP, fp->k);
+				insn->dst_reg = BPF_REG_A;
+				insn->src_reg = BPF_REG_TMP;
+				code = BPF_JMP | BPF_OP(code) | BPF_X;
+			} else {
+				insn->dst_reg = BPF_REG_A;
+				insn->src_reg = BPF_SRC(code) == BPF_X ?
+						BPF_REG_X : 0;
+				insn->imm = fp->k;
+			}
+
+			/* Common case where 'jump_false' is next insn */
+			if (fp->jf == 0) {
+				insn->code = code;
+				target = i + fp->jt + 1;
+				BPF_EMIT_JMP;
+				break;
+			}
+
+			/* Convert JEQ into JNE when 'jump_true' is next insn */
+			if (fp->jt == 0 && BPF_OP(code) == BPF_JEQ) {
+				insn->code = BPF_JMP | BPF_JNE | BPF_SRC(code);
+				target = i + fp->jf + 1;
+				BPF_EMIT_JMP;
+				break;
+			}
+
+			/* Other jumps are mapped into two insns: Jxx and JA */
+			insn->code = code;
+			target = i + fp->jt + 1;
+			BPF_EMIT_JMP;
+			insn++;
+
+			insn->code = BPF_JMP | BPF_JA;
+			target = i + fp->jf + 1;
+			BPF_EMIT_JMP;
+			break;
+
+		/* seccomp loads 32 bit words of its struct seccomp_data */
+		case BPF_S_ANC_SECCOMP_LD_W:
+			*insn = BPF_LDX_MEM(BPF_W, BPF_REG_A, BPF_REG_CTX,
+					    fp->k);
+			break;
+
+		default:
+			if (!convert_bpf_extensions(fp, &insn))
+				return -EINVAL;
+			break;
+		}
+
+		insn++;
+		if (new_prog)
+			memcpy(new_prog + new_len, tmp_insns,
+			       sizeof(*insn) * (insn - tmp_insns));
+		new_len += insn - tmp_insns;
+	}
+#undef BPF_EMIT_JMP
+
+	return new_len;
+}
+
+/**
+ *	sk_convert_filter - convert filter program
+ *	@prog: the program checked by sk_chk_filter()
+ *	@len: the length of the classic program
+ *	@new_prog: buffer where converted program will be stored
+ *	@new_len: pointer to store length of converted program
+ *
+ * Remap a classic program onto the internal instruction set, with A
+ * in R0, X in R7 and the context in R6. Called once with @new_prog
+ * set to NULL it only computes the length, called again with a buffer
+ * of that many instructions it emits the program.
+ *
+ * Returns 0 on success or a negative errno.
+ */
+int sk_convert_filter(struct sock_filter *prog, int len,
+		      struct sock_filter_int *new_prog, int *new_len)
+{
+	int *addrs;
+	int ret;
+
+	BUILD_BUG_ON(BPF_MEMWORDS * sizeof(u32) > MAX_BPF_STACK);
+	BUILD_BUG_ON(BPF_REG_FP + 1 != MAX_BPF_REG);
+	BUILD_BUG_ON(sizeof(struct sock_filter) !=
+		     sizeof(struct sock_filter_int));
+
+	if (len <= 0 || len > BPF_MAXINSNS)
+		return -EINVAL;
+
+	if (!new_prog) {
+		ret = __sk_convert_filter(prog, len, NULL, NULL);
+		if (ret < 0)
+			return ret;
+		*new_len = ret;
+		return 0;
+	}
+
+	addrs = kcalloc(len, sizeof(*addrs), GFP_KERNEL);
+	if (!addrs)
+		return -ENOMEM;
+
+	/* Lay out the program first so that jumps can be resolved */
+	ret = __sk_convert_filter(prog, len, NULL, addrs);
+	if (ret >= 0)
+		ret = __sk_convert_filter(prog, len, new_prog, addrs);
+	kfree(addrs);
+	if (ret < 0)
+		return ret;
+
+	*new_len = ret;
+	return 0;
+}
+EXPORT_SYMBOL_GPL(sk_convert_filter);
+
+/* Architectures with a JIT for internal BPF override this */
+void __weak bpf_int_jit_compile(struct sk_filter *prog)
+{
+}
+
+/**
+ *	sk_filter_select_runtime - select execution runtime for BPF program
+ *	@fp: sk_filter populated with internal BPF program
+ *
+ * Hand the program to the internal BPF JIT if the architecture has one
+ * and it is enabled, otherwise run it in the interpreter.
+ */
+void sk_filter_select_runtime(struct sk_filter *fp)
+{
+	fp->bpf_func = sk_run_filter_int;
+	fp->jited = 0;
+
+	bpf_int_jit_compile(fp);
+}
+EXPORT_SYMBOL_GPL(sk_filter_select_runtime);
+
+/**
+ *	sk_filter_free - free a filter and its JIT image
+ *	@fp: the filter
+ */
+void sk_filter_free(struct sk_filter *fp)
+{
+	if (fp->jited)
+		bpf_jit_free(fp);
+	kfree(fp);
+}
+EXPORT_SYMBOL_GPL(sk_filter_free);
+
 /*
  * Security :
  * A BPF program is able to use 16 cells of memory to store intermediate
@@ -623,23 +1594,110 @@ void sk_filter_release_rcu(struct rcu_head *rcu)
 {
 	struct sk_filter *fp = container_of(rcu, struct sk_filter, rcu);
 
-	bpf_jit_free(fp);
-	kfree(fp);
+	sk_filter_free(fp);
 }
 EXPORT_SYMBOL(sk_filter_release_rcu);
 
-static int __sk_prepare_filter(struct sk_filter *fp)
+static struct sk_filter *__sk_migrate_realloc(struct sk_filter *fp,
+					      struct sock *sk,
+					      unsigned int len)
+{
+	struct sk_filter *fp_new;
+
+	if (sk == NULL)
+		return krealloc(fp, len, GFP_KERNEL);
+
+	fp_new = sock_kmalloc(sk, len, GFP_KERNEL);
+	if (fp_new) {
+		memcpy(fp_new, fp, sizeof(struct sk_filter));
+		sock_kfree_s(sk, fp, sk_filter_len(fp));
+	}
+
+	return fp_new;
+}
+
+/*
+ * Replace the checked classic program of @fp by its internal BPF
+ * translation. On failure @fp is released and an ERR_PTR returned.
+ */
+static struct sk_filter *__sk_migrate_filter(struct sk_filter *fp,
+					     struct sock *sk)
+{
+	struct sock_filter *old_prog;
+	struct sk_filter *old_fp;
+	int err, new_len, old_len = fp->len;
+
+	/* The translation can't be done in place */
+	old_prog = kmemdup(fp->insns, old_len * sizeof(struct sock_filter),
+			   GFP_KERNEL);
+	if (!old_prog) {
+		err = -ENOMEM;
+		goto out_err;
+	}
+
+	err = sk_convert_filter(old_prog, old_len, NULL, &new_len);
+	if (err)
+		goto out_err_free;
+
+	old_fp = fp;
+	fp = __sk_migrate_realloc(old_fp, sk, sizeof(*fp) +
+				  new_len * sizeof(struct sock_filter_int));
+	if (!fp) {
+		fp = old_fp;
+		err = -ENOMEM;
+		goto out_err_free;
+	}
+	fp->len = new_len;
+
+	err = sk_convert_filter(old_prog, old_len, fp->insnsi, &new_len);
+	if (err)
+		goto out_err_free;
+
+	sk_filter_select_runtime(fp);
+
+	kfree(old_prog);
+	return fp;
+
+out_err_free:
+	kfree(old_prog);
+out_err:
+	if (sk != NULL)
+		sk_filter_uncharge(sk, fp);
+	else
+		kfree(fp);
+	return ERR_PTR(err);
+}
+
+/*
+ * Check the classic program of @fp and pick how it runs: an
+ * architecture JIT for classic BPF if there is one, otherwise the
+ * internal BPF translation. On failure @fp is released and an ERR_PTR
+ * returned.
+ */
+static struct sk_filter *__sk_prepare_filter(struct sk_filter *fp,
+					     struct sock *sk)
 {
 	int err;
 
 	fp->bpf_func = sk_run_filter;
+	fp->jited = 0;
 
 	err = sk_chk_filter(fp->insns, fp->len);
-	if (err)
-		return err;
+	if (err) {
+		if (sk != NULL)
+			sk_filter_uncharge(sk, fp);
+		else
+			kfree(fp);
+		return ERR_PTR(err);
+	}
 
 	bpf_jit_compile(fp);
-	return 0;
+	if (fp->bpf_func != sk_run_filter) {
+		fp->jited = 1;
+		return fp;
+	}
+
+	return __sk_migrate_filter(fp, sk);
 }
 
 /**
@@ -657,7 +1715,6 @@ int sk_unattached_filter_create(struct sk_filter **pfp,
 {
 	struct sk_filter *fp;
 	unsigned int fsize = sizeof(struct sock_filter) * fprog->len;
-	int err;
 
 	/* Make sure new filter is there and in the right amounts. */
 	if (fprog->filter == NULL)
@@ -671,15 +1728,12 @@ int sk_unattached_filter_create(struct sk_filter **pfp,
 	atomic_set(&fp->refcnt, 1);
 	fp->len = fprog->len;
 
-	err = __sk_prepare_filter(fp);
-	if (err)
-		goto free_mem;
+	fp = __sk_prepare_filter(fp, NULL);
+	if (IS_ERR(fp))
+		return PTR_ERR(fp);
 
 	*pfp = fp;
 	return 0;
-free_mem:
-	kfree(fp);
-	return err;
 }
 EXPORT_SYMBOL_GPL(sk_unattached_filter_create);
 
@@ -703,7 +1757,6 @@ int sk_attach_filter(struct sock_fprog *fprog, struct sock *sk)
 {
 	struct sk_filter *fp, *old_fp;
 	unsigned int fsize = sizeof(struct sock_filter) * fprog->len;
-	int err;
 
 	/* Make sure new filter is there and in the right amounts. */
 	if (fprog->filter == NULL)
@@ -720,11 +1773,9 @@ int sk_attach_filter(struct sock_fprog *fprog, struct sock *sk)
 	atomic_set(&fp->refcnt, 1);
 	fp->len = fprog->len;
 
-	err = __sk_prepare_filter(fp);
-	if (err) {
-		sk_filter_uncharge(sk, fp);
-		return err;
-	}
+	fp = __sk_prepare_filter(fp, sk);
+	if (IS_ERR(fp))
+		return PTR_ERR(fp);
 
 	old_fp = rcu_dereference_protected(sk->sk_filter,
 					   sock_owned_by_user(sk));
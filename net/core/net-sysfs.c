@@ -256,8 +256,7 @@ NETDEVICE_SHOW(tx_queue_len, fmt_ulong);
 
 static int change_tx_queue_len(struct net_device *net, unsigned long new_len)
 {
-	net->tx_queue_len = new_len;
-	return 0;
+	return dev_change_tx_queue_len(net, new_len);
 }
 
 static ssize_t store_tx_queue_len(struct device *dev,
@@ -697,6 +697,10 @@ static void __copy_skb_header(struct sk_buff *new, const struct sk_buff *old)
 	new->vlan_tci		= old->vlan_tci;
 
 	skb_copy_secmark(new, old);
+
+#ifdef CONFIG_NET_RX_BUSY_POLL
+	new->napi_id		= old->napi_id;
+#endif
 }
 
 /*
@@ -797,6 +801,7 @@ int skb_copy_ubufs(struct sk_buff *skb, gfp_t gfp_mask)
 	for (i = 0; i < num_frags; i++)
 		skb_frag_unref(skb, i);
 
+	uarg->zerocopy = 0;
 	uarg->callback(uarg);
 
 	/* skb frags point to kernel buffers */
@@ -811,6 +816,245 @@ int skb_copy_ubufs(struct sk_buff *skb, gfp_t gfp_mask)
 }
 EXPORT_SYMBOL_GPL(skb_copy_ubufs);
 
+static inline struct sk_buff *skb_from_uarg(struct ubuf_info *uarg)
+{
+	return container_of((void *)uarg, struct sk_buff, cb);
+}
+
+/**
+ *	sock_zerocopy_alloc - start a MSG_ZEROCOPY send
+ *	@sk: the sending socket
+ *
+ *	Allocates the notification skb that will complete the send on the
+ *	error queue of @sk and returns the ubuf_info embedded in it, with
+ *	one reference held by the caller. The skb is charged to the option
+ *	memory of @sk, which bounds the number of outstanding sends.
+ */
+struct ubuf_info *sock_zerocopy_alloc(struct sock *sk)
+{
+	struct ubuf_info *uarg;
+	struct sk_buff *skb;
+
+	skb = sock_omalloc(sk, 0, sk->sk_allocation);
+	if (!skb)
+		return NULL;
+
+	BUILD_BUG_ON(sizeof(*uarg) > sizeof(skb->cb));
+	uarg = (void *)skb->cb;
+
+	uarg->callback = sock_zerocopy_callback;
+	uarg->ctx = NULL;
+	uarg->desc = 0;
+	uarg->id = ((u32)atomic_inc_return(&sk->sk_zckey)) - 1;
+	uarg->len = 1;
+	uarg->zerocopy = 1;
+	atomic_set(&uarg->refcnt, 1);
+	sock_hold(sk);
+
+	return uarg;
+}
+EXPORT_SYMBOL_GPL(sock_zerocopy_alloc);
+
+/* Fold [lo, lo + len) into the notification at the tail of the queue */
+static bool skb_zerocopy_notify_extend(struct sk_buff *skb, u32 lo, u16 len,
+				       u8 code)
+{
+	struct sock_exterr_skb *serr = SKB_EXT_ERR(skb);
+	u32 old_lo, old_hi;
+
+	if (serr->ee.ee_origin != SO_EE_ORIGIN_ZEROCOPY ||
+	    serr->ee.ee_code != code)
+		return false;
+
+	old_lo = serr->ee.ee_info;
+	old_hi = serr->ee.ee_data;
+	if (lo != old_hi + 1)
+		return false;
+
+	/* the range must stay representable */
+	if ((u64)old_hi - old_lo + 1 + len >= (1ULL << 32))
+		return false;
+
+	serr->ee.ee_data += len;
+	return true;
+}
+
+static void __sock_zerocopy_callback(struct ubuf_info *uarg)
+{
+	struct sk_buff *tail, *skb = skb_from_uarg(uarg);
+	struct sock_exterr_skb *serr;
+	struct sock *sk = skb->sk;
+	struct sk_buff_head *q;
+	unsigned long flags;
+	u32 lo = uarg->id;
+	u16 len = uarg->len;
+	u8 code = uarg->zerocopy ? 0 : SO_EE_CODE_ZEROCOPY_COPIED;
+
+	/* an aborted send is not reported */
+	if (!len || sock_flag(sk, SOCK_DEAD))
+		goto release;
+
+	/* the control block is reused for the error report */
+	serr = SKB_EXT_ERR(skb);
+	memset(serr, 0, sizeof(*serr));
+	serr->ee.ee_errno = 0;
+	serr->ee.ee_origin = SO_EE_ORIGIN_ZEROCOPY;
+	serr->ee.ee_code = code;
+	serr->ee.ee_info = lo;
+	serr->ee.ee_data = lo + len - 1;
+
+	q = &sk->sk_error_queue;
+	spin_lock_irqsave(&q->lock, flags);
+	tail = skb_peek_tail(q);
+	if (!tail || !skb_zerocopy_notify_extend(tail, lo, len, code)) {
+		__skb_queue_tail(q, skb);
+		skb = NULL;
+	}
+	spin_unlock_irqrestore(&q->lock, flags);
+
+	sk->sk_error_report(sk);
+
+release:
+	consume_skb(skb);
+	sock_put(sk);
+}
+
+/**
+ *	sock_zerocopy_callback - drop a reference to a MSG_ZEROCOPY send
+ *	@uarg: the ubuf_info of the send
+ *
+ *	Called whenever an skb sharing the user pages of the send is freed
+ *	or has its pages copied. The last reference queues the completion
+ *	notification on the error queue of the socket.
+ */
+void sock_zerocopy_callback(struct ubuf_info *uarg)
+{
+	if (atomic_dec_and_test(&uarg->refcnt))
+		__sock_zerocopy_callback(uarg);
+}
+EXPORT_SYMBOL_GPL(sock_zerocopy_callback);
+
+/**
+ *	sock_zerocopy_put_abort - drop the caller reference of a failed send
+ *	@uarg: the ubuf_info of the send, may be %NULL
+ *
+ *	Used when the send queued no data at all. Its notification id is
+ *	handed back so that userspace sees a contiguous range, unless a
+ *	concurrent send on an unlocked path already took a later id. In
+ *	that case the id is reported like that of a completed send.
+ */
+void sock_zerocopy_put_abort(struct ubuf_info *uarg)
+{
+	if (uarg) {
+		struct sock *sk = skb_from_uarg(uarg)->sk;
+		u32 next = uarg->id + 1;
+
+		if ((u32)atomic_cmpxchg(&sk->sk_zckey, next, uarg->id) == next)
+			uarg->len--;
+
+		sock_zerocopy_put(uarg);
+	}
+}
+EXPORT_SYMBOL_GPL(sock_zerocopy_put_abort);
+
+/**
+ *	skb_zerocopy_iter - append user pages to an skb as frags
+ *	@skb: buffer to add to, already associated with a MSG_ZEROCOPY send
+ *	@from: user address of the data
+ *	@len: number of bytes at @from
+ *
+ *	Pins the pages backing @from and appends them as frags of @skb
+ *	instead of copying the data. Fewer than @len bytes are added if
+ *	@skb runs out of frags. The caller accounts the bytes to the socket.
+ *
+ *	Returns the number of bytes added, -EMSGSIZE if @skb has no free
+ *	frag or -EFAULT if no page could be pinned.
+ */
+int skb_zerocopy_iter(struct sk_buff *skb, const void __user *from, int len)
+{
+	struct page *pages[MAX_SKB_FRAGS];
+	unsigned long addr = (unsigned long)from;
+	int frag = skb_shinfo(skb)->nr_frags;
+	int off = addr & ~PAGE_MASK;
+	int copied = 0;
+	int i, n;
+
+	n = min_t(int, MAX_SKB_FRAGS - frag,
+		  DIV_ROUND_UP(off + len, PAGE_SIZE));
+	if (n <= 0)
+		return -EMSGSIZE;
+
+	n = get_user_pages_fast(addr & PAGE_MASK, n, 0, pages);
+	if (n <= 0)
+		return -EFAULT;
+
+	for (i = 0; i < n; i++) {
+		int size = min_t(int, len - copied, PAGE_SIZE - off);
+
+		skb_fill_page_desc(skb, frag++, pages[i], off, size);
+		copied += size;
+		off = 0;
+	}
+
+	skb->len += copied;
+	skb->data_len += copied;
+	skb->truesize += copied;
+	return copied;
+}
+EXPORT_SYMBOL_GPL(skb_zerocopy_iter);
+
+/**
+ *	skb_zerocopy_iovec - append user pages of an iovec to an skb as frags
+ *	@skb: buffer to add to
+ *	@iov: user iovec array
+ *	@offset: offset into @iov of the first byte
+ *	@len: number of bytes to add
+ *
+ *	Like skb_zerocopy_iter(), but all @len bytes are added or the call
+ *	fails. Returns 0 on success, -EMSGSIZE without touching @skb if the
+ *	pages do not fit in its frags, or -EFAULT.
+ */
+int skb_zerocopy_iovec(struct sk_buff *skb, const struct iovec *iov,
+		       int offset, int len)
+{
+	const struct iovec *v;
+	int npages = 0;
+	int off, left, size, ret;
+
+	while (offset >= iov->iov_len) {
+		offset -= iov->iov_len;
+		iov++;
+	}
+
+	/* count the pages first so that a failure leaves the skb alone */
+	for (v = iov, off = offset, left = len; left > 0; v++, off = 0) {
+		unsigned long base = (unsigned long)v->iov_base + off;
+
+		size = min_t(int, v->iov_len - off, left);
+		if (size)
+			npages += DIV_ROUND_UP((base & ~PAGE_MASK) + size,
+					       PAGE_SIZE);
+		left -= size;
+	}
+	if (skb_shinfo(skb)->nr_frags + npages > MAX_SKB_FRAGS)
+		return -EMSGSIZE;
+
+	for (v = iov, off = offset, left = len; left > 0; v++, off = 0) {
+		size = min_t(int, v->iov_len - off, left);
+		while (size > 0) {
+			ret = skb_zerocopy_iter(skb, v->iov_base + off, size);
+			if (ret < 0)
+				return ret;
+			off += ret;
+			size -= ret;
+			left -= ret;
+		}
+	}
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(skb_zerocopy_iovec);
+
 /**
  *	skb_clone	-	duplicate an sk_buff
  *	@skb: buffer to clone
@@ -972,6 +1216,7 @@ struct sk_buff *__pskb_copy(struct sk_buff *skb, int headroom, gfp_t gfp_mask)
 			skb_frag_ref(skb, i);
 		}
 		skb_shinfo(n)->nr_frags = i;
+		skb_zcopy_clone(n, skb);
 	}
 
 	if (skb_has_frag_list(skb)) {
@@ -1042,6 +1287,8 @@ int pskb_expand_head(struct sk_buff *skb, int nhead, int ntail,
 		/* copy this zero copy skb frags */
 		if (skb_orphan_frags(skb, gfp_mask))
 			goto nofrags;
+		if (skb_zcopy(skb))
+			sock_zerocopy_get(skb_uarg(skb));
 		for (i = 0; i < skb_shinfo(skb)->nr_frags; i++)
 			skb_frag_ref(skb, i);
 
@@ -1768,15 +2015,49 @@ static bool __skb_splice_bits(struct sk_buff *skb, struct pipe_inode_info *pipe,
 	return false;
 }
 
+/*
+ * Hand the pages collected by skb_splice_bits() to the pipe, for callers
+ * that hold the socket lock.
+ */
+ssize_t skb_socket_splice(struct sock *sk,
+			  struct pipe_inode_info *pipe,
+			  struct splice_pipe_desc *spd)
+{
+	ssize_t ret;
+
+	/*
+	 * Drop the socket lock, otherwise we have reverse
+	 * locking dependencies between sk_lock and i_mutex
+	 * here as compared to sendfile(). We enter here
+	 * with the socket lock held, and splice_to_pipe() will
+	 * grab the pipe inode lock. For sendfile() emulation,
+	 * we call into ->sendpage() with the i_mutex lock held
+	 * and networking will grab the socket lock.
+	 */
+	release_sock(sk);
+	ret = splice_to_pipe(pipe, spd);
+	lock_sock(sk);
+
+	return ret;
+}
+EXPORT_SYMBOL_GPL(skb_socket_splice);
+
 /*
  * Map data from the skb to a pipe. Should handle both the linear part,
  * the fragments, and the frag list. It does NOT handle frag lists within
  * the frag list, if such a thing exists. We'd probably need to recurse to
  * handle that cleanly.
+ *
+ * @sk is the socket the data is read from, which is not necessarily
+ * skb->sk, and @splice_cb moves the collected pages into the pipe with
+ * whatever locks the caller holds dropped as needed.
  */
-int skb_splice_bits(struct sk_buff *skb, unsigned int offset,
+int skb_splice_bits(struct sk_buff *skb, struct sock *sk, unsigned int offset,
 		    struct pipe_inode_info *pipe, unsigned int tlen,
-		    unsigned int flags)
+		    unsigned int flags,
+		    ssize_t (*splice_cb)(struct sock *,
+					 struct pipe_inode_info *,
+					 struct splice_pipe_desc *))
 {
 	struct partial_page partial[MAX_SKB_FRAGS];
 	struct page *pages[MAX_SKB_FRAGS];
@@ -1789,7 +2070,6 @@ int skb_splice_bits(struct sk_buff *skb, unsigned int offset,
 		.spd_release = sock_spd_release,
 	};
 	struct sk_buff *frag_iter;
-	struct sock *sk = skb->sk;
 	int ret = 0;
 
 	/*
@@ -1812,20 +2092,8 @@ int skb_splice_bits(struct sk_buff *skb, unsigned int offset,
 	}
 
 done:
-	if (spd.nr_pages) {
-		/*
-		 * Drop the socket lock, otherwise we have reverse
-		 * locking dependencies between sk_lock and i_mutex
-		 * here as compared to sendfile(). We enter here
-		 * with the socket lock held, and splice_to_pipe() will
-		 * grab the pipe inode lock. For sendfile() emulation,
-		 * we call into ->sendpage() with the i_mutex lock held
-		 * and networking will grab the socket lock.
-		 */
-		release_sock(sk);
-		ret = splice_to_pipe(pipe, &spd);
-		lock_sock(sk);
-	}
+	if (spd.nr_pages)
+		ret = splice_cb(sk, pipe, &spd);
 
 	return ret;
 }
@@ -2326,6 +2594,7 @@ void skb_split(struct sk_buff *skb, struct sk_buff *skb1, const u32 len)
 {
 	int pos = skb_headlen(skb);
 
+	skb_zcopy_clone(skb1, skb);
 	if (len < pos)	/* Split line is inside header. */
 		skb_split_inside_header(skb, skb1, len, pos);
 	else		/* Second chunk has no header, nothing to copy. */
@@ -2368,6 +2637,10 @@ int skb_shift(struct sk_buff *tgt, struct sk_buff *skb, int shiftlen)
 	BUG_ON(shiftlen > skb->len);
 	BUG_ON(skb_headlen(skb));	/* Would corrupt stream */
 
+	/* user pages must stay with the send they belong to */
+	if (skb_zcopy(tgt) || skb_zcopy(skb))
+		return 0;
+
 	todo = shiftlen;
 	from = 0;
 	to = skb_shinfo(tgt)->nr_frags;
@@ -2756,6 +3029,9 @@ struct sk_buff *skb_segment(struct sk_buff *skb, netdev_features_t features)
 	int i = 0;
 	int pos;
 
+	if (unlikely(skb_orphan_frags(skb, GFP_ATOMIC)))
+		return ERR_PTR(-ENOMEM);
+
 	__skb_push(skb, doffset);
 	headroom = skb_headroom(skb);
 	pos = skb_headlen(skb);
@@ -2842,6 +3118,8 @@ struct sk_buff *skb_segment(struct sk_buff *skb, netdev_features_t features)
 		skb_copy_from_linear_data_offset(skb, offset,
 						 skb_put(nskb, hsize), hsize);
 
+		skb_zcopy_clone(nskb, skb);
+
 		while (pos < offset + len && i < nfrags) {
 			*frag = skb_shinfo(skb)->frags[i];
 			__skb_frag_ref(frag);
@@ -154,11 +154,10 @@ EXPORT_SYMBOL_GPL(dccp_create_openreq_child);
 
 /*
  * Process an incoming packet for RESPOND sockets represented
- * as an request_sock.
+ * as an request_sock. The caller holds the rsk_lock of the request.
  */
 struct sock *dccp_check_req(struct sock *sk, struct sk_buff *skb,
-			    struct request_sock *req,
-			    struct request_sock **prev)
+			    struct request_sock *req)
 {
 	struct sock *child = NULL;
 	struct dccp_request_sock *dreq = dccp_rsk(req);
@@ -172,7 +171,7 @@ struct sock *dccp_check_req(struct sock *sk, struct sk_buff *skb,
 			/*
 			 * Send another RESPONSE packet
 			 * To protect against Request floods, increment retrans
-			 * counter (backoff, monitored by dccp_response_timer).
+			 * counter (backoff, monitored by the request timer).
 			 */
 			req->retrans++;
 			req->rsk_ops->rtx_syn_ack(sk, req, NULL);
@@ -206,9 +205,13 @@ struct sock *dccp_check_req(struct sock *sk, struct sk_buff *skb,
 	if (child == NULL)
 		goto listen_overflow;
 
-	inet_csk_reqsk_queue_unlink(sk, req, prev);
-	inet_csk_reqsk_queue_removed(sk, req);
-	inet_csk_reqsk_queue_add(sk, req, child);
+	/* The accept queue takes over the reference of the hash */
+	inet_csk_reqsk_queue_unlink(sk, req);
+	if (!inet_csk_reqsk_queue_add(sk, req, child)) {
+		bh_unlock_sock(child);
+		sock_put(child);
+		child = NULL;
+	}
 out:
 	return child;
 listen_overflow:
@@ -218,7 +221,7 @@ drop:
 	if (dccp_hdr(skb)->dccph_type != DCCP_PKT_RESET)
 		req->rsk_ops->send_reset(sk, skb);
 
-	inet_csk_reqsk_queue_drop(sk, req, prev);
+	inet_csk_reqsk_queue_drop(sk, req);
 	goto out;
 }
 
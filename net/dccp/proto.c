@@ -1161,6 +1161,7 @@ static int __init dccp_init(void)
 	for (i = 0; i <= dccp_hashinfo.ehash_mask; i++) {
 		INIT_HLIST_NULLS_HEAD(&dccp_hashinfo.ehash[i].chain, i);
 		INIT_HLIST_NULLS_HEAD(&dccp_hashinfo.ehash[i].twchain, i);
+		INIT_HLIST_HEAD(&dccp_hashinfo.ehash[i].reqchain);
 	}
 
 	if (inet_ehash_locks_alloc(&dccp_hashinfo))
@@ -373,6 +373,8 @@ lookup_protocol:
 
 	inet = inet_sk(sk);
 	inet->is_icsk = (INET_PROTOSW_ICSK & answer_flags) != 0;
+	if (inet->is_icsk)
+		spin_lock_init(&inet_csk(sk)->icsk_accept_queue.rskq_lock);
 
 	inet->nodefrag = 0;
 
@@ -1294,6 +1296,7 @@ static struct sk_buff *inet_gso_segment(struct sk_buff *skb,
 	int ihl;
 	int id;
 	unsigned int offset = 0;
+	bool ufo;
 
 	if (!(features & NETIF_F_V4_CSUM))
 		features &= ~NETIF_F_SG;
@@ -1303,9 +1306,13 @@ static struct sk_buff *inet_gso_segment(struct sk_buff *skb,
 		       SKB_GSO_UDP |
 		       SKB_GSO_DODGY |
 		       SKB_GSO_TCP_ECN |
+		       SKB_GSO_UDP_L4 |
 		       0)))
 		goto out;
 
+	/* UFO splits one datagram into IP fragments */
+	ufo = !!(skb_shinfo(skb)->gso_type & SKB_GSO_UDP);
+
 	if (unlikely(!pskb_may_pull(skb, sizeof(*iph))))
 		goto out;
 
@@ -1336,7 +1343,7 @@ static struct sk_buff *inet_gso_segment(struct sk_buff *skb,
 	skb = segs;
 	do {
 		iph = ip_hdr(skb);
-		if (proto == IPPROTO_UDP) {
+		if (ufo) {
 			iph->id = htons(id);
 			iph->frag_off = htons(offset >> 3);
 			if (skb->next != NULL)
@@ -1410,8 +1417,14 @@ static struct sk_buff **inet_gro_receive(struct sk_buff **head,
 		/* All fields must match except length and checksum. */
 		NAPI_GRO_CB(p)->flush |=
 			(iph->ttl ^ iph2->ttl) |
-			(iph->tos ^ iph2->tos) |
-			((u16)(ntohs(iph2->id) + NAPI_GRO_CB(p)->count) ^ id);
+			(iph->tos ^ iph2->tos);
+
+		/* TCP segments must carry consecutive IDs. Datagrams are
+		 * only merged with DF set, their ID is meaningless.
+		 */
+		if (proto != IPPROTO_UDP)
+			NAPI_GRO_CB(p)->flush |=
+				(u16)(ntohs(iph2->id) + NAPI_GRO_CB(p)->count) ^ id;
 
 		NAPI_GRO_CB(p)->flush |= flush;
 	}
@@ -1571,6 +1584,8 @@ static const struct net_protocol udp_protocol = {
 	.err_handler =	udp_err,
 	.gso_send_check = udp4_ufo_send_check,
 	.gso_segment = udp4_ufo_fragment,
+	.gro_receive = udp4_gro_receive,
+	.gro_complete = udp4_gro_complete,
 	.no_policy =	1,
 	.netns_ok =	1,
 };
@@ -14,14 +14,13 @@
  */
 
 #include <linux/module.h>
-#include <linux/jhash.h>
 
 #include <net/inet_connection_sock.h>
 #include <net/inet_hashtables.h>
 #include <net/inet_timewait_sock.h>
 #include <net/ip.h>
 #include <net/route.h>
-#include <net/tcp_states.h>
+#include <net/tcp.h>
 #include <net/xfrm.h>
 
 #ifdef INET_CSK_DEBUG
@@ -59,6 +58,8 @@ int inet_csk_bind_conflict(const struct sock *sk,
 	struct sock *sk2;
 	struct hlist_node *node;
 	int reuse = sk->sk_reuse;
+	int reuseport = sk->sk_reuseport;
+	kuid_t uid = sock_i_uid((struct sock *)sk);
 
 	/*
 	 * Unlike other sk lookup places we do not check
@@ -73,8 +74,11 @@ int inet_csk_bind_conflict(const struct sock *sk,
 		    (!sk->sk_bound_dev_if ||
 		     !sk2->sk_bound_dev_if ||
 		     sk->sk_bound_dev_if == sk2->sk_bound_dev_if)) {
-			if (!reuse || !sk2->sk_reuse ||
-			    sk2->sk_state == TCP_LISTEN) {
+			if ((!reuse || !sk2->sk_reuse ||
+			    sk2->sk_state == TCP_LISTEN) &&
+			    (!reuseport || !sk2->sk_reuseport ||
+			    (sk2->sk_state != TCP_TIME_WAIT &&
+			     !uid_eq(uid, sock_i_uid(sk2))))) {
 				const __be32 sk2_rcv_saddr = sk_rcv_saddr(sk2);
 				if (!sk2_rcv_saddr || !sk_rcv_saddr(sk) ||
 				    sk2_rcv_saddr == sk_rcv_saddr(sk))
@@ -106,6 +110,7 @@ int inet_csk_get_port(struct sock *sk, unsigned short snum)
 	int ret, attempts = 5;
 	struct net *net = sock_net(sk);
 	int smallest_size = -1, smallest_rover;
+	kuid_t uid = sock_i_uid(sk);
 
 	local_bh_disable();
 	if (!snum) {
@@ -125,9 +130,12 @@ again:
 			spin_lock(&head->lock);
 			inet_bind_bucket_for_each(tb, node, &head->chain)
 				if (net_eq(ib_net(tb), net) && tb->port == rover) {
-					if (tb->fastreuse > 0 &&
-					    sk->sk_reuse &&
-					    sk->sk_state != TCP_LISTEN &&
+					if (((tb->fastreuse > 0 &&
+					      sk->sk_reuse &&
+					      sk->sk_state != TCP_LISTEN) ||
+					     (tb->fastreuseport > 0 &&
+					      sk->sk_reuseport &&
+					      uid_eq(tb->fastuid, uid))) &&
 					    (tb->num_owners < smallest_size || smallest_size == -1)) {
 						smallest_size = tb->num_owners;
 						smallest_rover = rover;
@@ -185,14 +193,19 @@ tb_found:
 		if (sk->sk_reuse == SK_FORCE_REUSE)
 			goto success;
 
-		if (tb->fastreuse > 0 &&
-		    sk->sk_reuse && sk->sk_state != TCP_LISTEN &&
+		if (((tb->fastreuse > 0 &&
+		      sk->sk_reuse && sk->sk_state != TCP_LISTEN) ||
+		     (tb->fastreuseport > 0 &&
+		      sk->sk_reuseport && uid_eq(tb->fastuid, uid))) &&
 		    smallest_size == -1) {
 			goto success;
 		} else {
 			ret = 1;
 			if (inet_csk(sk)->icsk_af_ops->bind_conflict(sk, tb, true)) {
-				if (sk->sk_reuse && sk->sk_state != TCP_LISTEN &&
+				if (((sk->sk_reuse && sk->sk_state != TCP_LISTEN) ||
+				     (tb->fastreuseport > 0 &&
+				      sk->sk_reuseport &&
+				      uid_eq(tb->fastuid, uid))) &&
 				    smallest_size != -1 && --attempts >= 0) {
 					spin_unlock(&head->lock);
 					goto again;
@@ -212,9 +225,19 @@ tb_not_found:
 			tb->fastreuse = 1;
 		else
 			tb->fastreuse = 0;
-	} else if (tb->fastreuse &&
-		   (!sk->sk_reuse || sk->sk_state == TCP_LISTEN))
-		tb->fastreuse = 0;
+		if (sk->sk_reuseport) {
+			tb->fastreuseport = 1;
+			tb->fastuid = uid;
+		} else
+			tb->fastreuseport = 0;
+	} else {
+		if (tb->fastreuse &&
+		    (!sk->sk_reuse || sk->sk_state == TCP_LISTEN))
+			tb->fastreuse = 0;
+		if (tb->fastreuseport &&
+		    (!sk->sk_reuseport || !uid_eq(tb->fastuid, uid)))
+			tb->fastreuseport = 0;
+	}
 success:
 	if (!inet_csk(sk)->icsk_bind_hash)
 		inet_bind_hash(sk, tb, snum);
@@ -310,10 +333,9 @@ struct sock *inet_csk_accept(struct sock *sk, int flags, int *err)
 		if (error)
 			goto out_err;
 	}
-	req = reqsk_queue_remove(queue);
+	req = reqsk_queue_remove(queue, sk);
 	newsk = req->sk;
 
-	sk_acceptq_removed(sk);
 	if (sk->sk_protocol == IPPROTO_TCP && queue->fastopenq != NULL) {
 		spin_lock_bh(&queue->fastopenq->lock);
 		if (tcp_rsk(req)->listener) {
@@ -331,7 +353,7 @@ struct sock *inet_csk_accept(struct sock *sk, int flags, int *err)
 out:
 	release_sock(sk);
 	if (req)
-		__reqsk_free(req);
+		reqsk_put(req);
 	return newsk;
 out_err:
 	newsk = NULL;
@@ -456,64 +478,50 @@ no_route:
 }
 EXPORT_SYMBOL_GPL(inet_csk_route_child_sock);
 
-static inline u32 inet_synq_hash(const __be32 raddr, const __be16 rport,
-				 const u32 rnd, const u32 synq_hsize)
-{
-	return jhash_2words((__force u32)raddr, (__force u32)rport, rnd) & (synq_hsize - 1);
-}
-
 #if IS_ENABLED(CONFIG_IPV6)
 #define AF_INET_FAMILY(fam) ((fam) == AF_INET)
 #else
 #define AF_INET_FAMILY(fam) 1
 #endif
 
-struct request_sock *inet_csk_search_req(const struct sock *sk,
-					 struct request_sock ***prevp,
+/*
+ * Look up the request of listener @sk for the given peer. The request is
+ * returned with a reference held, the caller takes its rsk_lock and checks
+ * that it is still hashed before acting on it.
+ */
+struct request_sock *inet_csk_search_req(struct sock *sk,
 					 const __be16 rport, const __be32 raddr,
 					 const __be32 laddr)
 {
-	const struct inet_connection_sock *icsk = inet_csk(sk);
-	struct listen_sock *lopt = icsk->icsk_accept_queue.listen_opt;
-	struct request_sock *req, **prev;
+	struct inet_hashinfo *hashinfo = sk->sk_prot->h.hashinfo;
+	const u32 hash = inet_ehashfn(sock_net(sk), laddr, inet_sk(sk)->inet_num,
+				      raddr, rport);
+	struct inet_ehash_bucket *head = inet_ehash_bucket(hashinfo, hash);
+	spinlock_t *lock = inet_ehash_lockp(hashinfo, hash);
+	struct request_sock *req;
+	struct hlist_node *node;
 
-	for (prev = &lopt->syn_table[inet_synq_hash(raddr, rport, lopt->hash_rnd,
-						    lopt->nr_table_entries)];
-	     (req = *prev) != NULL;
-	     prev = &req->dl_next) {
+	spin_lock(lock);
+	hlist_for_each_entry(req, node, &head->reqchain, rsk_hash_node) {
 		const struct inet_request_sock *ireq = inet_rsk(req);
 
-		if (ireq->rmt_port == rport &&
+		if (req->rsk_listener == sk &&
+		    ireq->rmt_port == rport &&
 		    ireq->rmt_addr == raddr &&
 		    ireq->loc_addr == laddr &&
 		    AF_INET_FAMILY(req->rsk_ops->family)) {
 			WARN_ON(req->sk);
-			*prevp = prev;
-			break;
+			atomic_inc(&req->rsk_refcnt);
+			spin_unlock(lock);
+			return req;
 		}
 	}
+	spin_unlock(lock);
 
-	return req;
+	return NULL;
 }
 EXPORT_SYMBOL_GPL(inet_csk_search_req);
 
-void inet_csk_reqsk_queue_hash_add(struct sock *sk, struct request_sock *req,
-				   unsigned long timeout)
-{
-	struct inet_connection_sock *icsk = inet_csk(sk);
-	struct listen_sock *lopt = icsk->icsk_accept_queue.listen_opt;
-	const u32 h = inet_synq_hash(inet_rsk(req)->rmt_addr, inet_rsk(req)->rmt_port,
-				     lopt->hash_rnd, lopt->nr_table_entries);
-
-	reqsk_queue_hash_req(&icsk->icsk_accept_queue, h, req, timeout);
-	inet_csk_reqsk_queue_added(sk, timeout);
-}
-EXPORT_SYMBOL_GPL(inet_csk_reqsk_queue_hash_add);
-
-/* Only thing we need from tcp.h */
-extern int sysctl_tcp_synack_retries;
-
-
 /* Decide when to expire the request and when to resend SYN-ACK */
 static inline void syn_ack_recalc(struct request_sock *req, const int thresh,
 				  const int max_retries,
@@ -536,22 +544,59 @@ static inline void syn_ack_recalc(struct request_sock *req, const int thresh,
 		  req->retrans >= rskq_defer_accept - 1;
 }
 
-void inet_csk_reqsk_queue_prune(struct sock *parent,
-				const unsigned long interval,
-				const unsigned long timeout,
-				const unsigned long max_rto)
+/*
+ * Unhash a request, the caller holds its rsk_lock and a reference. Returns
+ * true if the request was hashed, the reference of the hash then belongs
+ * to the caller. The one of a pending timer is dropped.
+ */
+bool inet_csk_reqsk_queue_unlink(struct sock *sk, struct request_sock *req)
+{
+	struct inet_hashinfo *hashinfo = sk->sk_prot->h.hashinfo;
+	spinlock_t *lock = inet_ehash_lockp(hashinfo, req->rsk_hash);
+
+	if (!reqsk_hashed(req))
+		return false;
+
+	spin_lock(lock);
+	hlist_del_init(&req->rsk_hash_node);
+	spin_unlock(lock);
+
+	reqsk_queue_removed(&inet_csk(sk)->icsk_accept_queue, req);
+	if (del_timer(&req->rsk_timer))
+		reqsk_put(req);
+	return true;
+}
+EXPORT_SYMBOL(inet_csk_reqsk_queue_unlink);
+
+void inet_csk_reqsk_queue_drop(struct sock *sk, struct request_sock *req)
+{
+	if (inet_csk_reqsk_queue_unlink(sk, req))
+		reqsk_put(req);
+}
+EXPORT_SYMBOL(inet_csk_reqsk_queue_drop);
+
+/*
+ * Each request has its own timer, which retransmits the SYN-ACK and expires
+ * the request. It holds a reference on the request while pending.
+ */
+static void reqsk_timer_handler(unsigned long data)
 {
-	struct inet_connection_sock *icsk = inet_csk(parent);
+	struct request_sock *req = (struct request_sock *)data;
+	struct sock *sk_listener = req->rsk_listener;
+	struct inet_connection_sock *icsk = inet_csk(sk_listener);
 	struct request_sock_queue *queue = &icsk->icsk_accept_queue;
-	struct listen_sock *lopt = queue->listen_opt;
 	int max_retries = icsk->icsk_syn_retries ? : sysctl_tcp_synack_retries;
 	int thresh = max_retries;
-	unsigned long now = jiffies;
-	struct request_sock **reqp, *req;
-	int i, budget;
-
-	if (lopt == NULL || lopt->qlen == 0)
-		return;
+	int qlen, expire = 0, resend = 0;
+
+	spin_lock(&req->rsk_lock);
+	if (!reqsk_hashed(req))
+		goto out;
+	if (sk_listener->sk_state != TCP_LISTEN) {
+		NET_INC_STATS_BH(sock_net(sk_listener),
+				 LINUX_MIB_TCPREQLISTENERCLOSED);
+		goto drop;
+	}
 
 	/* Normally all the openreqs are young and become mature
 	 * (i.e. converted to established socket) for first timeout.
@@ -570,11 +615,12 @@ void inet_csk_reqsk_queue_prune(struct sock *parent,
 	 * embrions; and abort old ones without pity, if old
 	 * ones are about to clog our table.
 	 */
-	if (lopt->qlen>>(lopt->max_qlen_log-1)) {
-		int young = (lopt->qlen_young<<1);
+	qlen = reqsk_queue_len(queue);
+	if (qlen >> (queue->max_qlen_log - 1)) {
+		int young = reqsk_queue_len_young(queue) << 1;
 
 		while (thresh > 2) {
-			if (lopt->qlen < young)
+			if (qlen < young)
 				break;
 			thresh--;
 			young <<= 1;
@@ -584,52 +630,79 @@ void inet_csk_reqsk_queue_prune(struct sock *parent,
 	if (queue->rskq_defer_accept)
 		max_retries = queue->rskq_defer_accept;
 
-	budget = 2 * (lopt->nr_table_entries / (timeout / interval));
-	i = lopt->clock_hand;
+	syn_ack_recalc(req, thresh, max_retries, queue->rskq_defer_accept,
+		       &expire, &resend);
+	req->rsk_ops->syn_ack_timeout(sk_listener, req);
+	if (!expire && resend) {
+		NET_INC_STATS_BH(sock_net(sk_listener), LINUX_MIB_TCPREQRETRANS);
+		/* the timer runs outside of the RCU section of the rx path */
+		rcu_read_lock();
+		if (!req->rsk_ops->rtx_syn_ack(sk_listener, req, NULL))
+			resend = 0;
+		rcu_read_unlock();
+	}
+	if (!expire && (!resend || inet_rsk(req)->acked)) {
+		unsigned long timeo;
+
+		if (req->retrans++ == 0)
+			atomic_dec(&queue->young);
+		timeo = min(TCP_TIMEOUT_INIT << req->retrans, TCP_RTO_MAX);
+		req->expires = jiffies + timeo;
+		mod_timer_pinned(&req->rsk_timer, req->expires);
+		spin_unlock(&req->rsk_lock);
+		return;
+	}
+	NET_INC_STATS_BH(sock_net(sk_listener), LINUX_MIB_TCPREQTIMEOUT);
+drop:
+	inet_csk_reqsk_queue_drop(sk_listener, req);
+out:
+	spin_unlock(&req->rsk_lock);
+	reqsk_put(req);
+}
+
+void __inet_csk_reqsk_queue_hash_add(struct sock *sk, struct request_sock *req,
+				     u32 hash, unsigned long timeout)
+{
+	struct inet_hashinfo *hashinfo = sk->sk_prot->h.hashinfo;
+	struct inet_ehash_bucket *head = inet_ehash_bucket(hashinfo, hash);
+	spinlock_t *lock = inet_ehash_lockp(hashinfo, hash);
 
-	do {
-		reqp=&lopt->syn_table[i];
-		while ((req = *reqp) != NULL) {
-			if (time_after_eq(now, req->expires)) {
-				int expire = 0, resend = 0;
-
-				syn_ack_recalc(req, thresh, max_retries,
-					       queue->rskq_defer_accept,
-					       &expire, &resend);
-				req->rsk_ops->syn_ack_timeout(parent, req);
-				if (!expire &&
-				    (!resend ||
-				     !req->rsk_ops->rtx_syn_ack(parent, req, NULL) ||
-				     inet_rsk(req)->acked)) {
-					unsigned long timeo;
-
-					if (req->retrans++ == 0)
-						lopt->qlen_young--;
-					timeo = min((timeout << req->retrans), max_rto);
-					req->expires = now + timeo;
-					reqp = &req->dl_next;
-					continue;
-				}
+	req->retrans = 0;
+	req->sk = NULL;
+	req->rsk_hash = hash;
+	req->expires = jiffies + timeout;
 
-				/* Drop this request */
-				inet_csk_reqsk_queue_unlink(parent, req, reqp);
-				reqsk_queue_removed(queue, req);
-				reqsk_free(req);
-				continue;
-			}
-			reqp = &req->dl_next;
-		}
+	sock_hold(sk);
+	req->rsk_listener = sk;
 
-		i = (i + 1) & (lopt->nr_table_entries - 1);
+	/* The caller keeps its reference and drops it with reqsk_put(),
+	 * the others are for the hash and for the timer. The timer is
+	 * armed last, a lookup may unhash the request before.
+	 */
+	atomic_set(&req->rsk_refcnt, 1 + 2);
+	setup_timer(&req->rsk_timer, reqsk_timer_handler, (unsigned long)req);
 
-	} while (--budget > 0);
+	reqsk_queue_added(&inet_csk(sk)->icsk_accept_queue);
 
-	lopt->clock_hand = i;
+	spin_lock(lock);
+	hlist_add_head(&req->rsk_hash_node, &head->reqchain);
+	spin_unlock(lock);
 
-	if (lopt->qlen)
-		inet_csk_reset_keepalive_timer(parent, interval);
+	mod_timer_pinned(&req->rsk_timer, req->expires);
 }
-EXPORT_SYMBOL_GPL(inet_csk_reqsk_queue_prune);
+EXPORT_SYMBOL_GPL(__inet_csk_reqsk_queue_hash_add);
+
+void inet_csk_reqsk_queue_hash_add(struct sock *sk, struct request_sock *req,
+				   unsigned long timeout)
+{
+	const struct inet_request_sock *ireq = inet_rsk(req);
+	const u32 hash = inet_ehashfn(sock_net(sk), ireq->loc_addr,
+				      inet_sk(sk)->inet_num,
+				      ireq->rmt_addr, ireq->rmt_port);
+
+	__inet_csk_reqsk_queue_hash_add(sk, req, hash, timeout);
+}
+EXPORT_SYMBOL_GPL(inet_csk_reqsk_queue_hash_add);
 
 /**
  *	inet_csk_clone_lock - clone an inet socket, and lock its clone
@@ -662,6 +735,7 @@ struct sock *inet_csk_clone_lock(const struct sock *sk,
 
 		/* Deinitialize accept_queue to trap illegal accesses. */
 		memset(&newicsk->icsk_accept_queue, 0, sizeof(newicsk->icsk_accept_queue));
+		spin_lock_init(&newicsk->icsk_accept_queue.rskq_lock);
 
 		security_inet_csk_clone(newsk, req);
 	}
@@ -703,10 +777,8 @@ int inet_csk_listen_start(struct sock *sk, const int nr_table_entries)
 {
 	struct inet_sock *inet = inet_sk(sk);
 	struct inet_connection_sock *icsk = inet_csk(sk);
-	int rc = reqsk_queue_alloc(&icsk->icsk_accept_queue, nr_table_entries);
 
-	if (rc != 0)
-		return rc;
+	reqsk_queue_alloc(&icsk->icsk_accept_queue, nr_table_entries);
 
 	sk->sk_max_ack_backlog = 0;
 	sk->sk_ack_backlog = 0;
@@ -728,11 +800,68 @@ int inet_csk_listen_start(struct sock *sk, const int nr_table_entries)
 	}
 
 	sk->sk_state = TCP_CLOSE;
-	__reqsk_queue_destroy(&icsk->icsk_accept_queue);
 	return -EADDRINUSE;
 }
 EXPORT_SYMBOL_GPL(inet_csk_listen_start);
 
+static void inet_child_forget(struct sock *sk, struct request_sock *req,
+			      struct sock *child)
+{
+	sk->sk_prot->disconnect(child, O_NONBLOCK);
+
+	sock_orphan(child);
+
+	percpu_counter_inc(sk->sk_prot->orphan_count);
+
+	if (sk->sk_protocol == IPPROTO_TCP && tcp_rsk(req)->listener) {
+		BUG_ON(tcp_sk(child)->fastopen_rsk != req);
+		BUG_ON(sk != tcp_rsk(req)->listener);
+
+		/* Paranoid, to prevent race condition if
+		 * an inbound pkt destined for child is
+		 * blocked by sock lock in tcp_v4_rcv().
+		 * Also to satisfy an assertion in
+		 * tcp_v4_destroy_sock().
+		 */
+		tcp_sk(child)->fastopen_rsk = NULL;
+		sock_put(sk);
+	}
+	inet_csk_destroy_sock(child);
+	reqsk_put(req);
+}
+
+/*
+ * Queue an established child for accept(). SYNs and ACKs for a listener
+ * are processed without its lock, so it may have been closed meanwhile;
+ * the child is then disposed of and NULL returned. The caller holds the
+ * lock of the child and a reference on it, which it still has to drop.
+ */
+struct sock *inet_csk_reqsk_queue_add(struct sock *sk,
+				      struct request_sock *req,
+				      struct sock *child)
+{
+	struct request_sock_queue *queue = &inet_csk(sk)->icsk_accept_queue;
+
+	spin_lock(&queue->rskq_lock);
+	if (unlikely(sk->sk_state != TCP_LISTEN)) {
+		NET_INC_STATS_BH(sock_net(sk), LINUX_MIB_TCPREQLISTENERCLOSED);
+		inet_child_forget(sk, req, child);
+		child = NULL;
+	} else {
+		req->sk = child;
+		req->dl_next = NULL;
+		if (queue->rskq_accept_head == NULL)
+			queue->rskq_accept_head = req;
+		else
+			queue->rskq_accept_tail->dl_next = req;
+		queue->rskq_accept_tail = req;
+		sk_acceptq_added(sk);
+	}
+	spin_unlock(&queue->rskq_lock);
+	return child;
+}
+EXPORT_SYMBOL(inet_csk_reqsk_queue_add);
+
 /*
  *	This routine closes sockets which have been at least partially
  *	opened, but not yet accepted.
@@ -746,9 +875,6 @@ void inet_csk_listen_stop(struct sock *sk)
 
 	inet_csk_delete_keepalive_timer(sk);
 
-	/* make all the listen_opt local to us */
-	acc_req = reqsk_queue_yank_acceptq(queue);
-
 	/* Following specs, it would be better either to send FIN
 	 * (and enter FIN-WAIT-1, it is normal close)
 	 * or to send active reset (abort).
@@ -756,8 +882,12 @@ void inet_csk_listen_stop(struct sock *sk)
 	 * bad justification for our negligence 8)
 	 * To be honest, we are not able to make either
 	 * of the variants now.			--ANK
+	 *
+	 * The requests still in the established hash go away when their
+	 * timers find the listener closed. The state is no longer
+	 * TCP_LISTEN, so no child can be queued behind our back.
 	 */
-	reqsk_queue_destroy(queue);
+	acc_req = reqsk_queue_yank_acceptq(queue);
 
 	while ((req = acc_req) != NULL) {
 		struct sock *child = req->sk;
@@ -769,33 +899,13 @@ void inet_csk_listen_stop(struct sock *sk)
 		WARN_ON(sock_owned_by_user(child));
 		sock_hold(child);
 
-		sk->sk_prot->disconnect(child, O_NONBLOCK);
-
-		sock_orphan(child);
-
-		percpu_counter_inc(sk->sk_prot->orphan_count);
-
-		if (sk->sk_protocol == IPPROTO_TCP && tcp_rsk(req)->listener) {
-			BUG_ON(tcp_sk(child)->fastopen_rsk != req);
-			BUG_ON(sk != tcp_rsk(req)->listener);
-
-			/* Paranoid, to prevent race condition if
-			 * an inbound pkt destined for child is
-			 * blocked by sock lock in tcp_v4_rcv().
-			 * Also to satisfy an assertion in
-			 * tcp_v4_destroy_sock().
-			 */
-			tcp_sk(child)->fastopen_rsk = NULL;
-			sock_put(sk);
-		}
-		inet_csk_destroy_sock(child);
+		inet_child_forget(sk, req, child);
 
 		bh_unlock_sock(child);
 		local_bh_enable();
 		sock_put(child);
 
 		sk_acceptq_removed(sk);
-		__reqsk_free(req);
 	}
 	if (queue->fastopenq != NULL) {
 		/* Free all the reqs queued in rskq_rst_head. */
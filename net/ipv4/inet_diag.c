@@ -645,88 +645,71 @@ static int inet_diag_fill_req(struct sk_buff *skb, struct sock *sk,
 	return nlmsg_end(skb, nlh);
 }
 
-static int inet_diag_dump_reqs(struct sk_buff *skb, struct sock *sk,
+/* Dump the requests queued in @head, called with its ehash lock held */
+static int inet_diag_dump_reqs(struct sk_buff *skb,
+			       struct inet_ehash_bucket *head,
 			       struct netlink_callback *cb,
 			       struct inet_diag_req_v2 *r,
-			       const struct nlattr *bc)
+			       const struct nlattr *bc, int s_num, int *num)
 {
+	struct net *net = sock_net(skb->sk);
 	struct inet_diag_entry entry;
-	struct inet_connection_sock *icsk = inet_csk(sk);
-	struct listen_sock *lopt;
-	struct inet_sock *inet = inet_sk(sk);
-	int j, s_j;
-	int reqnum, s_reqnum;
-	int err = 0;
-
-	s_j = cb->args[3];
-	s_reqnum = cb->args[4];
-
-	if (s_j > 0)
-		s_j--;
-
-	entry.family = sk->sk_family;
-
-	read_lock_bh(&icsk->icsk_accept_queue.syn_wait_lock);
-
-	lopt = icsk->icsk_accept_queue.listen_opt;
-	if (!lopt || !lopt->qlen)
-		goto out;
-
-	if (bc != NULL) {
-		entry.sport = inet->inet_num;
-		entry.userlocks = sk->sk_userlocks;
-	}
-
-	for (j = s_j; j < lopt->nr_table_entries; j++) {
-		struct request_sock *req, *head = lopt->syn_table[j];
-
-		reqnum = 0;
-		for (req = head; req; reqnum++, req = req->dl_next) {
-			struct inet_request_sock *ireq = inet_rsk(req);
+	struct request_sock *req;
+	struct hlist_node *node;
+	int err;
 
-			if (reqnum < s_reqnum)
-				continue;
-			if (r->id.idiag_dport != ireq->rmt_port &&
-			    r->id.idiag_dport)
-				continue;
+	hlist_for_each_entry(req, node, &head->reqchain, rsk_hash_node) {
+		struct inet_request_sock *ireq = inet_rsk(req);
+		struct sock *sk = req->rsk_listener;
+		struct inet_sock *inet = inet_sk(sk);
 
-			if (bc) {
-				entry.saddr =
+		if (!net_eq(sock_net(sk), net))
+			continue;
+		if (*num < s_num)
+			goto next_req;
+		if (r->sdiag_family != AF_UNSPEC &&
+				sk->sk_family != r->sdiag_family)
+			goto next_req;
+		if (r->id.idiag_sport != inet->inet_sport &&
+		    r->id.idiag_sport)
+			goto next_req;
+		if (r->id.idiag_dport != ireq->rmt_port &&
+		    r->id.idiag_dport)
+			goto next_req;
+
+		if (bc) {
+			entry.family = sk->sk_family;
+			entry.saddr =
 #if IS_ENABLED(CONFIG_IPV6)
-					(entry.family == AF_INET6) ?
-					inet6_rsk(req)->loc_addr.s6_addr32 :
+				(entry.family == AF_INET6) ?
+				inet6_rsk(req)->loc_addr.s6_addr32 :
 #endif
-					&ireq->loc_addr;
-				entry.daddr =
+				&ireq->loc_addr;
+			entry.daddr =
 #if IS_ENABLED(CONFIG_IPV6)
-					(entry.family == AF_INET6) ?
-					inet6_rsk(req)->rmt_addr.s6_addr32 :
+				(entry.family == AF_INET6) ?
+				inet6_rsk(req)->rmt_addr.s6_addr32 :
 #endif
-					&ireq->rmt_addr;
-				entry.dport = ntohs(ireq->rmt_port);
+				&ireq->rmt_addr;
+			entry.sport = inet->inet_num;
+			entry.dport = ntohs(ireq->rmt_port);
+			entry.userlocks = sk->sk_userlocks;
 
-				if (!inet_diag_bc_run(bc, &entry))
-					continue;
-			}
-
-			err = inet_diag_fill_req(skb, sk, req,
-					       sk_user_ns(NETLINK_CB(cb->skb).ssk),
-					       NETLINK_CB(cb->skb).portid,
-					       cb->nlh->nlmsg_seq, cb->nlh);
-			if (err < 0) {
-				cb->args[3] = j + 1;
-				cb->args[4] = reqnum;
-				goto out;
-			}
+			if (!inet_diag_bc_run(bc, &entry))
+				goto next_req;
 		}
 
-		s_reqnum = 0;
+		err = inet_diag_fill_req(skb, sk, req,
+				       sk_user_ns(NETLINK_CB(cb->skb).ssk),
+				       NETLINK_CB(cb->skb).portid,
+				       cb->nlh->nlmsg_seq, cb->nlh);
+		if (err < 0)
+			return err;
+next_req:
+		++*num;
 	}
 
-out:
-	read_unlock_bh(&icsk->icsk_accept_queue.syn_wait_lock);
-
-	return err;
+	return 0;
 }
 
 void inet_diag_dump_icsk(struct inet_hashinfo *hashinfo, struct sk_buff *skb,
@@ -740,7 +723,7 @@ void inet_diag_dump_icsk(struct inet_hashinfo *hashinfo, struct sk_buff *skb,
 	s_num = num = cb->args[2];
 
 	if (cb->args[0] == 0) {
-		if (!(r->idiag_states & (TCPF_LISTEN | TCPF_SYN_RECV)))
+		if (!(r->idiag_states & TCPF_LISTEN))
 			goto skip_listen_ht;
 
 		for (i = s_i; i < INET_LHTABLE_SIZE; i++) {
@@ -770,42 +753,31 @@ void inet_diag_dump_icsk(struct inet_hashinfo *hashinfo, struct sk_buff *skb,
 				    r->id.idiag_sport)
 					goto next_listen;
 
-				if (!(r->idiag_states & TCPF_LISTEN) ||
-				    r->id.idiag_dport ||
-				    cb->args[3] > 0)
-					goto syn_recv;
-
-				if (inet_csk_diag_dump(sk, skb, cb, r, bc) < 0) {
-					spin_unlock_bh(&ilb->lock);
-					goto done;
-				}
-
-syn_recv:
-				if (!(r->idiag_states & TCPF_SYN_RECV))
+				if (r->id.idiag_dport)
 					goto next_listen;
 
-				if (inet_diag_dump_reqs(skb, sk, cb, r, bc) < 0) {
+				if (inet_csk_diag_dump(sk, skb, cb, r, bc) < 0) {
 					spin_unlock_bh(&ilb->lock);
 					goto done;
 				}
 
 next_listen:
-				cb->args[3] = 0;
-				cb->args[4] = 0;
 				++num;
 			}
 			spin_unlock_bh(&ilb->lock);
 
 			s_num = 0;
-			cb->args[3] = 0;
-			cb->args[4] = 0;
 		}
 skip_listen_ht:
 		cb->args[0] = 1;
 		s_i = num = s_num = 0;
 	}
 
-	if (!(r->idiag_states & ~(TCPF_LISTEN | TCPF_SYN_RECV)))
+	/*
+	 * Requests are kept next to the established sockets, so they are
+	 * found by the same walk over the ehash rather than per listener.
+	 */
+	if (!(r->idiag_states & ~TCPF_LISTEN))
 		goto out;
 
 	for (i = s_i; i <= hashinfo->ehash_mask; i++) {
@@ -817,7 +789,8 @@ skip_listen_ht:
 		num = 0;
 
 		if (hlist_nulls_empty(&head->chain) &&
-			hlist_nulls_empty(&head->twchain))
+			hlist_nulls_empty(&head->twchain) &&
+			hlist_empty(&head->reqchain))
 			continue;
 
 		if (i > s_i)
@@ -850,6 +823,12 @@ next_normal:
 			++num;
 		}
 
+		if ((r->idiag_states & TCPF_SYN_RECV) &&
+		    inet_diag_dump_reqs(skb, head, cb, r, bc, s_num, &num) < 0) {
+			spin_unlock_bh(lock);
+			goto done;
+		}
+
 		if (r->idiag_states & TCPF_TIME_WAIT) {
 			struct inet_timewait_sock *tw;
 
@@ -267,6 +267,14 @@ static const struct snmp_mib snmp4_net_list[] = {
 	SNMP_MIB_ITEM("TCPFastOpenPassiveFail", LINUX_MIB_TCPFASTOPENPASSIVEFAIL),
 	SNMP_MIB_ITEM("TCPFastOpenListenOverflow", LINUX_MIB_TCPFASTOPENLISTENOVERFLOW),
 	SNMP_MIB_ITEM("TCPFastOpenCookieReqd", LINUX_MIB_TCPFASTOPENCOOKIEREQD),
+	SNMP_MIB_ITEM("BusyPollRxPackets", LINUX_MIB_BUSYPOLLRXPACKETS),
+	SNMP_MIB_ITEM("BusyPollHits", LINUX_MIB_BUSYPOLLHITS),
+	SNMP_MIB_ITEM("BusyPollMisses", LINUX_MIB_BUSYPOLLMISSES),
+	SNMP_MIB_ITEM("BusyPollUsecs", LINUX_MIB_BUSYPOLLUSECS),
+	SNMP_MIB_ITEM("TCPReqTimeout", LINUX_MIB_TCPREQTIMEOUT),
+	SNMP_MIB_ITEM("TCPReqRetrans", LINUX_MIB_TCPREQRETRANS),
+	SNMP_MIB_ITEM("TCPReqListenerClosed", LINUX_MIB_TCPREQLISTENERCLOSED),
+	SNMP_MIB_ITEM("TCPReqRace", LINUX_MIB_TCPREQRACE),
 	SNMP_MIB_SENTINEL
 };
 
@@ -213,10 +213,16 @@ static inline struct sock *get_cookie_sock(struct sock *sk, struct sk_buff *skb,
 	struct sock *child;
 
 	child = icsk->icsk_af_ops->syn_recv_sock(sk, skb, req, dst);
-	if (child)
-		inet_csk_reqsk_queue_add(sk, req, child);
-	else
+	if (!child) {
 		reqsk_free(req);
+		return NULL;
+	}
+	if (!inet_csk_reqsk_queue_add(sk, req, child)) {
+		/* the listener was closed meanwhile */
+		bh_unlock_sock(child);
+		sock_put(child);
+		return NULL;
+	}
 
 	return child;
 }
@@ -37,6 +37,7 @@ static int ip_ttl_min = 1;
 static int ip_ttl_max = 255;
 static int ip_ping_group_range_min[] = { 0, 0 };
 static int ip_ping_group_range_max[] = { GID_T_MAX, GID_T_MAX };
+static unsigned long tcp_notsent_lowat_max = UINT_MAX;
 
 /* Update system visible IP port range */
 static void set_local_port_range(int range[2])
@@ -134,6 +135,29 @@ static int ipv4_ping_group_range(ctl_table *table, int write,
 	return ret;
 }
 
+/*
+ * tcp_notsent_lowat is unsigned and defaults to UINT_MAX, which would read
+ * back as -1 through proc_dointvec.
+ */
+static int proc_tcp_notsent_lowat(ctl_table *ctl, int write,
+				  void __user *buffer, size_t *lenp,
+				  loff_t *ppos)
+{
+	unsigned long val = sysctl_tcp_notsent_lowat;
+	ctl_table tmp = {
+		.data = &val,
+		.maxlen = sizeof(val),
+		.mode = ctl->mode,
+		.extra2 = &tcp_notsent_lowat_max,
+	};
+	int ret;
+
+	ret = proc_doulongvec_minmax(&tmp, write, buffer, lenp, ppos);
+	if (write && ret == 0)
+		sysctl_tcp_notsent_lowat = val;
+	return ret;
+}
+
 static int proc_tcp_congestion_control(ctl_table *ctl, int write,
 				       void __user *buffer, size_t *lenp, loff_t *ppos)
 {
@@ -671,6 +695,13 @@ static struct ctl_table ipv4_table[] = {
 		.mode		= 0644,
 		.proc_handler	= proc_dointvec
 	},
+	{
+		.procname	= "tcp_notsent_lowat",
+		.data		= &sysctl_tcp_notsent_lowat,
+		.maxlen		= sizeof(sysctl_tcp_notsent_lowat),
+		.mode		= 0644,
+		.proc_handler	= proc_tcp_notsent_lowat,
+	},
 	{
 		.procname	= "tcp_challenge_ack_limit",
 		.data		= &sysctl_tcp_challenge_ack_limit,
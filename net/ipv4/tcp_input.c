@@ -3552,6 +3552,35 @@ static bool tcp_process_frto(struct sock *sk, int flag)
 	return false;
 }
 
+/* Set sk_pacing_rate to twice the current delivery rate, mss * cwnd / srtt,
+ * so that a pacing packet scheduler such as FQ spreads a cwnd worth of
+ * data over half an RTT instead of sending it in one burst. Twice the
+ * rate leaves room for cwnd to keep growing in slow start.
+ */
+static void tcp_update_pacing_rate(struct sock *sk)
+{
+	const struct tcp_sock *tp = tcp_sk(sk);
+	u64 rate;
+
+	/* srtt is in jiffies << 3 */
+	rate = (u64)tp->mss_cache * 2 * (HZ << 3);
+
+	rate *= max(tp->snd_cwnd, tp->packets_out);
+
+	/* An srtt of a jiffy or less is not precise enough to derive
+	 * a rate from, and is 0 before the first sample: do not divide,
+	 * which amounts to assuming an RTT of 1/8 of a jiffy.
+	 */
+	if (tp->srtt > 8 + 2)
+		do_div(rate, tp->srtt);
+
+	/* sch_fq reads sk_pacing_rate without the socket lock, make
+	 * sure it never sees an intermediate value.
+	 */
+	ACCESS_ONCE(sk->sk_pacing_rate) = min_t(u64, rate,
+						sk->sk_max_pacing_rate);
+}
+
 /* This routine deals with incoming acks, but not outgoing ones. */
 static int tcp_ack(struct sock *sk, const struct sk_buff *skb, int flag)
 {
@@ -3567,6 +3596,7 @@ static int tcp_ack(struct sock *sk, const struct sk_buff *skb, int flag)
 	int prior_sacked = tp->sacked_out;
 	int pkts_acked = 0;
 	bool frto_cwnd = false;
+	u32 prior_cwnd = tp->snd_cwnd, prior_rtt = tp->srtt;
 
 	/* If the ack is older than previous acks
 	 * then we can probably ignore it.
@@ -3661,6 +3691,9 @@ static int tcp_ack(struct sock *sk, const struct sk_buff *skb, int flag)
 			tcp_cong_avoid(sk, ack, prior_in_flight);
 	}
 
+	if (tp->srtt != prior_rtt || tp->snd_cwnd != prior_cwnd)
+		tcp_update_pacing_rate(sk);
+
 	if ((flag & FLAG_FORWARD_PROGRESS) || !(flag & FLAG_NOT_DUP)) {
 		struct dst_entry *dst = __sk_dst_get(sk);
 		if (dst)
@@ -5908,13 +5941,12 @@ int tcp_rcv_state_process(struct sock *sk, struct sk_buff *skb,
 	struct request_sock *req;
 	int queued = 0;
 
-	tp->rx_opt.saw_tstamp = 0;
-
 	switch (sk->sk_state) {
 	case TCP_CLOSE:
 		goto discard;
 
 	case TCP_LISTEN:
+		/* Most listeners are not locked, do not write to them. */
 		if (th->ack)
 			return 1;
 
@@ -5950,6 +5982,7 @@ int tcp_rcv_state_process(struct sock *sk, struct sk_buff *skb,
 		goto discard;
 
 	case TCP_SYN_SENT:
+		tp->rx_opt.saw_tstamp = 0;
 		queued = tcp_rcv_synsent_state_process(sk, skb, th, len);
 		if (queued >= 0)
 			return queued;
@@ -5961,12 +5994,13 @@ int tcp_rcv_state_process(struct sock *sk, struct sk_buff *skb,
 		return 0;
 	}
 
+	tp->rx_opt.saw_tstamp = 0;
 	req = tp->fastopen_rsk;
 	if (req != NULL) {
 		BUG_ON(sk->sk_state != TCP_SYN_RECV &&
 		    sk->sk_state != TCP_FIN_WAIT1);
 
-		if (tcp_check_req(sk, skb, req, NULL, true) == NULL)
+		if (tcp_check_req(sk, skb, req, true) == NULL)
 			goto discard;
 	}
 	if (!tcp_validate_incoming(sk, skb, th, 0))
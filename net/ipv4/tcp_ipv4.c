@@ -75,6 +75,7 @@
 #include <net/netdma.h>
 #include <net/secure_seq.h>
 #include <net/tcp_memcontrol.h>
+#include <net/busy_poll.h>
 
 #include <linux/inet.h>
 #include <linux/ipv6.h>
@@ -481,12 +482,9 @@ void tcp_v4_err(struct sk_buff *icmp_skb, u32 info)
 		goto out;
 
 	switch (sk->sk_state) {
-		struct request_sock *req, **prev;
+		struct request_sock *req;
 	case TCP_LISTEN:
-		if (sock_owned_by_user(sk))
-			goto out;
-
-		req = inet_csk_search_req(sk, &prev, th->dest,
+		req = inet_csk_search_req(sk, th->dest,
 					  iph->daddr, iph->saddr);
 		if (!req)
 			goto out;
@@ -498,16 +496,18 @@ void tcp_v4_err(struct sk_buff *icmp_skb, u32 info)
 
 		if (seq != tcp_rsk(req)->snt_isn) {
 			NET_INC_STATS_BH(net, LINUX_MIB_OUTOFWINDOWICMPS);
-			goto out;
+		} else {
+			/*
+			 * Still in SYN_RECV, just remove it silently.
+			 * There is no good way to pass the error to the newly
+			 * created socket, and POSIX does not want network
+			 * errors returned from accept().
+			 */
+			spin_lock(&req->rsk_lock);
+			inet_csk_reqsk_queue_drop(sk, req);
+			spin_unlock(&req->rsk_lock);
 		}
-
-		/*
-		 * Still in SYN_RECV, just remove it silently.
-		 * There is no good way to pass the error to the newly
-		 * created socket, and POSIX does not want network
-		 * errors returned from accept().
-		 */
-		inet_csk_reqsk_queue_drop(sk, req, prev);
+		reqsk_put(req);
 		goto out;
 
 	case TCP_SYN_SENT:
@@ -668,7 +668,8 @@ static void tcp_v4_send_reset(struct sock *sk, struct sk_buff *skb)
 		 * no RST generated if md5 hash doesn't match.
 		 */
 		sk1 = __inet_lookup_listener(dev_net(skb_dst(skb)->dev),
-					     &tcp_hashinfo, ip_hdr(skb)->daddr,
+					     &tcp_hashinfo, ip_hdr(skb)->saddr,
+					     th->source, ip_hdr(skb)->daddr,
 					     ntohs(th->source), inet_iif(skb));
 		/* don't send rst if it can't find key */
 		if (!sk1)
@@ -898,10 +899,9 @@ bool tcp_syn_flood_action(struct sock *sk,
 			 const struct sk_buff *skb,
 			 const char *proto)
 {
+	struct request_sock_queue *queue = &inet_csk(sk)->icsk_accept_queue;
 	const char *msg = "Dropping request";
 	bool want_cookie = false;
-	struct listen_sock *lopt;
-
 
 
 #ifdef CONFIG_SYN_COOKIES
@@ -913,9 +913,8 @@ bool tcp_syn_flood_action(struct sock *sk,
 #endif
 		NET_INC_STATS_BH(sock_net(sk), LINUX_MIB_TCPREQQFULLDROP);
 
-	lopt = inet_csk(sk)->icsk_accept_queue.listen_opt;
-	if (!lopt->synflood_warned) {
-		lopt->synflood_warned = 1;
+	if (!queue->synflood_warned) {
+		queue->synflood_warned = 1;
 		pr_info("%s: Possible SYN flooding on port %d. %s.  Check SNMP counters.\n",
 			proto, ntohs(tcp_hdr(skb)->dest), msg);
 	}
@@ -1433,8 +1432,18 @@ static int tcp_v4_conn_req_fastopen(struct sock *sk,
 	inet_csk_reset_xmit_timer(child, ICSK_TIME_RETRANS,
 	    TCP_TIMEOUT_INIT, TCP_RTO_MAX);
 
-	/* Add the child socket directly into the accept queue */
-	inet_csk_reqsk_queue_add(sk, req, child);
+	/* Add the child socket directly into the accept queue. Should the
+	 * listener have been closed meanwhile, the child and the request
+	 * have already been disposed of; only our references remain.
+	 */
+	if (!inet_csk_reqsk_queue_add(sk, req, child)) {
+		spin_lock(&queue->fastopenq->lock);
+		queue->fastopenq->qlen--;
+		spin_unlock(&queue->fastopenq->lock);
+		bh_unlock_sock(child);
+		sock_put(child);
+		return 0;
+	}
 
 	/* Now finish processing the fastopen child socket. */
 	inet_csk(child)->icsk_af_ops->rebuild_header(child);
@@ -1648,17 +1657,20 @@ int tcp_v4_conn_request(struct sock *sk, struct sk_buff *skb)
 		goto drop_and_free;
 
 	if (likely(!do_fastopen)) {
-		int err;
-		err = ip_build_and_send_pkt(skb_synack, sk, ireq->loc_addr,
-		     ireq->rmt_addr, ireq->opt);
-		err = net_xmit_eval(err);
-		if (err || want_cookie)
-			goto drop_and_free;
-
 		tcp_rsk(req)->snt_synack = tcp_time_stamp;
 		tcp_rsk(req)->listener = NULL;
-		/* Add the request_sock to the SYN table */
-		inet_csk_reqsk_queue_hash_add(sk, req, TCP_TIMEOUT_INIT);
+		/* Hash the request_sock before the SYN-ACK goes out, so that
+		 * the ACK finds it. Should sending fail, the timer of the
+		 * request retransmits.
+		 */
+		if (!want_cookie)
+			inet_csk_reqsk_queue_hash_add(sk, req, TCP_TIMEOUT_INIT);
+		ip_build_and_send_pkt(skb_synack, sk, ireq->loc_addr,
+				      ireq->rmt_addr, ireq->opt);
+		if (want_cookie)
+			goto drop_and_free;
+
+		reqsk_put(req);
 		if (fastopen_cookie_present(&foc) && foc.len != 0)
 			NET_INC_STATS_BH(sock_net(sk),
 			    LINUX_MIB_TCPFASTOPENPASSIVEFAIL);
@@ -1785,13 +1797,25 @@ static struct sock *tcp_v4_hnd_req(struct sock *sk, struct sk_buff *skb)
 {
 	struct tcphdr *th = tcp_hdr(skb);
 	const struct iphdr *iph = ip_hdr(skb);
-	struct sock *nsk;
-	struct request_sock **prev;
-	/* Find possible connection requests. */
-	struct request_sock *req = inet_csk_search_req(sk, &prev, th->source,
-						       iph->saddr, iph->daddr);
-	if (req)
-		return tcp_check_req(sk, skb, req, prev, false);
+	struct request_sock *req;
+	struct sock *nsk = NULL;
+	bool hashed = false;
+
+	/* Find possible connection requests. Another CPU may have turned
+	 * the request into a socket meanwhile, look for that one then.
+	 */
+	req = inet_csk_search_req(sk, th->source, iph->saddr, iph->daddr);
+	if (req) {
+		spin_lock(&req->rsk_lock);
+		hashed = reqsk_hashed(req);
+		if (hashed)
+			nsk = tcp_check_req(sk, skb, req, false);
+		spin_unlock(&req->rsk_lock);
+		reqsk_put(req);
+		if (hashed)
+			return nsk;
+		NET_INC_STATS_BH(sock_net(sk), LINUX_MIB_TCPREQRACE);
+	}
 
 	nsk = inet_lookup_established(sock_net(sk), &tcp_hashinfo, iph->saddr,
 			th->source, iph->daddr, th->dest, inet_iif(skb));
@@ -2019,8 +2043,19 @@ process:
 	if (sk_filter(sk, skb))
 		goto discard_and_relse;
 
+	sk_mark_napi_id(sk, skb);
 	skb->dev = NULL;
 
+	/* Listeners keep their requests in the established hash and are
+	 * not locked, unless Fast Open puts children in their accept queue
+	 * straight from the SYN.
+	 */
+	if (tcp_listener_lockless(sk)) {
+		ret = tcp_v4_do_rcv(sk, skb);
+		sock_put(sk);
+		return ret;
+	}
+
 	bh_lock_sock_nested(sk);
 	ret = 0;
 	if (!sock_owned_by_user(sk)) {
@@ -2083,6 +2118,7 @@ do_time_wait:
 	case TCP_TW_SYN: {
 		struct sock *sk2 = inet_lookup_listener(dev_net(skb->dev),
 							&tcp_hashinfo,
+							iph->saddr, th->source,
 							iph->daddr, th->dest,
 							inet_iif(skb));
 		if (sk2) {
@@ -2129,6 +2165,7 @@ const struct inet_connection_sock_af_ops ipv4_specific = {
 	.net_header_len	   = sizeof(struct iphdr),
 	.setsockopt	   = ip_setsockopt,
 	.getsockopt	   = ip_getsockopt,
+	.recv_error	   = ip_recv_error,
 	.addr2sockaddr	   = inet_csk_addr2sockaddr,
 	.sockaddr_len	   = sizeof(struct sockaddr_in),
 	.bind_conflict	   = inet_csk_bind_conflict,
@@ -2231,6 +2268,27 @@ static inline struct inet_timewait_sock *tw_next(struct inet_timewait_sock *tw)
 		hlist_nulls_entry(tw->tw_node.next, typeof(*tw), tw_node) : NULL;
 }
 
+static inline struct request_sock *req_head(struct hlist_head *head)
+{
+	return hlist_empty(head) ? NULL :
+		hlist_entry(head->first, struct request_sock, rsk_hash_node);
+}
+
+static inline struct request_sock *req_next(struct request_sock *req)
+{
+	return req->rsk_hash_node.next ?
+		hlist_entry(req->rsk_hash_node.next, struct request_sock,
+			    rsk_hash_node) : NULL;
+}
+
+static inline bool req_match(const struct request_sock *req,
+			     const struct tcp_iter_state *st,
+			     const struct net *net)
+{
+	return req->rsk_ops->family == st->family &&
+	       net_eq(sock_net(req->rsk_listener), net);
+}
+
 /*
  * Get next listener socket follow cur.  If cur is NULL, get first socket
  * starting from bucket given in st->bucket; when st->bucket is zero the
@@ -2238,7 +2296,6 @@ static inline struct inet_timewait_sock *tw_next(struct inet_timewait_sock *tw)
  */
 static void *listening_get_next(struct seq_file *seq, void *cur)
 {
-	struct inet_connection_sock *icsk;
 	struct hlist_nulls_node *node;
 	struct sock *sk = cur;
 	struct inet_listen_hashbucket *ilb;
@@ -2256,35 +2313,7 @@ static void *listening_get_next(struct seq_file *seq, void *cur)
 	++st->num;
 	++st->offset;
 
-	if (st->state == TCP_SEQ_STATE_OPENREQ) {
-		struct request_sock *req = cur;
-
-		icsk = inet_csk(st->syn_wait_sk);
-		req = req->dl_next;
-		while (1) {
-			while (req) {
-				if (req->rsk_ops->family == st->family) {
-					cur = req;
-					goto out;
-				}
-				req = req->dl_next;
-			}
-			if (++st->sbucket >= icsk->icsk_accept_queue.listen_opt->nr_table_entries)
-				break;
-get_req:
-			req = icsk->icsk_accept_queue.listen_opt->syn_table[st->sbucket];
-		}
-		sk	  = sk_nulls_next(st->syn_wait_sk);
-		st->state = TCP_SEQ_STATE_LISTENING;
-		read_unlock_bh(&icsk->icsk_accept_queue.syn_wait_lock);
-	} else {
-		icsk = inet_csk(sk);
-		read_lock_bh(&icsk->icsk_accept_queue.syn_wait_lock);
-		if (reqsk_queue_len(&icsk->icsk_accept_queue))
-			goto start_req;
-		read_unlock_bh(&icsk->icsk_accept_queue.syn_wait_lock);
-		sk = sk_nulls_next(sk);
-	}
+	sk = sk_nulls_next(sk);
 get_sk:
 	sk_nulls_for_each_from(sk, node) {
 		if (!net_eq(sock_net(sk), net))
@@ -2293,17 +2322,6 @@ get_sk:
 			cur = sk;
 			goto out;
 		}
-		icsk = inet_csk(sk);
-		read_lock_bh(&icsk->icsk_accept_queue.syn_wait_lock);
-		if (reqsk_queue_len(&icsk->icsk_accept_queue)) {
-start_req:
-			st->uid		= sock_i_uid(sk);
-			st->syn_wait_sk = sk;
-			st->state	= TCP_SEQ_STATE_OPENREQ;
-			st->sbucket	= 0;
-			goto get_req;
-		}
-		read_unlock_bh(&icsk->icsk_accept_queue.syn_wait_lock);
 	}
 	spin_unlock_bh(&ilb->lock);
 	st->offset = 0;
@@ -2337,12 +2355,14 @@ static void *listening_get_idx(struct seq_file *seq, loff_t *pos)
 static inline bool empty_bucket(struct tcp_iter_state *st)
 {
 	return hlist_nulls_empty(&tcp_hashinfo.ehash[st->bucket].chain) &&
-		hlist_nulls_empty(&tcp_hashinfo.ehash[st->bucket].twchain);
+		hlist_nulls_empty(&tcp_hashinfo.ehash[st->bucket].twchain) &&
+		hlist_empty(&tcp_hashinfo.ehash[st->bucket].reqchain);
 }
 
 /*
  * Get first established socket starting from bucket given in st->bucket.
  * If st->bucket is zero, the very first socket in the hash is returned.
+ * The connection requests of a bucket follow its TIME_WAIT sockets.
  */
 static void *established_get_first(struct seq_file *seq)
 {
@@ -2355,6 +2375,7 @@ static void *established_get_first(struct seq_file *seq)
 		struct sock *sk;
 		struct hlist_nulls_node *node;
 		struct inet_timewait_sock *tw;
+		struct request_sock *req;
 		spinlock_t *lock = inet_ehash_lockp(&tcp_hashinfo, st->bucket);
 
 		/* Lockless fast path for the common case of empty buckets */
@@ -2380,6 +2401,14 @@ static void *established_get_first(struct seq_file *seq)
 			rc = tw;
 			goto out;
 		}
+		st->state = TCP_SEQ_STATE_OPENREQ;
+		req = req_head(&tcp_hashinfo.ehash[st->bucket].reqchain);
+		for (; req; req = req_next(req)) {
+			if (req_match(req, st, net)) {
+				rc = req;
+				goto out;
+			}
+		}
 		spin_unlock_bh(lock);
 		st->state = TCP_SEQ_STATE_ESTABLISHED;
 	}
@@ -2391,6 +2420,7 @@ static void *established_get_next(struct seq_file *seq, void *cur)
 {
 	struct sock *sk = cur;
 	struct inet_timewait_sock *tw;
+	struct request_sock *req;
 	struct hlist_nulls_node *node;
 	struct tcp_iter_state *st = seq->private;
 	struct net *net = seq_file_net(seq);
@@ -2398,43 +2428,58 @@ static void *established_get_next(struct seq_file *seq, void *cur)
 	++st->num;
 	++st->offset;
 
+	if (st->state == TCP_SEQ_STATE_OPENREQ) {
+		req = req_next(cur);
+		goto get_req;
+	}
 	if (st->state == TCP_SEQ_STATE_TIME_WAIT) {
-		tw = cur;
-		tw = tw_next(tw);
-get_tw:
-		while (tw && (tw->tw_family != st->family || !net_eq(twsk_net(tw), net))) {
-			tw = tw_next(tw);
-		}
-		if (tw) {
-			cur = tw;
-			goto out;
-		}
-		spin_unlock_bh(inet_ehash_lockp(&tcp_hashinfo, st->bucket));
-		st->state = TCP_SEQ_STATE_ESTABLISHED;
-
-		/* Look for next non empty bucket */
-		st->offset = 0;
-		while (++st->bucket <= tcp_hashinfo.ehash_mask &&
-				empty_bucket(st))
-			;
-		if (st->bucket > tcp_hashinfo.ehash_mask)
-			return NULL;
-
-		spin_lock_bh(inet_ehash_lockp(&tcp_hashinfo, st->bucket));
-		sk = sk_nulls_head(&tcp_hashinfo.ehash[st->bucket].chain);
-	} else
-		sk = sk_nulls_next(sk);
+		tw = tw_next(cur);
+		goto get_tw;
+	}
 
+	sk = sk_nulls_next(sk);
+get_sk:
 	sk_nulls_for_each_from(sk, node) {
-		if (sk->sk_family == st->family && net_eq(sock_net(sk), net))
-			goto found;
+		if (sk->sk_family == st->family && net_eq(sock_net(sk), net)) {
+			cur = sk;
+			goto out;
+		}
 	}
 
 	st->state = TCP_SEQ_STATE_TIME_WAIT;
 	tw = tw_head(&tcp_hashinfo.ehash[st->bucket].twchain);
-	goto get_tw;
-found:
-	cur = sk;
+get_tw:
+	while (tw && (tw->tw_family != st->family || !net_eq(twsk_net(tw), net))) {
+		tw = tw_next(tw);
+	}
+	if (tw) {
+		cur = tw;
+		goto out;
+	}
+
+	st->state = TCP_SEQ_STATE_OPENREQ;
+	req = req_head(&tcp_hashinfo.ehash[st->bucket].reqchain);
+get_req:
+	while (req && !req_match(req, st, net))
+		req = req_next(req);
+	if (req) {
+		cur = req;
+		goto out;
+	}
+	spin_unlock_bh(inet_ehash_lockp(&tcp_hashinfo, st->bucket));
+	st->state = TCP_SEQ_STATE_ESTABLISHED;
+
+	/* Look for next non empty bucket */
+	st->offset = 0;
+	while (++st->bucket <= tcp_hashinfo.ehash_mask &&
+			empty_bucket(st))
+		;
+	if (st->bucket > tcp_hashinfo.ehash_mask)
+		return NULL;
+
+	spin_lock_bh(inet_ehash_lockp(&tcp_hashinfo, st->bucket));
+	sk = sk_nulls_head(&tcp_hashinfo.ehash[st->bucket].chain);
+	goto get_sk;
 out:
 	return cur;
 }
@@ -2478,7 +2523,6 @@ static void *tcp_seek_last_pos(struct seq_file *seq)
 	void *rc = NULL;
 
 	switch (st->state) {
-	case TCP_SEQ_STATE_OPENREQ:
 	case TCP_SEQ_STATE_LISTENING:
 		if (st->bucket >= INET_LHTABLE_SIZE)
 			break;
@@ -2492,6 +2536,7 @@ static void *tcp_seek_last_pos(struct seq_file *seq)
 		/* Fallthrough */
 	case TCP_SEQ_STATE_ESTABLISHED:
 	case TCP_SEQ_STATE_TIME_WAIT:
+	case TCP_SEQ_STATE_OPENREQ:
 		st->state = TCP_SEQ_STATE_ESTABLISHED;
 		if (st->bucket > tcp_hashinfo.ehash_mask)
 			break;
@@ -2538,7 +2583,6 @@ static void *tcp_seq_next(struct seq_file *seq, void *v, loff_t *pos)
 	}
 
 	switch (st->state) {
-	case TCP_SEQ_STATE_OPENREQ:
 	case TCP_SEQ_STATE_LISTENING:
 		rc = listening_get_next(seq, v);
 		if (!rc) {
@@ -2550,6 +2594,7 @@ static void *tcp_seq_next(struct seq_file *seq, void *v, loff_t *pos)
 		break;
 	case TCP_SEQ_STATE_ESTABLISHED:
 	case TCP_SEQ_STATE_TIME_WAIT:
+	case TCP_SEQ_STATE_OPENREQ:
 		rc = established_get_next(seq, v);
 		break;
 	}
@@ -2564,15 +2609,11 @@ static void tcp_seq_stop(struct seq_file *seq, void *v)
 	struct tcp_iter_state *st = seq->private;
 
 	switch (st->state) {
-	case TCP_SEQ_STATE_OPENREQ:
-		if (v) {
-			struct inet_connection_sock *icsk = inet_csk(st->syn_wait_sk);
-			read_unlock_bh(&icsk->icsk_accept_queue.syn_wait_lock);
-		}
 	case TCP_SEQ_STATE_LISTENING:
 		if (v != SEQ_START_TOKEN)
 			spin_unlock_bh(&tcp_hashinfo.listening_hash[st->bucket].lock);
 		break;
+	case TCP_SEQ_STATE_OPENREQ:
 	case TCP_SEQ_STATE_TIME_WAIT:
 	case TCP_SEQ_STATE_ESTABLISHED:
 		if (v)
@@ -2622,10 +2663,11 @@ void tcp_proc_unregister(struct net *net, struct tcp_seq_afinfo *afinfo)
 }
 EXPORT_SYMBOL(tcp_proc_unregister);
 
-static void get_openreq4(const struct sock *sk, const struct request_sock *req,
-			 struct seq_file *f, int i, kuid_t uid, int *len)
+static void get_openreq4(const struct request_sock *req,
+			 struct seq_file *f, int i, int *len)
 {
 	const struct inet_request_sock *ireq = inet_rsk(req);
+	struct sock *sk = req->rsk_listener;
 	long delta = req->expires - jiffies;
 
 	seq_printf(f, "%4d: %08X:%04X %08X:%04X"
@@ -2640,7 +2682,7 @@ static void get_openreq4(const struct sock *sk, const struct request_sock *req,
 		1,    /* timers active (only the expire timer) */
 		jiffies_delta_to_clock_t(delta),
 		req->retrans,
-		from_kuid_munged(seq_user_ns(f), uid),
+		from_kuid_munged(seq_user_ns(f), sock_i_uid(sk)),
 		0,  /* non standard timer */
 		0, /* open_requests have no inode */
 		atomic_read(&sk->sk_refcnt),
@@ -2747,7 +2789,7 @@ static int tcp4_seq_show(struct seq_file *seq, void *v)
 		get_tcp4_sock(v, seq, st->num, &len);
 		break;
 	case TCP_SEQ_STATE_OPENREQ:
-		get_openreq4(st->syn_wait_sk, v, seq, st->num, st->uid, &len);
+		get_openreq4(v, seq, st->num, &len);
 		break;
 	case TCP_SEQ_STATE_TIME_WAIT:
 		get_timewait4_sock(v, seq, st->num, &len);
@@ -2866,6 +2908,7 @@ struct proto tcp_prot = {
 	.backlog_rcv		= tcp_v4_do_rcv,
 	.release_cb		= tcp_release_cb,
 	.mtu_reduced		= tcp_v4_mtu_reduced,
+	.stream_memory_free	= tcp_stream_memory_free,
 	.hash			= inet_hash,
 	.unhash			= inet_unhash,
 	.get_port		= inet_csk_get_port,
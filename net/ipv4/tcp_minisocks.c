@@ -520,7 +520,8 @@ EXPORT_SYMBOL(tcp_create_openreq_child);
 /*
  * Process an incoming packet for SYN_RECV sockets represented as a
  * request_sock. Normally sk is the listener socket but for TFO it
- * points to the child socket.
+ * points to the child socket. For a listener the caller holds the
+ * rsk_lock of the request, not the lock of the listener.
  *
  * XXX (TFO) - The current impl contains a special check for ack
  * validation and inside tcp_v4_reqsk_send_ack(). Can we do better?
@@ -530,7 +531,6 @@ EXPORT_SYMBOL(tcp_create_openreq_child);
 
 struct sock *tcp_check_req(struct sock *sk, struct sk_buff *skb,
 			   struct request_sock *req,
-			   struct request_sock **prev,
 			   bool fastopen)
 {
 	struct tcp_options_received tmp_opt;
@@ -722,11 +722,15 @@ struct sock *tcp_check_req(struct sock *sk, struct sk_buff *skb,
 	if (child == NULL)
 		goto listen_overflow;
 
-	inet_csk_reqsk_queue_unlink(sk, req, prev);
-	inet_csk_reqsk_queue_removed(sk, req);
+	/* The accept queue takes over the reference of the hash */
+	inet_csk_reqsk_queue_unlink(sk, req);
+	if (inet_csk_reqsk_queue_add(sk, req, child))
+		return child;
 
-	inet_csk_reqsk_queue_add(sk, req, child);
-	return child;
+	/* The listener was closed meanwhile, the child is gone */
+	bh_unlock_sock(child);
+	sock_put(child);
+	return NULL;
 
 listen_overflow:
 	if (!sysctl_tcp_abort_on_overflow) {
@@ -747,7 +751,7 @@ embryonic_reset:
 		tcp_reset(sk);
 	}
 	if (!fastopen) {
-		inet_csk_reqsk_queue_drop(sk, req, prev);
+		inet_csk_reqsk_queue_drop(sk, req);
 		NET_INC_STATS_BH(sock_net(sk), LINUX_MIB_EMBRYONICRSTS);
 	}
 	return NULL;
@@ -53,6 +53,9 @@ int sysctl_tcp_workaround_signed_windows __read_mostly = 0;
 /* Default TSQ limit of two TSO segments */
 int sysctl_tcp_limit_output_bytes __read_mostly = 131072;
 
+/* Default limit of unsent bytes in the write queue, no limit */
+unsigned int sysctl_tcp_notsent_lowat __read_mostly = UINT_MAX;
+
 /* This limits the percentage of the congestion window which we
  * will allow a single TSO frame to consume.  Building TSO frames
  * which are too large can cause TCP streams to be bursty.
@@ -2005,8 +2008,14 @@ static bool tcp_write_xmit(struct sock *sk, unsigned int mss_now, int nonagle,
 
 		/* TSQ : sk_wmem_alloc accounts skb truesize,
 		 * including skb overhead. But thats OK.
+		 * A paced flow needs no more than ~1ms worth of data
+		 * below it, more only adds queueing delay.
 		 */
-		if (atomic_read(&sk->sk_wmem_alloc) >= sysctl_tcp_limit_output_bytes) {
+		limit = max_t(unsigned int, skb->truesize,
+			      sk->sk_pacing_rate >> 10);
+		limit = min_t(unsigned int, limit,
+			      sysctl_tcp_limit_output_bytes);
+		if (atomic_read(&sk->sk_wmem_alloc) >= limit) {
 			set_bit(TSQ_THROTTLED, &tp->tsq_flags);
 			break;
 		}
@@ -16,13 +16,13 @@
 #include <linux/module.h>
 #include <linux/in6.h>
 #include <linux/ipv6.h>
-#include <linux/jhash.h>
 #include <linux/slab.h>
 
 #include <net/addrconf.h>
 #include <net/inet_connection_sock.h>
 #include <net/inet_ecn.h>
 #include <net/inet_hashtables.h>
+#include <net/inet6_hashtables.h>
 #include <net/ip6_route.h>
 #include <net/sock.h>
 #include <net/inet6_connection_sock.h>
@@ -32,6 +32,9 @@ int inet6_csk_bind_conflict(const struct sock *sk,
 {
 	const struct sock *sk2;
 	const struct hlist_node *node;
+	int reuse = sk->sk_reuse;
+	int reuseport = sk->sk_reuseport;
+	kuid_t uid = sock_i_uid((struct sock *)sk);
 
 	/* We must walk the whole port owner list in this case. -DaveM */
 	/*
@@ -43,9 +46,12 @@ int inet6_csk_bind_conflict(const struct sock *sk,
 		    (!sk->sk_bound_dev_if ||
 		     !sk2->sk_bound_dev_if ||
 		     sk->sk_bound_dev_if == sk2->sk_bound_dev_if) &&
-		    (!sk->sk_reuse || !sk2->sk_reuse ||
+		    (!reuse || !sk2->sk_reuse ||
 		     sk2->sk_state == TCP_LISTEN) &&
-		     ipv6_rcv_saddr_equal(sk, sk2))
+		    (!reuseport || !sk2->sk_reuseport ||
+		     (sk2->sk_state != TCP_TIME_WAIT &&
+		      !uid_eq(uid, sock_i_uid((struct sock *)sk2)))) &&
+		    ipv6_rcv_saddr_equal(sk, sk2))
 			break;
 	}
 
@@ -82,53 +88,40 @@ struct dst_entry *inet6_csk_route_req(struct sock *sk,
 }
 
 /*
- * request_sock (formerly open request) hash tables.
+ * request_sock (formerly open request) lookup, the requests are hashed
+ * in the established hash like the sockets they turn into.
  */
-static u32 inet6_synq_hash(const struct in6_addr *raddr, const __be16 rport,
-			   const u32 rnd, const u32 synq_hsize)
-{
-	u32 c;
-
-	c = jhash_3words((__force u32)raddr->s6_addr32[0],
-			 (__force u32)raddr->s6_addr32[1],
-			 (__force u32)raddr->s6_addr32[2],
-			 rnd);
-
-	c = jhash_2words((__force u32)raddr->s6_addr32[3],
-			 (__force u32)rport,
-			 c);
-
-	return c & (synq_hsize - 1);
-}
-
-struct request_sock *inet6_csk_search_req(const struct sock *sk,
-					  struct request_sock ***prevp,
+struct request_sock *inet6_csk_search_req(struct sock *sk,
 					  const __be16 rport,
 					  const struct in6_addr *raddr,
 					  const struct in6_addr *laddr,
 					  const int iif)
 {
-	const struct inet_connection_sock *icsk = inet_csk(sk);
-	struct listen_sock *lopt = icsk->icsk_accept_queue.listen_opt;
-	struct request_sock *req, **prev;
-
-	for (prev = &lopt->syn_table[inet6_synq_hash(raddr, rport,
-						     lopt->hash_rnd,
-						     lopt->nr_table_entries)];
-	     (req = *prev) != NULL;
-	     prev = &req->dl_next) {
+	struct inet_hashinfo *hashinfo = sk->sk_prot->h.hashinfo;
+	const u32 hash = inet6_ehashfn(sock_net(sk), laddr,
+				       inet_sk(sk)->inet_num, raddr, rport);
+	struct inet_ehash_bucket *head = inet_ehash_bucket(hashinfo, hash);
+	spinlock_t *lock = inet_ehash_lockp(hashinfo, hash);
+	struct request_sock *req;
+	struct hlist_node *node;
+
+	spin_lock(lock);
+	hlist_for_each_entry(req, node, &head->reqchain, rsk_hash_node) {
 		const struct inet6_request_sock *treq = inet6_rsk(req);
 
-		if (inet_rsk(req)->rmt_port == rport &&
+		if (req->rsk_listener == sk &&
+		    inet_rsk(req)->rmt_port == rport &&
 		    req->rsk_ops->family == AF_INET6 &&
 		    ipv6_addr_equal(&treq->rmt_addr, raddr) &&
 		    ipv6_addr_equal(&treq->loc_addr, laddr) &&
 		    (!treq->iif || treq->iif == iif)) {
 			WARN_ON(req->sk != NULL);
-			*prevp = prev;
+			atomic_inc(&req->rsk_refcnt);
+			spin_unlock(lock);
 			return req;
 		}
 	}
+	spin_unlock(lock);
 
 	return NULL;
 }
@@ -139,14 +132,12 @@ void inet6_csk_reqsk_queue_hash_add(struct sock *sk,
 				    struct request_sock *req,
 				    const unsigned long timeout)
 {
-	struct inet_connection_sock *icsk = inet_csk(sk);
-	struct listen_sock *lopt = icsk->icsk_accept_queue.listen_opt;
-	const u32 h = inet6_synq_hash(&inet6_rsk(req)->rmt_addr,
-				      inet_rsk(req)->rmt_port,
-				      lopt->hash_rnd, lopt->nr_table_entries);
-
-	reqsk_queue_hash_req(&icsk->icsk_accept_queue, h, req, timeout);
-	inet_csk_reqsk_queue_added(sk, timeout);
+	const struct inet6_request_sock *treq = inet6_rsk(req);
+	const u32 hash = inet6_ehashfn(sock_net(sk), &treq->loc_addr,
+				       inet_sk(sk)->inet_num,
+				       &treq->rmt_addr, inet_rsk(req)->rmt_port);
+
+	__inet_csk_reqsk_queue_hash_add(sk, req, hash, timeout);
 }
 
 EXPORT_SYMBOL_GPL(inet6_csk_reqsk_queue_hash_add);
@@ -1207,9 +1207,11 @@ int ip6_append_data(struct sock *sk, int getfrag(void *from, char *to,
 {
 	struct inet_sock *inet = inet_sk(sk);
 	struct ipv6_pinfo *np = inet6_sk(sk);
+	struct ubuf_info *uarg = NULL;
 	struct inet_cork *cork;
 	struct sk_buff *skb, *skb_prev = NULL;
 	unsigned int maxfraglen, fragheaderlen;
+	bool zc = false;
 	int exthdrlen;
 	int dst_exthdrlen;
 	int hh_len;
@@ -1217,6 +1219,7 @@ int ip6_append_data(struct sock *sk, int getfrag(void *from, char *to,
 	int copy;
 	int err;
 	int offset = 0;
+	int csummode = CHECKSUM_NONE;
 	__u8 tx_flags = 0;
 
 	if (flags&MSG_PROBE)
@@ -1292,6 +1295,9 @@ int ip6_append_data(struct sock *sk, int getfrag(void *from, char *to,
 		dst_exthdrlen = 0;
 		mtu = cork->fragsize;
 	}
+	/* GSO packets are built whole, the device segments them */
+	if (cork->gso_size)
+		mtu = sizeof(struct ipv6hdr) + IPV6_MAXPLEN;
 
 	hh_len = LL_RESERVED_SPACE(rt->dst.dev);
 
@@ -1306,6 +1312,9 @@ int ip6_append_data(struct sock *sk, int getfrag(void *from, char *to,
 		}
 	}
 
+	if (transhdrlen && cork->gso_size && !dst_exthdrlen)
+		csummode = CHECKSUM_PARTIAL;
+
 	/* For UDP, check if TX timestamp is enabled */
 	if (sk->sk_type == SOCK_DGRAM) {
 		err = sock_tx_timestamp(sk, &tx_flags);
@@ -1330,6 +1339,28 @@ int ip6_append_data(struct sock *sk, int getfrag(void *from, char *to,
 	 */
 
 	cork->length += length;
+
+	if ((flags & MSG_ZEROCOPY) && length && sock_flag(sk, SOCK_ZEROCOPY)) {
+		err = -ENOBUFS;
+		uarg = sock_zerocopy_alloc(sk);
+		if (!uarg)
+			goto error;
+
+		/* Only a single uncorked packet of user iovecs is sent
+		 * from user pages, the others are copied and completed
+		 * right away.
+		 */
+		if (skb_queue_empty(&sk->sk_write_queue) &&
+		    !(flags & MSG_MORE) &&
+		    cork->length + fragheaderlen <= mtu &&
+		    !(cork->flags & IPCORK_ALLFRAG) &&
+		    rt->dst.dev->features & NETIF_F_SG &&
+		    getfrag == ip_generic_getfrag)
+			zc = true;
+		else
+			uarg->zerocopy = 0;
+	}
+
 	if (length > mtu) {
 		int proto = sk->sk_protocol;
 		if (dontfrag && (proto == IPPROTO_UDP || proto == IPPROTO_RAW)){
@@ -1345,6 +1376,7 @@ int ip6_append_data(struct sock *sk, int getfrag(void *from, char *to,
 						  transhdrlen, mtu, flags, rt);
 			if (err)
 				goto error;
+			sock_zerocopy_put(uarg);
 			return 0;
 		}
 	}
@@ -1364,6 +1396,7 @@ int ip6_append_data(struct sock *sk, int getfrag(void *from, char *to,
 			unsigned int fraglen;
 			unsigned int fraggap;
 			unsigned int alloclen;
+			unsigned int pagedlen = 0;
 alloc_new_skb:
 			/* There's no room in the current skb */
 			if (skb)
@@ -1388,7 +1421,12 @@ alloc_new_skb:
 			if ((flags & MSG_MORE) &&
 			    !(rt->dst.dev->features&NETIF_F_SG))
 				alloclen = mtu;
-			else
+			else if (zc || (cork->gso_size &&
+					rt->dst.dev->features & NETIF_F_SG)) {
+				/* the payload goes in frags */
+				alloclen = fragheaderlen + transhdrlen;
+				pagedlen = datalen - transhdrlen;
+			} else
 				alloclen = datalen + fragheaderlen;
 
 			alloclen += dst_exthdrlen;
@@ -1436,7 +1474,7 @@ alloc_new_skb:
 			/*
 			 *	Fill in the control structures
 			 */
-			skb->ip_summed = CHECKSUM_NONE;
+			skb->ip_summed = csummode;
 			skb->csum = 0;
 			/* reserve for fragmentation and ipsec header */
 			skb_reserve(skb, hh_len + sizeof(struct frag_hdr) +
@@ -1448,7 +1486,7 @@ alloc_new_skb:
 			/*
 			 *	Find where to start putting bytes
 			 */
-			data = skb_put(skb, fraglen);
+			data = skb_put(skb, fraglen - pagedlen);
 			skb_set_network_header(skb, exthdrlen);
 			data += fragheaderlen;
 			skb->transport_header = (skb->network_header +
@@ -1462,7 +1500,7 @@ alloc_new_skb:
 				data += fraggap;
 				pskb_trim_unique(skb_prev, maxfraglen);
 			}
-			copy = datalen - transhdrlen - fraggap;
+			copy = datalen - transhdrlen - fraggap - pagedlen;
 
 			if (copy < 0) {
 				err = -EINVAL;
@@ -1475,10 +1513,11 @@ alloc_new_skb:
 			}
 
 			offset += copy;
-			length -= datalen - fraggap;
+			length -= datalen - fraggap - pagedlen;
 			transhdrlen = 0;
 			exthdrlen = 0;
 			dst_exthdrlen = 0;
+			csummode = CHECKSUM_NONE;
 
 			/*
 			 * Put the packet on the pending queue
@@ -1500,6 +1539,26 @@ alloc_new_skb:
 				err = -EFAULT;
 				goto error;
 			}
+		} else if (zc) {
+			unsigned int off = skb->len;
+
+			err = skb_zerocopy_iovec(skb, from, offset, copy);
+			if (err == -EMSGSIZE) {
+				/* too many pages, copy after all */
+				zc = false;
+				uarg->zerocopy = 0;
+				continue;
+			}
+			if (err)
+				goto error;
+
+			/* the checksum is only offloaded for GSO packets */
+			if (skb->ip_summed != CHECKSUM_PARTIAL)
+				skb->csum = csum_block_add(skb->csum,
+						skb_checksum(skb, off, copy, 0),
+						off);
+			skb_zcopy_set(skb, uarg);
+			atomic_add(copy, &sk->sk_wmem_alloc);
 		} else {
 			int i = skb_shinfo(skb)->nr_frags;
 			struct page_frag *pfrag = sk_page_frag(sk);
@@ -1536,11 +1595,13 @@ alloc_new_skb:
 		length -= copy;
 	}
 
+	sock_zerocopy_put(uarg);
 	return 0;
 
 error_efault:
 	err = -EFAULT;
 error:
+	sock_zerocopy_put_abort(uarg);
 	cork->length -= length;
 	IP6_INC_STATS(sock_net(sk), rt->rt6i_idev, IPSTATS_MIB_OUTDISCARDS);
 	return err;
@@ -63,6 +63,7 @@
 #include <net/inet_common.h>
 #include <net/secure_seq.h>
 #include <net/tcp_memcontrol.h>
+#include <net/busy_poll.h>
 
 #include <asm/uaccess.h>
 
@@ -413,12 +414,9 @@ static void tcp_v6_err(struct sk_buff *skb, struct inet6_skb_parm *opt,
 
 	/* Might be for an request_sock */
 	switch (sk->sk_state) {
-		struct request_sock *req, **prev;
+		struct request_sock *req;
 	case TCP_LISTEN:
-		if (sock_owned_by_user(sk))
-			goto out;
-
-		req = inet6_csk_search_req(sk, &prev, th->dest, &hdr->daddr,
+		req = inet6_csk_search_req(sk, th->dest, &hdr->daddr,
 					   &hdr->saddr, inet6_iif(skb));
 		if (!req)
 			goto out;
@@ -430,10 +428,12 @@ static void tcp_v6_err(struct sk_buff *skb, struct inet6_skb_parm *opt,
 
 		if (seq != tcp_rsk(req)->snt_isn) {
 			NET_INC_STATS_BH(net, LINUX_MIB_OUTOFWINDOWICMPS);
-			goto out;
+		} else {
+			spin_lock(&req->rsk_lock);
+			inet_csk_reqsk_queue_drop(sk, req);
+			spin_unlock(&req->rsk_lock);
 		}
-
-		inet_csk_reqsk_queue_drop(sk, req, prev);
+		reqsk_put(req);
 		goto out;
 
 	case TCP_SYN_SENT:
@@ -930,7 +930,8 @@ static void tcp_v6_send_reset(struct sock *sk, struct sk_buff *skb)
 		 * no RST generated if md5 hash doesn't match.
 		 */
 		sk1 = inet6_lookup_listener(dev_net(skb_dst(skb)->dev),
-					   &tcp_hashinfo, &ipv6h->daddr,
+					   &tcp_hashinfo, &ipv6h->saddr,
+					   th->source, &ipv6h->daddr,
 					   ntohs(th->source), inet6_iif(skb));
 		if (!sk1)
 			return;
@@ -994,16 +995,28 @@ static void tcp_v6_reqsk_send_ack(struct sock *sk, struct sk_buff *skb,
 
 static struct sock *tcp_v6_hnd_req(struct sock *sk,struct sk_buff *skb)
 {
-	struct request_sock *req, **prev;
 	const struct tcphdr *th = tcp_hdr(skb);
-	struct sock *nsk;
+	struct request_sock *req;
+	struct sock *nsk = NULL;
+	bool hashed = false;
 
-	/* Find possible connection requests. */
-	req = inet6_csk_search_req(sk, &prev, th->source,
+	/* Find possible connection requests. Another CPU may have turned
+	 * the request into a socket meanwhile, look for that one then.
+	 */
+	req = inet6_csk_search_req(sk, th->source,
 				   &ipv6_hdr(skb)->saddr,
 				   &ipv6_hdr(skb)->daddr, inet6_iif(skb));
-	if (req)
-		return tcp_check_req(sk, skb, req, prev, false);
+	if (req) {
+		spin_lock(&req->rsk_lock);
+		hashed = reqsk_hashed(req);
+		if (hashed)
+			nsk = tcp_check_req(sk, skb, req, false);
+		spin_unlock(&req->rsk_lock);
+		reqsk_put(req);
+		if (hashed)
+			return nsk;
+		NET_INC_STATS_BH(sock_net(sk), LINUX_MIB_TCPREQRACE);
+	}
 
 	nsk = __inet6_lookup_established(sock_net(sk), &tcp_hashinfo,
 			&ipv6_hdr(skb)->saddr, th->source,
@@ -1188,15 +1201,21 @@ have_isn:
 	if (security_inet_conn_request(sk, skb, req))
 		goto drop_and_release;
 
-	if (tcp_v6_send_synack(sk, dst, &fl6, req,
-			       (struct request_values *)&tmp_ext,
-			       skb_get_queue_mapping(skb)) ||
-	    want_cookie)
-		goto drop_and_free;
-
 	tcp_rsk(req)->snt_synack = tcp_time_stamp;
 	tcp_rsk(req)->listener = NULL;
-	inet6_csk_reqsk_queue_hash_add(sk, req, TCP_TIMEOUT_INIT);
+	/* Hash the request_sock before the SYN-ACK goes out, so that
+	 * the ACK finds it. Should sending fail, the timer of the
+	 * request retransmits.
+	 */
+	if (!want_cookie)
+		inet6_csk_reqsk_queue_hash_add(sk, req, TCP_TIMEOUT_INIT);
+	tcp_v6_send_synack(sk, dst, &fl6, req,
+			   (struct request_values *)&tmp_ext,
+			   skb_get_queue_mapping(skb));
+	if (want_cookie)
+		goto drop_and_free;
+
+	reqsk_put(req);
 	return 0;
 
 drop_and_release:
@@ -1623,8 +1642,16 @@ process:
 	if (sk_filter(sk, skb))
 		goto discard_and_relse;
 
+	sk_mark_napi_id(sk, skb);
 	skb->dev = NULL;
 
+	/* Listeners are not locked, see tcp_v4_rcv() */
+	if (tcp_listener_lockless(sk)) {
+		ret = tcp_v6_do_rcv(sk, skb);
+		sock_put(sk);
+		return ret ? -1 : 0;
+	}
+
 	bh_lock_sock_nested(sk);
 	ret = 0;
 	if (!sock_owned_by_user(sk)) {
@@ -1693,6 +1720,7 @@ do_time_wait:
 		struct sock *sk2;
 
 		sk2 = inet6_lookup_listener(dev_net(skb->dev), &tcp_hashinfo,
+					    &ipv6_hdr(skb)->saddr, th->source,
 					    &ipv6_hdr(skb)->daddr,
 					    ntohs(th->dest), inet6_iif(skb));
 		if (sk2 != NULL) {
@@ -1768,6 +1796,7 @@ static const struct inet_connection_sock_af_ops ipv6_specific = {
 	.net_frag_header_len = sizeof(struct frag_hdr),
 	.setsockopt	   = ipv6_setsockopt,
 	.getsockopt	   = ipv6_getsockopt,
+	.recv_error	   = ipv6_recv_error,
 	.addr2sockaddr	   = inet6_csk_addr2sockaddr,
 	.sockaddr_len	   = sizeof(struct sockaddr_in6),
 	.bind_conflict	   = inet6_csk_bind_conflict,
@@ -1799,6 +1828,7 @@ static const struct inet_connection_sock_af_ops ipv6_mapped = {
 	.net_header_len	   = sizeof(struct iphdr),
 	.setsockopt	   = ipv6_setsockopt,
 	.getsockopt	   = ipv6_getsockopt,
+	.recv_error	   = ipv6_recv_error,
 	.addr2sockaddr	   = inet6_csk_addr2sockaddr,
 	.sockaddr_len	   = sizeof(struct sockaddr_in6),
 	.bind_conflict	   = inet6_csk_bind_conflict,
@@ -1843,8 +1873,9 @@ static void tcp_v6_destroy_sock(struct sock *sk)
 #ifdef CONFIG_PROC_FS
 /* Proc filesystem TCPv6 sock list dumping. */
 static void get_openreq6(struct seq_file *seq,
-			 const struct sock *sk, struct request_sock *req, int i, kuid_t uid)
+			 struct request_sock *req, int i)
 {
+	kuid_t uid = sock_i_uid(req->rsk_listener);
 	int ttd = req->expires - jiffies;
 	const struct in6_addr *src = &inet6_rsk(req)->loc_addr;
 	const struct in6_addr *dest = &inet6_rsk(req)->rmt_addr;
@@ -1976,7 +2007,7 @@ static int tcp6_seq_show(struct seq_file *seq, void *v)
 		get_tcp6_sock(seq, v, st->num);
 		break;
 	case TCP_SEQ_STATE_OPENREQ:
-		get_openreq6(seq, st->syn_wait_sk, v, st->num, st->uid);
+		get_openreq6(seq, v, st->num);
 		break;
 	case TCP_SEQ_STATE_TIME_WAIT:
 		get_timewait6_sock(seq, v, st->num);
@@ -2033,6 +2064,7 @@ struct proto tcpv6_prot = {
 	.backlog_rcv		= tcp_v6_do_rcv,
 	.release_cb		= tcp_release_cb,
 	.mtu_reduced		= tcp_v6_mtu_reduced,
+	.stream_memory_free	= tcp_stream_memory_free,
 	.hash			= tcp_v6_hash,
 	.unhash			= inet_unhash,
 	.get_port		= inet_csk_get_port,
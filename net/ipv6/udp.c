@@ -45,10 +45,12 @@
 #include <net/tcp_states.h>
 #include <net/ip6_checksum.h>
 #include <net/xfrm.h>
+#include <net/inet6_hashtables.h>
 
 #include <linux/proc_fs.h>
 #include <linux/seq_file.h>
 #include <trace/events/skb.h>
+#include <net/busy_poll.h>
 #include "udp_impl.h"
 
 int ipv6_rcv_saddr_equal(const struct sock *sk, const struct sock *sk2)
@@ -203,7 +205,8 @@ static struct sock *udp6_lib_lookup2(struct net *net,
 {
 	struct sock *sk, *result;
 	struct hlist_nulls_node *node;
-	int score, badness;
+	int score, badness, matches = 0, reuseport = 0;
+	u32 hash = 0;
 
 begin:
 	result = NULL;
@@ -214,8 +217,18 @@ begin:
 		if (score > badness) {
 			result = sk;
 			badness = score;
-			if (score == SCORE2_MAX)
+			reuseport = sk->sk_reuseport;
+			if (reuseport) {
+				hash = inet6_ehashfn(net, daddr, hnum,
+						     saddr, sport);
+				matches = 1;
+			} else if (score == SCORE2_MAX)
 				goto exact_match;
+		} else if (score == badness && reuseport) {
+			matches++;
+			if (((u64)hash * matches) >> 32 == 0)
+				result = sk;
+			hash = next_pseudo_random32(hash);
 		}
 	}
 	/*
@@ -249,7 +262,8 @@ struct sock *__udp6_lib_lookup(struct net *net,
 	unsigned short hnum = ntohs(dport);
 	unsigned int hash2, slot2, slot = udp_hashfn(net, hnum, udptable->mask);
 	struct udp_hslot *hslot2, *hslot = &udptable->hash[slot];
-	int score, badness;
+	int score, badness, matches = 0, reuseport = 0;
+	u32 hash = 0;
 
 	rcu_read_lock();
 	if (hslot->count > 10) {
@@ -284,6 +298,17 @@ begin:
 		if (score > badness) {
 			result = sk;
 			badness = score;
+			reuseport = sk->sk_reuseport;
+			if (reuseport) {
+				hash = inet6_ehashfn(net, daddr, hnum,
+						     saddr, sport);
+				matches = 1;
+			}
+		} else if (score == badness && reuseport) {
+			matches++;
+			if (((u64)hash * matches) >> 32 == 0)
+				result = sk;
+			hash = next_pseudo_random32(hash);
 		}
 	}
 	/*
@@ -445,6 +470,8 @@ try_again:
 		if (np->rxopt.all)
 			datagram_recv_ctl(sk, msg, skb);
 	}
+	if (udp_sk(sk)->gro_enabled)
+		udp_cmsg_recv(msg, sk, skb);
 
 	err = copied;
 	if (flags & MSG_TRUNC)
@@ -518,8 +545,10 @@ static int __udpv6_queue_rcv_skb(struct sock *sk, struct sk_buff *skb)
 {
 	int rc;
 
-	if (!ipv6_addr_any(&inet6_sk(sk)->daddr))
+	if (!ipv6_addr_any(&inet6_sk(sk)->daddr)) {
 		sock_rps_save_rxhash(sk, skb);
+		sk_mark_napi_id(sk, skb);
+	}
 
 	rc = sock_queue_rcv_skb(sk, skb);
 	if (rc < 0) {
@@ -551,7 +580,7 @@ void udpv6_encap_enable(void)
 }
 EXPORT_SYMBOL(udpv6_encap_enable);
 
-int udpv6_queue_rcv_skb(struct sock *sk, struct sk_buff *skb)
+static int udpv6_queue_rcv_one_skb(struct sock *sk, struct sk_buff *skb)
 {
 	struct udp_sock *up = udp_sk(sk);
 	int rc;
@@ -638,6 +667,25 @@ drop:
 	return -1;
 }
 
+int udpv6_queue_rcv_skb(struct sock *sk, struct sk_buff *skb)
+{
+	struct sk_buff *next, *segs;
+
+	if (likely(!udp_unexpected_gso(sk, skb)))
+		return udpv6_queue_rcv_one_skb(sk, skb);
+
+	segs = udp_rcv_segment(sk, skb, false);
+	for (skb = segs; skb; skb = next) {
+		next = skb->next;
+		skb->next = NULL;
+
+		/* No resubmission for a single datagram, see the IPv4 side */
+		if (udpv6_queue_rcv_one_skb(sk, skb) > 0)
+			kfree_skb(skb);
+	}
+	return 0;
+}
+
 static struct sock *udp_v6_mcast_next(struct net *net, struct sock *sk,
 				      __be16 loc_port, const struct in6_addr *loc_addr,
 				      __be16 rmt_port, const struct in6_addr *rmt_addr,
@@ -956,6 +1004,7 @@ static int udp_v6_push_pending_frames(struct sock *sk)
 	struct udp_sock  *up = udp_sk(sk);
 	struct inet_sock *inet = inet_sk(sk);
 	struct flowi6 *fl6 = &inet->cork.fl.u.ip6;
+	unsigned int gso_size = inet->cork.base.gso_size;
 	int err = 0;
 	int is_udplite = IS_UDPLITE(sk);
 	__wsum csum = 0;
@@ -973,6 +1022,29 @@ static int udp_v6_push_pending_frames(struct sock *sk)
 	uh->len = htons(up->len);
 	uh->check = 0;
 
+	if (gso_size) {
+		const int hlen = skb_transport_offset(skb) +
+				 sizeof(struct udphdr);
+		const int datalen = up->len - sizeof(struct udphdr);
+
+		err = -EINVAL;
+		if (hlen + gso_size > inet->cork.base.fragsize ||
+		    datalen > gso_size * UDP_MAX_SEGMENTS || is_udplite)
+			goto flush;
+		/* see udp_send_skb() */
+		err = -EIO;
+		if (skb_queue_len(&sk->sk_write_queue) != 1 ||
+		    skb->ip_summed != CHECKSUM_PARTIAL)
+			goto flush;
+		err = 0;
+		if (datalen > gso_size) {
+			skb_shinfo(skb)->gso_size = gso_size;
+			skb_shinfo(skb)->gso_type = SKB_GSO_UDP_L4;
+			skb_shinfo(skb)->gso_segs = DIV_ROUND_UP(datalen,
+								 gso_size);
+		}
+	}
+
 	if (is_udplite)
 		csum = udplite_csum_outgoing(sk, skb);
 	else if (skb->ip_summed == CHECKSUM_PARTIAL) { /* UDP hardware csum */
@@ -1003,6 +1075,10 @@ out:
 	up->len = 0;
 	up->pending = 0;
 	return err;
+
+flush:
+	ip6_flush_pending_frames(sk);
+	goto out;
 }
 
 int udpv6_sendmsg(struct kiocb *iocb, struct sock *sk,
@@ -1027,6 +1103,7 @@ int udpv6_sendmsg(struct kiocb *iocb, struct sock *sk,
 	int err;
 	int connected = 0;
 	int is_udplite = IS_UDPLITE(sk);
+	u16 gso_size = up->gso_size;
 	int (*getfrag)(void *, char *, int, int, int, struct sk_buff *);
 
 	/* destination address check */
@@ -1153,8 +1230,11 @@ do_udp_sendmsg:
 		memset(opt, 0, sizeof(struct ipv6_txoptions));
 		opt->tot_len = sizeof(*opt);
 
-		err = datagram_send_ctl(sock_net(sk), sk, msg, &fl6, opt,
-					&hlimit, &tclass, &dontfrag);
+		err = udp_cmsg_send(sk, msg, &gso_size);
+		if (err > 0)
+			err = datagram_send_ctl(sock_net(sk), sk, msg, &fl6,
+						opt, &hlimit, &tclass,
+						&dontfrag);
 		if (err < 0) {
 			fl6_sock_release(flowlabel);
 			return err;
@@ -1168,6 +1248,11 @@ do_udp_sendmsg:
 			opt = NULL;
 		connected = 0;
 	}
+	/* A GSO packet must go out in one piece */
+	if (gso_size && corkreq) {
+		fl6_sock_release(flowlabel);
+		return -EINVAL;
+	}
 	if (opt == NULL)
 		opt = np->opt;
 	if (flowlabel)
@@ -1233,6 +1318,7 @@ back_from_confirm:
 	}
 
 	up->pending = AF_INET6;
+	inet->cork.base.gso_size = gso_size;
 
 do_append_data:
 	up->len += ulen;
@@ -1299,6 +1385,9 @@ void udpv6_destroy_sock(struct sock *sk)
 	udp_v6_flush_pending_frames(sk);
 	release_sock(sk);
 
+	if (udp_sk(sk)->gro_enabled)
+		static_key_slow_dec(&udp_gro_needed);
+
 	inet6_destroy_sock(sk);
 }
 
@@ -1362,6 +1451,42 @@ static int udp6_ufo_send_check(struct sk_buff *skb)
 	return 0;
 }
 
+static struct sk_buff *udp6_gso_segment(struct sk_buff *gso_skb,
+					netdev_features_t features)
+{
+	const struct ipv6hdr *ipv6h;
+	struct sk_buff *segs, *seg;
+	struct udphdr *uh;
+	unsigned int len;
+
+	segs = __udp_gso_segment(gso_skb, features);
+	if (IS_ERR_OR_NULL(segs))
+		return segs;
+
+	for (seg = segs; seg; seg = seg->next) {
+		ipv6h = ipv6_hdr(seg);
+		uh = udp_hdr(seg);
+		len = ntohs(uh->len);
+
+		if (seg->ip_summed == CHECKSUM_PARTIAL) {
+			uh->check = ~csum_ipv6_magic(&ipv6h->saddr,
+						     &ipv6h->daddr, len,
+						     IPPROTO_UDP, 0);
+			continue;
+		}
+
+		/* skb_segment() summed the payload while copying it */
+		uh->check = 0;
+		uh->check = csum_ipv6_magic(&ipv6h->saddr, &ipv6h->daddr, len,
+					    IPPROTO_UDP,
+					    csum_partial(uh, sizeof(*uh),
+							 seg->csum));
+		if (uh->check == 0)
+			uh->check = CSUM_MANGLED_0;
+	}
+	return segs;
+}
+
 static struct sk_buff *udp6_ufo_fragment(struct sk_buff *skb,
 	netdev_features_t features)
 {
@@ -1379,6 +1504,9 @@ static struct sk_buff *udp6_ufo_fragment(struct sk_buff *skb,
 	if (unlikely(skb->len <= mss))
 		goto out;
 
+	if (skb_shinfo(skb)->gso_type & SKB_GSO_UDP_L4)
+		return udp6_gso_segment(skb, features);
+
 	if (skb_gso_ok(skb, features | NETIF_F_GSO_ROBUST)) {
 		/* Packet is from an untrusted source, reset gso_segs. */
 		int type = skb_shinfo(skb)->gso_type;
@@ -1435,11 +1563,87 @@ out:
 	return segs;
 }
 
+static struct sk_buff **udp6_gro_receive(struct sk_buff **head,
+					 struct sk_buff *skb)
+{
+	const struct ipv6hdr *iph = skb_gro_network_header(skb);
+	unsigned int off, hlen;
+	struct udphdr *uh;
+	struct sock *sk;
+	__wsum wsum;
+	bool gro;
+
+	if (!static_key_false(&udp_gro_needed))
+		goto flush;
+
+	off = skb_gro_offset(skb);
+	hlen = off + sizeof(*uh);
+	uh = skb_gro_header_fast(skb, off);
+	if (skb_gro_header_hard(skb, hlen)) {
+		uh = skb_gro_header_slow(skb, hlen, off);
+		if (unlikely(!uh))
+			goto flush;
+	}
+
+	sk = __udp6_lib_lookup(dev_net(skb->dev), &iph->saddr, uh->source,
+			       &iph->daddr, uh->dest, skb->dev->ifindex,
+			       &udp_table);
+	if (!sk)
+		goto flush;
+	gro = udp_sk(sk)->gro_enabled && !udp_sk(sk)->encap_type;
+	sock_put(sk);
+	if (!gro)
+		goto flush;
+
+	switch (skb->ip_summed) {
+	case CHECKSUM_COMPLETE:
+		if (!csum_ipv6_magic(&iph->saddr, &iph->daddr,
+				     skb_gro_len(skb), IPPROTO_UDP,
+				     skb->csum)) {
+			skb->ip_summed = CHECKSUM_UNNECESSARY;
+			break;
+		}
+		goto flush;
+
+	case CHECKSUM_NONE:
+		wsum = ~csum_unfold(csum_ipv6_magic(&iph->saddr, &iph->daddr,
+						    skb_gro_len(skb),
+						    IPPROTO_UDP, 0));
+		if (csum_fold(skb_checksum(skb, skb_gro_offset(skb),
+					   skb_gro_len(skb), wsum)))
+			goto flush;
+
+		skb->ip_summed = CHECKSUM_UNNECESSARY;
+		break;
+	}
+
+	return udp_gro_receive(head, skb, uh);
+
+flush:
+	NAPI_GRO_CB(skb)->flush = 1;
+	return NULL;
+}
+
+static int udp6_gro_complete(struct sk_buff *skb)
+{
+	const struct ipv6hdr *ipv6h = ipv6_hdr(skb);
+	struct udphdr *uh = udp_hdr(skb);
+	unsigned int len = skb->len - skb_transport_offset(skb);
+
+	uh->len = htons(len);
+	uh->check = ~csum_ipv6_magic(&ipv6h->saddr, &ipv6h->daddr, len,
+				     IPPROTO_UDP, 0);
+
+	return udp_gro_complete(skb);
+}
+
 static const struct inet6_protocol udpv6_protocol = {
 	.handler	=	udpv6_rcv,
 	.err_handler	=	udpv6_err,
 	.gso_send_check =	udp6_ufo_send_check,
 	.gso_segment	=	udp6_ufo_fragment,
+	.gro_receive	=	udp6_gro_receive,
+	.gro_complete	=	udp6_gro_complete,
 	.flags		=	INET6_PROTO_NOPOLICY|INET6_PROTO_FINAL,
 };
 
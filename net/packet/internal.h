@@ -78,18 +78,27 @@ struct packet_fanout {
 	u16			id;
 	u8			type;
 	u8			defrag;
+	u8			rollover;
 	atomic_t		rr_cur;
 	struct list_head	list;
 	struct sock		*arr[PACKET_FANOUT_MAX];
+	unsigned int		next[PACKET_FANOUT_MAX];	/* rollover hint */
 	spinlock_t		lock;
 	atomic_t		sk_ref;
 	struct packet_type	prot_hook ____cacheline_aligned_in_smp;
 };
 
+struct packet_fanout_stats {
+	atomic_long_t		delivered;
+	atomic_long_t		dropped;
+	atomic_long_t		rollover;
+};
+
 struct packet_sock {
 	/* struct sock has to be the first member of packet_sock */
 	struct sock		sk;
 	struct packet_fanout	*fanout;
+	struct packet_fanout_stats	fanout_stats;
 	struct tpacket_stats	stats;
 	union  tpacket_stats_u	stats_u;
 	struct packet_ring_buffer	rx_ring;
@@ -65,6 +65,18 @@ static inline struct sk_buff *dequeue_skb(struct Qdisc *q)
 			q->q.qlen--;
 		} else
 			skb = NULL;
+	} else if (unlikely(skb_queue_len(&q->bulk_q))) {
+		struct net_device *dev = qdisc_dev(q);
+		struct netdev_queue *txq;
+
+		/* leftovers of a bulk dequeue go out before the rest */
+		skb = skb_peek(&q->bulk_q);
+		txq = netdev_get_tx_queue(dev, skb_get_queue_mapping(skb));
+		if (!netif_xmit_frozen_or_stopped(txq)) {
+			__skb_unlink(skb, &q->bulk_q);
+			q->q.qlen--;
+		} else
+			skb = NULL;
 	} else {
 		skb = q->dequeue(q);
 	}
@@ -101,11 +113,61 @@ static inline int handle_dev_cpu_collision(struct sk_buff *skb,
 	return ret;
 }
 
+/* Upper bound on the skbs sent under one HARD_TX_LOCK acquisition */
+#define QDISC_XMIT_BATCH	16
+
+/*
+ * Dequeue further skbs for @txq behind @skb onto @batch, as many as the
+ * driver can take according to BQL. An skb bound for another queue ends
+ * the batch and is put back on bulk_q.
+ *
+ * pfifo_ring used to batch regardless of BQL, so it keeps doing that for
+ * drivers that do not report a limit.
+ */
+static void try_bulk_dequeue_skb(struct Qdisc *q, struct sk_buff *skb,
+				 struct netdev_queue *txq,
+				 struct sk_buff_head *batch)
+{
+	struct net_device *dev = qdisc_dev(q);
+	int bytelimit = qdisc_avail_bulklimit(txq);
+
+	if (bytelimit <= 0 && (q->flags & TCQ_F_NOLOCK))
+		bytelimit = INT_MAX;
+	bytelimit -= qdisc_pkt_len(skb);
+
+	while (bytelimit > 0 && skb_queue_len(batch) < QDISC_XMIT_BATCH - 1) {
+		if (skb_queue_len(&q->bulk_q)) {
+			skb = __skb_dequeue(&q->bulk_q);
+			q->q.qlen--;
+		} else {
+			skb = q->dequeue(q);
+			if (!skb)
+				break;
+		}
+
+		if (unlikely(netdev_get_tx_queue(dev,
+				skb_get_queue_mapping(skb)) != txq)) {
+			__skb_queue_head(&q->bulk_q, skb);
+			q->q.qlen++;
+			break;
+		}
+
+		bytelimit -= qdisc_pkt_len(skb);
+		__skb_queue_tail(batch, skb);
+	}
+}
+
 /*
  * Transmit one skb, and handle the return status as required. Holding the
  * __QDISC_STATE_RUNNING bit guarantees that only one CPU can execute this
  * function.
  *
+ * Further skbs for the same queue are dequeued first and sent under the same
+ * driver lock, all but the last flagged with skb->xmit_more. Whatever the
+ * driver does not take is put back in front of the queue.
+ *
+ * A NULL @root_lock means @q is a TCQ_F_NOLOCK qdisc.
+ *
  * Returns to the caller:
  *				0  - queue is empty or throttled.
  *				>0 - queue is not empty.
@@ -114,22 +176,45 @@ int sch_direct_xmit(struct sk_buff *skb, struct Qdisc *q,
 		    struct net_device *dev, struct netdev_queue *txq,
 		    spinlock_t *root_lock)
 {
+	struct sk_buff_head batch;
 	int ret = NETDEV_TX_BUSY;
 
+	__skb_queue_head_init(&batch);
+	try_bulk_dequeue_skb(q, skb, txq, &batch);
+
 	/* And release qdisc */
-	spin_unlock(root_lock);
+	if (root_lock)
+		spin_unlock(root_lock);
 
 	HARD_TX_LOCK(dev, txq, smp_processor_id());
-	if (!netif_xmit_frozen_or_stopped(txq))
-		ret = dev_hard_start_xmit(skb, dev, txq);
-
+	if (!netif_xmit_frozen_or_stopped(txq)) {
+		for (;;) {
+			ret = dev_hard_start_xmit(skb, dev, txq,
+						  !skb_queue_empty(&batch));
+			if (!dev_xmit_complete(ret))
+				break;
+			skb = __skb_dequeue(&batch);
+			if (!skb)
+				break;
+			if (netif_xmit_stopped(txq)) {
+				ret = NETDEV_TX_BUSY;
+				break;
+			}
+		}
+	}
 	HARD_TX_UNLOCK(dev, txq);
 
-	spin_lock(root_lock);
+	if (root_lock)
+		spin_lock(root_lock);
+
+	if (unlikely(!skb_queue_empty(&batch))) {
+		q->q.qlen += skb_queue_len(&batch);
+		skb_queue_splice(&batch, &q->bulk_q);
+	}
 
-	if (dev_xmit_complete(ret)) {
+	if (!skb || dev_xmit_complete(ret)) {
 		/* Driver sent out skb successfully or skb was consumed */
-		ret = qdisc_qlen(q);
+		ret = root_lock ? qdisc_qlen(q) : 1;
 	} else if (ret == NETDEV_TX_LOCKED) {
 		/* Driver try lock failed */
 		ret = handle_dev_cpu_collision(skb, txq, q);
@@ -149,7 +234,8 @@ int sch_direct_xmit(struct sk_buff *skb, struct Qdisc *q,
 }
 
 /*
- * NOTE: Called under qdisc_lock(q) with locally disabled BH.
+ * NOTE: Called under qdisc_lock(q) with locally disabled BH, unless q is
+ * a TCQ_F_NOLOCK qdisc.
  *
  * __QDISC_STATE_RUNNING guarantees only one CPU can process
  * this qdisc at a time. qdisc_lock(q) serializes queue accesses for
@@ -179,7 +265,7 @@ static inline int qdisc_restart(struct Qdisc *q)
 	if (unlikely(!skb))
 		return 0;
 	WARN_ON_ONCE(skb_dst_is_noref(skb));
-	root_lock = qdisc_lock(q);
+	root_lock = (q->flags & TCQ_F_NOLOCK) ? NULL : qdisc_lock(q);
 	dev = qdisc_dev(q);
 	txq = netdev_get_tx_queue(dev, skb_get_queue_mapping(skb));
 
@@ -527,6 +613,257 @@ struct Qdisc_ops pfifo_fast_ops __read_mostly = {
 };
 EXPORT_SYMBOL(pfifo_fast_ops);
 
+/*
+ * pfifo_ring: pfifo_fast for a qdisc that is run without its root lock.
+ *
+ * Each band is a fixed size ring of skb pointers, an empty slot being
+ * NULL. Senders only serialise on the producer lock of their band and
+ * never touch the root lock. The consumer side needs no lock: it is only
+ * entered by the owner of __QDISC_STATE_RUNNING, or once the qdisc has
+ * been deactivated and quiesced.
+ *
+ * Like pfifo_fast, the qdisc as a whole holds at most tx_queue_len skbs,
+ * so every ring is large enough to take all of them. The queue length and
+ * backlog are counted by the senders and copied into q.qlen and
+ * qstats.backlog by the owner, which is the only one allowed to write
+ * those fields.
+ */
+struct skb_ring {
+	spinlock_t		producer_lock ____cacheline_aligned_in_smp;
+	unsigned int		producer;
+	unsigned int		consumer ____cacheline_aligned_in_smp;
+	unsigned int		mask;
+	struct sk_buff		**queue;
+};
+
+struct pfifo_ring_priv {
+	struct skb_ring		ring[PFIFO_FAST_BANDS];
+	atomic_t		qlen;
+	atomic_t		backlog;
+	atomic_t		drops;
+};
+
+static int skb_ring_produce(struct skb_ring *r, struct sk_buff *skb)
+{
+	struct sk_buff **slot;
+	int err = -ENOBUFS;
+
+	spin_lock(&r->producer_lock);
+	slot = &r->queue[r->producer & r->mask];
+	if (!ACCESS_ONCE(*slot)) {
+		/* Publish the skb only once its contents are visible */
+		smp_wmb();
+		ACCESS_ONCE(*slot) = skb;
+		r->producer++;
+		err = 0;
+	}
+	spin_unlock(&r->producer_lock);
+
+	return err;
+}
+
+static struct sk_buff *skb_ring_peek(struct skb_ring *r)
+{
+	return ACCESS_ONCE(r->queue[r->consumer & r->mask]);
+}
+
+static struct sk_buff *skb_ring_consume(struct skb_ring *r)
+{
+	struct sk_buff **slot = &r->queue[r->consumer & r->mask];
+	struct sk_buff *skb = ACCESS_ONCE(*slot);
+
+	if (skb) {
+		smp_read_barrier_depends();
+		ACCESS_ONCE(*slot) = NULL;
+		r->consumer++;
+	}
+
+	return skb;
+}
+
+static unsigned int pfifo_ring_size(unsigned long limit)
+{
+	return roundup_pow_of_two(limit ? : 1);
+}
+
+/* Only called by the owner of the qdisc */
+static void pfifo_ring_update_stats(struct Qdisc *qdisc)
+{
+	struct pfifo_ring_priv *priv = qdisc_priv(qdisc);
+
+	/* skbs the generic code holds on to are still part of the queue */
+	qdisc->q.qlen = atomic_read(&priv->qlen) +
+			skb_queue_len(&qdisc->bulk_q) + !!qdisc->gso_skb;
+	qdisc->qstats.backlog = atomic_read(&priv->backlog);
+	qdisc->qstats.drops = atomic_read(&priv->drops);
+}
+
+static int pfifo_ring_enqueue(struct sk_buff *skb, struct Qdisc *qdisc)
+{
+	int band = prio2band[skb->priority & TC_PRIO_MAX];
+	struct pfifo_ring_priv *priv = qdisc_priv(qdisc);
+	unsigned long limit = qdisc_dev(qdisc)->tx_queue_len ? : 1;
+
+	if (unlikely(atomic_inc_return(&priv->qlen) > limit))
+		goto drop;
+
+	atomic_add(qdisc_pkt_len(skb), &priv->backlog);
+	if (unlikely(skb_ring_produce(&priv->ring[band], skb))) {
+		atomic_sub(qdisc_pkt_len(skb), &priv->backlog);
+		goto drop;
+	}
+
+	return NET_XMIT_SUCCESS;
+
+drop:
+	atomic_dec(&priv->qlen);
+	atomic_inc(&priv->drops);
+	kfree_skb(skb);
+	return NET_XMIT_DROP;
+}
+
+static struct sk_buff *pfifo_ring_dequeue(struct Qdisc *qdisc)
+{
+	struct pfifo_ring_priv *priv = qdisc_priv(qdisc);
+	struct sk_buff *skb = NULL;
+	int band;
+
+	for (band = 0; band < PFIFO_FAST_BANDS; band++) {
+		skb = skb_ring_consume(&priv->ring[band]);
+		if (skb) {
+			atomic_dec(&priv->qlen);
+			atomic_sub(qdisc_pkt_len(skb), &priv->backlog);
+			qdisc_bstats_update(qdisc, skb);
+			break;
+		}
+	}
+
+	pfifo_ring_update_stats(qdisc);
+	return skb;
+}
+
+static struct sk_buff *pfifo_ring_peek(struct Qdisc *qdisc)
+{
+	struct pfifo_ring_priv *priv = qdisc_priv(qdisc);
+	struct sk_buff *skb;
+	int band;
+
+	for (band = 0; band < PFIFO_FAST_BANDS; band++) {
+		skb = skb_ring_peek(&priv->ring[band]);
+		if (skb)
+			return skb;
+	}
+
+	return NULL;
+}
+
+static void pfifo_ring_reset(struct Qdisc *qdisc)
+{
+	struct pfifo_ring_priv *priv = qdisc_priv(qdisc);
+	struct sk_buff *skb;
+	int band;
+
+	for (band = 0; band < PFIFO_FAST_BANDS; band++) {
+		if (!priv->ring[band].queue)
+			continue;
+		while ((skb = skb_ring_consume(&priv->ring[band])) != NULL)
+			kfree_skb(skb);
+	}
+	atomic_set(&priv->qlen, 0);
+	atomic_set(&priv->backlog, 0);
+	qdisc->qstats.backlog = 0;
+}
+
+static void pfifo_ring_destroy(struct Qdisc *qdisc)
+{
+	struct pfifo_ring_priv *priv = qdisc_priv(qdisc);
+	int band;
+
+	for (band = 0; band < PFIFO_FAST_BANDS; band++)
+		kfree(priv->ring[band].queue);
+}
+
+static int pfifo_ring_init(struct Qdisc *qdisc, struct nlattr *opt)
+{
+	struct pfifo_ring_priv *priv = qdisc_priv(qdisc);
+	unsigned int size = pfifo_ring_size(qdisc_dev(qdisc)->tx_queue_len);
+	int band;
+
+	for (band = 0; band < PFIFO_FAST_BANDS; band++) {
+		struct skb_ring *r = &priv->ring[band];
+
+		r->queue = kzalloc_node(size * sizeof(*r->queue), GFP_KERNEL,
+				netdev_queue_numa_node_read(qdisc->dev_queue));
+		if (!r->queue)
+			return -ENOMEM;
+		spin_lock_init(&r->producer_lock);
+		r->mask = size - 1;
+	}
+	atomic_set(&priv->qlen, 0);
+	atomic_set(&priv->backlog, 0);
+	atomic_set(&priv->drops, 0);
+
+	qdisc->flags |= TCQ_F_NOLOCK | TCQ_F_CAN_BYPASS;
+	return 0;
+}
+
+/*
+ * Called under RTNL with the device deactivated, so the qdisc is neither
+ * fed nor run and its rings have been purged.
+ */
+static int pfifo_ring_change_tx_queue_len(struct Qdisc *qdisc,
+					  unsigned int new_len)
+{
+	struct pfifo_ring_priv *priv = qdisc_priv(qdisc);
+	unsigned int size = pfifo_ring_size(new_len);
+	struct sk_buff **queues[PFIFO_FAST_BANDS];
+	int band;
+
+	if (size == priv->ring[0].mask + 1)
+		return 0;
+
+	for (band = 0; band < PFIFO_FAST_BANDS; band++) {
+		queues[band] = kzalloc_node(size * sizeof(*queues[band]),
+				GFP_KERNEL,
+				netdev_queue_numa_node_read(qdisc->dev_queue));
+		if (!queues[band]) {
+			while (--band >= 0)
+				kfree(queues[band]);
+			return -ENOMEM;
+		}
+	}
+
+	pfifo_ring_reset(qdisc);
+	for (band = 0; band < PFIFO_FAST_BANDS; band++) {
+		struct skb_ring *r = &priv->ring[band];
+
+		spin_lock_bh(&r->producer_lock);
+		swap(r->queue, queues[band]);
+		r->mask = size - 1;
+		r->producer = 0;
+		r->consumer = 0;
+		spin_unlock_bh(&r->producer_lock);
+		kfree(queues[band]);
+	}
+
+	return 0;
+}
+
+struct Qdisc_ops pfifo_ring_ops __read_mostly = {
+	.id		=	"pfifo_ring",
+	.priv_size	=	sizeof(struct pfifo_ring_priv),
+	.enqueue	=	pfifo_ring_enqueue,
+	.dequeue	=	pfifo_ring_dequeue,
+	.peek		=	pfifo_ring_peek,
+	.init		=	pfifo_ring_init,
+	.reset		=	pfifo_ring_reset,
+	.destroy	=	pfifo_ring_destroy,
+	.change_tx_queue_len =	pfifo_ring_change_tx_queue_len,
+	.dump		=	pfifo_fast_dump,
+	.owner		=	THIS_MODULE,
+};
+EXPORT_SYMBOL(pfifo_ring_ops);
+
 static struct lock_class_key qdisc_tx_busylock;
 
 struct Qdisc *qdisc_alloc(struct netdev_queue *dev_queue,
@@ -556,6 +893,7 @@ struct Qdisc *qdisc_alloc(struct netdev_queue *dev_queue,
 	}
 	INIT_LIST_HEAD(&sch->list);
 	skb_queue_head_init(&sch->q);
+	skb_queue_head_init(&sch->bulk_q);
 
 	spin_lock_init(&sch->busylock);
 	lockdep_set_class(&sch->busylock,
@@ -606,6 +944,11 @@ void qdisc_reset(struct Qdisc *qdisc)
 		qdisc->gso_skb = NULL;
 		qdisc->q.qlen = 0;
 	}
+
+	if (skb_queue_len(&qdisc->bulk_q)) {
+		__skb_queue_purge(&qdisc->bulk_q);
+		qdisc->q.qlen = 0;
+	}
 }
 EXPORT_SYMBOL(qdisc_reset);
 
@@ -639,6 +982,8 @@ void qdisc_destroy(struct Qdisc *qdisc)
 	dev_put(qdisc_dev(qdisc));
 
 	kfree_skb(qdisc->gso_skb);
+	if (skb_queue_len(&qdisc->bulk_q))
+		__skb_queue_purge(&qdisc->bulk_q);
 	/*
 	 * gen_estimator est_timer() might access qdisc->q.lock,
 	 * wait a RCU grace period before freeing qdisc.
@@ -771,12 +1116,31 @@ static void dev_deactivate_queue(struct net_device *dev,
 			set_bit(__QDISC_STATE_DEACTIVATED, &qdisc->state);
 
 		rcu_assign_pointer(dev_queue->qdisc, qdisc_default);
-		qdisc_reset(qdisc);
+		if (!(qdisc->flags & TCQ_F_NOLOCK))
+			qdisc_reset(qdisc);
 
 		spin_unlock_bh(qdisc_lock(qdisc));
 	}
 }
 
+/*
+ * A TCQ_F_NOLOCK qdisc can still be fed and run after it has been marked
+ * deactivated, so it is only purged once dev_deactivate_many() has waited
+ * for all of its users.
+ */
+static void dev_reset_queue(struct net_device *dev,
+			    struct netdev_queue *dev_queue,
+			    void *_unused)
+{
+	struct Qdisc *qdisc = dev_queue->qdisc_sleeping;
+
+	if (qdisc->flags & TCQ_F_NOLOCK) {
+		spin_lock_bh(qdisc_lock(qdisc));
+		qdisc_reset(qdisc);
+		spin_unlock_bh(qdisc_lock(qdisc));
+	}
+}
+
 static bool some_qdisc_is_busy(struct net_device *dev)
 {
 	unsigned int i;
@@ -835,9 +1199,11 @@ void dev_deactivate_many(struct list_head *head)
 		synchronize_net();
 
 	/* Wait for outstanding qdisc_run calls. */
-	list_for_each_entry(dev, head, unreg_list)
+	list_for_each_entry(dev, head, unreg_list) {
 		while (some_qdisc_is_busy(dev))
 			yield();
+		netdev_for_each_tx_queue(dev, dev_reset_queue, NULL);
+	}
 }
 
 void dev_deactivate(struct net_device *dev)
@@ -850,6 +1216,53 @@ void dev_deactivate(struct net_device *dev)
 }
 EXPORT_SYMBOL(dev_deactivate);
 
+static bool qdisc_follows_tx_queue_len(struct net_device *dev)
+{
+	unsigned int i;
+
+	for (i = 0; i < dev->num_tx_queues; i++) {
+		struct netdev_queue *dev_queue = netdev_get_tx_queue(dev, i);
+
+		if (dev_queue->qdisc_sleeping->ops->change_tx_queue_len)
+			return true;
+	}
+	return false;
+}
+
+/*
+ * Let the qdiscs attached to the device queues follow a change of
+ * dev->tx_queue_len. The device is deactivated meanwhile, so they can
+ * resize their queues without racing against senders.
+ */
+int dev_qdisc_change_tx_queue_len(struct net_device *dev)
+{
+	bool up = dev->flags & IFF_UP;
+	unsigned int i;
+	int ret = 0;
+
+	ASSERT_RTNL();
+
+	if (!qdisc_follows_tx_queue_len(dev))
+		return 0;
+
+	if (up)
+		dev_deactivate(dev);
+
+	for (i = 0; i < dev->num_tx_queues; i++) {
+		struct Qdisc *qdisc = netdev_get_tx_queue(dev, i)->qdisc_sleeping;
+
+		if (!qdisc->ops->change_tx_queue_len)
+			continue;
+		ret = qdisc->ops->change_tx_queue_len(qdisc, dev->tx_queue_len);
+		if (ret)
+			break;
+	}
+
+	if (up)
+		dev_activate(dev);
+	return ret;
+}
+
 static void dev_init_scheduler_queue(struct net_device *dev,
 				     struct netdev_queue *dev_queue,
 				     void *_qdisc)
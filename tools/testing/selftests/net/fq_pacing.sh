@@ -0,0 +1,76 @@
+#!/bin/sh
+#
+# Check that the fq qdisc paces a bulk TCP flow. The flow crosses a veth
+# pair between two network namespaces, with fq and a maxrate on the
+# sending side and netem delaying the acks on the way back. The transfer
+# must take about as long as the rate allows.
+#
+# Uses msg_zerocopy in copy mode as the traffic generator.
+
+NS1=fq-ns1
+NS2=fq-ns2
+RATE=20		# mbit/s
+DELAY=20	# ms added to the ack path
+COUNT=100	# sends of 64KB
+RX_IDLE=2000	# ms the receiver waits for more data before it exits
+
+cleanup() {
+	ip netns del $NS1 2>/dev/null
+	ip netns del $NS2 2>/dev/null
+}
+
+setup() {
+	ip netns add $NS1 || return 1
+	ip netns add $NS2 || return 1
+	ip link add fq-veth1 type veth peer name fq-veth2 || return 1
+	ip link set fq-veth1 netns $NS1
+	ip link set fq-veth2 netns $NS2
+
+	ip netns exec $NS1 ip addr add 192.168.202.1/24 dev fq-veth1
+	ip netns exec $NS2 ip addr add 192.168.202.2/24 dev fq-veth2
+	ip netns exec $NS1 ip link set fq-veth1 up
+	ip netns exec $NS2 ip link set fq-veth2 up
+
+	ip netns exec $NS1 tc qdisc add dev fq-veth1 root fq \
+		maxrate ${RATE}mbit || return 1
+	ip netns exec $NS2 tc qdisc add dev fq-veth2 root netem \
+		delay ${DELAY}ms || return 1
+}
+
+now_ms() {
+	echo $(($(date +%s%N) / 1000000))
+}
+
+if [ "$(id -u)" != 0 ]; then
+	echo "fq pacing test needs root, skipped"
+	exit 0
+fi
+
+trap cleanup EXIT
+if ! setup; then
+	echo "could not set up veth pair with fq and netem, skipped"
+	exit 0
+fi
+
+ip netns exec $NS2 ./msg_zerocopy -4 -t -r &
+rx=$!
+sleep 1
+
+start=$(now_ms)
+ip netns exec $NS1 ./msg_zerocopy -4 -t -s -c -n $COUNT \
+	-D 192.168.202.2 || exit 1
+wait $rx || exit 1
+elapsed=$(($(now_ms) - start - RX_IDLE))
+
+# bits / (mbit/s) = usecs, allow 10% for the initial quantum and rounding
+expected=$((COUNT * 65536 * 8 / RATE / 1000))
+echo "sent $((COUNT * 64))KB in ${elapsed}ms, at ${RATE}mbit/s: ${expected}ms"
+
+tc_stats=$(ip netns exec $NS1 tc -s qdisc show dev fq-veth1)
+echo "$tc_stats"
+
+if [ $elapsed -lt $((expected * 9 / 10)) ]; then
+	echo "flow was not paced"
+	exit 1
+fi
+exit 0
@@ -0,0 +1,358 @@
+/*
+ *  tools/testing/selftests/net/msg_zerocopy.c
+ *
+ *  Send data with MSG_ZEROCOPY and check that every send call is
+ *  completed exactly once through the socket error queue.
+ *
+ *  By default a receiver is forked, so that the data travels over
+ *  loopback. With -r or -s only one side runs, which lets
+ *  msg_zerocopy.sh place the two in network namespaces joined by veth.
+ *
+ *  Both loopback and veth deliver locally, which copies the user pages,
+ *  so the notifications are expected to report SO_EE_CODE_ZEROCOPY_COPIED.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ */
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <linux/errqueue.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+
+#ifndef SO_ZEROCOPY
+#define SO_ZEROCOPY	60
+#endif
+
+#ifndef MSG_ZEROCOPY
+#define MSG_ZEROCOPY	0x4000000
+#endif
+
+#ifndef SO_EE_ORIGIN_ZEROCOPY
+#define SO_EE_ORIGIN_ZEROCOPY		5
+#endif
+
+#ifndef SO_EE_CODE_ZEROCOPY_COPIED
+#define SO_EE_CODE_ZEROCOPY_COPIED	1
+#endif
+
+static int cfg_family = PF_INET;
+static int cfg_type = SOCK_STREAM;
+static const char *cfg_addr;
+static int cfg_port = 8000;
+static int cfg_count = 1000;
+static int cfg_size;
+static int cfg_zerocopy = 1;
+static int cfg_rx = 1, cfg_tx = 1;
+
+static char payload[65536];
+
+/* notification state of the sender */
+static unsigned int next_completion;
+static unsigned int completions, copied;
+
+static void error(const char *msg)
+{
+	perror(msg);
+	exit(1);
+}
+
+static socklen_t setup_sockaddr(struct sockaddr_storage *ss, const char *addr)
+{
+	struct sockaddr_in6 *sin6 = (struct sockaddr_in6 *)ss;
+	struct sockaddr_in *sin = (struct sockaddr_in *)ss;
+
+	memset(ss, 0, sizeof(*ss));
+	if (cfg_family == PF_INET) {
+		sin->sin_family = AF_INET;
+		sin->sin_port = htons(cfg_port);
+		if (!addr)
+			sin->sin_addr.s_addr = htonl(INADDR_ANY);
+		else if (inet_pton(AF_INET, addr, &sin->sin_addr) != 1)
+			error("inet_pton");
+		return sizeof(*sin);
+	}
+
+	sin6->sin6_family = AF_INET6;
+	sin6->sin6_port = htons(cfg_port);
+	if (!addr)
+		sin6->sin6_addr = in6addr_any;
+	else if (inet_pton(AF_INET6, addr, &sin6->sin6_addr) != 1)
+		error("inet_pton");
+	return sizeof(*sin6);
+}
+
+static int setup_rx(void)
+{
+	struct sockaddr_storage ss;
+	socklen_t len;
+	int fd, one = 1;
+
+	fd = socket(cfg_family, cfg_type, 0);
+	if (fd < 0)
+		error("socket rx");
+	if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)))
+		error("setsockopt SO_REUSEADDR");
+
+	len = setup_sockaddr(&ss, NULL);
+	if (bind(fd, (struct sockaddr *)&ss, len))
+		error("bind");
+	if (cfg_type == SOCK_STREAM && listen(fd, 1))
+		error("listen");
+
+	return fd;
+}
+
+static void do_rx(int fd)
+{
+	struct timeval tv = { .tv_sec = 2 };
+	unsigned long bytes = 0, packets = 0;
+	static char buf[65536];
+	int ret;
+
+	if (cfg_type == SOCK_STREAM) {
+		int conn = accept(fd, NULL, NULL);
+
+		if (conn < 0)
+			error("accept");
+		close(fd);
+		fd = conn;
+	}
+
+	/* datagrams have no end of stream, stop when the sender is quiet */
+	if (setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)))
+		error("setsockopt SO_RCVTIMEO");
+
+	while ((ret = recv(fd, buf, sizeof(buf), 0)) > 0) {
+		bytes += ret;
+		packets++;
+	}
+	if (ret < 0 && errno != EAGAIN)
+		error("recv");
+
+	fprintf(stderr, "rx: %lu bytes in %lu reads\n", bytes, packets);
+	close(fd);
+}
+
+static void read_notification(int fd)
+{
+	struct sock_extended_err *serr;
+	char control[128];
+	struct msghdr msg = {
+		.msg_control = control,
+		.msg_controllen = sizeof(control),
+	};
+	struct cmsghdr *cm;
+
+	if (recvmsg(fd, &msg, MSG_ERRQUEUE) < 0)
+		error("recvmsg MSG_ERRQUEUE");
+
+	cm = CMSG_FIRSTHDR(&msg);
+	if (!cm)
+		error("no cmsg");
+	if (!((cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR) ||
+	      (cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR))) {
+		fprintf(stderr, "unexpected cmsg %d/%d\n",
+			cm->cmsg_level, cm->cmsg_type);
+		exit(1);
+	}
+
+	serr = (struct sock_extended_err *)CMSG_DATA(cm);
+	if (serr->ee_origin != SO_EE_ORIGIN_ZEROCOPY || serr->ee_errno) {
+		fprintf(stderr, "unexpected origin %u errno %u\n",
+			serr->ee_origin, serr->ee_errno);
+		exit(1);
+	}
+
+	/* notifications cover ranges of calls and arrive in order */
+	if (serr->ee_info != next_completion) {
+		fprintf(stderr, "notification for %u..%u, expected %u\n",
+			serr->ee_info, serr->ee_data, next_completion);
+		exit(1);
+	}
+
+	completions += serr->ee_data - serr->ee_info + 1;
+	if (serr->ee_code & SO_EE_CODE_ZEROCOPY_COPIED)
+		copied += serr->ee_data - serr->ee_info + 1;
+	next_completion = serr->ee_data + 1;
+}
+
+/* read all pending notifications, waiting up to @timeout ms for one */
+static void read_notifications(int fd, int timeout)
+{
+	struct pollfd pfd = { .fd = fd };
+
+	while (poll(&pfd, 1, timeout) == 1 && (pfd.revents & POLLERR)) {
+		read_notification(fd);
+		timeout = 0;
+	}
+}
+
+static void do_tx(void)
+{
+	struct sockaddr_storage ss;
+	unsigned int sends = 0;
+	int fd, i, one = 1;
+	socklen_t len;
+
+	fd = socket(cfg_family, cfg_type, 0);
+	if (fd < 0)
+		error("socket tx");
+
+	if (cfg_zerocopy &&
+	    setsockopt(fd, SOL_SOCKET, SO_ZEROCOPY, &one, sizeof(one)))
+		error("setsockopt SO_ZEROCOPY");
+
+	len = setup_sockaddr(&ss, cfg_addr);
+	if (connect(fd, (struct sockaddr *)&ss, len))
+		error("connect");
+
+	for (i = 0; i < cfg_count; i++) {
+		int flags = cfg_zerocopy ? MSG_ZEROCOPY : 0;
+		int ret;
+
+		ret = send(fd, payload, cfg_size, flags);
+		if (ret == -1 && errno == ENOBUFS && cfg_zerocopy) {
+			/* notification memory is used up, reap some */
+			read_notifications(fd, 100);
+			i--;
+			continue;
+		}
+		if (ret == -1)
+			error("send");
+		if (cfg_type == SOCK_DGRAM && ret != cfg_size) {
+			fprintf(stderr, "short datagram %d\n", ret);
+			exit(1);
+		}
+
+		sends++;
+		if (cfg_zerocopy)
+			read_notifications(fd, 0);
+	}
+
+	if (cfg_zerocopy) {
+		while (completions < sends) {
+			unsigned int before = completions;
+
+			read_notifications(fd, 1000);
+			if (completions == before)
+				break;
+		}
+	}
+
+	fprintf(stderr, "tx: %u sends, %u completions, %u copied\n",
+		sends, completions, copied);
+	close(fd);
+
+	if (cfg_zerocopy && completions != sends) {
+		fprintf(stderr, "missing completions\n");
+		exit(1);
+	}
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s [-4|-6] [-t|-u] [-r|-s] [-c] "
+		"[-D addr] [-p port] [-n count] [-l size]\n", prog);
+	exit(1);
+}
+
+static void parse_opts(int argc, char **argv)
+{
+	int c;
+
+	while ((c = getopt(argc, argv, "46turscD:p:n:l:")) != -1) {
+		switch (c) {
+		case '4':
+			cfg_family = PF_INET;
+			break;
+		case '6':
+			cfg_family = PF_INET6;
+			break;
+		case 't':
+			cfg_type = SOCK_STREAM;
+			break;
+		case 'u':
+			cfg_type = SOCK_DGRAM;
+			break;
+		case 'r':
+			cfg_tx = 0;
+			break;
+		case 's':
+			cfg_rx = 0;
+			break;
+		case 'c':
+			cfg_zerocopy = 0;
+			break;
+		case 'D':
+			cfg_addr = optarg;
+			break;
+		case 'p':
+			cfg_port = strtol(optarg, NULL, 0);
+			break;
+		case 'n':
+			cfg_count = strtol(optarg, NULL, 0);
+			break;
+		case 'l':
+			cfg_size = strtol(optarg, NULL, 0);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	if (!cfg_rx && !cfg_tx)
+		usage(argv[0]);
+	if (!cfg_addr)
+		cfg_addr = cfg_family == PF_INET ? "127.0.0.1" : "::1";
+
+	/* a datagram must fit the veth MTU to be sent from user pages */
+	if (!cfg_size)
+		cfg_size = cfg_type == SOCK_STREAM ? sizeof(payload) : 1400;
+	if (cfg_size <= 0 || cfg_size > sizeof(payload))
+		usage(argv[0]);
+}
+
+int main(int argc, char **argv)
+{
+	int status, fd;
+	pid_t pid;
+
+	parse_opts(argc, argv);
+	memset(payload, 'a', sizeof(payload));
+
+	if (!cfg_tx) {
+		do_rx(setup_rx());
+		return 0;
+	}
+	if (!cfg_rx) {
+		do_tx();
+		return 0;
+	}
+
+	fd = setup_rx();
+	pid = fork();
+	if (pid < 0)
+		error("fork");
+	if (!pid) {
+		do_rx(fd);
+		exit(0);
+	}
+	close(fd);
+
+	do_tx();
+
+	if (waitpid(pid, &status, 0) < 0)
+		error("waitpid");
+	return WIFEXITED(status) ? WEXITSTATUS(status) : 1;
+}
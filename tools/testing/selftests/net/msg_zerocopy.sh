@@ -0,0 +1,65 @@
+#!/bin/sh
+#
+# Run msg_zerocopy for TCP and UDP over IPv4 and IPv6, first over
+# loopback and then across a veth pair between two network namespaces.
+
+NS1=zerocopy-ns1
+NS2=zerocopy-ns2
+
+cleanup() {
+	ip netns del $NS1 2>/dev/null
+	ip netns del $NS2 2>/dev/null
+}
+
+setup() {
+	ip netns add $NS1 || return 1
+	ip netns add $NS2 || return 1
+	ip link add zc-veth1 type veth peer name zc-veth2 || return 1
+	ip link set zc-veth1 netns $NS1
+	ip link set zc-veth2 netns $NS2
+
+	ip netns exec $NS1 ip addr add 192.168.201.1/24 dev zc-veth1
+	ip netns exec $NS2 ip addr add 192.168.201.2/24 dev zc-veth2
+	ip netns exec $NS1 ip -6 addr add fd00:201::1/64 dev zc-veth1 nodad
+	ip netns exec $NS2 ip -6 addr add fd00:201::2/64 dev zc-veth2 nodad
+	ip netns exec $NS1 ip link set zc-veth1 up
+	ip netns exec $NS2 ip link set zc-veth2 up
+}
+
+ret=0
+
+for family in -4 -6; do
+	for proto in -t -u; do
+		echo "loopback $family $proto"
+		./msg_zerocopy $family $proto || ret=1
+	done
+done
+
+if [ "$(id -u)" != 0 ]; then
+	echo "veth tests need root, skipped"
+	exit $ret
+fi
+
+trap cleanup EXIT
+if ! setup; then
+	echo "could not set up veth pair, skipped"
+	exit $ret
+fi
+
+for family in -4 -6; do
+	if [ $family = -4 ]; then
+		addr=192.168.201.2
+	else
+		addr=fd00:201::2
+	fi
+
+	for proto in -t -u; do
+		echo "veth $family $proto"
+		ip netns exec $NS2 ./msg_zerocopy $family $proto -r &
+		sleep 1
+		ip netns exec $NS1 ./msg_zerocopy $family $proto -s -D $addr || ret=1
+		wait $! || ret=1
+	done
+done
+
+exit $ret
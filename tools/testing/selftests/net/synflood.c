@@ -0,0 +1,369 @@
+/*
+ *  tools/testing/selftests/net/synflood.c
+ *
+ *  Put a single TCP listener on loopback under load and report the rate
+ *  it keeps up with.
+ *
+ *  In the default storm mode a number of client processes connect and
+ *  close in a loop, while as many server processes accept on the shared
+ *  listener. In syn mode a number of processes send bare SYNs from random
+ *  127/8 sources over a raw socket, the handshakes are never completed.
+ *
+ *  The request socket counters of /proc/net/netstat are reported as the
+ *  difference over the run.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ */
+
+#define _GNU_SOURCE
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/ip.h>
+#include <netinet/tcp.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+
+enum {
+	MODE_STORM,
+	MODE_SYN,
+};
+
+static int cfg_mode = MODE_STORM;
+static int cfg_port = 8000;
+static int cfg_procs = 4;
+static int cfg_secs = 5;
+static int cfg_backlog = 4096;
+
+static const char *counters[] = {
+	"ListenOverflows",
+	"ListenDrops",
+	"TCPReqTimeout",
+	"TCPReqRetrans",
+	"TCPReqListenerClosed",
+	"TCPReqRace",
+	NULL
+};
+
+static void error(const char *msg)
+{
+	perror(msg);
+	exit(1);
+}
+
+static double now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+/* read the TcpExt counters named in counters[], -1 if the kernel
+ * does not have one
+ */
+static void read_counters(long long *vals)
+{
+	char names[4096], values[4096];
+	char *name, *value, *sn, *sv;
+	FILE *f;
+	int i;
+
+	for (i = 0; counters[i]; i++)
+		vals[i] = -1;
+
+	f = fopen("/proc/net/netstat", "r");
+	if (!f)
+		return;
+
+	while (fgets(names, sizeof(names), f) &&
+	       fgets(values, sizeof(values), f)) {
+		if (strncmp(names, "TcpExt:", 7))
+			continue;
+
+		name = strtok_r(names + 7, " \n", &sn);
+		value = strtok_r(values + 7, " \n", &sv);
+		while (name && value) {
+			for (i = 0; counters[i]; i++)
+				if (!strcmp(name, counters[i]))
+					vals[i] = atoll(value);
+			name = strtok_r(NULL, " \n", &sn);
+			value = strtok_r(NULL, " \n", &sv);
+		}
+	}
+	fclose(f);
+}
+
+static void setup_sockaddr(struct sockaddr_in *sin)
+{
+	memset(sin, 0, sizeof(*sin));
+	sin->sin_family = AF_INET;
+	sin->sin_port = htons(cfg_port);
+	sin->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+}
+
+static int setup_listener(void)
+{
+	struct sockaddr_in sin;
+	int fd, one = 1;
+
+	fd = socket(PF_INET, SOCK_STREAM, 0);
+	if (fd < 0)
+		error("socket listen");
+	if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)))
+		error("setsockopt SO_REUSEADDR");
+
+	setup_sockaddr(&sin);
+	if (bind(fd, (struct sockaddr *)&sin, sizeof(sin)))
+		error("bind");
+	if (listen(fd, cfg_backlog))
+		error("listen");
+
+	return fd;
+}
+
+/* accept until killed, the clients do the counting */
+static void do_server(int fd)
+{
+	int child;
+
+	while (1) {
+		child = accept(fd, NULL, NULL);
+		if (child < 0)
+			error("accept");
+		close(child);
+	}
+}
+
+/* connect and reset, so that no TIME_WAIT socket holds the port */
+static unsigned long do_client(void)
+{
+	struct linger linger = { .l_onoff = 1, .l_linger = 0 };
+	double end = now() + cfg_secs;
+	struct sockaddr_in sin;
+	unsigned long count = 0;
+	int fd;
+
+	setup_sockaddr(&sin);
+	while (now() < end) {
+		fd = socket(PF_INET, SOCK_STREAM, 0);
+		if (fd < 0)
+			error("socket connect");
+		if (connect(fd, (struct sockaddr *)&sin, sizeof(sin)))
+			error("connect");
+		if (setsockopt(fd, SOL_SOCKET, SO_LINGER, &linger,
+			       sizeof(linger)))
+			error("setsockopt SO_LINGER");
+		close(fd);
+		count++;
+	}
+
+	return count;
+}
+
+static unsigned short csum_fold(unsigned long sum)
+{
+	while (sum >> 16)
+		sum = (sum & 0xffff) + (sum >> 16);
+	return ~sum;
+}
+
+static unsigned long csum_add(unsigned long sum, const void *data, int len)
+{
+	const unsigned short *p = data;
+
+	for (; len > 1; len -= 2)
+		sum += *p++;
+	if (len)
+		sum += *(const unsigned char *)p;
+	return sum;
+}
+
+static void build_syn(char *pkt, unsigned int saddr)
+{
+	struct iphdr *iph = (struct iphdr *)pkt;
+	struct tcphdr *th = (struct tcphdr *)(iph + 1);
+	struct {
+		unsigned int saddr, daddr;
+		unsigned char zero, proto;
+		unsigned short len;
+	} pseudo;
+
+	memset(pkt, 0, sizeof(*iph) + sizeof(*th));
+	iph->version = 4;
+	iph->ihl = sizeof(*iph) >> 2;
+	iph->ttl = 64;
+	iph->protocol = IPPROTO_TCP;
+	iph->tot_len = htons(sizeof(*iph) + sizeof(*th));
+	iph->saddr = saddr;
+	iph->daddr = htonl(INADDR_LOOPBACK);
+
+	th->source = htons(1024 + random() % 60000);
+	th->dest = htons(cfg_port);
+	th->seq = random();
+	th->doff = sizeof(*th) >> 2;
+	th->syn = 1;
+	th->window = htons(65535);
+
+	pseudo.saddr = iph->saddr;
+	pseudo.daddr = iph->daddr;
+	pseudo.zero = 0;
+	pseudo.proto = IPPROTO_TCP;
+	pseudo.len = htons(sizeof(*th));
+	th->check = csum_fold(csum_add(csum_add(0, &pseudo, sizeof(pseudo)),
+				       th, sizeof(*th)));
+}
+
+/* send SYNs from 127.x.y.z, the kernel fills in the ip checksum */
+static unsigned long do_syn(void)
+{
+	double end = now() + cfg_secs;
+	struct sockaddr_in sin;
+	unsigned long count = 0;
+	char pkt[64];
+	int fd, len;
+
+	fd = socket(PF_INET, SOCK_RAW, IPPROTO_RAW);
+	if (fd < 0)
+		error("socket raw");
+
+	setup_sockaddr(&sin);
+	len = sizeof(struct iphdr) + sizeof(struct tcphdr);
+	srandom(getpid());
+
+	while (now() < end) {
+		build_syn(pkt, htonl((127 << 24) | (random() & 0xffffff)));
+		if (sendto(fd, pkt, len, 0, (struct sockaddr *)&sin,
+			   sizeof(sin)) != len)
+			error("sendto");
+		count++;
+	}
+
+	close(fd);
+	return count;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s [-m storm|syn] [-n procs] [-p port] "
+		"[-b backlog] [-t secs]\n", prog);
+	exit(1);
+}
+
+static void parse_opts(int argc, char **argv)
+{
+	int c;
+
+	while ((c = getopt(argc, argv, "m:n:p:b:t:")) != -1) {
+		switch (c) {
+		case 'm':
+			if (!strcmp(optarg, "storm"))
+				cfg_mode = MODE_STORM;
+			else if (!strcmp(optarg, "syn"))
+				cfg_mode = MODE_SYN;
+			else
+				usage(argv[0]);
+			break;
+		case 'n':
+			cfg_procs = strtol(optarg, NULL, 0);
+			break;
+		case 'p':
+			cfg_port = strtol(optarg, NULL, 0);
+			break;
+		case 'b':
+			cfg_backlog = strtol(optarg, NULL, 0);
+			break;
+		case 't':
+			cfg_secs = strtol(optarg, NULL, 0);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	if (cfg_procs <= 0 || cfg_secs <= 0)
+		usage(argv[0]);
+}
+
+int main(int argc, char **argv)
+{
+	long long before[8], after[8];
+	unsigned long total = 0, count;
+	pid_t *servers, pid;
+	int i, fd, status, ret = 0;
+	int pipefd[2];
+	double start, elapsed;
+
+	parse_opts(argc, argv);
+
+	fd = setup_listener();
+	servers = calloc(cfg_procs, sizeof(*servers));
+	if (!servers)
+		error("calloc");
+
+	for (i = 0; cfg_mode == MODE_STORM && i < cfg_procs; i++) {
+		servers[i] = fork();
+		if (servers[i] < 0)
+			error("fork");
+		if (!servers[i])
+			do_server(fd);
+	}
+
+	if (pipe(pipefd))
+		error("pipe");
+
+	read_counters(before);
+	start = now();
+
+	for (i = 0; i < cfg_procs; i++) {
+		pid = fork();
+		if (pid < 0)
+			error("fork");
+		if (!pid) {
+			close(fd);
+			count = cfg_mode == MODE_STORM ? do_client() : do_syn();
+			if (write(pipefd[1], &count, sizeof(count)) !=
+			    sizeof(count))
+				error("write pipe");
+			exit(0);
+		}
+	}
+	close(pipefd[1]);
+
+	for (i = 0; i < cfg_procs; i++) {
+		if (wait(&status) < 0)
+			error("wait");
+		if (!WIFEXITED(status) || WEXITSTATUS(status))
+			ret = 1;
+	}
+	elapsed = now() - start;
+	while (read(pipefd[0], &count, sizeof(count)) == sizeof(count))
+		total += count;
+
+	fprintf(stderr, "%s: %lu in %.2f s, %.0f per second\n",
+		cfg_mode == MODE_STORM ? "connections" : "syns",
+		total, elapsed, total / elapsed);
+
+	read_counters(after);
+	for (i = 0; counters[i]; i++)
+		if (before[i] >= 0 && after[i] >= 0)
+			fprintf(stderr, "  %s: %lld\n", counters[i],
+				after[i] - before[i]);
+
+	for (i = 0; cfg_mode == MODE_STORM && i < cfg_procs; i++) {
+		kill(servers[i], SIGTERM);
+		waitpid(servers[i], NULL, 0);
+	}
+	close(fd);
+	free(servers);
+	return ret;
+}
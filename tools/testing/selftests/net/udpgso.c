@@ -0,0 +1,335 @@
+/*
+ *  tools/testing/selftests/net/udpgso.c
+ *
+ *  Send large datagrams with a UDP_SEGMENT size over loopback and check
+ *  that they arrive as datagrams of that size, or coalesced with the
+ *  size in a UDP_GRO control message when the receiver asks for it.
+ *  Also check that sends the kernel cannot segment are refused.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ */
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#ifndef SOL_UDP
+#define SOL_UDP		17
+#endif
+
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT	103
+#endif
+
+#ifndef UDP_GRO
+#define UDP_GRO		104
+#endif
+
+/* largest UDP payload of an IPv4 and an IPv6 datagram */
+#define MAX_PAYLOAD4	(65535 - 20 - 8)
+#define MAX_PAYLOAD6	(65535 - 8)
+
+static int cfg_family = PF_INET;
+static int cfg_port = 8000;
+static int cfg_cmsg;
+static int cfg_gro;
+static int cfg_need_mtu;
+
+static char buf[65536];
+
+/* stand-in for a segment one byte larger than fits in the path mtu */
+#define CONST_MTU	-1
+
+struct testcase {
+	const char *name;
+	int tlen;	/* bytes passed to a single send */
+	int gso_len;	/* UDP_SEGMENT size */
+	int tfail;	/* errno the send fails with, or 0 */
+};
+
+static struct testcase testcases[] = {
+	{ "no segmentation needed",	1000,	1400,	0 },
+	{ "exactly one segment",	1400,	1400,	0 },
+	{ "one byte over",		1401,	1400,	0 },
+	{ "two full segments",		2800,	1400,	0 },
+	{ "ten segments",		14000,	1400,	0 },
+	{ "small segments",		6400,	100,	0 },
+	{ "large datagram",		65000,	1400,	0 },
+	{ "too many segments",		20000,	100,	EINVAL },
+	{ "segment over mtu",		0,	CONST_MTU, EINVAL },
+	{ NULL }
+};
+
+static void error(const char *msg)
+{
+	perror(msg);
+	exit(1);
+}
+
+static socklen_t setup_sockaddr(struct sockaddr_storage *ss)
+{
+	struct sockaddr_in6 *sin6 = (struct sockaddr_in6 *)ss;
+	struct sockaddr_in *sin = (struct sockaddr_in *)ss;
+
+	memset(ss, 0, sizeof(*ss));
+	if (cfg_family == PF_INET) {
+		sin->sin_family = AF_INET;
+		sin->sin_port = htons(cfg_port);
+		sin->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		return sizeof(*sin);
+	}
+
+	sin6->sin6_family = AF_INET6;
+	sin6->sin6_port = htons(cfg_port);
+	sin6->sin6_addr = in6addr_loopback;
+	return sizeof(*sin6);
+}
+
+static int setup_rx(void)
+{
+	struct sockaddr_storage ss;
+	int fd, one = 1;
+	socklen_t len;
+
+	fd = socket(cfg_family, SOCK_DGRAM, 0);
+	if (fd < 0)
+		error("socket rx");
+
+	len = setup_sockaddr(&ss);
+	if (bind(fd, (struct sockaddr *)&ss, len))
+		error("bind");
+	if (cfg_gro && setsockopt(fd, SOL_UDP, UDP_GRO, &one, sizeof(one)))
+		error("setsockopt UDP_GRO");
+
+	return fd;
+}
+
+static int setup_tx(void)
+{
+	struct sockaddr_storage ss;
+	socklen_t len;
+	int fd;
+
+	fd = socket(cfg_family, SOCK_DGRAM, 0);
+	if (fd < 0)
+		error("socket tx");
+
+	len = setup_sockaddr(&ss);
+	if (connect(fd, (struct sockaddr *)&ss, len))
+		error("connect");
+
+	return fd;
+}
+
+static int get_path_mtu(int fd)
+{
+	socklen_t len;
+	int mtu, ret;
+
+	len = sizeof(mtu);
+	if (cfg_family == PF_INET)
+		ret = getsockopt(fd, IPPROTO_IP, IP_MTU, &mtu, &len);
+	else
+		ret = getsockopt(fd, IPPROTO_IPV6, IPV6_MTU, &mtu, &len);
+	if (ret)
+		error("getsockopt mtu");
+
+	return mtu;
+}
+
+static int send_one(int fd, int len, int gso_len)
+{
+	char control[CMSG_SPACE(sizeof(uint16_t))] = {0};
+	struct iovec iov = { .iov_base = buf, .iov_len = len };
+	struct msghdr msg = { .msg_iov = &iov, .msg_iovlen = 1 };
+	struct cmsghdr *cm;
+
+	if (cfg_cmsg) {
+		msg.msg_control = control;
+		msg.msg_controllen = sizeof(control);
+
+		cm = CMSG_FIRSTHDR(&msg);
+		cm->cmsg_level = SOL_UDP;
+		cm->cmsg_type = UDP_SEGMENT;
+		cm->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+		*((uint16_t *)CMSG_DATA(cm)) = gso_len;
+	} else if (setsockopt(fd, SOL_UDP, UDP_SEGMENT, &gso_len,
+			      sizeof(gso_len))) {
+		error("setsockopt UDP_SEGMENT");
+	}
+
+	return sendmsg(fd, &msg, 0);
+}
+
+/* read one datagram, returns its length and the UDP_GRO size or 0 */
+static int recv_one(int fd, int *gso_len)
+{
+	char control[CMSG_SPACE(sizeof(int))];
+	struct iovec iov = { .iov_base = buf, .iov_len = sizeof(buf) };
+	struct msghdr msg = {
+		.msg_iov = &iov,
+		.msg_iovlen = 1,
+		.msg_control = control,
+		.msg_controllen = sizeof(control),
+	};
+	struct pollfd pfd = { .fd = fd, .events = POLLIN };
+	struct cmsghdr *cm;
+	int ret;
+
+	if (poll(&pfd, 1, 1000) != 1) {
+		fprintf(stderr, "no datagram to read\n");
+		exit(1);
+	}
+
+	ret = recvmsg(fd, &msg, MSG_DONTWAIT);
+	if (ret < 0)
+		error("recvmsg");
+
+	*gso_len = 0;
+	for (cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm))
+		if (cm->cmsg_level == SOL_UDP && cm->cmsg_type == UDP_GRO)
+			*gso_len = *(int *)CMSG_DATA(cm);
+
+	return ret;
+}
+
+static void check_rx(int fd, int tlen, int gso_len)
+{
+	int ret, gro;
+
+	if (cfg_gro) {
+		ret = recv_one(fd, &gro);
+		if (ret != tlen) {
+			fprintf(stderr, "read %d bytes, expected %d\n",
+				ret, tlen);
+			exit(1);
+		}
+		if (gro != (tlen > gso_len ? gso_len : 0)) {
+			fprintf(stderr, "UDP_GRO size %d for %d bytes\n",
+				gro, tlen);
+			exit(1);
+		}
+		return;
+	}
+
+	while (tlen > 0) {
+		int expected = tlen < gso_len ? tlen : gso_len;
+
+		ret = recv_one(fd, &gro);
+		if (ret != expected) {
+			fprintf(stderr, "read %d bytes, expected %d\n",
+				ret, expected);
+			exit(1);
+		}
+		tlen -= ret;
+	}
+}
+
+static void run_test(int fdt, int fdr, struct testcase *test)
+{
+	int hlen = cfg_family == PF_INET ? 20 + 8 : 40 + 8;
+	int max = cfg_family == PF_INET ? MAX_PAYLOAD4 : MAX_PAYLOAD6;
+	int gso_len = test->gso_len;
+	int tlen = test->tlen;
+	int ret;
+
+	/* two segments, of which the first does not fit */
+	if (gso_len == CONST_MTU) {
+		gso_len = get_path_mtu(fdt) - hlen + 1;
+		tlen = gso_len + 1;
+	}
+
+	fprintf(stderr, "  %s: %d bytes, segment size %d\n",
+		test->name, tlen, gso_len);
+
+	if (tlen > max) {
+		fprintf(stderr, "  path mtu too large, skipped\n");
+		if (cfg_need_mtu)
+			exit(1);
+		return;
+	}
+
+	ret = send_one(fdt, tlen, gso_len);
+	if (test->tfail) {
+		if (ret != -1 || errno != test->tfail) {
+			fprintf(stderr, "send returned %d (%s), expected %s\n",
+				ret, ret == -1 ? strerror(errno) : "no error",
+				strerror(test->tfail));
+			exit(1);
+		}
+		return;
+	}
+	if (ret != tlen) {
+		if (ret == -1)
+			error("send");
+		fprintf(stderr, "sent %d bytes of %d\n", ret, tlen);
+		exit(1);
+	}
+
+	check_rx(fdr, tlen, gso_len);
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s [-4|-6] [-C] [-G] [-M] [-p port]\n", prog);
+	exit(1);
+}
+
+static void parse_opts(int argc, char **argv)
+{
+	int c;
+
+	while ((c = getopt(argc, argv, "46CGMp:")) != -1) {
+		switch (c) {
+		case '4':
+			cfg_family = PF_INET;
+			break;
+		case '6':
+			cfg_family = PF_INET6;
+			break;
+		case 'C':
+			cfg_cmsg = 1;
+			break;
+		case 'G':
+			cfg_gro = 1;
+			break;
+		case 'M':
+			cfg_need_mtu = 1;
+			break;
+		case 'p':
+			cfg_port = strtol(optarg, NULL, 0);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+}
+
+int main(int argc, char **argv)
+{
+	struct testcase *test;
+	int fdt, fdr;
+
+	parse_opts(argc, argv);
+	memset(buf, 'a', sizeof(buf));
+
+	fdr = setup_rx();
+	fdt = setup_tx();
+
+	for (test = testcases; test->name; test++)
+		run_test(fdt, fdr, test);
+
+	close(fdt);
+	close(fdr);
+	fprintf(stderr, "OK\n");
+	return 0;
+}
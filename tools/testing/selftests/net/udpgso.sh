@@ -0,0 +1,47 @@
+#!/bin/sh
+#
+# Run udpgso over loopback for IPv4 and IPv6, passing the segment size
+# as a socket option and as a control message, to plain receivers and
+# to receivers that set UDP_GRO.
+#
+# The 64K mtu of loopback is too large for a segment to exceed it, so
+# the tests are run again in a network namespace whose loopback has an
+# ethernet sized mtu, where the "segment over mtu" case must not be
+# skipped.
+
+NS=udpgso-ns
+
+cleanup() {
+	ip netns del $NS 2>/dev/null
+}
+
+ret=0
+
+for family in -4 -6; do
+	for cmsg in "" -C; do
+		for gro in "" -G; do
+			echo "udpgso $family $cmsg $gro"
+			./udpgso $family $cmsg $gro || ret=1
+		done
+	done
+done
+
+if [ "$(id -u)" != 0 ]; then
+	echo "small mtu tests need root, skipped"
+	exit $ret
+fi
+
+trap cleanup EXIT
+if ! ip netns add $NS || ! ip netns exec $NS ip link set lo mtu 1500 up; then
+	echo "could not set up network namespace, skipped"
+	exit $ret
+fi
+
+for family in -4 -6; do
+	for cmsg in "" -C; do
+		echo "udpgso mtu 1500 $family $cmsg"
+		ip netns exec $NS ./udpgso $family $cmsg -M || ret=1
+	done
+done
+
+exit $ret
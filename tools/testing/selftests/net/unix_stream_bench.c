@@ -0,0 +1,301 @@
+/*
+ *  tools/testing/selftests/net/unix_stream_bench.c
+ *
+ *  Measure the throughput of an AF_UNIX stream socketpair. A child
+ *  process sends for a fixed time and the parent reads until the
+ *  child closes its end, then reports the rate.
+ *
+ *  The sender writes with write(), with sendfile() from a file or by
+ *  splicing the buffer through a pipe, the latter two go through the
+ *  sendpage path. The receiver reads with read() or splices into a
+ *  pipe that is drained into /dev/null.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ */
+
+#define _GNU_SOURCE
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+
+enum {
+	MODE_RW,
+	MODE_SENDFILE,
+	MODE_SPLICE,
+};
+
+static int cfg_tx_mode = MODE_RW;
+static int cfg_rx_mode = MODE_RW;
+static int cfg_size = 65536;
+static int cfg_secs = 5;
+static int cfg_verify;
+
+static char payload[1 << 20];
+
+static void error(const char *msg)
+{
+	perror(msg);
+	exit(1);
+}
+
+static double now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+/* every byte of the stream is its offset modulo a prime, so that
+ * misplaced data does not line up with the buffer size
+ */
+static void fill_payload(void)
+{
+	int i;
+
+	for (i = 0; i < sizeof(payload); i++)
+		payload[i] = i % 251;
+}
+
+static int open_payload_file(void)
+{
+	char path[] = "/tmp/unix_stream_bench.XXXXXX";
+	int fd;
+
+	fd = mkstemp(path);
+	if (fd < 0)
+		error("mkstemp");
+	unlink(path);
+
+	if (write(fd, payload, cfg_size) != cfg_size)
+		error("write file");
+	return fd;
+}
+
+/* send whole buffers, so the stream keeps the pattern of fill_payload */
+static void send_one(int fd, int file_fd, int *pipefd)
+{
+	struct iovec iov = { .iov_base = payload, .iov_len = cfg_size };
+	off_t off = 0;
+	int done = 0;
+	ssize_t ret;
+
+	switch (cfg_tx_mode) {
+	case MODE_RW:
+		while (done < cfg_size) {
+			ret = write(fd, payload + done, cfg_size - done);
+			if (ret < 0)
+				error("write");
+			done += ret;
+		}
+		break;
+	case MODE_SENDFILE:
+		while (off < cfg_size) {
+			ret = sendfile(fd, file_fd, &off, cfg_size - off);
+			if (ret < 0)
+				error("sendfile");
+		}
+		break;
+	case MODE_SPLICE:
+		while (iov.iov_len) {
+			ret = vmsplice(pipefd[1], &iov, 1, 0);
+			if (ret < 0)
+				error("vmsplice");
+			iov.iov_base = (char *)iov.iov_base + ret;
+			iov.iov_len -= ret;
+
+			while (ret) {
+				ssize_t n;
+
+				n = splice(pipefd[0], NULL, fd, NULL, ret,
+					   SPLICE_F_MOVE);
+				if (n < 0)
+					error("splice to socket");
+				ret -= n;
+			}
+		}
+		break;
+	}
+}
+
+static void do_tx(int fd)
+{
+	int file_fd = -1, pipefd[2];
+	double end = now() + cfg_secs;
+
+	if (cfg_tx_mode == MODE_SENDFILE)
+		file_fd = open_payload_file();
+	if (cfg_tx_mode == MODE_SPLICE && pipe(pipefd))
+		error("pipe");
+
+	while (now() < end)
+		send_one(fd, file_fd, pipefd);
+
+	close(fd);
+}
+
+static void verify(const char *buf, ssize_t len, unsigned long long offset)
+{
+	ssize_t i;
+
+	for (i = 0; i < len; i++) {
+		if (buf[i] != (char)(((offset + i) % cfg_size) % 251)) {
+			fprintf(stderr, "bad data at offset %llu\n",
+				offset + i);
+			exit(1);
+		}
+	}
+}
+
+static ssize_t recv_one(int fd, int devnull, int *pipefd, char *buf,
+			unsigned long long offset)
+{
+	ssize_t ret, left;
+
+	if (cfg_rx_mode == MODE_RW) {
+		ret = read(fd, buf, sizeof(payload));
+		if (ret < 0)
+			error("read");
+		if (cfg_verify)
+			verify(buf, ret, offset);
+		return ret;
+	}
+
+	ret = splice(fd, NULL, pipefd[1], NULL, sizeof(payload),
+		     SPLICE_F_MOVE);
+	if (ret < 0)
+		error("splice from socket");
+
+	for (left = ret; left; ) {
+		ssize_t n;
+
+		n = splice(pipefd[0], NULL, devnull, NULL, left,
+			   SPLICE_F_MOVE);
+		if (n < 0)
+			error("splice to /dev/null");
+		left -= n;
+	}
+	return ret;
+}
+
+static void do_rx(int fd)
+{
+	unsigned long long bytes = 0;
+	static char buf[sizeof(payload)];
+	int devnull = -1, pipefd[2];
+	double start = 0, elapsed;
+	ssize_t ret;
+
+	if (cfg_rx_mode == MODE_SPLICE) {
+		devnull = open("/dev/null", O_WRONLY);
+		if (devnull < 0)
+			error("open /dev/null");
+		if (pipe(pipefd))
+			error("pipe");
+	}
+
+	do {
+		ret = recv_one(fd, devnull, pipefd, buf, bytes);
+		if (!start)
+			start = now();
+		bytes += ret;
+	} while (ret);
+
+	elapsed = now() - start;
+	fprintf(stderr, "rx: %llu MB in %.2f s, %.1f MB/s\n",
+		bytes >> 20, elapsed, (bytes >> 20) / elapsed);
+	close(fd);
+}
+
+static int parse_mode(const char *mode)
+{
+	if (!strcmp(mode, "rw"))
+		return MODE_RW;
+	if (!strcmp(mode, "sendfile"))
+		return MODE_SENDFILE;
+	if (!strcmp(mode, "splice"))
+		return MODE_SPLICE;
+
+	fprintf(stderr, "unknown mode %s\n", mode);
+	exit(1);
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s [-s rw|sendfile|splice] [-r rw|splice] "
+		"[-l size] [-t secs] [-v]\n", prog);
+	exit(1);
+}
+
+static void parse_opts(int argc, char **argv)
+{
+	int c;
+
+	while ((c = getopt(argc, argv, "s:r:l:t:v")) != -1) {
+		switch (c) {
+		case 's':
+			cfg_tx_mode = parse_mode(optarg);
+			break;
+		case 'r':
+			cfg_rx_mode = parse_mode(optarg);
+			break;
+		case 'l':
+			cfg_size = strtol(optarg, NULL, 0);
+			break;
+		case 't':
+			cfg_secs = strtol(optarg, NULL, 0);
+			break;
+		case 'v':
+			cfg_verify = 1;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	if (cfg_rx_mode == MODE_SENDFILE)
+		usage(argv[0]);
+	if (cfg_verify && cfg_rx_mode != MODE_RW)
+		usage(argv[0]);
+	if (cfg_size <= 0 || cfg_size > sizeof(payload))
+		usage(argv[0]);
+}
+
+int main(int argc, char **argv)
+{
+	int status, fds[2];
+	pid_t pid;
+
+	parse_opts(argc, argv);
+	fill_payload();
+
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds))
+		error("socketpair");
+
+	pid = fork();
+	if (pid < 0)
+		error("fork");
+	if (!pid) {
+		close(fds[0]);
+		do_tx(fds[1]);
+		exit(0);
+	}
+	close(fds[1]);
+
+	do_rx(fds[0]);
+
+	if (waitpid(pid, &status, 0) < 0)
+		error("waitpid");
+	return WIFEXITED(status) ? WEXITSTATUS(status) : 1;
+}
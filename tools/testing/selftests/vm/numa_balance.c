@@ -0,0 +1,279 @@
+/*
+ * Check that automatic NUMA balancing moves memory after its user.
+ *
+ * The buffer is populated while running on the CPUs of one node, then
+ * the task is moved to the CPUs of another node and keeps touching the
+ * buffer. NUMA hinting faults should migrate the pages to the new node
+ * within the time limit. Page placement is queried with move_pages(2).
+ *
+ * Needs a kernel with CONFIG_NUMA_BALANCING and at least two nodes with
+ * CPUs, numa=fake=2 is enough on a single node machine or in a VM. The
+ * test is skipped otherwise.
+ *
+ * Before that, a PROT_NONE page is written through /proc/self/mem: the
+ * forced fault must not be taken for a NUMA hinting one, which would make
+ * the page accessible, or loop forever on the write.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <setjmp.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#define LENGTH		(64UL * 1024 * 1024)
+#define TIMEOUT		30	/* seconds */
+#define MAX_NODES	64
+
+#ifndef MADV_NOHUGEPAGE
+#define MADV_NOHUGEPAGE	15
+#endif
+
+static const char *counters[] = {
+	"numa_pte_updates",
+	"numa_hint_faults",
+	"numa_hint_faults_local",
+	"numa_pages_migrated",
+	NULL
+};
+
+static void read_counters(long long *vals)
+{
+	char name[64];
+	long long val;
+	FILE *f;
+	int i;
+
+	for (i = 0; counters[i]; i++)
+		vals[i] = -1;
+
+	f = fopen("/proc/vmstat", "r");
+	if (!f)
+		return;
+	while (fscanf(f, "%63s %lld", name, &val) == 2)
+		for (i = 0; counters[i]; i++)
+			if (!strcmp(name, counters[i]))
+				vals[i] = val;
+	fclose(f);
+}
+
+/* the CPUs of @node, false if it has none */
+static int node_cpus(int node, cpu_set_t *set)
+{
+	char path[64], buf[4096], *p, *end;
+	long first, last;
+	FILE *f;
+
+	snprintf(path, sizeof(path),
+		 "/sys/devices/system/node/node%d/cpulist", node);
+	f = fopen(path, "r");
+	if (!f)
+		return 0;
+	if (!fgets(buf, sizeof(buf), f))
+		buf[0] = '\0';
+	fclose(f);
+
+	CPU_ZERO(set);
+	for (p = buf; *p && *p != '\n'; p = end) {
+		first = last = strtol(p, &end, 10);
+		if (end == p)
+			break;
+		if (*end == '-')
+			last = strtol(end + 1, &end, 10);
+		while (first <= last)
+			CPU_SET(first++, set);
+		if (*end == ',')
+			end++;
+	}
+	return CPU_COUNT(set) > 0;
+}
+
+/* percentage of the pages of the buffer that are on @node */
+static int pages_on_node(char *buf, int node)
+{
+	unsigned long i, nr = LENGTH / getpagesize(), on_node = 0;
+	void **pages;
+	int *status;
+
+	pages = calloc(nr, sizeof(*pages));
+	status = calloc(nr, sizeof(*status));
+	if (!pages || !status) {
+		perror("calloc");
+		exit(1);
+	}
+
+	for (i = 0; i < nr; i++)
+		pages[i] = buf + i * getpagesize();
+	if (syscall(__NR_move_pages, 0, nr, pages, NULL, status, 0)) {
+		perror("move_pages");
+		exit(1);
+	}
+	for (i = 0; i < nr; i++)
+		if (status[i] == node)
+			on_node++;
+
+	free(pages);
+	free(status);
+	return on_node * 100 / nr;
+}
+
+static sigjmp_buf segv_env;
+
+static void segv_handler(int sig)
+{
+	(void)sig;
+	siglongjmp(segv_env, 1);
+}
+
+/* write to a PROT_NONE page with FOLL_FORCE, 0 if it stays inaccessible */
+static int prot_none_forced_write(void)
+{
+	int fd, val = 1, ret = 1;
+	volatile int *p;
+
+	p = mmap(NULL, getpagesize(), PROT_READ | PROT_WRITE,
+		 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (p == MAP_FAILED) {
+		perror("mmap");
+		return 1;
+	}
+	*p = val;
+	if (mprotect((void *)p, getpagesize(), PROT_NONE)) {
+		perror("mprotect");
+		goto out;
+	}
+
+	fd = open("/proc/self/mem", O_RDWR);
+	if (fd < 0) {
+		perror("open /proc/self/mem");
+		goto out;
+	}
+	val = 2;
+	if (pwrite(fd, &val, sizeof(val), (off_t)(unsigned long)p) !=
+	    sizeof(val) ||
+	    pread(fd, &val, sizeof(val), (off_t)(unsigned long)p) !=
+	    sizeof(val)) {
+		perror("/proc/self/mem");
+		close(fd);
+		goto out;
+	}
+	close(fd);
+	if (val != 2) {
+		printf("PROT_NONE page reads back %d after writing 2\n", val);
+		goto out;
+	}
+
+	signal(SIGSEGV, segv_handler);
+	if (!sigsetjmp(segv_env, 1)) {
+		val = *p;
+		printf("PROT_NONE page became accessible\n");
+	} else {
+		ret = 0;
+	}
+	signal(SIGSEGV, SIG_DFL);
+out:
+	munmap((void *)p, getpagesize());
+	return ret;
+}
+
+static void touch(char *buf)
+{
+	unsigned long i;
+
+	for (i = 0; i < LENGTH; i += getpagesize())
+		buf[i]++;
+}
+
+int main(void)
+{
+	long long before[8], after[8];
+	cpu_set_t from_cpus, to_cpus;
+	int from = -1, to = -1, node, pct = 0;
+	time_t end;
+	char *buf;
+	FILE *f;
+	int i;
+
+	if (prot_none_forced_write()) {
+		printf("[FAIL]\n");
+		return 1;
+	}
+	printf("forced write to a PROT_NONE page: ok\n");
+
+	f = fopen("/proc/sys/kernel/numa_balancing", "r");
+	if (!f || fscanf(f, "%d", &i) != 1 || !i) {
+		printf("automatic NUMA balancing not enabled, skipping\n");
+		return 0;
+	}
+	fclose(f);
+
+	for (node = 0; node < MAX_NODES && to < 0; node++) {
+		if (!node_cpus(node, from < 0 ? &from_cpus : &to_cpus))
+			continue;
+		if (from < 0)
+			from = node;
+		else
+			to = node;
+	}
+	if (to < 0) {
+		printf("need two nodes with CPUs, skipping\n");
+		return 0;
+	}
+
+	if (sched_setaffinity(0, sizeof(from_cpus), &from_cpus)) {
+		perror("sched_setaffinity");
+		return 1;
+	}
+
+	buf = mmap(NULL, LENGTH, PROT_READ | PROT_WRITE,
+		   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (buf == MAP_FAILED) {
+		perror("mmap");
+		return 1;
+	}
+	/* huge pages are not sampled */
+	madvise(buf, LENGTH, MADV_NOHUGEPAGE);
+	memset(buf, 1, LENGTH);
+	printf("populated on node %d: %d%% of the pages there\n",
+	       from, pages_on_node(buf, from));
+
+	read_counters(before);
+	if (sched_setaffinity(0, sizeof(to_cpus), &to_cpus)) {
+		perror("sched_setaffinity");
+		return 1;
+	}
+
+	end = time(NULL) + TIMEOUT;
+	while (time(NULL) < end) {
+		touch(buf);
+		pct = pages_on_node(buf, to);
+		if (pct >= 90)
+			break;
+	}
+	read_counters(after);
+
+	printf("after running on node %d: %d%% of the pages there\n", to, pct);
+	for (i = 0; counters[i]; i++)
+		if (before[i] >= 0 && after[i] >= 0)
+			printf("  %s: %lld\n", counters[i], after[i] - before[i]);
+
+	munmap(buf, LENGTH);
+	if (pct < 90) {
+		printf("[FAIL]\n");
+		return 1;
+	}
+	printf("[PASS]\n");
+	return 0;
+}